@@ -0,0 +1,246 @@
+//====================================================================
+// Lossless frame capture stream implementation.
+//====================================================================
+
+#include <stddef.h>
+#include <string.h>
+
+#include "CaptureCodec.h"
+
+static const char s_stream_magic[8] = { 'P', 'V', 'R', 'C', 'A', 'P', '0', '1' };
+
+static void put_u32 (std::vector<unsigned char>& out, unsigned int value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back((unsigned char)(value >> (i * 8)));
+    }
+}
+
+static void put_f64 (std::vector<unsigned char>& out, double value)
+{
+    unsigned char bytes[8];
+    memcpy(bytes, &value, sizeof(bytes));
+    out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+static bool get_u32 (const unsigned char*& data, const unsigned char* end, unsigned int* value)
+{
+    if (end - data < 4)
+    {
+        return false;
+    }
+    *value = data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24);
+    data += 4;
+    return true;
+}
+
+static bool get_f64 (const unsigned char*& data, const unsigned char* end, double* value)
+{
+    if (end - data < 8)
+    {
+        return false;
+    }
+    memcpy(value, data, sizeof(*value));
+    data += 8;
+    return true;
+}
+
+static void flush_literals (const std::vector<unsigned char>& in, size_t start, size_t end, std::vector<unsigned char>& out)
+{
+    while (start < end)
+    {
+        size_t count = end - start < 128 ? end - start : 128;
+        out.push_back((unsigned char)(count - 1));
+        out.insert(out.end(), in.begin() + start, in.begin() + start + count);
+        start += count;
+    }
+}
+
+// Runs of three or more zeros are worth a control byte of their own
+static void run_length_encode (const std::vector<unsigned char>& in, std::vector<unsigned char>& out)
+{
+    size_t size = in.size();
+    size_t literal_start = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t zeros = 0;
+        while (i + zeros < size && in[i + zeros] == 0 && zeros < 130)
+        {
+            ++zeros;
+        }
+        if (zeros >= 3)
+        {
+            flush_literals(in, literal_start, i, out);
+            out.push_back((unsigned char)(zeros + 125));
+            i += zeros;
+            literal_start = i;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    flush_literals(in, literal_start, size, out);
+}
+
+static bool run_length_decode (const unsigned char* data, const unsigned char* end, std::vector<unsigned char>& out)
+{
+    size_t written = 0;
+    while (data < end)
+    {
+        unsigned int control = *data++;
+        if (control < 128)
+        {
+            size_t count = control + 1;
+            if ((size_t)(end - data) < count || written + count > out.size())
+            {
+                return false;
+            }
+            memcpy(&out[written], data, count);
+            data += count;
+            written += count;
+        }
+        else
+        {
+            size_t count = control - 125;
+            if (written + count > out.size())
+            {
+                return false;
+            }
+            memset(&out[written], 0, count);
+            written += count;
+        }
+    }
+    return written == out.size();
+}
+
+CaptureEncoder::CaptureEncoder ()
+{
+    this->width = 0;
+    this->height = 0;
+    this->since_key = 0;
+}
+
+void CaptureEncoder::begin (std::vector<unsigned char>& out)
+{
+    out.insert(out.end(), s_stream_magic, s_stream_magic + sizeof(s_stream_magic));
+    this->width = 0;
+    this->height = 0;
+}
+
+void CaptureEncoder::encode (const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int pitch, double time, std::vector<unsigned char>& out)
+{
+    bool key = width != this->width || height != this->height || this->since_key + 1 >= CAPTURE_KEYFRAME_INTERVAL;
+    this->since_key = key ? 0 : this->since_key + 1;
+    this->width = width;
+    this->height = height;
+
+    // Drop the unused fourth byte
+    size_t row_bytes = (size_t)width * 3;
+    this->current.resize(row_bytes * height);
+    this->residual.resize(row_bytes * height);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        const unsigned char* in = pixels + (size_t)y * pitch;
+        unsigned char* packed = &this->current[y * row_bytes];
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            packed[x * 3 + 0] = in[x * 4 + 0];
+            packed[x * 3 + 1] = in[x * 4 + 1];
+            packed[x * 3 + 2] = in[x * 4 + 2];
+        }
+    }
+
+    size_t size = this->current.size();
+    if (key)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            bool row_start = i % row_bytes < 3;
+            this->residual[i] = (unsigned char)(this->current[i] - (row_start ? 0 : this->current[i - 3]));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            this->residual[i] = (unsigned char)(this->current[i] - this->previous[i]);
+        }
+    }
+    this->previous.swap(this->current);
+
+    put_u32(out, width);
+    put_u32(out, height);
+    put_u32(out, key ? 1 : 0);
+    put_f64(out, time);
+    size_t size_offset = out.size();
+    put_u32(out, 0);
+    run_length_encode(this->residual, out);
+    unsigned int payload = (unsigned int)(out.size() - size_offset - 4);
+    for (int i = 0; i < 4; ++i)
+    {
+        out[size_offset + i] = (unsigned char)(payload >> (i * 8));
+    }
+}
+
+CaptureDecoder::CaptureDecoder ()
+{
+}
+
+bool CaptureDecoder::read_header (const unsigned char*& data, const unsigned char* end)
+{
+    if (end - data < (ptrdiff_t)sizeof(s_stream_magic) || memcmp(data, s_stream_magic, sizeof(s_stream_magic)) != 0)
+    {
+        return false;
+    }
+    data += sizeof(s_stream_magic);
+    this->previous.clear();
+    return true;
+}
+
+bool CaptureDecoder::read_frame (const unsigned char*& data, const unsigned char* end, frame* out)
+{
+    unsigned int width, height, key, payload;
+    double time;
+    if (!get_u32(data, end, &width) || !get_u32(data, end, &height) || !get_u32(data, end, &key) ||
+        !get_f64(data, end, &time) || !get_u32(data, end, &payload) || (size_t)(end - data) < payload)
+    {
+        return false;
+    }
+    size_t row_bytes = (size_t)width * 3;
+    size_t size = row_bytes * height;
+    if (!key && this->previous.size() != size)
+    {
+        return false;
+    }
+    this->residual.resize(size);
+    if (!run_length_decode(data, data + payload, this->residual))
+    {
+        return false;
+    }
+    data += payload;
+
+    out->width = width;
+    out->height = height;
+    out->time = time;
+    out->pixels.resize(size);
+    if (key)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            bool row_start = i % row_bytes < 3;
+            out->pixels[i] = (unsigned char)(this->residual[i] + (row_start ? 0 : out->pixels[i - 3]));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            out->pixels[i] = (unsigned char)(this->residual[i] + this->previous[i]);
+        }
+    }
+    this->previous = out->pixels;
+    return true;
+}
@@ -0,0 +1,67 @@
+//====================================================================
+// Lossless frame capture stream.
+//
+// Frames are stored as packed 24 bit BGR. Key frames predict each byte
+// from the same channel of the pixel to its left, the frames between
+// them from the same byte of the previous frame, and the residuals are
+// run length coded, which suits a mostly still table under a moving
+// ball. Deliberately free of Windows, Direct3D and LibOVR types so it
+// can be exercised offline with synthetic frames.
+//
+// Stream layout, little endian:
+//
+//     "PVRCAP01"
+//     per frame: width u32, height u32, key u32, time f64,
+//                payload bytes u32, payload
+//
+// Payload control bytes 0-127 are followed by that many plus one
+// literal residuals; 128-255 stand for that many minus 125 zeros.
+//====================================================================
+
+#pragma once
+
+#include <vector>
+
+#define CAPTURE_KEYFRAME_INTERVAL 60
+
+class CaptureEncoder
+{
+public:
+    CaptureEncoder ();
+
+    // Appends the stream header
+    void begin (std::vector<unsigned char>& out);
+
+    // Appends one frame of 32 bit BGRX pixels, rows pitch bytes apart
+    void encode (const unsigned char* pixels, unsigned int width, unsigned int height, unsigned int pitch, double time, std::vector<unsigned char>& out);
+
+private:
+    std::vector<unsigned char> previous;
+    std::vector<unsigned char> current;
+    std::vector<unsigned char> residual;
+    unsigned int width;
+    unsigned int height;
+    unsigned int since_key;
+};
+
+class CaptureDecoder
+{
+public:
+    struct frame {
+        unsigned int width;
+        unsigned int height;
+        double time;
+        std::vector<unsigned char> pixels; // packed BGR
+    };
+
+    CaptureDecoder ();
+
+    // Each consumes what it read from the front of [data, end). False on a
+    // short or malformed stream.
+    bool read_header (const unsigned char*& data, const unsigned char* end);
+    bool read_frame (const unsigned char*& data, const unsigned char* end, frame* out);
+
+private:
+    std::vector<unsigned char> previous;
+    std::vector<unsigned char> residual;
+};
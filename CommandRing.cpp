@@ -0,0 +1,120 @@
+//====================================================================
+// Command ring implementation.
+//====================================================================
+
+#include <stdlib.h>
+
+#include "CommandRing.h"
+
+// Marks the unused tail of the buffer when a packet doesn't fit before
+// the end and wraps around to the start instead
+#define COMMAND_RING_WRAP 0xFFFFFFFF
+
+CommandRing::CommandRing (DWORD capacity)
+{
+    this->ring_capacity = capacity;
+    this->mask = capacity - 1;
+    this->buffer = (unsigned char*)_aligned_malloc(capacity, 64);
+    this->write_position = 0;
+    this->pending_position = 0;
+    this->read_position = 0;
+    this->consumer_waiting = 0;
+    this->work_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+}
+
+CommandRing::~CommandRing ()
+{
+    CloseHandle(this->work_event);
+    _aligned_free(this->buffer);
+}
+
+command_header* CommandRing::reserve (DWORD opcode, DWORD size)
+{
+    size = (size + 7) & ~7u;
+    for (;;)
+    {
+        DWORD write = (DWORD)this->write_position;
+        DWORD read = (DWORD)this->read_position;
+        DWORD offset = write & this->mask;
+        DWORD contiguous = this->ring_capacity - offset;
+        DWORD free = this->ring_capacity - (write - read);
+        if (contiguous < size)
+        {
+            // Pad out the end of the buffer as soon as there's room for the
+            // padding alone, and publish it so the consumer can skip it while
+            // we wait for the packet to fit at the start. Waiting for both at
+            // once would never end for packets over half the capacity.
+            if (free >= contiguous)
+            {
+                command_header* wrap = (command_header*)(this->buffer + offset);
+                wrap->opcode = COMMAND_RING_WRAP;
+                wrap->size = contiguous;
+                MemoryBarrier();
+                InterlockedExchange(&this->write_position, (LONG)(write + contiguous));
+                continue;
+            }
+        }
+        else if (free >= size)
+        {
+            command_header* command = (command_header*)(this->buffer + offset);
+            command->opcode = opcode;
+            command->size = size;
+            this->pending_position = write + size;
+            return command;
+        }
+
+        // Full, give the consumer a chance to catch up
+        this->wake();
+        SwitchToThread();
+    }
+}
+
+void CommandRing::commit ()
+{
+    MemoryBarrier();
+    InterlockedExchange(&this->write_position, (LONG)this->pending_position);
+    if (this->consumer_waiting)
+    {
+        SetEvent(this->work_event);
+    }
+}
+
+const command_header* CommandRing::peek ()
+{
+    for (;;)
+    {
+        DWORD read = (DWORD)this->read_position;
+        if (read == (DWORD)this->write_position)
+        {
+            return 0;
+        }
+        MemoryBarrier();
+        const command_header* command = (const command_header*)(this->buffer + (read & this->mask));
+        if (command->opcode != COMMAND_RING_WRAP)
+        {
+            return command;
+        }
+        InterlockedExchange(&this->read_position, (LONG)(read + command->size));
+    }
+}
+
+void CommandRing::release (const command_header* command)
+{
+    MemoryBarrier();
+    InterlockedExchange(&this->read_position, this->read_position + (LONG)command->size);
+}
+
+void CommandRing::wait_for_work (DWORD timeout_ms)
+{
+    InterlockedExchange(&this->consumer_waiting, 1);
+    if (this->empty())
+    {
+        WaitForSingleObject(this->work_event, timeout_ms);
+    }
+    InterlockedExchange(&this->consumer_waiting, 0);
+}
+
+void CommandRing::wake ()
+{
+    SetEvent(this->work_event);
+}
@@ -0,0 +1,60 @@
+//====================================================================
+// Lock-free single-producer/single-consumer ring of variable sized
+// command packets.
+//
+// The producer reserves space for a packet, fills it in and commits
+// it. The consumer peeks at the oldest packet, executes it and
+// releases it. Each side only ever writes its own position, so no
+// locks are needed; the consumer sleeps on an event when the ring is
+// empty and the producer spins politely when it is full.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+
+struct command_header {
+    DWORD opcode;
+    DWORD size; // Including the header, always a multiple of 8
+};
+
+class CommandRing
+{
+public:
+    // Capacity must be a power of two
+    CommandRing (DWORD capacity);
+    ~CommandRing ();
+
+    DWORD capacity () const { return this->ring_capacity; }
+
+    // Producer side. reserve never returns null but may wait for space;
+    // size can be anything up to the capacity.
+    command_header* reserve (DWORD opcode, DWORD size);
+    void commit ();
+
+    // Consumer side. peek returns null once the ring is empty and
+    // wait_for_work blocks until the producer commits something.
+    const command_header* peek ();
+    void release (const command_header* command);
+    void wait_for_work (DWORD timeout_ms);
+
+    // Wakes a waiting consumer, e.g. for shutdown
+    void wake ();
+
+    bool empty () const { return this->read_position == this->write_position; }
+
+private:
+    CommandRing (const CommandRing&);
+    CommandRing& operator= (const CommandRing&);
+
+    unsigned char* buffer;
+    DWORD ring_capacity;
+    DWORD mask;
+
+    // Padded apart so producer and consumer don't share a cache line
+    __declspec(align(64)) volatile LONG write_position;
+    DWORD pending_position;
+    __declspec(align(64)) volatile LONG read_position;
+    volatile LONG consumer_waiting;
+    HANDLE work_event;
+};
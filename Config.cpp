@@ -0,0 +1,58 @@
+//====================================================================
+// Settings file implementation.
+//====================================================================
+
+#include <Windows.h>
+#include <stdlib.h>
+
+#include "Config.h"
+
+std::string config_data_path (const char file_name[])
+{
+    // Find the DLL we live in rather than the game executable
+    HMODULE module = NULL;
+    GetModuleHandleExA(
+        GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        (LPCSTR)&config_data_path,
+        &module
+    );
+    char* file_part;
+    char module_path[MAX_PATH];
+    char path[MAX_PATH];
+    GetModuleFileNameA(module, module_path, sizeof(module_path));
+    GetFullPathNameA(module_path, sizeof(path), path, &file_part);
+    *file_part = '\0';
+    return std::string(path) + file_name;
+}
+
+static const char* config_path ()
+{
+    static std::string path;
+    if (path.empty())
+    {
+        path = config_data_path("PinballVRcade.ini");
+    }
+    return path.c_str();
+}
+
+std::string config_string (const char section[], const char key[], const char default_value[])
+{
+    char value[MAX_PATH];
+    GetPrivateProfileStringA(section, key, default_value, value, sizeof(value), config_path());
+    return value;
+}
+
+int config_int (const char section[], const char key[], int default_value)
+{
+    return GetPrivateProfileIntA(section, key, default_value, config_path());
+}
+
+float config_float (const char section[], const char key[], float default_value)
+{
+    std::string value = config_string(section, key, "");
+    if (value.empty())
+    {
+        return default_value;
+    }
+    return (float)atof(value.c_str());
+}
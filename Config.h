@@ -0,0 +1,16 @@
+//====================================================================
+// Runtime settings read from PinballVRcade.ini next to the patch DLL.
+//
+// Every setting has a built-in default, so the ini file is optional.
+//====================================================================
+
+#pragma once
+
+#include <string>
+
+std::string config_string (const char section[], const char key[], const char default_value[]);
+int config_int (const char section[], const char key[], int default_value);
+float config_float (const char section[], const char key[], float default_value);
+
+// Full path for a data file stored next to the patch DLL.
+std::string config_data_path (const char file_name[]);
@@ -0,0 +1,22 @@
+//====================================================================
+// 64 bit FNV-1a, used wherever the hooks recognise content they've
+// seen before: shader bytecode, texture levels and the UI draw stream.
+//====================================================================
+
+#pragma once
+
+#include <stddef.h>
+
+static const unsigned __int64 s_empty_hash = 14695981039346656037ULL;
+
+// Continues from a previous hash, or from s_empty_hash
+inline unsigned __int64 hash_bytes (unsigned __int64 hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,147 @@
+//====================================================================
+// Direct3D9Ex device underneath the hooks.
+//
+// With [Rendering] FlipModel=1 the driver's device is an
+// IDirect3DDevice9Ex presenting through the flip model, and this stage
+// keeps it looking like the plain device the game asked for. Ex
+// devices refuse D3DPOOL_MANAGED, so managed resources are created in
+// the default pool instead, which an Ex device never loses: buffers
+// stay lockable there as they are, textures are made dynamic so they
+// do too. Everything above this stage, hooks and pipeline included,
+// is unchanged.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+#include "DeviceInterceptor.h"
+
+// Textures that are only dynamic because they stand in for managed ones
+// are tagged, since their contents change no more often than the
+// game's managed textures did
+// {3F9A2C47-1E6B-4D80-8C35-B7D4E0A91F26}
+static const GUID s_emulated_managed_guid = { 0x3f9a2c47, 0x1e6b, 0x4d80, { 0x8c, 0x35, 0xb7, 0xd4, 0xe0, 0xa9, 0x1f, 0x26 } };
+
+inline void mark_emulated_managed (IDirect3DResource9* resource)
+{
+    DWORD emulated = 1;
+    resource->SetPrivateData(s_emulated_managed_guid, &emulated, sizeof(emulated), 0);
+}
+
+inline bool is_emulated_managed (IDirect3DResource9* resource)
+{
+    DWORD size = 0;
+    return resource->GetPrivateData(s_emulated_managed_guid, NULL, &size) == D3D_OK;
+}
+
+template <typename Next>
+class Direct3D9ExStage : public Next
+{
+public:
+    Direct3D9ExStage (IDirect3DDevice9* inner) : Next(inner) {}
+
+    // Flip model swap chains need at least two back buffers and can't be
+    // multisampled or locked; fullscreen already flips. The game sees the
+    // swap chain it actually got.
+    static void use_flip_model (D3DPRESENT_PARAMETERS* pPresentationParameters)
+    {
+        if (pPresentationParameters->Windowed &&
+            pPresentationParameters->MultiSampleType == D3DMULTISAMPLE_NONE &&
+            !(pPresentationParameters->Flags & D3DPRESENTFLAG_LOCKABLE_BACKBUFFER))
+        {
+            pPresentationParameters->SwapEffect = D3DSWAPEFFECT_FLIPEX;
+            if (pPresentationParameters->BackBufferCount < 2)
+            {
+                pPresentationParameters->BackBufferCount = 2;
+            }
+        }
+    }
+
+    HRESULT EvictManagedResources ()
+    {
+        // There are none to evict
+        return D3D_OK;
+    }
+
+    HRESULT Reset (D3DPRESENT_PARAMETERS* pPresentationParameters)
+    {
+        use_flip_model(pPresentationParameters);
+        return Next::Reset(pPresentationParameters);
+    }
+
+    HRESULT Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
+    {
+        return this->device_ex()->PresentEx(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion, 0);
+    }
+
+    HRESULT CreateTexture (UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle)
+    {
+        if (Pool != D3DPOOL_MANAGED)
+        {
+            return Next::CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+        }
+        HRESULT result = Next::CreateTexture(Width, Height, Levels, Usage | D3DUSAGE_DYNAMIC, Format, D3DPOOL_DEFAULT, ppTexture, pSharedHandle);
+        if (SUCCEEDED(result))
+        {
+            mark_emulated_managed(*ppTexture);
+        }
+        return result;
+    }
+
+    HRESULT CreateVolumeTexture (UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle)
+    {
+        if (Pool != D3DPOOL_MANAGED)
+        {
+            return Next::CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle);
+        }
+        HRESULT result = Next::CreateVolumeTexture(Width, Height, Depth, Levels, Usage | D3DUSAGE_DYNAMIC, Format, D3DPOOL_DEFAULT, ppVolumeTexture, pSharedHandle);
+        if (SUCCEEDED(result))
+        {
+            mark_emulated_managed(*ppVolumeTexture);
+        }
+        return result;
+    }
+
+    HRESULT CreateCubeTexture (UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle)
+    {
+        if (Pool != D3DPOOL_MANAGED)
+        {
+            return Next::CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle);
+        }
+        HRESULT result = Next::CreateCubeTexture(EdgeLength, Levels, Usage | D3DUSAGE_DYNAMIC, Format, D3DPOOL_DEFAULT, ppCubeTexture, pSharedHandle);
+        if (SUCCEEDED(result))
+        {
+            mark_emulated_managed(*ppCubeTexture);
+        }
+        return result;
+    }
+
+    HRESULT CreateVertexBuffer (UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle)
+    {
+        if (Pool == D3DPOOL_MANAGED)
+        {
+            Pool = D3DPOOL_DEFAULT;
+        }
+        return Next::CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+    }
+
+    HRESULT CreateIndexBuffer (UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle)
+    {
+        if (Pool == D3DPOOL_MANAGED)
+        {
+            Pool = D3DPOOL_DEFAULT;
+        }
+        return Next::CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle);
+    }
+
+private:
+    IDirect3DDevice9Ex* device_ex ()
+    {
+        return static_cast<IDirect3DDevice9Ex*>(this->wrapped_device());
+    }
+};
+
+typedef InterceptedDevice9<
+    Direct3D9ExStage< DeviceForwarder >
+> ExDevice9;
@@ -0,0 +1,298 @@
+//====================================================================
+// Compile-time composed device interceptors.
+//
+// Each feature that wants to see the device call stream is written as
+// a stage: a class template that derives from the next stage in the
+// chain and redeclares only the methods it cares about, calling down
+// with Next::Method(...). DeviceForwarder terminates the chain by
+// calling the wrapped device. InterceptedDevice9 turns a chain into a
+// COM object.
+//
+// Stage methods are ordinary non-virtual members, so a method that no
+// stage touches compiles down to a single call on the wrapped device
+// and the only virtual dispatch is the one the game already pays for.
+// Stages are stacked with nested templates, e.g.
+//
+//     typedef InterceptedDevice9< FrameStage< DeviceForwarder > > Device;
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+class DeviceForwarder
+{
+public:
+    DeviceForwarder (IDirect3DDevice9* inner) : inner(inner) {}
+
+    IDirect3DDevice9* wrapped_device () const { return this->inner; }
+
+    /*** IUnknown methods ***/
+    HRESULT QueryInterface (REFIID riid, void** ppvObj) { return this->inner->QueryInterface(riid, ppvObj); }
+    ULONG AddRef () { return this->inner->AddRef(); }
+    ULONG Release () { return this->inner->Release(); }
+
+    /*** IDirect3DDevice9 methods ***/
+    HRESULT TestCooperativeLevel () { return this->inner->TestCooperativeLevel(); }
+    UINT GetAvailableTextureMem () { return this->inner->GetAvailableTextureMem(); }
+    HRESULT EvictManagedResources () { return this->inner->EvictManagedResources(); }
+    HRESULT GetDirect3D (IDirect3D9** ppD3D9) { return this->inner->GetDirect3D(ppD3D9); }
+    HRESULT GetDeviceCaps (D3DCAPS9* pCaps) { return this->inner->GetDeviceCaps(pCaps); }
+    HRESULT GetDisplayMode (UINT iSwapChain,D3DDISPLAYMODE* pMode) { return this->inner->GetDisplayMode(iSwapChain, pMode); }
+    HRESULT GetCreationParameters (D3DDEVICE_CREATION_PARAMETERS *pParameters) { return this->inner->GetCreationParameters(pParameters); }
+    HRESULT SetCursorProperties (UINT XHotSpot,UINT YHotSpot,IDirect3DSurface9* pCursorBitmap) { return this->inner->SetCursorProperties(XHotSpot, YHotSpot, pCursorBitmap); }
+    void SetCursorPosition (int X,int Y,DWORD Flags) { this->inner->SetCursorPosition(X, Y, Flags); }
+    BOOL ShowCursor (BOOL bShow) { return this->inner->ShowCursor(bShow); }
+    HRESULT CreateAdditionalSwapChain (D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DSwapChain9** pSwapChain) { return this->inner->CreateAdditionalSwapChain(pPresentationParameters, pSwapChain); }
+    HRESULT GetSwapChain (UINT iSwapChain,IDirect3DSwapChain9** pSwapChain) { return this->inner->GetSwapChain(iSwapChain, pSwapChain); }
+    UINT GetNumberOfSwapChains () { return this->inner->GetNumberOfSwapChains(); }
+    HRESULT Reset (D3DPRESENT_PARAMETERS* pPresentationParameters) { return this->inner->Reset(pPresentationParameters); }
+    HRESULT Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion) { return this->inner->Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion); }
+    HRESULT GetBackBuffer (UINT iSwapChain,UINT iBackBuffer,D3DBACKBUFFER_TYPE Type,IDirect3DSurface9** ppBackBuffer) { return this->inner->GetBackBuffer(iSwapChain, iBackBuffer, Type, ppBackBuffer); }
+    HRESULT GetRasterStatus (UINT iSwapChain,D3DRASTER_STATUS* pRasterStatus) { return this->inner->GetRasterStatus(iSwapChain, pRasterStatus); }
+    HRESULT SetDialogBoxMode (BOOL bEnableDialogs) { return this->inner->SetDialogBoxMode(bEnableDialogs); }
+    void SetGammaRamp (UINT iSwapChain,DWORD Flags,CONST D3DGAMMARAMP* pRamp) { this->inner->SetGammaRamp(iSwapChain, Flags, pRamp); }
+    void GetGammaRamp (UINT iSwapChain,D3DGAMMARAMP* pRamp) { this->inner->GetGammaRamp(iSwapChain, pRamp); }
+    HRESULT CreateTexture (UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle) { return this->inner->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle); }
+    HRESULT CreateVolumeTexture (UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle) { return this->inner->CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle); }
+    HRESULT CreateCubeTexture (UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle) { return this->inner->CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle); }
+    HRESULT CreateVertexBuffer (UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle) { return this->inner->CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle); }
+    HRESULT CreateIndexBuffer (UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle) { return this->inner->CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle); }
+    HRESULT CreateRenderTarget (UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Lockable,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->inner->CreateRenderTarget(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle); }
+    HRESULT CreateDepthStencilSurface (UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Discard,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->inner->CreateDepthStencilSurface(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle); }
+    HRESULT UpdateSurface (IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint) { return this->inner->UpdateSurface(pSourceSurface, pSourceRect, pDestinationSurface, pDestPoint); }
+    HRESULT UpdateTexture (IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture) { return this->inner->UpdateTexture(pSourceTexture, pDestinationTexture); }
+    HRESULT GetRenderTargetData (IDirect3DSurface9* pRenderTarget,IDirect3DSurface9* pDestSurface) { return this->inner->GetRenderTargetData(pRenderTarget, pDestSurface); }
+    HRESULT GetFrontBufferData (UINT iSwapChain,IDirect3DSurface9* pDestSurface) { return this->inner->GetFrontBufferData(iSwapChain, pDestSurface); }
+    HRESULT StretchRect (IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestSurface,CONST RECT* pDestRect,D3DTEXTUREFILTERTYPE Filter) { return this->inner->StretchRect(pSourceSurface, pSourceRect, pDestSurface, pDestRect, Filter); }
+    HRESULT ColorFill (IDirect3DSurface9* pSurface,CONST RECT* pRect,D3DCOLOR color) { return this->inner->ColorFill(pSurface, pRect, color); }
+    HRESULT CreateOffscreenPlainSurface (UINT Width,UINT Height,D3DFORMAT Format,D3DPOOL Pool,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->inner->CreateOffscreenPlainSurface(Width, Height, Format, Pool, ppSurface, pSharedHandle); }
+    HRESULT SetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget) { return this->inner->SetRenderTarget(RenderTargetIndex, pRenderTarget); }
+    HRESULT GetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget) { return this->inner->GetRenderTarget(RenderTargetIndex, ppRenderTarget); }
+    HRESULT SetDepthStencilSurface (IDirect3DSurface9* pNewZStencil) { return this->inner->SetDepthStencilSurface(pNewZStencil); }
+    HRESULT GetDepthStencilSurface (IDirect3DSurface9** ppZStencilSurface) { return this->inner->GetDepthStencilSurface(ppZStencilSurface); }
+    HRESULT BeginScene () { return this->inner->BeginScene(); }
+    HRESULT EndScene () { return this->inner->EndScene(); }
+    HRESULT Clear (DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil) { return this->inner->Clear(Count, pRects, Flags, Color, Z, Stencil); }
+    HRESULT SetTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->inner->SetTransform(State, pMatrix); }
+    HRESULT GetTransform (D3DTRANSFORMSTATETYPE State,D3DMATRIX* pMatrix) { return this->inner->GetTransform(State, pMatrix); }
+    HRESULT MultiplyTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->inner->MultiplyTransform(State, pMatrix); }
+    HRESULT SetViewport (CONST D3DVIEWPORT9* pViewport) { return this->inner->SetViewport(pViewport); }
+    HRESULT GetViewport (D3DVIEWPORT9* pViewport) { return this->inner->GetViewport(pViewport); }
+    HRESULT SetMaterial (CONST D3DMATERIAL9* pMaterial) { return this->inner->SetMaterial(pMaterial); }
+    HRESULT GetMaterial (D3DMATERIAL9* pMaterial) { return this->inner->GetMaterial(pMaterial); }
+    HRESULT SetLight (DWORD Index,CONST D3DLIGHT9* pLight) { return this->inner->SetLight(Index, pLight); }
+    HRESULT GetLight (DWORD Index,D3DLIGHT9* pLight) { return this->inner->GetLight(Index, pLight); }
+    HRESULT LightEnable (DWORD Index,BOOL Enable) { return this->inner->LightEnable(Index, Enable); }
+    HRESULT GetLightEnable (DWORD Index,BOOL* pEnable) { return this->inner->GetLightEnable(Index, pEnable); }
+    HRESULT SetClipPlane (DWORD Index,CONST float* pPlane) { return this->inner->SetClipPlane(Index, pPlane); }
+    HRESULT GetClipPlane (DWORD Index,float* pPlane) { return this->inner->GetClipPlane(Index, pPlane); }
+    HRESULT SetRenderState (D3DRENDERSTATETYPE State,DWORD Value) { return this->inner->SetRenderState(State, Value); }
+    HRESULT GetRenderState (D3DRENDERSTATETYPE State,DWORD* pValue) { return this->inner->GetRenderState(State, pValue); }
+    HRESULT CreateStateBlock (D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB) { return this->inner->CreateStateBlock(Type, ppSB); }
+    HRESULT BeginStateBlock () { return this->inner->BeginStateBlock(); }
+    HRESULT EndStateBlock (IDirect3DStateBlock9** ppSB) { return this->inner->EndStateBlock(ppSB); }
+    HRESULT SetClipStatus (CONST D3DCLIPSTATUS9* pClipStatus) { return this->inner->SetClipStatus(pClipStatus); }
+    HRESULT GetClipStatus (D3DCLIPSTATUS9* pClipStatus) { return this->inner->GetClipStatus(pClipStatus); }
+    HRESULT GetTexture (DWORD Stage,IDirect3DBaseTexture9** ppTexture) { return this->inner->GetTexture(Stage, ppTexture); }
+    HRESULT SetTexture (DWORD Stage,IDirect3DBaseTexture9* pTexture) { return this->inner->SetTexture(Stage, pTexture); }
+    HRESULT GetTextureStageState (DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue) { return this->inner->GetTextureStageState(Stage, Type, pValue); }
+    HRESULT SetTextureStageState (DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD Value) { return this->inner->SetTextureStageState(Stage, Type, Value); }
+    HRESULT GetSamplerState (DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD* pValue) { return this->inner->GetSamplerState(Sampler, Type, pValue); }
+    HRESULT SetSamplerState (DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value) { return this->inner->SetSamplerState(Sampler, Type, Value); }
+    HRESULT ValidateDevice (DWORD* pNumPasses) { return this->inner->ValidateDevice(pNumPasses); }
+    HRESULT SetPaletteEntries (UINT PaletteNumber,CONST PALETTEENTRY* pEntries) { return this->inner->SetPaletteEntries(PaletteNumber, pEntries); }
+    HRESULT GetPaletteEntries (UINT PaletteNumber,PALETTEENTRY* pEntries) { return this->inner->GetPaletteEntries(PaletteNumber, pEntries); }
+    HRESULT SetCurrentTexturePalette (UINT PaletteNumber) { return this->inner->SetCurrentTexturePalette(PaletteNumber); }
+    HRESULT GetCurrentTexturePalette (UINT *PaletteNumber) { return this->inner->GetCurrentTexturePalette(PaletteNumber); }
+    HRESULT SetScissorRect (CONST RECT* pRect) { return this->inner->SetScissorRect(pRect); }
+    HRESULT GetScissorRect (RECT* pRect) { return this->inner->GetScissorRect(pRect); }
+    HRESULT SetSoftwareVertexProcessing (BOOL bSoftware) { return this->inner->SetSoftwareVertexProcessing(bSoftware); }
+    BOOL GetSoftwareVertexProcessing () { return this->inner->GetSoftwareVertexProcessing(); }
+    HRESULT SetNPatchMode (float nSegments) { return this->inner->SetNPatchMode(nSegments); }
+    float GetNPatchMode () { return this->inner->GetNPatchMode(); }
+    HRESULT DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount) { return this->inner->DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount); }
+    HRESULT DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount) { return this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount); }
+    HRESULT DrawPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->inner->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride); }
+    HRESULT DrawIndexedPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->inner->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride); }
+    HRESULT ProcessVertices (UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags) { return this->inner->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags); }
+    HRESULT CreateVertexDeclaration (CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl) { return this->inner->CreateVertexDeclaration(pVertexElements, ppDecl); }
+    HRESULT SetVertexDeclaration (IDirect3DVertexDeclaration9* pDecl) { return this->inner->SetVertexDeclaration(pDecl); }
+    HRESULT GetVertexDeclaration (IDirect3DVertexDeclaration9** ppDecl) { return this->inner->GetVertexDeclaration(ppDecl); }
+    HRESULT SetFVF (DWORD FVF) { return this->inner->SetFVF(FVF); }
+    HRESULT GetFVF (DWORD* pFVF) { return this->inner->GetFVF(pFVF); }
+    HRESULT CreateVertexShader (CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader) { return this->inner->CreateVertexShader(pFunction, ppShader); }
+    HRESULT SetVertexShader (IDirect3DVertexShader9* pShader) { return this->inner->SetVertexShader(pShader); }
+    HRESULT GetVertexShader (IDirect3DVertexShader9** ppShader) { return this->inner->GetVertexShader(ppShader); }
+    HRESULT SetVertexShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return this->inner->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    HRESULT GetVertexShaderConstantF (UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->inner->GetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    HRESULT SetVertexShaderConstantI (UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->inner->SetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    HRESULT GetVertexShaderConstantI (UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->inner->GetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    HRESULT SetVertexShaderConstantB (UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->inner->SetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    HRESULT GetVertexShaderConstantB (UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->inner->GetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    HRESULT SetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride) { return this->inner->SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride); }
+    HRESULT GetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride) { return this->inner->GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride); }
+    HRESULT SetStreamSourceFreq (UINT StreamNumber,UINT Setting) { return this->inner->SetStreamSourceFreq(StreamNumber, Setting); }
+    HRESULT GetStreamSourceFreq (UINT StreamNumber,UINT* pSetting) { return this->inner->GetStreamSourceFreq(StreamNumber, pSetting); }
+    HRESULT SetIndices (IDirect3DIndexBuffer9* pIndexData) { return this->inner->SetIndices(pIndexData); }
+    HRESULT GetIndices (IDirect3DIndexBuffer9** ppIndexData) { return this->inner->GetIndices(ppIndexData); }
+    HRESULT CreatePixelShader (CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader) { return this->inner->CreatePixelShader(pFunction, ppShader); }
+    HRESULT SetPixelShader (IDirect3DPixelShader9* pShader) { return this->inner->SetPixelShader(pShader); }
+    HRESULT GetPixelShader (IDirect3DPixelShader9** ppShader) { return this->inner->GetPixelShader(ppShader); }
+    HRESULT SetPixelShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return this->inner->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    HRESULT GetPixelShaderConstantF (UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->inner->GetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    HRESULT SetPixelShaderConstantI (UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->inner->SetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    HRESULT GetPixelShaderConstantI (UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->inner->GetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    HRESULT SetPixelShaderConstantB (UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->inner->SetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    HRESULT GetPixelShaderConstantB (UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->inner->GetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    HRESULT DrawRectPatch (UINT Handle,CONST float* pNumSegs,CONST D3DRECTPATCH_INFO* pRectPatchInfo) { return this->inner->DrawRectPatch(Handle, pNumSegs, pRectPatchInfo); }
+    HRESULT DrawTriPatch (UINT Handle,CONST float* pNumSegs,CONST D3DTRIPATCH_INFO* pTriPatchInfo) { return this->inner->DrawTriPatch(Handle, pNumSegs, pTriPatchInfo); }
+    HRESULT DeletePatch (UINT Handle) { return this->inner->DeletePatch(Handle); }
+    HRESULT CreateQuery (D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery) { return this->inner->CreateQuery(Type, ppQuery); }
+
+private:
+    IDirect3DDevice9* inner;
+};
+
+template <typename Chain>
+class InterceptedDevice9 : public IDirect3DDevice9
+{
+public:
+    InterceptedDevice9 (IDirect3DDevice9* inner) : chain(inner) {}
+
+    Chain& stages () { return this->chain; }
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj) { return this->chain.QueryInterface(riid, ppvObj); }
+    STDMETHOD_(ULONG,AddRef)(THIS) { return this->chain.AddRef(); }
+    STDMETHOD_(ULONG,Release)(THIS)
+    {
+        ULONG count = this->chain.Release();
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    /*** IDirect3DDevice9 methods ***/
+    STDMETHOD(TestCooperativeLevel)(THIS) { return this->chain.TestCooperativeLevel(); }
+    STDMETHOD_(UINT, GetAvailableTextureMem)(THIS) { return this->chain.GetAvailableTextureMem(); }
+    STDMETHOD(EvictManagedResources)(THIS) { return this->chain.EvictManagedResources(); }
+    STDMETHOD(GetDirect3D)(THIS_ IDirect3D9** ppD3D9) { return this->chain.GetDirect3D(ppD3D9); }
+    STDMETHOD(GetDeviceCaps)(THIS_ D3DCAPS9* pCaps) { return this->chain.GetDeviceCaps(pCaps); }
+    STDMETHOD(GetDisplayMode)(THIS_ UINT iSwapChain,D3DDISPLAYMODE* pMode) { return this->chain.GetDisplayMode(iSwapChain, pMode); }
+    STDMETHOD(GetCreationParameters)(THIS_ D3DDEVICE_CREATION_PARAMETERS *pParameters) { return this->chain.GetCreationParameters(pParameters); }
+    STDMETHOD(SetCursorProperties)(THIS_ UINT XHotSpot,UINT YHotSpot,IDirect3DSurface9* pCursorBitmap) { return this->chain.SetCursorProperties(XHotSpot, YHotSpot, pCursorBitmap); }
+    STDMETHOD_(void, SetCursorPosition)(THIS_ int X,int Y,DWORD Flags) { this->chain.SetCursorPosition(X, Y, Flags); }
+    STDMETHOD_(BOOL, ShowCursor)(THIS_ BOOL bShow) { return this->chain.ShowCursor(bShow); }
+    STDMETHOD(CreateAdditionalSwapChain)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DSwapChain9** pSwapChain) { return this->chain.CreateAdditionalSwapChain(pPresentationParameters, pSwapChain); }
+    STDMETHOD(GetSwapChain)(THIS_ UINT iSwapChain,IDirect3DSwapChain9** pSwapChain) { return this->chain.GetSwapChain(iSwapChain, pSwapChain); }
+    STDMETHOD_(UINT, GetNumberOfSwapChains)(THIS) { return this->chain.GetNumberOfSwapChains(); }
+    STDMETHOD(Reset)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters) { return this->chain.Reset(pPresentationParameters); }
+    STDMETHOD(Present)(THIS_ CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion) { return this->chain.Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion); }
+    STDMETHOD(GetBackBuffer)(THIS_ UINT iSwapChain,UINT iBackBuffer,D3DBACKBUFFER_TYPE Type,IDirect3DSurface9** ppBackBuffer) { return this->chain.GetBackBuffer(iSwapChain, iBackBuffer, Type, ppBackBuffer); }
+    STDMETHOD(GetRasterStatus)(THIS_ UINT iSwapChain,D3DRASTER_STATUS* pRasterStatus) { return this->chain.GetRasterStatus(iSwapChain, pRasterStatus); }
+    STDMETHOD(SetDialogBoxMode)(THIS_ BOOL bEnableDialogs) { return this->chain.SetDialogBoxMode(bEnableDialogs); }
+    STDMETHOD_(void, SetGammaRamp)(THIS_ UINT iSwapChain,DWORD Flags,CONST D3DGAMMARAMP* pRamp) { this->chain.SetGammaRamp(iSwapChain, Flags, pRamp); }
+    STDMETHOD_(void, GetGammaRamp)(THIS_ UINT iSwapChain,D3DGAMMARAMP* pRamp) { this->chain.GetGammaRamp(iSwapChain, pRamp); }
+    STDMETHOD(CreateTexture)(THIS_ UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle) { return this->chain.CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle); }
+    STDMETHOD(CreateVolumeTexture)(THIS_ UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle) { return this->chain.CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle); }
+    STDMETHOD(CreateCubeTexture)(THIS_ UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle) { return this->chain.CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle); }
+    STDMETHOD(CreateVertexBuffer)(THIS_ UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle) { return this->chain.CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle); }
+    STDMETHOD(CreateIndexBuffer)(THIS_ UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle) { return this->chain.CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle); }
+    STDMETHOD(CreateRenderTarget)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Lockable,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->chain.CreateRenderTarget(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle); }
+    STDMETHOD(CreateDepthStencilSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Discard,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->chain.CreateDepthStencilSurface(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle); }
+    STDMETHOD(UpdateSurface)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint) { return this->chain.UpdateSurface(pSourceSurface, pSourceRect, pDestinationSurface, pDestPoint); }
+    STDMETHOD(UpdateTexture)(THIS_ IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture) { return this->chain.UpdateTexture(pSourceTexture, pDestinationTexture); }
+    STDMETHOD(GetRenderTargetData)(THIS_ IDirect3DSurface9* pRenderTarget,IDirect3DSurface9* pDestSurface) { return this->chain.GetRenderTargetData(pRenderTarget, pDestSurface); }
+    STDMETHOD(GetFrontBufferData)(THIS_ UINT iSwapChain,IDirect3DSurface9* pDestSurface) { return this->chain.GetFrontBufferData(iSwapChain, pDestSurface); }
+    STDMETHOD(StretchRect)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestSurface,CONST RECT* pDestRect,D3DTEXTUREFILTERTYPE Filter) { return this->chain.StretchRect(pSourceSurface, pSourceRect, pDestSurface, pDestRect, Filter); }
+    STDMETHOD(ColorFill)(THIS_ IDirect3DSurface9* pSurface,CONST RECT* pRect,D3DCOLOR color) { return this->chain.ColorFill(pSurface, pRect, color); }
+    STDMETHOD(CreateOffscreenPlainSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DPOOL Pool,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->chain.CreateOffscreenPlainSurface(Width, Height, Format, Pool, ppSurface, pSharedHandle); }
+    STDMETHOD(SetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget) { return this->chain.SetRenderTarget(RenderTargetIndex, pRenderTarget); }
+    STDMETHOD(GetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget) { return this->chain.GetRenderTarget(RenderTargetIndex, ppRenderTarget); }
+    STDMETHOD(SetDepthStencilSurface)(THIS_ IDirect3DSurface9* pNewZStencil) { return this->chain.SetDepthStencilSurface(pNewZStencil); }
+    STDMETHOD(GetDepthStencilSurface)(THIS_ IDirect3DSurface9** ppZStencilSurface) { return this->chain.GetDepthStencilSurface(ppZStencilSurface); }
+    STDMETHOD(BeginScene)(THIS) { return this->chain.BeginScene(); }
+    STDMETHOD(EndScene)(THIS) { return this->chain.EndScene(); }
+    STDMETHOD(Clear)(THIS_ DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil) { return this->chain.Clear(Count, pRects, Flags, Color, Z, Stencil); }
+    STDMETHOD(SetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->chain.SetTransform(State, pMatrix); }
+    STDMETHOD(GetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,D3DMATRIX* pMatrix) { return this->chain.GetTransform(State, pMatrix); }
+    STDMETHOD(MultiplyTransform)(THIS_ D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->chain.MultiplyTransform(State, pMatrix); }
+    STDMETHOD(SetViewport)(THIS_ CONST D3DVIEWPORT9* pViewport) { return this->chain.SetViewport(pViewport); }
+    STDMETHOD(GetViewport)(THIS_ D3DVIEWPORT9* pViewport) { return this->chain.GetViewport(pViewport); }
+    STDMETHOD(SetMaterial)(THIS_ CONST D3DMATERIAL9* pMaterial) { return this->chain.SetMaterial(pMaterial); }
+    STDMETHOD(GetMaterial)(THIS_ D3DMATERIAL9* pMaterial) { return this->chain.GetMaterial(pMaterial); }
+    STDMETHOD(SetLight)(THIS_ DWORD Index,CONST D3DLIGHT9* pLight) { return this->chain.SetLight(Index, pLight); }
+    STDMETHOD(GetLight)(THIS_ DWORD Index,D3DLIGHT9* pLight) { return this->chain.GetLight(Index, pLight); }
+    STDMETHOD(LightEnable)(THIS_ DWORD Index,BOOL Enable) { return this->chain.LightEnable(Index, Enable); }
+    STDMETHOD(GetLightEnable)(THIS_ DWORD Index,BOOL* pEnable) { return this->chain.GetLightEnable(Index, pEnable); }
+    STDMETHOD(SetClipPlane)(THIS_ DWORD Index,CONST float* pPlane) { return this->chain.SetClipPlane(Index, pPlane); }
+    STDMETHOD(GetClipPlane)(THIS_ DWORD Index,float* pPlane) { return this->chain.GetClipPlane(Index, pPlane); }
+    STDMETHOD(SetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD Value) { return this->chain.SetRenderState(State, Value); }
+    STDMETHOD(GetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD* pValue) { return this->chain.GetRenderState(State, pValue); }
+    STDMETHOD(CreateStateBlock)(THIS_ D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB) { return this->chain.CreateStateBlock(Type, ppSB); }
+    STDMETHOD(BeginStateBlock)(THIS) { return this->chain.BeginStateBlock(); }
+    STDMETHOD(EndStateBlock)(THIS_ IDirect3DStateBlock9** ppSB) { return this->chain.EndStateBlock(ppSB); }
+    STDMETHOD(SetClipStatus)(THIS_ CONST D3DCLIPSTATUS9* pClipStatus) { return this->chain.SetClipStatus(pClipStatus); }
+    STDMETHOD(GetClipStatus)(THIS_ D3DCLIPSTATUS9* pClipStatus) { return this->chain.GetClipStatus(pClipStatus); }
+    STDMETHOD(GetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9** ppTexture) { return this->chain.GetTexture(Stage, ppTexture); }
+    STDMETHOD(SetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9* pTexture) { return this->chain.SetTexture(Stage, pTexture); }
+    STDMETHOD(GetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue) { return this->chain.GetTextureStageState(Stage, Type, pValue); }
+    STDMETHOD(SetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD Value) { return this->chain.SetTextureStageState(Stage, Type, Value); }
+    STDMETHOD(GetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD* pValue) { return this->chain.GetSamplerState(Sampler, Type, pValue); }
+    STDMETHOD(SetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value) { return this->chain.SetSamplerState(Sampler, Type, Value); }
+    STDMETHOD(ValidateDevice)(THIS_ DWORD* pNumPasses) { return this->chain.ValidateDevice(pNumPasses); }
+    STDMETHOD(SetPaletteEntries)(THIS_ UINT PaletteNumber,CONST PALETTEENTRY* pEntries) { return this->chain.SetPaletteEntries(PaletteNumber, pEntries); }
+    STDMETHOD(GetPaletteEntries)(THIS_ UINT PaletteNumber,PALETTEENTRY* pEntries) { return this->chain.GetPaletteEntries(PaletteNumber, pEntries); }
+    STDMETHOD(SetCurrentTexturePalette)(THIS_ UINT PaletteNumber) { return this->chain.SetCurrentTexturePalette(PaletteNumber); }
+    STDMETHOD(GetCurrentTexturePalette)(THIS_ UINT *PaletteNumber) { return this->chain.GetCurrentTexturePalette(PaletteNumber); }
+    STDMETHOD(SetScissorRect)(THIS_ CONST RECT* pRect) { return this->chain.SetScissorRect(pRect); }
+    STDMETHOD(GetScissorRect)(THIS_ RECT* pRect) { return this->chain.GetScissorRect(pRect); }
+    STDMETHOD(SetSoftwareVertexProcessing)(THIS_ BOOL bSoftware) { return this->chain.SetSoftwareVertexProcessing(bSoftware); }
+    STDMETHOD_(BOOL, GetSoftwareVertexProcessing)(THIS) { return this->chain.GetSoftwareVertexProcessing(); }
+    STDMETHOD(SetNPatchMode)(THIS_ float nSegments) { return this->chain.SetNPatchMode(nSegments); }
+    STDMETHOD_(float, GetNPatchMode)(THIS) { return this->chain.GetNPatchMode(); }
+    STDMETHOD(DrawPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount) { return this->chain.DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount); }
+    STDMETHOD(DrawIndexedPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount) { return this->chain.DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount); }
+    STDMETHOD(DrawPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->chain.DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride); }
+    STDMETHOD(DrawIndexedPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->chain.DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride); }
+    STDMETHOD(ProcessVertices)(THIS_ UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags) { return this->chain.ProcessVertices(SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags); }
+    STDMETHOD(CreateVertexDeclaration)(THIS_ CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl) { return this->chain.CreateVertexDeclaration(pVertexElements, ppDecl); }
+    STDMETHOD(SetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9* pDecl) { return this->chain.SetVertexDeclaration(pDecl); }
+    STDMETHOD(GetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9** ppDecl) { return this->chain.GetVertexDeclaration(ppDecl); }
+    STDMETHOD(SetFVF)(THIS_ DWORD FVF) { return this->chain.SetFVF(FVF); }
+    STDMETHOD(GetFVF)(THIS_ DWORD* pFVF) { return this->chain.GetFVF(pFVF); }
+    STDMETHOD(CreateVertexShader)(THIS_ CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader) { return this->chain.CreateVertexShader(pFunction, ppShader); }
+    STDMETHOD(SetVertexShader)(THIS_ IDirect3DVertexShader9* pShader) { return this->chain.SetVertexShader(pShader); }
+    STDMETHOD(GetVertexShader)(THIS_ IDirect3DVertexShader9** ppShader) { return this->chain.GetVertexShader(ppShader); }
+    STDMETHOD(SetVertexShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return this->chain.SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(GetVertexShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->chain.GetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(SetVertexShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->chain.SetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(GetVertexShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->chain.GetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(SetVertexShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->chain.SetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(GetVertexShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->chain.GetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(SetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride) { return this->chain.SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride); }
+    STDMETHOD(GetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride) { return this->chain.GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride); }
+    STDMETHOD(SetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT Setting) { return this->chain.SetStreamSourceFreq(StreamNumber, Setting); }
+    STDMETHOD(GetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT* pSetting) { return this->chain.GetStreamSourceFreq(StreamNumber, pSetting); }
+    STDMETHOD(SetIndices)(THIS_ IDirect3DIndexBuffer9* pIndexData) { return this->chain.SetIndices(pIndexData); }
+    STDMETHOD(GetIndices)(THIS_ IDirect3DIndexBuffer9** ppIndexData) { return this->chain.GetIndices(ppIndexData); }
+    STDMETHOD(CreatePixelShader)(THIS_ CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader) { return this->chain.CreatePixelShader(pFunction, ppShader); }
+    STDMETHOD(SetPixelShader)(THIS_ IDirect3DPixelShader9* pShader) { return this->chain.SetPixelShader(pShader); }
+    STDMETHOD(GetPixelShader)(THIS_ IDirect3DPixelShader9** ppShader) { return this->chain.GetPixelShader(ppShader); }
+    STDMETHOD(SetPixelShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return this->chain.SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(GetPixelShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->chain.GetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(SetPixelShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->chain.SetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(GetPixelShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->chain.GetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(SetPixelShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->chain.SetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(GetPixelShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->chain.GetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(DrawRectPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DRECTPATCH_INFO* pRectPatchInfo) { return this->chain.DrawRectPatch(Handle, pNumSegs, pRectPatchInfo); }
+    STDMETHOD(DrawTriPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DTRIPATCH_INFO* pTriPatchInfo) { return this->chain.DrawTriPatch(Handle, pNumSegs, pTriPatchInfo); }
+    STDMETHOD(DeletePatch)(THIS_ UINT Handle) { return this->chain.DeletePatch(Handle); }
+    STDMETHOD(CreateQuery)(THIS_ D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery) { return this->chain.CreateQuery(Type, ppQuery); }
+
+private:
+    Chain chain;
+};
@@ -0,0 +1,217 @@
+//====================================================================
+// Interceptor stages layered on top of the hooked device, and the
+// device variants built from them.
+//
+// See DeviceInterceptor.h for how stages compose. Each stage only
+// declares the calls it needs to see; everything else is inherited
+// straight from the stage below.
+//====================================================================
+
+#pragma once
+
+#include <stdio.h>
+
+#include "DeviceInterceptor.h"
+#include "TimestepPatch.h"
+
+// Keeps the simulation timestep patch in step with presented frames
+template <typename Next>
+class FramePacingStage : public Next
+{
+public:
+    FramePacingStage (IDirect3DDevice9* inner) : Next(inner) {}
+
+    HRESULT Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
+    {
+        timestep_patch_frame();
+        return Next::Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+    }
+};
+
+// Counts what the game submits per frame and reports averages
+template <typename Next>
+class CallStatsStage : public Next
+{
+public:
+    CallStatsStage (IDirect3DDevice9* inner) : Next(inner)
+    {
+        this->reset_counts();
+    }
+
+    HRESULT Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
+    {
+        if (++this->frames >= 300)
+        {
+            char message[256];
+            sprintf_s(message, "PinballVRcade: per frame %.1f draws, %.0f primitives, %.1f state changes, %.1f shader constant vectors, %.1f render target changes\n",
+                (float)this->draws / this->frames,
+                (float)this->primitives / this->frames,
+                (float)this->state_changes / this->frames,
+                (float)this->constant_vectors / this->frames,
+                (float)this->render_target_changes / this->frames);
+            OutputDebugStringA(message);
+            this->reset_counts();
+        }
+        return Next::Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+    }
+
+    HRESULT SetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget)
+    {
+        ++this->render_target_changes;
+        return Next::SetRenderTarget(RenderTargetIndex, pRenderTarget);
+    }
+
+    HRESULT SetRenderState (D3DRENDERSTATETYPE State,DWORD Value)
+    {
+        ++this->state_changes;
+        return Next::SetRenderState(State, Value);
+    }
+
+    HRESULT SetSamplerState (DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value)
+    {
+        ++this->state_changes;
+        return Next::SetSamplerState(Sampler, Type, Value);
+    }
+
+    HRESULT SetTexture (DWORD Stage,IDirect3DBaseTexture9* pTexture)
+    {
+        ++this->state_changes;
+        return Next::SetTexture(Stage, pTexture);
+    }
+
+    HRESULT SetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride)
+    {
+        ++this->state_changes;
+        return Next::SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride);
+    }
+
+    HRESULT SetVertexShader (IDirect3DVertexShader9* pShader)
+    {
+        ++this->state_changes;
+        return Next::SetVertexShader(pShader);
+    }
+
+    HRESULT SetPixelShader (IDirect3DPixelShader9* pShader)
+    {
+        ++this->state_changes;
+        return Next::SetPixelShader(pShader);
+    }
+
+    HRESULT SetVertexShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
+    {
+        this->constant_vectors += Vector4fCount;
+        return Next::SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+    }
+
+    HRESULT SetPixelShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
+    {
+        this->constant_vectors += Vector4fCount;
+        return Next::SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+    }
+
+    HRESULT DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount)
+    {
+        ++this->draws;
+        this->primitives += PrimitiveCount;
+        return Next::DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount);
+    }
+
+    HRESULT DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount)
+    {
+        ++this->draws;
+        this->primitives += primCount;
+        return Next::DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    }
+
+    HRESULT DrawPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
+    {
+        ++this->draws;
+        this->primitives += PrimitiveCount;
+        return Next::DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride);
+    }
+
+    HRESULT DrawIndexedPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
+    {
+        ++this->draws;
+        this->primitives += PrimitiveCount;
+        return Next::DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride);
+    }
+
+private:
+    void reset_counts ()
+    {
+        this->frames = 0;
+        this->draws = 0;
+        this->primitives = 0;
+        this->state_changes = 0;
+        this->constant_vectors = 0;
+        this->render_target_changes = 0;
+    }
+
+    unsigned int frames;
+    unsigned int draws;
+    unsigned int primitives;
+    unsigned int state_changes;
+    unsigned int constant_vectors;
+    unsigned int render_target_changes;
+};
+
+// Measures how long the rest of the chain spends in Present, which
+// includes distortion and the driver's own frame wait
+template <typename Next>
+class PresentTimingStage : public Next
+{
+public:
+    PresentTimingStage (IDirect3DDevice9* inner) : Next(inner)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        this->ms_per_tick = 1000.0 / (double)frequency.QuadPart;
+        this->frames = 0;
+        this->present_ticks = 0;
+        this->worst_ticks = 0;
+    }
+
+    HRESULT Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
+    {
+        LARGE_INTEGER start;
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&start);
+        HRESULT result = Next::Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+        QueryPerformanceCounter(&end);
+
+        LONGLONG ticks = end.QuadPart - start.QuadPart;
+        this->present_ticks += ticks;
+        this->worst_ticks = max(this->worst_ticks, ticks);
+        if (++this->frames >= 300)
+        {
+            char message[128];
+            sprintf_s(message, "PinballVRcade: Present took %.2f ms on average, %.2f ms at worst\n",
+                this->present_ticks * this->ms_per_tick / this->frames,
+                this->worst_ticks * this->ms_per_tick);
+            OutputDebugStringA(message);
+            this->frames = 0;
+            this->present_ticks = 0;
+            this->worst_ticks = 0;
+        }
+        return result;
+    }
+
+private:
+    double ms_per_tick;
+    unsigned int frames;
+    LONGLONG present_ticks;
+    LONGLONG worst_ticks;
+};
+
+// What ships by default, and the same chain with statistics on top for
+// [Debug] Instrument=1. Outer stages see each call first.
+typedef InterceptedDevice9<
+    FramePacingStage< DeviceForwarder >
+> ProductionDevice9;
+
+typedef InterceptedDevice9<
+    CallStatsStage<
+    PresentTimingStage<
+    FramePacingStage< DeviceForwarder > > >
+> InstrumentedDevice9;
@@ -0,0 +1,139 @@
+//====================================================================
+// Vtable layout of IDirect3DDevice9.
+//
+// IDIRECT3DDEVICE9_METHODS lists every method in the order d3d9.h
+// declares them, which is the order of the vtable. Expanding it with
+// DEVICE_SLOT_ENUM gives each method its slot index at compile time,
+// e.g. DEVICE_SLOT(Present).
+//====================================================================
+
+#pragma once
+
+#define IDIRECT3DDEVICE9_METHODS(X) \
+    X(QueryInterface) \
+    X(AddRef) \
+    X(Release) \
+    X(TestCooperativeLevel) \
+    X(GetAvailableTextureMem) \
+    X(EvictManagedResources) \
+    X(GetDirect3D) \
+    X(GetDeviceCaps) \
+    X(GetDisplayMode) \
+    X(GetCreationParameters) \
+    X(SetCursorProperties) \
+    X(SetCursorPosition) \
+    X(ShowCursor) \
+    X(CreateAdditionalSwapChain) \
+    X(GetSwapChain) \
+    X(GetNumberOfSwapChains) \
+    X(Reset) \
+    X(Present) \
+    X(GetBackBuffer) \
+    X(GetRasterStatus) \
+    X(SetDialogBoxMode) \
+    X(SetGammaRamp) \
+    X(GetGammaRamp) \
+    X(CreateTexture) \
+    X(CreateVolumeTexture) \
+    X(CreateCubeTexture) \
+    X(CreateVertexBuffer) \
+    X(CreateIndexBuffer) \
+    X(CreateRenderTarget) \
+    X(CreateDepthStencilSurface) \
+    X(UpdateSurface) \
+    X(UpdateTexture) \
+    X(GetRenderTargetData) \
+    X(GetFrontBufferData) \
+    X(StretchRect) \
+    X(ColorFill) \
+    X(CreateOffscreenPlainSurface) \
+    X(SetRenderTarget) \
+    X(GetRenderTarget) \
+    X(SetDepthStencilSurface) \
+    X(GetDepthStencilSurface) \
+    X(BeginScene) \
+    X(EndScene) \
+    X(Clear) \
+    X(SetTransform) \
+    X(GetTransform) \
+    X(MultiplyTransform) \
+    X(SetViewport) \
+    X(GetViewport) \
+    X(SetMaterial) \
+    X(GetMaterial) \
+    X(SetLight) \
+    X(GetLight) \
+    X(LightEnable) \
+    X(GetLightEnable) \
+    X(SetClipPlane) \
+    X(GetClipPlane) \
+    X(SetRenderState) \
+    X(GetRenderState) \
+    X(CreateStateBlock) \
+    X(BeginStateBlock) \
+    X(EndStateBlock) \
+    X(SetClipStatus) \
+    X(GetClipStatus) \
+    X(GetTexture) \
+    X(SetTexture) \
+    X(GetTextureStageState) \
+    X(SetTextureStageState) \
+    X(GetSamplerState) \
+    X(SetSamplerState) \
+    X(ValidateDevice) \
+    X(SetPaletteEntries) \
+    X(GetPaletteEntries) \
+    X(SetCurrentTexturePalette) \
+    X(GetCurrentTexturePalette) \
+    X(SetScissorRect) \
+    X(GetScissorRect) \
+    X(SetSoftwareVertexProcessing) \
+    X(GetSoftwareVertexProcessing) \
+    X(SetNPatchMode) \
+    X(GetNPatchMode) \
+    X(DrawPrimitive) \
+    X(DrawIndexedPrimitive) \
+    X(DrawPrimitiveUP) \
+    X(DrawIndexedPrimitiveUP) \
+    X(ProcessVertices) \
+    X(CreateVertexDeclaration) \
+    X(SetVertexDeclaration) \
+    X(GetVertexDeclaration) \
+    X(SetFVF) \
+    X(GetFVF) \
+    X(CreateVertexShader) \
+    X(SetVertexShader) \
+    X(GetVertexShader) \
+    X(SetVertexShaderConstantF) \
+    X(GetVertexShaderConstantF) \
+    X(SetVertexShaderConstantI) \
+    X(GetVertexShaderConstantI) \
+    X(SetVertexShaderConstantB) \
+    X(GetVertexShaderConstantB) \
+    X(SetStreamSource) \
+    X(GetStreamSource) \
+    X(SetStreamSourceFreq) \
+    X(GetStreamSourceFreq) \
+    X(SetIndices) \
+    X(GetIndices) \
+    X(CreatePixelShader) \
+    X(SetPixelShader) \
+    X(GetPixelShader) \
+    X(SetPixelShaderConstantF) \
+    X(GetPixelShaderConstantF) \
+    X(SetPixelShaderConstantI) \
+    X(GetPixelShaderConstantI) \
+    X(SetPixelShaderConstantB) \
+    X(GetPixelShaderConstantB) \
+    X(DrawRectPatch) \
+    X(DrawTriPatch) \
+    X(DeletePatch) \
+    X(CreateQuery)
+
+#define DEVICE_SLOT(name) DEVICE_SLOT_##name
+#define DEVICE_SLOT_ENUM(name) DEVICE_SLOT(name),
+
+enum device_slot {
+    IDIRECT3DDEVICE9_METHODS(DEVICE_SLOT_ENUM)
+    DEVICE_SLOT_COUNT
+};
@@ -0,0 +1,702 @@
+//====================================================================
+// Selective vtable patching implementation.
+//
+// Devices are created and released on the game's render thread, so
+// the bookkeeping here isn't locked. Lookups happen on every patched
+// call and are a short linear scan.
+//====================================================================
+
+#include <string.h>
+
+#include "DeviceVtablePatch.h"
+#include "DeviceVtable.h"
+#include "hacks.h"
+
+// Catches a method missing from or added to IDIRECT3DDEVICE9_METHODS
+C_ASSERT(DEVICE_SLOT_COUNT == 119);
+
+#define MAX_PATCHED_VTABLES 4
+#define MAX_BOUND_DEVICES 8
+
+struct patched_vtable {
+    void** vtable;
+    void* original[DEVICE_SLOT_COUNT];
+};
+
+struct bound_device {
+    IDirect3DDevice9* device;
+    IDirect3DDevice9* target;
+};
+
+static patched_vtable s_vtables[MAX_PATCHED_VTABLES];
+static unsigned int s_vtable_count = 0;
+static bound_device s_devices[MAX_BOUND_DEVICES];
+
+static void** vtable_of (IDirect3DDevice9* device)
+{
+    return *(void***)device;
+}
+
+static const patched_vtable* find_vtable (void** vtable)
+{
+    for (unsigned int i = 0; i < s_vtable_count; ++i)
+    {
+        if (s_vtables[i].vtable == vtable)
+        {
+            return &s_vtables[i];
+        }
+    }
+    return 0;
+}
+
+static void* original_slot (IDirect3DDevice9* device, device_slot slot)
+{
+    return find_vtable(vtable_of(device))->original[slot];
+}
+
+static IDirect3DDevice9* bound_target (IDirect3DDevice9* device)
+{
+    for (unsigned int i = 0; i < MAX_BOUND_DEVICES; ++i)
+    {
+        if (s_devices[i].device == device)
+        {
+            return s_devices[i].target;
+        }
+    }
+    return 0;
+}
+
+// Signatures of the patched slots, with the device as an explicit this
+typedef ULONG (STDMETHODCALLTYPE* Release_t)(IDirect3DDevice9*);
+typedef HRESULT (STDMETHODCALLTYPE* Reset_t)(IDirect3DDevice9*, D3DPRESENT_PARAMETERS*);
+typedef HRESULT (STDMETHODCALLTYPE* Present_t)(IDirect3DDevice9*, CONST RECT*, CONST RECT*, HWND, CONST RGNDATA*);
+typedef HRESULT (STDMETHODCALLTYPE* CreateTexture_t)(IDirect3DDevice9*, UINT, UINT, UINT, DWORD, D3DFORMAT, D3DPOOL, IDirect3DTexture9**, HANDLE*);
+typedef HRESULT (STDMETHODCALLTYPE* CreateVertexBuffer_t)(IDirect3DDevice9*, UINT, DWORD, DWORD, D3DPOOL, IDirect3DVertexBuffer9**, HANDLE*);
+typedef HRESULT (STDMETHODCALLTYPE* CreateRenderTarget_t)(IDirect3DDevice9*, UINT, UINT, D3DFORMAT, D3DMULTISAMPLE_TYPE, DWORD, BOOL, IDirect3DSurface9**, HANDLE*);
+typedef HRESULT (STDMETHODCALLTYPE* SetRenderTarget_t)(IDirect3DDevice9*, DWORD, IDirect3DSurface9*);
+typedef HRESULT (STDMETHODCALLTYPE* GetRenderTarget_t)(IDirect3DDevice9*, DWORD, IDirect3DSurface9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetDepthStencilSurface_t)(IDirect3DDevice9*, IDirect3DSurface9*);
+typedef HRESULT (STDMETHODCALLTYPE* GetDepthStencilSurface_t)(IDirect3DDevice9*, IDirect3DSurface9**);
+typedef HRESULT (STDMETHODCALLTYPE* Clear_t)(IDirect3DDevice9*, DWORD, CONST D3DRECT*, DWORD, D3DCOLOR, float, DWORD);
+typedef HRESULT (STDMETHODCALLTYPE* SetViewport_t)(IDirect3DDevice9*, CONST D3DVIEWPORT9*);
+typedef HRESULT (STDMETHODCALLTYPE* GetViewport_t)(IDirect3DDevice9*, D3DVIEWPORT9*);
+typedef HRESULT (STDMETHODCALLTYPE* SetRenderState_t)(IDirect3DDevice9*, D3DRENDERSTATETYPE, DWORD);
+typedef HRESULT (STDMETHODCALLTYPE* CreateStateBlock_t)(IDirect3DDevice9*, D3DSTATEBLOCKTYPE, IDirect3DStateBlock9**);
+typedef HRESULT (STDMETHODCALLTYPE* EndStateBlock_t)(IDirect3DDevice9*, IDirect3DStateBlock9**);
+typedef HRESULT (STDMETHODCALLTYPE* GetTexture_t)(IDirect3DDevice9*, DWORD, IDirect3DBaseTexture9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetTexture_t)(IDirect3DDevice9*, DWORD, IDirect3DBaseTexture9*);
+typedef HRESULT (STDMETHODCALLTYPE* SetScissorRect_t)(IDirect3DDevice9*, CONST RECT*);
+typedef HRESULT (STDMETHODCALLTYPE* GetScissorRect_t)(IDirect3DDevice9*, RECT*);
+typedef HRESULT (STDMETHODCALLTYPE* DrawPrimitive_t)(IDirect3DDevice9*, D3DPRIMITIVETYPE, UINT, UINT);
+typedef HRESULT (STDMETHODCALLTYPE* DrawIndexedPrimitive_t)(IDirect3DDevice9*, D3DPRIMITIVETYPE, INT, UINT, UINT, UINT, UINT);
+typedef HRESULT (STDMETHODCALLTYPE* ProcessVertices_t)(IDirect3DDevice9*, UINT, UINT, UINT, IDirect3DVertexBuffer9*, IDirect3DVertexDeclaration9*, DWORD);
+typedef HRESULT (STDMETHODCALLTYPE* CreateVertexDeclaration_t)(IDirect3DDevice9*, CONST D3DVERTEXELEMENT9*, IDirect3DVertexDeclaration9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetVertexDeclaration_t)(IDirect3DDevice9*, IDirect3DVertexDeclaration9*);
+typedef HRESULT (STDMETHODCALLTYPE* SetFVF_t)(IDirect3DDevice9*, DWORD);
+typedef HRESULT (STDMETHODCALLTYPE* CreateVertexShader_t)(IDirect3DDevice9*, CONST DWORD*, IDirect3DVertexShader9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetVertexShader_t)(IDirect3DDevice9*, IDirect3DVertexShader9*);
+typedef HRESULT (STDMETHODCALLTYPE* GetVertexShader_t)(IDirect3DDevice9*, IDirect3DVertexShader9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetVertexShaderConstantF_t)(IDirect3DDevice9*, UINT, CONST float*, UINT);
+typedef HRESULT (STDMETHODCALLTYPE* SetStreamSource_t)(IDirect3DDevice9*, UINT, IDirect3DVertexBuffer9*, UINT, UINT);
+typedef HRESULT (STDMETHODCALLTYPE* GetStreamSource_t)(IDirect3DDevice9*, UINT, IDirect3DVertexBuffer9**, UINT*, UINT*);
+typedef HRESULT (STDMETHODCALLTYPE* SetIndices_t)(IDirect3DDevice9*, IDirect3DIndexBuffer9*);
+typedef HRESULT (STDMETHODCALLTYPE* CreatePixelShader_t)(IDirect3DDevice9*, CONST DWORD*, IDirect3DPixelShader9**);
+typedef HRESULT (STDMETHODCALLTYPE* SetPixelShader_t)(IDirect3DDevice9*, IDirect3DPixelShader9*);
+typedef HRESULT (STDMETHODCALLTYPE* GetPixelShader_t)(IDirect3DDevice9*, IDirect3DPixelShader9**);
+
+//====================================================================
+// Replacement slot functions. Bound devices go through the hooks,
+// anything else straight to the driver.
+//====================================================================
+
+static ULONG STDMETHODCALLTYPE hook_Release (IDirect3DDevice9* device)
+{
+    ULONG count = ((Release_t)original_slot(device, DEVICE_SLOT(Release)))(device);
+    if (count == 0)
+    {
+        // The address may be reused by the next device
+        for (unsigned int i = 0; i < MAX_BOUND_DEVICES; ++i)
+        {
+            if (s_devices[i].device == device)
+            {
+                s_devices[i].device = 0;
+                s_devices[i].target = 0;
+            }
+        }
+    }
+    return count;
+}
+
+static HRESULT STDMETHODCALLTYPE hook_Reset (IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->Reset(pPresentationParameters);
+    }
+    return ((Reset_t)original_slot(device, DEVICE_SLOT(Reset)))(device, pPresentationParameters);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_Present (IDirect3DDevice9* device, CONST RECT* pSourceRect, CONST RECT* pDestRect, HWND hDestWindowOverride, CONST RGNDATA* pDirtyRegion)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+    }
+    return ((Present_t)original_slot(device, DEVICE_SLOT(Present)))(device, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateTexture (IDirect3DDevice9* device, UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture9** ppTexture, HANDLE* pSharedHandle)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+    }
+    return ((CreateTexture_t)original_slot(device, DEVICE_SLOT(CreateTexture)))(device, Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateVertexBuffer (IDirect3DDevice9* device, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer9** ppVertexBuffer, HANDLE* pSharedHandle)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+    }
+    return ((CreateVertexBuffer_t)original_slot(device, DEVICE_SLOT(CreateVertexBuffer)))(device, Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateRenderTarget (IDirect3DDevice9* device, UINT Width, UINT Height, D3DFORMAT Format, D3DMULTISAMPLE_TYPE MultiSample, DWORD MultisampleQuality, BOOL Lockable, IDirect3DSurface9** ppSurface, HANDLE* pSharedHandle)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateRenderTarget(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle);
+    }
+    return ((CreateRenderTarget_t)original_slot(device, DEVICE_SLOT(CreateRenderTarget)))(device, Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetRenderTarget (IDirect3DDevice9* device, DWORD RenderTargetIndex, IDirect3DSurface9* pRenderTarget)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+    }
+    return ((SetRenderTarget_t)original_slot(device, DEVICE_SLOT(SetRenderTarget)))(device, RenderTargetIndex, pRenderTarget);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetRenderTarget (IDirect3DDevice9* device, DWORD RenderTargetIndex, IDirect3DSurface9** ppRenderTarget)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetRenderTarget(RenderTargetIndex, ppRenderTarget);
+    }
+    return ((GetRenderTarget_t)original_slot(device, DEVICE_SLOT(GetRenderTarget)))(device, RenderTargetIndex, ppRenderTarget);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetDepthStencilSurface (IDirect3DDevice9* device, IDirect3DSurface9* pNewZStencil)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetDepthStencilSurface(pNewZStencil);
+    }
+    return ((SetDepthStencilSurface_t)original_slot(device, DEVICE_SLOT(SetDepthStencilSurface)))(device, pNewZStencil);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetDepthStencilSurface (IDirect3DDevice9* device, IDirect3DSurface9** ppZStencilSurface)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetDepthStencilSurface(ppZStencilSurface);
+    }
+    return ((GetDepthStencilSurface_t)original_slot(device, DEVICE_SLOT(GetDepthStencilSurface)))(device, ppZStencilSurface);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_Clear (IDirect3DDevice9* device, DWORD Count, CONST D3DRECT* pRects, DWORD Flags, D3DCOLOR Color, float Z, DWORD Stencil)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->Clear(Count, pRects, Flags, Color, Z, Stencil);
+    }
+    return ((Clear_t)original_slot(device, DEVICE_SLOT(Clear)))(device, Count, pRects, Flags, Color, Z, Stencil);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetViewport (IDirect3DDevice9* device, CONST D3DVIEWPORT9* pViewport)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetViewport(pViewport);
+    }
+    return ((SetViewport_t)original_slot(device, DEVICE_SLOT(SetViewport)))(device, pViewport);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetViewport (IDirect3DDevice9* device, D3DVIEWPORT9* pViewport)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetViewport(pViewport);
+    }
+    return ((GetViewport_t)original_slot(device, DEVICE_SLOT(GetViewport)))(device, pViewport);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetRenderState (IDirect3DDevice9* device, D3DRENDERSTATETYPE State, DWORD Value)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetRenderState(State, Value);
+    }
+    return ((SetRenderState_t)original_slot(device, DEVICE_SLOT(SetRenderState)))(device, State, Value);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateStateBlock (IDirect3DDevice9* device, D3DSTATEBLOCKTYPE Type, IDirect3DStateBlock9** ppSB)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateStateBlock(Type, ppSB);
+    }
+    return ((CreateStateBlock_t)original_slot(device, DEVICE_SLOT(CreateStateBlock)))(device, Type, ppSB);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_EndStateBlock (IDirect3DDevice9* device, IDirect3DStateBlock9** ppSB)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->EndStateBlock(ppSB);
+    }
+    return ((EndStateBlock_t)original_slot(device, DEVICE_SLOT(EndStateBlock)))(device, ppSB);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetTexture (IDirect3DDevice9* device, DWORD Stage, IDirect3DBaseTexture9** ppTexture)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetTexture(Stage, ppTexture);
+    }
+    return ((GetTexture_t)original_slot(device, DEVICE_SLOT(GetTexture)))(device, Stage, ppTexture);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetTexture (IDirect3DDevice9* device, DWORD Stage, IDirect3DBaseTexture9* pTexture)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetTexture(Stage, pTexture);
+    }
+    return ((SetTexture_t)original_slot(device, DEVICE_SLOT(SetTexture)))(device, Stage, pTexture);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetScissorRect (IDirect3DDevice9* device, CONST RECT* pRect)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetScissorRect(pRect);
+    }
+    return ((SetScissorRect_t)original_slot(device, DEVICE_SLOT(SetScissorRect)))(device, pRect);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetScissorRect (IDirect3DDevice9* device, RECT* pRect)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetScissorRect(pRect);
+    }
+    return ((GetScissorRect_t)original_slot(device, DEVICE_SLOT(GetScissorRect)))(device, pRect);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_DrawPrimitive (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount);
+    }
+    return ((DrawPrimitive_t)original_slot(device, DEVICE_SLOT(DrawPrimitive)))(device, PrimitiveType, StartVertex, PrimitiveCount);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_DrawIndexedPrimitive (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    }
+    return ((DrawIndexedPrimitive_t)original_slot(device, DEVICE_SLOT(DrawIndexedPrimitive)))(device, PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_ProcessVertices (IDirect3DDevice9* device, UINT SrcStartIndex, UINT DestIndex, UINT VertexCount, IDirect3DVertexBuffer9* pDestBuffer, IDirect3DVertexDeclaration9* pVertexDecl, DWORD Flags)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags);
+    }
+    return ((ProcessVertices_t)original_slot(device, DEVICE_SLOT(ProcessVertices)))(device, SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateVertexDeclaration (IDirect3DDevice9* device, CONST D3DVERTEXELEMENT9* pVertexElements, IDirect3DVertexDeclaration9** ppDecl)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateVertexDeclaration(pVertexElements, ppDecl);
+    }
+    return ((CreateVertexDeclaration_t)original_slot(device, DEVICE_SLOT(CreateVertexDeclaration)))(device, pVertexElements, ppDecl);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetVertexDeclaration (IDirect3DDevice9* device, IDirect3DVertexDeclaration9* pDecl)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetVertexDeclaration(pDecl);
+    }
+    return ((SetVertexDeclaration_t)original_slot(device, DEVICE_SLOT(SetVertexDeclaration)))(device, pDecl);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetFVF (IDirect3DDevice9* device, DWORD FVF)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetFVF(FVF);
+    }
+    return ((SetFVF_t)original_slot(device, DEVICE_SLOT(SetFVF)))(device, FVF);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreateVertexShader (IDirect3DDevice9* device, CONST DWORD* pFunction, IDirect3DVertexShader9** ppShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreateVertexShader(pFunction, ppShader);
+    }
+    return ((CreateVertexShader_t)original_slot(device, DEVICE_SLOT(CreateVertexShader)))(device, pFunction, ppShader);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetVertexShader (IDirect3DDevice9* device, IDirect3DVertexShader9* pShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetVertexShader(pShader);
+    }
+    return ((SetVertexShader_t)original_slot(device, DEVICE_SLOT(SetVertexShader)))(device, pShader);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetVertexShader (IDirect3DDevice9* device, IDirect3DVertexShader9** ppShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetVertexShader(ppShader);
+    }
+    return ((GetVertexShader_t)original_slot(device, DEVICE_SLOT(GetVertexShader)))(device, ppShader);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetVertexShaderConstantF (IDirect3DDevice9* device, UINT StartRegister, CONST float* pConstantData, UINT Vector4fCount)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+    }
+    return ((SetVertexShaderConstantF_t)original_slot(device, DEVICE_SLOT(SetVertexShaderConstantF)))(device, StartRegister, pConstantData, Vector4fCount);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetStreamSource (IDirect3DDevice9* device, UINT StreamNumber, IDirect3DVertexBuffer9* pStreamData, UINT OffsetInBytes, UINT Stride)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride);
+    }
+    return ((SetStreamSource_t)original_slot(device, DEVICE_SLOT(SetStreamSource)))(device, StreamNumber, pStreamData, OffsetInBytes, Stride);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetStreamSource (IDirect3DDevice9* device, UINT StreamNumber, IDirect3DVertexBuffer9** ppStreamData, UINT* pOffsetInBytes, UINT* pStride)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride);
+    }
+    return ((GetStreamSource_t)original_slot(device, DEVICE_SLOT(GetStreamSource)))(device, StreamNumber, ppStreamData, pOffsetInBytes, pStride);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetIndices (IDirect3DDevice9* device, IDirect3DIndexBuffer9* pIndexData)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetIndices(pIndexData);
+    }
+    return ((SetIndices_t)original_slot(device, DEVICE_SLOT(SetIndices)))(device, pIndexData);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_CreatePixelShader (IDirect3DDevice9* device, CONST DWORD* pFunction, IDirect3DPixelShader9** ppShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->CreatePixelShader(pFunction, ppShader);
+    }
+    return ((CreatePixelShader_t)original_slot(device, DEVICE_SLOT(CreatePixelShader)))(device, pFunction, ppShader);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_SetPixelShader (IDirect3DDevice9* device, IDirect3DPixelShader9* pShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->SetPixelShader(pShader);
+    }
+    return ((SetPixelShader_t)original_slot(device, DEVICE_SLOT(SetPixelShader)))(device, pShader);
+}
+
+static HRESULT STDMETHODCALLTYPE hook_GetPixelShader (IDirect3DDevice9* device, IDirect3DPixelShader9** ppShader)
+{
+    IDirect3DDevice9* target = bound_target(device);
+    if (target)
+    {
+        return target->GetPixelShader(ppShader);
+    }
+    return ((GetPixelShader_t)original_slot(device, DEVICE_SLOT(GetPixelShader)))(device, ppShader);
+}
+
+struct slot_patch {
+    device_slot slot;
+    void* function;
+};
+
+// The slots the hooks do real work in. Everything else Direct3DDevice9Hooks
+// implements is a plain forward.
+static const slot_patch s_slot_patches[] = {
+    { DEVICE_SLOT(Release), (void*)&hook_Release },
+    { DEVICE_SLOT(Reset), (void*)&hook_Reset },
+    { DEVICE_SLOT(Present), (void*)&hook_Present },
+    { DEVICE_SLOT(CreateTexture), (void*)&hook_CreateTexture },
+    { DEVICE_SLOT(CreateVertexBuffer), (void*)&hook_CreateVertexBuffer },
+    { DEVICE_SLOT(CreateRenderTarget), (void*)&hook_CreateRenderTarget },
+    { DEVICE_SLOT(SetRenderTarget), (void*)&hook_SetRenderTarget },
+    { DEVICE_SLOT(GetRenderTarget), (void*)&hook_GetRenderTarget },
+    { DEVICE_SLOT(SetDepthStencilSurface), (void*)&hook_SetDepthStencilSurface },
+    { DEVICE_SLOT(GetDepthStencilSurface), (void*)&hook_GetDepthStencilSurface },
+    { DEVICE_SLOT(Clear), (void*)&hook_Clear },
+    { DEVICE_SLOT(SetViewport), (void*)&hook_SetViewport },
+    { DEVICE_SLOT(GetViewport), (void*)&hook_GetViewport },
+    { DEVICE_SLOT(SetRenderState), (void*)&hook_SetRenderState },
+    { DEVICE_SLOT(CreateStateBlock), (void*)&hook_CreateStateBlock },
+    { DEVICE_SLOT(EndStateBlock), (void*)&hook_EndStateBlock },
+    { DEVICE_SLOT(GetTexture), (void*)&hook_GetTexture },
+    { DEVICE_SLOT(SetTexture), (void*)&hook_SetTexture },
+    { DEVICE_SLOT(SetScissorRect), (void*)&hook_SetScissorRect },
+    { DEVICE_SLOT(GetScissorRect), (void*)&hook_GetScissorRect },
+    { DEVICE_SLOT(DrawPrimitive), (void*)&hook_DrawPrimitive },
+    { DEVICE_SLOT(DrawIndexedPrimitive), (void*)&hook_DrawIndexedPrimitive },
+    { DEVICE_SLOT(ProcessVertices), (void*)&hook_ProcessVertices },
+    { DEVICE_SLOT(CreateVertexDeclaration), (void*)&hook_CreateVertexDeclaration },
+    { DEVICE_SLOT(SetVertexDeclaration), (void*)&hook_SetVertexDeclaration },
+    { DEVICE_SLOT(SetFVF), (void*)&hook_SetFVF },
+    { DEVICE_SLOT(CreateVertexShader), (void*)&hook_CreateVertexShader },
+    { DEVICE_SLOT(SetVertexShader), (void*)&hook_SetVertexShader },
+    { DEVICE_SLOT(GetVertexShader), (void*)&hook_GetVertexShader },
+    { DEVICE_SLOT(SetVertexShaderConstantF), (void*)&hook_SetVertexShaderConstantF },
+    { DEVICE_SLOT(SetStreamSource), (void*)&hook_SetStreamSource },
+    { DEVICE_SLOT(GetStreamSource), (void*)&hook_GetStreamSource },
+    { DEVICE_SLOT(SetIndices), (void*)&hook_SetIndices },
+    { DEVICE_SLOT(CreatePixelShader), (void*)&hook_CreatePixelShader },
+    { DEVICE_SLOT(SetPixelShader), (void*)&hook_SetPixelShader },
+    { DEVICE_SLOT(GetPixelShader), (void*)&hook_GetPixelShader },
+};
+
+//====================================================================
+// Device the hooks call into. Patched slots jump to the saved
+// originals so the hooks never see their own calls again.
+//====================================================================
+
+class UnpatchedDevice9 : public IDirect3DDevice9
+{
+public:
+    UnpatchedDevice9 (IDirect3DDevice9* device, const patched_vtable* vtable)
+    {
+        this->device = device;
+        this->original = vtable->original;
+    }
+
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj) { return this->device->QueryInterface(riid, ppvObj); }
+    STDMETHOD_(ULONG,AddRef)(THIS) { return this->device->AddRef(); }
+    STDMETHOD_(ULONG,Release)(THIS) { return ((Release_t)this->original[DEVICE_SLOT(Release)])(this->device); }
+    STDMETHOD(TestCooperativeLevel)(THIS) { return this->device->TestCooperativeLevel(); }
+    STDMETHOD_(UINT, GetAvailableTextureMem)(THIS) { return this->device->GetAvailableTextureMem(); }
+    STDMETHOD(EvictManagedResources)(THIS) { return this->device->EvictManagedResources(); }
+    STDMETHOD(GetDirect3D)(THIS_ IDirect3D9** ppD3D9) { return this->device->GetDirect3D(ppD3D9); }
+    STDMETHOD(GetDeviceCaps)(THIS_ D3DCAPS9* pCaps) { return this->device->GetDeviceCaps(pCaps); }
+    STDMETHOD(GetDisplayMode)(THIS_ UINT iSwapChain,D3DDISPLAYMODE* pMode) { return this->device->GetDisplayMode(iSwapChain, pMode); }
+    STDMETHOD(GetCreationParameters)(THIS_ D3DDEVICE_CREATION_PARAMETERS *pParameters) { return this->device->GetCreationParameters(pParameters); }
+    STDMETHOD(SetCursorProperties)(THIS_ UINT XHotSpot,UINT YHotSpot,IDirect3DSurface9* pCursorBitmap) { return this->device->SetCursorProperties(XHotSpot, YHotSpot, pCursorBitmap); }
+    STDMETHOD_(void, SetCursorPosition)(THIS_ int X,int Y,DWORD Flags) { this->device->SetCursorPosition(X, Y, Flags); }
+    STDMETHOD_(BOOL, ShowCursor)(THIS_ BOOL bShow) { return this->device->ShowCursor(bShow); }
+    STDMETHOD(CreateAdditionalSwapChain)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DSwapChain9** pSwapChain) { return this->device->CreateAdditionalSwapChain(pPresentationParameters, pSwapChain); }
+    STDMETHOD(GetSwapChain)(THIS_ UINT iSwapChain,IDirect3DSwapChain9** pSwapChain) { return this->device->GetSwapChain(iSwapChain, pSwapChain); }
+    STDMETHOD_(UINT, GetNumberOfSwapChains)(THIS) { return this->device->GetNumberOfSwapChains(); }
+    STDMETHOD(Reset)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters) { return ((Reset_t)this->original[DEVICE_SLOT(Reset)])(this->device, pPresentationParameters); }
+    STDMETHOD(Present)(THIS_ CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion) { return ((Present_t)this->original[DEVICE_SLOT(Present)])(this->device, pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion); }
+    STDMETHOD(GetBackBuffer)(THIS_ UINT iSwapChain,UINT iBackBuffer,D3DBACKBUFFER_TYPE Type,IDirect3DSurface9** ppBackBuffer) { return this->device->GetBackBuffer(iSwapChain, iBackBuffer, Type, ppBackBuffer); }
+    STDMETHOD(GetRasterStatus)(THIS_ UINT iSwapChain,D3DRASTER_STATUS* pRasterStatus) { return this->device->GetRasterStatus(iSwapChain, pRasterStatus); }
+    STDMETHOD(SetDialogBoxMode)(THIS_ BOOL bEnableDialogs) { return this->device->SetDialogBoxMode(bEnableDialogs); }
+    STDMETHOD_(void, SetGammaRamp)(THIS_ UINT iSwapChain,DWORD Flags,CONST D3DGAMMARAMP* pRamp) { this->device->SetGammaRamp(iSwapChain, Flags, pRamp); }
+    STDMETHOD_(void, GetGammaRamp)(THIS_ UINT iSwapChain,D3DGAMMARAMP* pRamp) { this->device->GetGammaRamp(iSwapChain, pRamp); }
+    STDMETHOD(CreateTexture)(THIS_ UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle) { return ((CreateTexture_t)this->original[DEVICE_SLOT(CreateTexture)])(this->device, Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle); }
+    STDMETHOD(CreateVolumeTexture)(THIS_ UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle) { return this->device->CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle); }
+    STDMETHOD(CreateCubeTexture)(THIS_ UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle) { return this->device->CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle); }
+    STDMETHOD(CreateVertexBuffer)(THIS_ UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle) { return ((CreateVertexBuffer_t)this->original[DEVICE_SLOT(CreateVertexBuffer)])(this->device, Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle); }
+    STDMETHOD(CreateIndexBuffer)(THIS_ UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle) { return this->device->CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle); }
+    STDMETHOD(CreateRenderTarget)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Lockable,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return ((CreateRenderTarget_t)this->original[DEVICE_SLOT(CreateRenderTarget)])(this->device, Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle); }
+    STDMETHOD(CreateDepthStencilSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Discard,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->device->CreateDepthStencilSurface(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle); }
+    STDMETHOD(UpdateSurface)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint) { return this->device->UpdateSurface(pSourceSurface, pSourceRect, pDestinationSurface, pDestPoint); }
+    STDMETHOD(UpdateTexture)(THIS_ IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture) { return this->device->UpdateTexture(pSourceTexture, pDestinationTexture); }
+    STDMETHOD(GetRenderTargetData)(THIS_ IDirect3DSurface9* pRenderTarget,IDirect3DSurface9* pDestSurface) { return this->device->GetRenderTargetData(pRenderTarget, pDestSurface); }
+    STDMETHOD(GetFrontBufferData)(THIS_ UINT iSwapChain,IDirect3DSurface9* pDestSurface) { return this->device->GetFrontBufferData(iSwapChain, pDestSurface); }
+    STDMETHOD(StretchRect)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestSurface,CONST RECT* pDestRect,D3DTEXTUREFILTERTYPE Filter) { return this->device->StretchRect(pSourceSurface, pSourceRect, pDestSurface, pDestRect, Filter); }
+    STDMETHOD(ColorFill)(THIS_ IDirect3DSurface9* pSurface,CONST RECT* pRect,D3DCOLOR color) { return this->device->ColorFill(pSurface, pRect, color); }
+    STDMETHOD(CreateOffscreenPlainSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DPOOL Pool,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle) { return this->device->CreateOffscreenPlainSurface(Width, Height, Format, Pool, ppSurface, pSharedHandle); }
+    STDMETHOD(SetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget) { return ((SetRenderTarget_t)this->original[DEVICE_SLOT(SetRenderTarget)])(this->device, RenderTargetIndex, pRenderTarget); }
+    STDMETHOD(GetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget) { return ((GetRenderTarget_t)this->original[DEVICE_SLOT(GetRenderTarget)])(this->device, RenderTargetIndex, ppRenderTarget); }
+    STDMETHOD(SetDepthStencilSurface)(THIS_ IDirect3DSurface9* pNewZStencil) { return ((SetDepthStencilSurface_t)this->original[DEVICE_SLOT(SetDepthStencilSurface)])(this->device, pNewZStencil); }
+    STDMETHOD(GetDepthStencilSurface)(THIS_ IDirect3DSurface9** ppZStencilSurface) { return ((GetDepthStencilSurface_t)this->original[DEVICE_SLOT(GetDepthStencilSurface)])(this->device, ppZStencilSurface); }
+    STDMETHOD(BeginScene)(THIS) { return this->device->BeginScene(); }
+    STDMETHOD(EndScene)(THIS) { return this->device->EndScene(); }
+    STDMETHOD(Clear)(THIS_ DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil) { return ((Clear_t)this->original[DEVICE_SLOT(Clear)])(this->device, Count, pRects, Flags, Color, Z, Stencil); }
+    STDMETHOD(SetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->device->SetTransform(State, pMatrix); }
+    STDMETHOD(GetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,D3DMATRIX* pMatrix) { return this->device->GetTransform(State, pMatrix); }
+    STDMETHOD(MultiplyTransform)(THIS_ D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix) { return this->device->MultiplyTransform(State, pMatrix); }
+    STDMETHOD(SetViewport)(THIS_ CONST D3DVIEWPORT9* pViewport) { return ((SetViewport_t)this->original[DEVICE_SLOT(SetViewport)])(this->device, pViewport); }
+    STDMETHOD(GetViewport)(THIS_ D3DVIEWPORT9* pViewport) { return ((GetViewport_t)this->original[DEVICE_SLOT(GetViewport)])(this->device, pViewport); }
+    STDMETHOD(SetMaterial)(THIS_ CONST D3DMATERIAL9* pMaterial) { return this->device->SetMaterial(pMaterial); }
+    STDMETHOD(GetMaterial)(THIS_ D3DMATERIAL9* pMaterial) { return this->device->GetMaterial(pMaterial); }
+    STDMETHOD(SetLight)(THIS_ DWORD Index,CONST D3DLIGHT9* pLight) { return this->device->SetLight(Index, pLight); }
+    STDMETHOD(GetLight)(THIS_ DWORD Index,D3DLIGHT9* pLight) { return this->device->GetLight(Index, pLight); }
+    STDMETHOD(LightEnable)(THIS_ DWORD Index,BOOL Enable) { return this->device->LightEnable(Index, Enable); }
+    STDMETHOD(GetLightEnable)(THIS_ DWORD Index,BOOL* pEnable) { return this->device->GetLightEnable(Index, pEnable); }
+    STDMETHOD(SetClipPlane)(THIS_ DWORD Index,CONST float* pPlane) { return this->device->SetClipPlane(Index, pPlane); }
+    STDMETHOD(GetClipPlane)(THIS_ DWORD Index,float* pPlane) { return this->device->GetClipPlane(Index, pPlane); }
+    STDMETHOD(SetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD Value) { return ((SetRenderState_t)this->original[DEVICE_SLOT(SetRenderState)])(this->device, State, Value); }
+    STDMETHOD(GetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD* pValue) { return this->device->GetRenderState(State, pValue); }
+    STDMETHOD(CreateStateBlock)(THIS_ D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB) { return ((CreateStateBlock_t)this->original[DEVICE_SLOT(CreateStateBlock)])(this->device, Type, ppSB); }
+    STDMETHOD(BeginStateBlock)(THIS) { return this->device->BeginStateBlock(); }
+    STDMETHOD(EndStateBlock)(THIS_ IDirect3DStateBlock9** ppSB) { return ((EndStateBlock_t)this->original[DEVICE_SLOT(EndStateBlock)])(this->device, ppSB); }
+    STDMETHOD(SetClipStatus)(THIS_ CONST D3DCLIPSTATUS9* pClipStatus) { return this->device->SetClipStatus(pClipStatus); }
+    STDMETHOD(GetClipStatus)(THIS_ D3DCLIPSTATUS9* pClipStatus) { return this->device->GetClipStatus(pClipStatus); }
+    STDMETHOD(GetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9** ppTexture) { return ((GetTexture_t)this->original[DEVICE_SLOT(GetTexture)])(this->device, Stage, ppTexture); }
+    STDMETHOD(SetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9* pTexture) { return ((SetTexture_t)this->original[DEVICE_SLOT(SetTexture)])(this->device, Stage, pTexture); }
+    STDMETHOD(GetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue) { return this->device->GetTextureStageState(Stage, Type, pValue); }
+    STDMETHOD(SetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD Value) { return this->device->SetTextureStageState(Stage, Type, Value); }
+    STDMETHOD(GetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD* pValue) { return this->device->GetSamplerState(Sampler, Type, pValue); }
+    STDMETHOD(SetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value) { return this->device->SetSamplerState(Sampler, Type, Value); }
+    STDMETHOD(ValidateDevice)(THIS_ DWORD* pNumPasses) { return this->device->ValidateDevice(pNumPasses); }
+    STDMETHOD(SetPaletteEntries)(THIS_ UINT PaletteNumber,CONST PALETTEENTRY* pEntries) { return this->device->SetPaletteEntries(PaletteNumber, pEntries); }
+    STDMETHOD(GetPaletteEntries)(THIS_ UINT PaletteNumber,PALETTEENTRY* pEntries) { return this->device->GetPaletteEntries(PaletteNumber, pEntries); }
+    STDMETHOD(SetCurrentTexturePalette)(THIS_ UINT PaletteNumber) { return this->device->SetCurrentTexturePalette(PaletteNumber); }
+    STDMETHOD(GetCurrentTexturePalette)(THIS_ UINT *PaletteNumber) { return this->device->GetCurrentTexturePalette(PaletteNumber); }
+    STDMETHOD(SetScissorRect)(THIS_ CONST RECT* pRect) { return ((SetScissorRect_t)this->original[DEVICE_SLOT(SetScissorRect)])(this->device, pRect); }
+    STDMETHOD(GetScissorRect)(THIS_ RECT* pRect) { return ((GetScissorRect_t)this->original[DEVICE_SLOT(GetScissorRect)])(this->device, pRect); }
+    STDMETHOD(SetSoftwareVertexProcessing)(THIS_ BOOL bSoftware) { return this->device->SetSoftwareVertexProcessing(bSoftware); }
+    STDMETHOD_(BOOL, GetSoftwareVertexProcessing)(THIS) { return this->device->GetSoftwareVertexProcessing(); }
+    STDMETHOD(SetNPatchMode)(THIS_ float nSegments) { return this->device->SetNPatchMode(nSegments); }
+    STDMETHOD_(float, GetNPatchMode)(THIS) { return this->device->GetNPatchMode(); }
+    STDMETHOD(DrawPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount) { return ((DrawPrimitive_t)this->original[DEVICE_SLOT(DrawPrimitive)])(this->device, PrimitiveType, StartVertex, PrimitiveCount); }
+    STDMETHOD(DrawIndexedPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount) { return ((DrawIndexedPrimitive_t)this->original[DEVICE_SLOT(DrawIndexedPrimitive)])(this->device, PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount); }
+    STDMETHOD(DrawPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->device->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride); }
+    STDMETHOD(DrawIndexedPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride) { return this->device->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride); }
+    STDMETHOD(ProcessVertices)(THIS_ UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags) { return ((ProcessVertices_t)this->original[DEVICE_SLOT(ProcessVertices)])(this->device, SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags); }
+    STDMETHOD(CreateVertexDeclaration)(THIS_ CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl) { return ((CreateVertexDeclaration_t)this->original[DEVICE_SLOT(CreateVertexDeclaration)])(this->device, pVertexElements, ppDecl); }
+    STDMETHOD(SetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9* pDecl) { return ((SetVertexDeclaration_t)this->original[DEVICE_SLOT(SetVertexDeclaration)])(this->device, pDecl); }
+    STDMETHOD(GetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9** ppDecl) { return this->device->GetVertexDeclaration(ppDecl); }
+    STDMETHOD(SetFVF)(THIS_ DWORD FVF) { return ((SetFVF_t)this->original[DEVICE_SLOT(SetFVF)])(this->device, FVF); }
+    STDMETHOD(GetFVF)(THIS_ DWORD* pFVF) { return this->device->GetFVF(pFVF); }
+    STDMETHOD(CreateVertexShader)(THIS_ CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader) { return ((CreateVertexShader_t)this->original[DEVICE_SLOT(CreateVertexShader)])(this->device, pFunction, ppShader); }
+    STDMETHOD(SetVertexShader)(THIS_ IDirect3DVertexShader9* pShader) { return ((SetVertexShader_t)this->original[DEVICE_SLOT(SetVertexShader)])(this->device, pShader); }
+    STDMETHOD(GetVertexShader)(THIS_ IDirect3DVertexShader9** ppShader) { return ((GetVertexShader_t)this->original[DEVICE_SLOT(GetVertexShader)])(this->device, ppShader); }
+    STDMETHOD(SetVertexShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return ((SetVertexShaderConstantF_t)this->original[DEVICE_SLOT(SetVertexShaderConstantF)])(this->device, StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(GetVertexShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->device->GetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(SetVertexShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->device->SetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(GetVertexShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->device->GetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(SetVertexShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->device->SetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(GetVertexShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->device->GetVertexShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(SetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride) { return ((SetStreamSource_t)this->original[DEVICE_SLOT(SetStreamSource)])(this->device, StreamNumber, pStreamData, OffsetInBytes, Stride); }
+    STDMETHOD(GetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride) { return ((GetStreamSource_t)this->original[DEVICE_SLOT(GetStreamSource)])(this->device, StreamNumber, ppStreamData, pOffsetInBytes, pStride); }
+    STDMETHOD(SetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT Setting) { return this->device->SetStreamSourceFreq(StreamNumber, Setting); }
+    STDMETHOD(GetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT* pSetting) { return this->device->GetStreamSourceFreq(StreamNumber, pSetting); }
+    STDMETHOD(SetIndices)(THIS_ IDirect3DIndexBuffer9* pIndexData) { return ((SetIndices_t)this->original[DEVICE_SLOT(SetIndices)])(this->device, pIndexData); }
+    STDMETHOD(GetIndices)(THIS_ IDirect3DIndexBuffer9** ppIndexData) { return this->device->GetIndices(ppIndexData); }
+    STDMETHOD(CreatePixelShader)(THIS_ CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader) { return ((CreatePixelShader_t)this->original[DEVICE_SLOT(CreatePixelShader)])(this->device, pFunction, ppShader); }
+    STDMETHOD(SetPixelShader)(THIS_ IDirect3DPixelShader9* pShader) { return ((SetPixelShader_t)this->original[DEVICE_SLOT(SetPixelShader)])(this->device, pShader); }
+    STDMETHOD(GetPixelShader)(THIS_ IDirect3DPixelShader9** ppShader) { return ((GetPixelShader_t)this->original[DEVICE_SLOT(GetPixelShader)])(this->device, ppShader); }
+    STDMETHOD(SetPixelShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount) { return this->device->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(GetPixelShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount) { return this->device->GetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount); }
+    STDMETHOD(SetPixelShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount) { return this->device->SetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(GetPixelShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount) { return this->device->GetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount); }
+    STDMETHOD(SetPixelShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount) { return this->device->SetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(GetPixelShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount) { return this->device->GetPixelShaderConstantB(StartRegister, pConstantData, BoolCount); }
+    STDMETHOD(DrawRectPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DRECTPATCH_INFO* pRectPatchInfo) { return this->device->DrawRectPatch(Handle, pNumSegs, pRectPatchInfo); }
+    STDMETHOD(DrawTriPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DTRIPATCH_INFO* pTriPatchInfo) { return this->device->DrawTriPatch(Handle, pNumSegs, pTriPatchInfo); }
+    STDMETHOD(DeletePatch)(THIS_ UINT Handle) { return this->device->DeletePatch(Handle); }
+    STDMETHOD(CreateQuery)(THIS_ D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery) { return this->device->CreateQuery(Type, ppQuery); }
+
+private:
+    IDirect3DDevice9* device;
+    void* const* original;
+};
+
+IDirect3DDevice9* vtable_patch_device (IDirect3DDevice9* device)
+{
+    void** vtable = vtable_of(device);
+    const patched_vtable* patched = find_vtable(vtable);
+    if (!patched)
+    {
+        if (s_vtable_count == MAX_PATCHED_VTABLES)
+        {
+            OutputDebugStringA("PinballVRcade: too many device vtables to patch\n");
+            return 0;
+        }
+        patched_vtable* record = &s_vtables[s_vtable_count];
+        record->vtable = vtable;
+        memcpy(record->original, vtable, sizeof(record->original));
+        for (unsigned int i = 0; i < sizeof(s_slot_patches) / sizeof(s_slot_patches[0]); ++i)
+        {
+            const slot_patch& patch = s_slot_patches[i];
+            install_patch((uintptr_t)&vtable[patch.slot], sizeof(void*), &patch.function);
+        }
+        ++s_vtable_count;
+        patched = record;
+    }
+    return new UnpatchedDevice9(device, patched);
+}
+
+void vtable_patch_bind (IDirect3DDevice9* device, IDirect3DDevice9* target)
+{
+    for (unsigned int i = 0; i < MAX_BOUND_DEVICES; ++i)
+    {
+        if (!s_devices[i].device)
+        {
+            s_devices[i].target = target;
+            s_devices[i].device = device;
+            return;
+        }
+    }
+    OutputDebugStringA("PinballVRcade: too many devices, new device left unhooked\n");
+}
@@ -0,0 +1,25 @@
+//====================================================================
+// Selective vtable patching for IDirect3DDevice9.
+//
+// Instead of wrapping the whole device, this mode hands the game the
+// driver's own device and only redirects the vtable slots the hooks
+// actually need. Every other call runs at native speed, and identity
+// (QueryInterface, AddRef, Release) is the driver's.
+//
+// Patched slots are shared by every device using the same vtable, so
+// calls on devices that were never bound go straight to the original
+// functions.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+// Patches the device's vtable if it isn't already and returns a device
+// that always reaches the original implementations, for the hooks to
+// use as their inner device. Returns null if patching failed.
+IDirect3DDevice9* vtable_patch_device (IDirect3DDevice9* device);
+
+// Routes patched calls on the device into target until the device is
+// released.
+void vtable_patch_bind (IDirect3DDevice9* device, IDirect3DDevice9* target);
@@ -1,28 +1,28 @@
 //====================================================================
 // Hooked IDirect3D9 interface implementation.
 //
-// All this interface does is initialize LibOVR and hook devices
-// that get created.
+// All this interface does is hook devices that get created, handing
+// them the headset LibOVR initialization found.
 //====================================================================
 
+#include "Config.h"
 #include "Direct3D9Hooks.h"
 #include "Direct3DDevice9Hooks.h"
+#include "Direct3DDevice9Pipeline.h"
+#include "DeviceExStage.h"
+#include "DeviceStages.h"
+#include "DeviceVtablePatch.h"
+#include "HmdStartup.h"
+#include "StartupTimeline.h"
 
 #include <OVR.h>
 
-Direct3D9Hooks::Direct3D9Hooks (IDirect3D9* inner)
+Direct3D9Hooks::Direct3D9Hooks (IDirect3D9* inner, IDirect3D9Ex* inner_ex)
 {
     this->inner = inner;
-
-    // Initialize LibOVR
-    ovr_Initialize();
-    this->hmd = ovrHmd_Create(0);
-    if (!this->hmd)
-    {
-        const char* error = ovrHmd_GetLastError(this->hmd);
-        OutputDebugStringA(error);
-    }
-    ovrHmd_ConfigureTracking(this->hmd, ovrTrackingCap_Orientation | ovrTrackingCap_MagYawCorrection | ovrTrackingCap_Position, 0);
+    this->inner_ex = inner_ex;
+    this->hmd = 0;
+    this->tracking = 0;
 }
 
 /*** IUnknown methods ***/
@@ -108,8 +108,104 @@ HMONITOR Direct3D9Hooks::GetAdapterMonitor (UINT Adapter)
 
 HRESULT Direct3D9Hooks::CreateDevice (UINT Adapter,D3DDEVTYPE DeviceType,HWND hFocusWindow,DWORD BehaviorFlags,D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DDevice9** ppReturnedDeviceInterface)
 {
+    // Either wrap the whole device (the default) or patch just the slots
+    // the hooks need into the driver's vtable
+    bool vtable_hooks = config_string("Rendering", "Hooking", "wrap") == "vtable";
+
+    // Optionally move draw submission onto a render thread. The device is
+    // then used from two threads, so the runtime has to lock around it.
+    // The game talks to the driver directly with vtable hooks, so the
+    // pipeline can't sit in between.
+    bool pipelined = config_int("Rendering", "Pipeline", 0) != 0 && !vtable_hooks;
+    if (pipelined)
+    {
+        BehaviorFlags |= D3DCREATE_MULTITHREADED;
+    }
+
+    // LibOVR has been initializing since the DLL attached
+    hmd_startup_result(&this->hmd, &this->tracking);
+
     IDirect3DDevice9* inner_device;
-    HRESULT result = this->inner->CreateDevice(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, &inner_device);
-    *ppReturnedDeviceInterface = new Direct3DDevice9Hooks(this, inner_device, *pPresentationParameters, this->hmd);
+    startup_timeline_begin("CreateDevice");
+    HRESULT result;
+    if (this->inner_ex && !vtable_hooks)
+    {
+        result = this->create_device_ex(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, &inner_device);
+    }
+    else
+    {
+        result = this->inner->CreateDevice(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, &inner_device);
+    }
+    startup_timeline_end("CreateDevice");
+    IDirect3DDevice9* patched_device = 0;
+    if (SUCCEEDED(result) && vtable_hooks)
+    {
+        IDirect3DDevice9* unpatched = vtable_patch_device(inner_device);
+        if (unpatched)
+        {
+            patched_device = inner_device;
+            inner_device = unpatched;
+        }
+    }
+    Direct3DDevice9Pipeline* pipeline = 0;
+    if (SUCCEEDED(result) && pipelined)
+    {
+        pipeline = new Direct3DDevice9Pipeline(inner_device);
+        inner_device = pipeline;
+    }
+    IDirect3DDevice9* hooks = new Direct3DDevice9Hooks(this, inner_device, *pPresentationParameters, this->hmd, this->tracking, pipeline);
+
+    // Cross-cutting stages wrap the hooked device; which chain is used is
+    // decided once here rather than on every call
+    IDirect3DDevice9* device;
+    if (config_int("Debug", "Instrument", 0))
+    {
+        device = new InstrumentedDevice9(hooks);
+    }
+    else
+    {
+        device = new ProductionDevice9(hooks);
+    }
+
+    // With vtable hooks the game keeps the driver's device and only the
+    // patched calls find their way into the chain
+    if (patched_device)
+    {
+        vtable_patch_bind(patched_device, device);
+        device = patched_device;
+    }
+    *ppReturnedDeviceInterface = device;
+    return result;
+}
+
+HRESULT Direct3D9Hooks::create_device_ex (UINT Adapter,D3DDEVTYPE DeviceType,HWND hFocusWindow,DWORD BehaviorFlags,D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DDevice9** ppReturnedDeviceInterface)
+{
+    // Fullscreen Ex devices take the display mode separately
+    Direct3D9ExStage<DeviceForwarder>::use_flip_model(pPresentationParameters);
+    D3DDISPLAYMODEEX display_mode;
+    D3DDISPLAYMODEEX* fullscreen_mode = 0;
+    if (!pPresentationParameters->Windowed)
+    {
+        display_mode.Size = sizeof(display_mode);
+        display_mode.Width = pPresentationParameters->BackBufferWidth;
+        display_mode.Height = pPresentationParameters->BackBufferHeight;
+        display_mode.RefreshRate = pPresentationParameters->FullScreen_RefreshRateInHz;
+        display_mode.Format = pPresentationParameters->BackBufferFormat;
+        display_mode.ScanLineOrdering = D3DSCANLINEORDERING_PROGRESSIVE;
+        fullscreen_mode = &display_mode;
+    }
+    IDirect3DDevice9Ex* device;
+    HRESULT result = this->inner_ex->CreateDeviceEx(Adapter, DeviceType, hFocusWindow, BehaviorFlags, pPresentationParameters, fullscreen_mode, &device);
+    if (FAILED(result))
+    {
+        return result;
+    }
+
+    // Never queue more than the frame being shown, and don't let other
+    // processes' GPU work get in ahead of ours. Raising the priority can be
+    // refused without the right privileges, which is harmless.
+    device->SetMaximumFrameLatency(1);
+    device->SetGPUThreadPriority(7);
+    *ppReturnedDeviceInterface = new ExDevice9(device);
     return result;
 }
@@ -5,10 +5,13 @@
 #include <d3d9.h>
 #include <OVR.h>
 
+class TrackingThread;
+
 class Direct3D9Hooks : public IDirect3D9 
 {
 public:
-    Direct3D9Hooks (IDirect3D9* inner);
+    // inner_ex is the same object when Direct3D9Ex is in use, null otherwise
+    Direct3D9Hooks (IDirect3D9* inner, IDirect3D9Ex* inner_ex);
     
     /*** IUnknown methods ***/
     STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
@@ -32,6 +35,13 @@ public:
     STDMETHOD(CreateDevice)(THIS_ UINT Adapter,D3DDEVTYPE DeviceType,HWND hFocusWindow,DWORD BehaviorFlags,D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DDevice9** ppReturnedDeviceInterface);
 
 private:
+    // Creates the driver's device as an IDirect3DDevice9Ex presenting
+    // through the flip model, behind a stage that keeps it looking like a
+    // plain one
+    HRESULT create_device_ex (UINT Adapter,D3DDEVTYPE DeviceType,HWND hFocusWindow,DWORD BehaviorFlags,D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DDevice9** ppReturnedDeviceInterface);
+
     IDirect3D9* inner;
+    IDirect3D9Ex* inner_ex;
     ovrHmd hmd;
+    TrackingThread* tracking;
 };
@@ -10,13 +10,54 @@
 // VR rendering purposes.
 //====================================================================
 
+#include <math.h>
+#include <stdio.h>
 #include <d3dx9.h>
+#include "Config.h"
+#include "ContentHash.h"
 #include "Direct3DDevice9Hooks.h"
+#include "Direct3DDevice9Pipeline.h"
+#include "Direct3DStateBlock9Hooks.h"
+#include "Direct3DTexture9Hooks.h"
+#include "DeviceExStage.h"
+#include "DeviceVtable.h"
+#include "DistortionRenderer.h"
+#include "FrameCapture.h"
+#include "GpuProfiler.h"
+#include "HiddenAreaMask.h"
 #include "hacks.h"
+#include "StartupTimeline.h"
+#include "TimestepPatch.h"
 
 #define OVR_D3D_VERSION 9
 #include <OVR_CAPI_D3D.h>
 
+// Render states that decide what a UI quad looks like, tracked so they
+// can go into the UI stream hash
+static const D3DRENDERSTATETYPE s_ui_blend_states[7] = {
+    D3DRS_ALPHABLENDENABLE,
+    D3DRS_SRCBLEND,
+    D3DRS_DESTBLEND,
+    D3DRS_BLENDOP,
+    D3DRS_ALPHATESTENABLE,
+    D3DRS_ALPHAREF,
+    D3DRS_ALPHAFUNC,
+};
+
+// The game's stencil state, put back after scene draws the hidden area
+// mask tested. Mask and write mask must stay at these indices.
+static const D3DRENDERSTATETYPE s_stencil_states[9] = {
+    D3DRS_STENCILENABLE,
+    D3DRS_STENCILMASK,
+    D3DRS_STENCILWRITEMASK,
+    D3DRS_STENCILFUNC,
+    D3DRS_STENCILREF,
+    D3DRS_STENCILFAIL,
+    D3DRS_STENCILZFAIL,
+    D3DRS_STENCILPASS,
+    D3DRS_TWOSIDEDSTENCILMODE,
+};
+
 static const float s_identity_matrix[16] = {
     1, 0, 0, 0,
     0, 1, 0, 0,
@@ -24,120 +65,840 @@ static const float s_identity_matrix[16] = {
     0, 0, 0, 1,
 };
 
-static void patch_timestep (int frame_hz)
-{
-    rolling_crc crc;
-    crc.block_size = 9;
-    crc.a = 0x05cc;
-    crc.b = 0x1acf;
-
-    uintptr_t address = find_fingerprint(crc);
-    uintptr_t ms_per_tick_compare = address + 0x00C5D0B5 - 0x00C5D046;
-
-    // Get the address of the intervals_per_tick global by reading its address from
-    // an instruction that uses it as an operand.
-    uintptr_t ms_per_tick_address;
-    read_code(ms_per_tick_compare + 2, sizeof(ms_per_tick_address), &ms_per_tick_address);
-
-    // Reassign it to the frame hz.
-    double intervals_per_tick = 1000 / (double)frame_hz;
-    install_patch(ms_per_tick_address, sizeof(intervals_per_tick), &intervals_per_tick);
-
-    // Get the global step scale and divide it by two
-    uintptr_t global_step_address;
-    uintptr_t global_step_load = address + 0x00C5D0F7 - 0x00C5D046;
-    read_code(global_step_load + 2, sizeof(global_step_address), &global_step_address);
-    float* global_step = (float*)global_step_address;
-    float new_global_step = *global_step * (60 / (float)frame_hz);
-    install_patch(global_step_address, sizeof(new_global_step), &new_global_step);
-
-    // Get the address of the instruction that assigns the simulation steps
-    unsigned milliseconds_per_frame = 1000 / frame_hz;
-    uintptr_t frame_interval_load = address + 0x00C5D100 - 0x00C5D046;
-    install_patch(frame_interval_load + 1, sizeof(milliseconds_per_frame), &milliseconds_per_frame);
-}
-
-Direct3DDevice9Hooks::Direct3DDevice9Hooks (IDirect3D9* parent, IDirect3DDevice9* inner, const D3DPRESENT_PARAMETERS& present_parameters, ovrHmd hmd)
+Direct3DDevice9Hooks::Direct3DDevice9Hooks (IDirect3D9* parent, IDirect3DDevice9* inner, const D3DPRESENT_PARAMETERS& present_parameters, ovrHmd hmd, TrackingThread* tracking, Direct3DDevice9Pipeline* pipeline)
 {
     this->parent = parent;
     this->inner = inner;
+    this->pipeline = pipeline;
     this->present_parameters = present_parameters;
     this->stereo_quad_buffer = 0;
+    this->stereo_quad_buffer_length = 0;
+    this->hmd_texture = 0;
+    this->eye_target = 0;
+    this->eye_target_surface = 0;
+    this->eye_depth = 0;
+    this->game_render_target = 0;
+    this->game_depth_stencil = 0;
+    memset(&this->game_viewport, 0, sizeof(this->game_viewport));
+    memset(&this->game_scissor, 0, sizeof(this->game_scissor));
+    this->redirected = false;
+    this->frame_scale_x = 1.0f;
+    this->frame_scale_y = 1.0f;
+    this->distortion = 0;
+    InitializeCriticalSection(&this->represent_lock);
+    memset(this->presented_pose, 0, sizeof(this->presented_pose));
+    this->represent_state = 0;
+    this->represent_scratch = 0;
+    this->represent_count = 0;
     this->hmd = hmd;
+    this->tracking = tracking;
     this->stereo = false;
     this->render_distorted = true;
     this->reset_pressed = false;
     this->frame_index = 0;
+    this->head_pose_latched[0] = this->head_pose_latched[1] = false;
+    memset(this->head_pose, 0, sizeof(this->head_pose));
+    this->head_pose[0].Orientation.w = this->head_pose[1].Orientation.w = 1.0f;
+    this->head_pose_time[0] = this->head_pose_time[1] = 0;
+    this->pose_age_total = 0;
+    this->pose_age_samples = 0;
+    this->just_in_time = config_int("Rendering", "JustInTime", 0) != 0;
+    this->pacer.configure(config_float("Rendering", "JustInTimeMargin", 2.0f) / 1000.0);
+    this->frame_start_time = 0;
+    this->pacing_disjoint = 0;
+    this->pacing_frequency = 0;
+    this->pacing_begin = 0;
+    this->pacing_end = 0;
+    this->pacing_measuring = false;
+    this->pacing_query_pending = false;
+    this->pacing_cpu_time = 0;
+    this->pacing_delay_total = 0;
+    this->pacing_frames = 0;
+    if (this->just_in_time && (
+        FAILED(this->inner->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &this->pacing_disjoint)) ||
+        FAILED(this->inner->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &this->pacing_frequency)) ||
+        FAILED(this->inner->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &this->pacing_begin)) ||
+        FAILED(this->inner->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &this->pacing_end))))
+    {
+        OutputDebugStringA("PinballVRcade: no timestamp queries, frames start as early as possible\n");
+        this->just_in_time = false;
+    }
+    this->ui_layer = 0;
+    this->ui_layer_state = 0;
+    this->ui_layer_rebuild = true;
+    this->ui_layer_cleared = false;
+    this->ui_layer_volatile = false;
+    this->ui_layer_empty = true;
+    this->ui_layer_draws = 0;
+    this->ui_stream_hash = s_empty_hash;
+    this->ui_previous_hash = s_empty_hash;
+    this->ui_layer_hash = s_empty_hash;
+    this->current_texture = 0;
+    this->texture_dedup = config_int("Rendering", "TextureDedup", 0) != 0;
+    this->wrap_textures = this->texture_dedup || config_int("Rendering", "UiLayer", 0) != 0;
+    memset(this->bound_textures, 0, sizeof(this->bound_textures));
+    this->reported_saved_bytes = 0;
+    for (int i = 0; i < 7; ++i)
+    {
+        this->inner->GetRenderState(s_ui_blend_states[i], &this->ui_blend_state[i]);
+    }
+    this->hidden_area = 0;
+    this->hidden_area_state = 0;
+    this->hidden_area_surface = 0;
+    this->hidden_area_bit = 0;
+    this->hidden_area_bound = false;
+    this->hidden_area_pending = false;
+    for (int i = 0; i < 9; ++i)
+    {
+        this->inner->GetRenderState(s_stencil_states[i], &this->stencil_state[i]);
+    }
+    this->profiler = 0;
+    if (config_int("Debug", "Instrument", 0))
+    {
+        this->profiler = new GpuProfiler(this->inner);
+        if (!this->profiler->valid())
+        {
+            delete this->profiler;
+            this->profiler = 0;
+        }
+    }
+    this->capture = 0;
+    this->capture_distorted = false;
+    std::string capture_mode = config_string("Debug", "Capture", "");
+    if (capture_mode == "distorted" || capture_mode == "undistorted")
+    {
+        this->capture = new FrameCapture(this->inner, config_string("Debug", "CaptureFile", "capture.pvrcap").c_str());
+        if (!this->capture->valid())
+        {
+            delete this->capture;
+            this->capture = 0;
+        }
+        this->capture_distorted = capture_mode == "distorted";
+    }
     memset(&this->current_stream, 0, sizeof(this->current_stream));
+    memset(&this->position_stream, 0, sizeof(this->position_stream));
+    this->position_offset = -1;
+    this->current_indices = 0;
+    this->current_vertex_shader = 0;
+    this->wvp_register = 11;
+    memset(this->vertex_constants, 0, sizeof(this->vertex_constants));
+    D3DXMatrixIdentity(&this->fixed_world);
+    D3DXMatrixIdentity(&this->fixed_view);
+    D3DXMatrixIdentity(&this->fixed_projection);
+    D3DCAPS9 caps;
+    this->vertex_constant_count = SUCCEEDED(this->inner->GetDeviceCaps(&caps)) ? min(caps.MaxVertexShaderConst, (DWORD)256) : 256;
+    this->current_pixel_shader = 0;
+    this->cull_frames = 0;
+    this->cull_draws = 0;
+    this->cull_skipped[0] = this->cull_skipped[1] = 0;
+    this->far_layer = 0;
+    this->far_depth = 0;
+    this->far_layer_state = 0;
+    this->far_layer_bound = false;
+    memset(&this->far_field_fov, 0, sizeof(this->far_field_fov));
+    this->last_clear_color = D3DCOLOR_XRGB(0, 0, 0);
+    this->last_clear_z = 1.0f;
+    this->far_draws = 0;
     this->inner->GetRenderTarget(0, &this->back_buffer_surface);
 
-    if (present_parameters.Windowed == 0)
+    // Mono draws call the inner device's implementation directly
+    void** inner_vtable = *(void***)this->inner;
+    this->mono_draws.draw_primitive_device = this->inner;
+    this->mono_draws.draw_primitive = (draw_primitive_function)inner_vtable[DEVICE_SLOT(DrawPrimitive)];
+    this->mono_draws.draw_indexed_primitive_device = this->inner;
+    this->mono_draws.draw_indexed_primitive = (draw_indexed_primitive_function)inner_vtable[DEVICE_SLOT(DrawIndexedPrimitive)];
+    this->stereo_draws = this->mono_draws;
+    this->update_draw_dispatch();
+
+    this->update_simulation_rate();
+
+    if (this->hmd && this->create_hmd_resources())
     {
-        D3DDISPLAYMODE display_mode;
-        this->inner->GetDisplayMode(0, &display_mode);
-        patch_timestep(display_mode.RefreshRate);
+        // As Pinball Arcade gets patched, its code is likely to move around, so
+        // we keep a fingerprint hash of some stable code close to the matrix
+        // call site we need to patch. We can search the code segment for things
+        // matching this fingerprint and rediscover the location of the code we
+        // want to patch.
+        rolling_crc VIEW_PROJECTION_MULTIPLY_FINGERPRINT;
+        VIEW_PROJECTION_MULTIPLY_FINGERPRINT.block_size = 0x18;
+        VIEW_PROJECTION_MULTIPLY_FINGERPRINT.a = 0x0f20;
+        VIEW_PROJECTION_MULTIPLY_FINGERPRINT.b = 0xb638;
+        size_t VIEW_PROJECTION_MULTIPLY_FINGERPRINT_OFFSET = 0x25;
+
+        // Create a patch that loads two identity matrices instead of the view and
+        // projection matrices so that when C_WORLDVIEWPROJ shader constants get set,
+        // get only the WORLD part of the transformation and can apply our own
+        // view and projection matrices
+        unsigned char patch[10];
+        patch[0] = 0xB8; // MOV eax
+        *(uintptr_t*)&patch[1] = (uintptr_t)s_identity_matrix;
+        patch[5] = 0xB9; // MOV ecx
+        *(uintptr_t*)&patch[6] = (uintptr_t)s_identity_matrix;
+
+        uintptr_t address = find_fingerprint(VIEW_PROJECTION_MULTIPLY_FINGERPRINT);
+        install_patch(address + VIEW_PROJECTION_MULTIPLY_FINGERPRINT_OFFSET, sizeof(patch), patch);
     }
+}
 
-    if (this->hmd)
+bool Direct3DDevice9Hooks::create_hmd_resources ()
+{
+    // Everything created here is sized from the back buffer or the eye
+    // targets and lives in D3DPOOL_DEFAULT, so it's torn down and rebuilt
+    // around every Reset.
+    this->target_size = OVR::Sizei(this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight);
+    float pixel_density = config_float("Rendering", "PixelDensity", 0.0f);
+    if (pixel_density > 0)
     {
-        OVR::Sizei left_size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Left, hmd->DefaultEyeFov[0], 1.0f);
-        OVR::Sizei right_size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Right, hmd->DefaultEyeFov[1], 1.0f);
+        OVR::Sizei left_size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Left, hmd->DefaultEyeFov[0], pixel_density);
+        OVR::Sizei right_size = ovrHmd_GetFovTextureSize(hmd, ovrEye_Right, hmd->DefaultEyeFov[1], pixel_density);
         this->target_size = OVR::Sizei(left_size.w + right_size.w, max(left_size.h, right_size.h));
-        this->target_size = OVR::Sizei(this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight);
-
-        ovrD3D9Config cfg;
-        cfg.D3D9.Header.API = ovrRenderAPI_D3D9;
-        cfg.D3D9.Header.RTSize = OVR::Sizei(this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight);
-        cfg.D3D9.Header.Multisample = this->present_parameters.MultiSampleQuality;
-        cfg.D3D9.pDevice = this->inner;
-        cfg.D3D9.pSwapChain = 0;
-        unsigned caps =
-            ovrDistortionCap_Chromatic
-            | ovrDistortionCap_NoRestore
-            | ovrDistortionCap_SRGB
-            | ovrDistortionCap_Overdrive;
-        if (!ovrHmd_ConfigureRendering(this->hmd, &cfg.Config, caps, hmd->DefaultEyeFov, this->eye_render_desc))
-        {
-            this->hmd = 0;
-            this->hmd_texture = 0;
+    }
+
+    // Client distortion is built once, its resources survive a Reset. They
+    // belong to the driver's device, which re-presenting draws with
+    // directly; the pipeline passes them through as they are.
+    if (!this->distortion && config_string("Rendering", "Distortion", "sdk") == "client")
+    {
+        this->distortion = new DistortionRenderer(this->hmd, hmd->DefaultEyeFov);
+        this->flush_pipeline();
+        if (!this->distortion->create(this->pipeline ? this->pipeline->driver_device() : this->inner))
+        {
+            OutputDebugStringA("PinballVRcade: client distortion unavailable, falling back to LibOVR's\n");
+            delete this->distortion;
+            this->distortion = 0;
+        }
+        else if (this->pipeline && config_int("Rendering", "Represent", 0))
+        {
+            // Only the render thread is still around while the game stalls
+            this->pipeline->set_idle_handler(&Direct3DDevice9Hooks::represent_when_late, this, 1);
+        }
+        if (this->distortion)
+        {
+            std::string dump_path = config_string("Debug", "DistortionMeshDump", "");
+            if (!dump_path.empty())
+            {
+                this->distortion->dump(dump_path.c_str());
+            }
+        }
+    }
+    if (this->distortion)
+    {
+        // We draw the distortion pass, LibOVR only has to describe the eyes
+        this->eye_render_desc[ovrEye_Left] = ovrHmd_GetRenderDesc(this->hmd, ovrEye_Left, hmd->DefaultEyeFov[ovrEye_Left]);
+        this->eye_render_desc[ovrEye_Right] = ovrHmd_GetRenderDesc(this->hmd, ovrEye_Right, hmd->DefaultEyeFov[ovrEye_Right]);
+    }
+    else if (!this->configure_sdk_rendering())
+    {
+        this->hmd = 0;
+        return false;
+    }
+
+    // The mask's mesh survives a Reset too
+    if (!this->hidden_area && config_int("Rendering", "HiddenAreaMask", 0))
+    {
+        this->hidden_area = new HiddenAreaMask(this->hmd, hmd->DefaultEyeFov);
+        if (!this->hidden_area->create(this->inner))
+        {
+            OutputDebugStringA("PinballVRcade: hidden area mask unavailable, shading every pixel\n");
+            delete this->hidden_area;
+            this->hidden_area = 0;
+        }
+    }
+    if (this->hidden_area)
+    {
+        this->inner->CreateStateBlock(D3DSBT_ALL, &this->hidden_area_state);
+    }
+
+    this->inner->CreateTexture(
+        this->target_size.w,
+        this->target_size.h,
+        1,  // Levels
+        D3DUSAGE_RENDERTARGET,
+        this->present_parameters.BackBufferFormat,
+        D3DPOOL_DEFAULT,
+        &this->hmd_texture,
+        NULL // pSharedHandle
+    );
+    if (pixel_density > 0)
+    {
+        this->create_eye_targets(pixel_density);
+    }
+    if (this->distortion && this->pipeline)
+    {
+        this->create_represent_resources();
+    }
+
+    this->create_far_layer();
+
+    // The game's depth buffer has to fit the layer as well as the back buffer
+    if (config_int("Rendering", "UiLayer", 0) && this->present_parameters.MultiSampleType == D3DMULTISAMPLE_NONE)
+    {
+        this->inner->CreateTexture(
+            this->present_parameters.BackBufferWidth,
+            this->present_parameters.BackBufferHeight,
+            1,  // Levels
+            D3DUSAGE_RENDERTARGET,
+            D3DFMT_A8R8G8B8,
+            D3DPOOL_DEFAULT,
+            &this->ui_layer,
+            NULL // pSharedHandle
+        );
+        this->inner->CreateStateBlock(D3DSBT_ALL, &this->ui_layer_state);
+        this->ui_layer_rebuild = true;
+        this->ui_layer_empty = true;
+    }
+    return true;
+}
+
+void Direct3DDevice9Hooks::create_eye_targets (float pixel_density)
+{
+    // The window's depth buffer format, unless the game brings its own
+    D3DFORMAT depth_format = this->present_parameters.EnableAutoDepthStencil ? this->present_parameters.AutoDepthStencilFormat : D3DFMT_D24S8;
+    this->inner->CreateTexture(this->target_size.w, this->target_size.h, 1, D3DUSAGE_RENDERTARGET, this->present_parameters.BackBufferFormat, D3DPOOL_DEFAULT, &this->eye_target, NULL);
+    this->inner->CreateDepthStencilSurface(this->target_size.w, this->target_size.h, depth_format, D3DMULTISAMPLE_NONE, 0, TRUE, &this->eye_depth, NULL);
+    if (this->eye_target)
+    {
+        this->eye_target->GetSurfaceLevel(0, &this->eye_target_surface);
+    }
+    if (!this->eye_target_surface || !this->eye_depth)
+    {
+        OutputDebugStringA("PinballVRcade: couldn't create native eye targets, rendering at the window's size\n");
+        this->release_eye_targets();
+        return;
+    }
+    this->frame_scale_x = (float)this->target_size.w / this->present_parameters.BackBufferWidth;
+    this->frame_scale_y = (float)this->target_size.h / this->present_parameters.BackBufferHeight;
+
+    char message[128];
+    sprintf_s(message, "PinballVRcade: rendering eyes at %dx%d for pixel density %.2f\n", this->target_size.w, this->target_size.h, pixel_density);
+    OutputDebugStringA(message);
+
+    // Whatever the game has bound right now is what it thinks it's drawing to
+    this->inner->GetRenderTarget(0, &this->game_render_target);
+    this->inner->GetDepthStencilSurface(&this->game_depth_stencil);
+    this->bind_game_render_target();
+    this->bind_game_depth_stencil();
+}
+
+void Direct3DDevice9Hooks::release_eye_targets ()
+{
+    // Give the game's surfaces back to the device before letting go of them
+    if (this->redirected)
+    {
+        this->inner->SetRenderTarget(0, this->game_render_target);
+        this->inner->SetDepthStencilSurface(this->game_depth_stencil);
+        this->redirected = false;
+    }
+    if (this->game_render_target)
+    {
+        this->game_render_target->Release();
+        this->game_render_target = 0;
+    }
+    if (this->game_depth_stencil)
+    {
+        this->game_depth_stencil->Release();
+        this->game_depth_stencil = 0;
+    }
+    if (this->eye_target_surface)
+    {
+        this->eye_target_surface->Release();
+        this->eye_target_surface = 0;
+    }
+    if (this->eye_target)
+    {
+        this->eye_target->Release();
+        this->eye_target = 0;
+    }
+    if (this->eye_depth)
+    {
+        this->eye_depth->Release();
+        this->eye_depth = 0;
+    }
+    this->target_size = OVR::Sizei(this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight);
+    this->frame_scale_x = 1.0f;
+    this->frame_scale_y = 1.0f;
+}
+
+LONG Direct3DDevice9Hooks::to_target_x (LONG x)
+{
+    return MulDiv(x, this->target_size.w, this->present_parameters.BackBufferWidth);
+}
+
+LONG Direct3DDevice9Hooks::to_target_y (LONG y)
+{
+    return MulDiv(y, this->target_size.h, this->present_parameters.BackBufferHeight);
+}
+
+bool Direct3DDevice9Hooks::is_back_buffer (IDirect3DSurface9* surface)
+{
+    IDirect3DSurface9* back_buffer = 0;
+    this->inner->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+    if (back_buffer)
+    {
+        back_buffer->Release();
+    }
+    return surface && surface == back_buffer;
+}
+
+bool Direct3DDevice9Hooks::is_window_sized (IDirect3DSurface9* surface)
+{
+    D3DSURFACE_DESC desc;
+    surface->GetDesc(&desc);
+    return desc.Width == this->present_parameters.BackBufferWidth && desc.Height == this->present_parameters.BackBufferHeight;
+}
+
+HRESULT Direct3DDevice9Hooks::bind_game_render_target ()
+{
+    // Binding a render target resets the viewport and scissor to cover it
+    this->redirected = this->is_back_buffer(this->game_render_target);
+    D3DVIEWPORT9 viewport = { 0, 0, this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight, 0.0f, 1.0f };
+    RECT scissor = { 0, 0, this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight };
+    this->game_viewport = viewport;
+    this->game_scissor = scissor;
+    return this->inner->SetRenderTarget(0, this->redirected ? this->eye_target_surface : this->game_render_target);
+}
+
+HRESULT Direct3DDevice9Hooks::bind_game_depth_stencil ()
+{
+    // A depth buffer only fits the eye target if it fit the window
+    bool redirect = this->redirected && this->game_depth_stencil && this->is_window_sized(this->game_depth_stencil);
+    return this->inner->SetDepthStencilSurface(redirect ? this->eye_depth : this->game_depth_stencil);
+}
+
+IDirect3DSurface9* Direct3DDevice9Hooks::get_frame_surface ()
+{
+    // Whatever the game's frame is drawn into, referenced for the caller
+    IDirect3DSurface9* surface;
+    if (this->eye_target_surface)
+    {
+        surface = this->eye_target_surface;
+        surface->AddRef();
+    }
+    else
+    {
+        this->inner->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &surface);
+    }
+    return surface;
+}
+
+void Direct3DDevice9Hooks::create_far_layer ()
+{
+    float disparity = config_float("Rendering", "FarFieldDisparity", 0.0f);
+    if (disparity <= 0)
+    {
+        return;
+    }
+
+    // One field of view that covers both eyes, so each eye can take its
+    // part of the layer
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        const ovrFovPort& fov = this->eye_render_desc[eye].Fov;
+        this->far_field_fov.UpTan = max(this->far_field_fov.UpTan, fov.UpTan);
+        this->far_field_fov.DownTan = max(this->far_field_fov.DownTan, fov.DownTan);
+        this->far_field_fov.LeftTan = max(this->far_field_fov.LeftTan, fov.LeftTan);
+        this->far_field_fov.RightTan = max(this->far_field_fov.RightTan, fov.RightTan);
+    }
+
+    // A point at depth d lands ipd * focal / d pixels apart in the two eyes
+    UINT width = this->target_size.w / 2;
+    UINT height = this->target_size.h;
+    float ipd = fabsf(this->eye_render_desc[ovrEye_Left].ViewAdjust.x - this->eye_render_desc[ovrEye_Right].ViewAdjust.x);
+    float focal = width / (this->far_field_fov.LeftTan + this->far_field_fov.RightTan);
+    this->far_field.configure(ipd * focal / disparity);
+
+    // It shares the game's clear values, so it takes the back buffer's format
+    if (this->present_parameters.MultiSampleType != D3DMULTISAMPLE_NONE)
+    {
+        return;
+    }
+    this->inner->CreateTexture(width, height, 1, D3DUSAGE_RENDERTARGET, this->present_parameters.BackBufferFormat, D3DPOOL_DEFAULT, &this->far_layer, NULL);
+    this->inner->CreateDepthStencilSurface(width, height, D3DFMT_D24S8, D3DMULTISAMPLE_NONE, 0, TRUE, &this->far_depth, NULL);
+    this->inner->CreateStateBlock(D3DSBT_ALL, &this->far_layer_state);
+    if (!this->far_layer || !this->far_depth || !this->far_layer_state)
+    {
+        OutputDebugStringA("PinballVRcade: couldn't create the far field layer, everything stays in stereo\n");
+    }
+}
+
+void Direct3DDevice9Hooks::create_represent_resources ()
+{
+    D3DDISPLAYMODE display_mode;
+    this->inner->GetDisplayMode(0, &display_mode);
+    this->represent_deadline.configure(display_mode.RefreshRate ? 1.0 / display_mode.RefreshRate : 0, 0.002);
+
+    // Built on the driver's device since that's where they're used. The
+    // back buffer can't be restored into if it's multisampled.
+    this->flush_pipeline();
+    IDirect3DDevice9* device = this->pipeline->driver_device();
+    device->CreateStateBlock(D3DSBT_ALL, &this->represent_state);
+    if (this->present_parameters.MultiSampleType == D3DMULTISAMPLE_NONE)
+    {
+        device->CreateRenderTarget(
+            this->present_parameters.BackBufferWidth,
+            this->present_parameters.BackBufferHeight,
+            this->present_parameters.BackBufferFormat,
+            D3DMULTISAMPLE_NONE,
+            0,     // MultisampleQuality
+            FALSE, // Lockable
+            &this->represent_scratch,
+            NULL   // pSharedHandle
+        );
+    }
+}
+
+bool Direct3DDevice9Hooks::configure_sdk_rendering ()
+{
+    ovrD3D9Config cfg;
+    cfg.D3D9.Header.API = ovrRenderAPI_D3D9;
+    cfg.D3D9.Header.RTSize = OVR::Sizei(this->present_parameters.BackBufferWidth, this->present_parameters.BackBufferHeight);
+    cfg.D3D9.Header.Multisample = this->present_parameters.MultiSampleQuality;
+    // LibOVR draws straight to the driver's device, so it must only run
+    // once the render thread has caught up
+    cfg.D3D9.pDevice = this->pipeline ? this->pipeline->driver_device() : this->inner;
+    cfg.D3D9.pSwapChain = 0;
+    unsigned caps =
+        ovrDistortionCap_Chromatic
+        | ovrDistortionCap_NoRestore
+        | ovrDistortionCap_SRGB
+        | ovrDistortionCap_Overdrive;
+    this->flush_pipeline();
+    startup_timeline_begin("ovrHmd_ConfigureRendering");
+    bool configured = ovrHmd_ConfigureRendering(this->hmd, &cfg.Config, caps, hmd->DefaultEyeFov, this->eye_render_desc) != 0;
+    startup_timeline_end("ovrHmd_ConfigureRendering");
+    return configured;
+}
+
+void Direct3DDevice9Hooks::release_hmd_resources ()
+{
+    this->release_eye_targets();
+    EnterCriticalSection(&this->represent_lock);
+    if (this->hmd_texture)
+    {
+        this->hmd_texture->Release();
+        this->hmd_texture = 0;
+    }
+    if (this->represent_state)
+    {
+        this->represent_state->Release();
+        this->represent_state = 0;
+    }
+    if (this->represent_scratch)
+    {
+        this->represent_scratch->Release();
+        this->represent_scratch = 0;
+    }
+    LeaveCriticalSection(&this->represent_lock);
+    if (this->ui_layer)
+    {
+        this->ui_layer->Release();
+        this->ui_layer = 0;
+    }
+    if (this->ui_layer_state)
+    {
+        this->ui_layer_state->Release();
+        this->ui_layer_state = 0;
+    }
+    if (this->far_layer)
+    {
+        this->far_layer->Release();
+        this->far_layer = 0;
+    }
+    this->far_layer_bound = false;
+    if (this->far_depth)
+    {
+        this->far_depth->Release();
+        this->far_depth = 0;
+    }
+    if (this->far_layer_state)
+    {
+        this->far_layer_state->Release();
+        this->far_layer_state = 0;
+    }
+    if (this->hidden_area_state)
+    {
+        this->hidden_area_state->Release();
+        this->hidden_area_state = 0;
+    }
+    this->hidden_area_surface = 0;
+    this->hidden_area_bound = false;
+    this->hidden_area_pending = false;
+
+    // Passing no config makes LibOVR drop its own device resources
+    if (!this->distortion)
+    {
+        this->flush_pipeline();
+        ovrHmd_ConfigureRendering(this->hmd, NULL, 0, NULL, NULL);
+    }
+}
+
+void Direct3DDevice9Hooks::present_client_distortion (const ovrRecti& left_viewport, const ovrRecti& right_viewport)
+{
+    // Draw straight to the back buffer with our cached meshes, then show it
+    IDirect3DSurface9* back_buffer;
+    this->inner->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+    this->inner->SetRenderTarget(0, back_buffer);
+
+    ovrRecti eye_viewport[2] = { left_viewport, right_viewport };
+    this->inner->BeginScene();
+    this->distortion->render(this->inner, this->hmd_texture, this->target_size, eye_viewport, this->head_pose);
+    this->inner->EndScene();
+    if (this->capture && this->capture_distorted)
+    {
+        this->capture->capture(back_buffer, ovr_GetTimeInSeconds());
+    }
+    back_buffer->Release();
+    this->inner->Present(NULL, NULL, NULL, NULL);
+    ovrHmd_EndFrameTiming(this->hmd);
+    this->presented_pose[0] = this->head_pose[0];
+    this->presented_pose[1] = this->head_pose[1];
+}
+
+bool Direct3DDevice9Hooks::represent_when_late (void* context, IDirect3DDevice9* device, double now, double last_present)
+{
+    // Runs on the render thread. If the game is in the middle of handing
+    // over a frame it isn't late, so don't wait for it.
+    Direct3DDevice9Hooks* self = (Direct3DDevice9Hooks*)context;
+    if (!TryEnterCriticalSection(&self->represent_lock))
+    {
+        return false;
+    }
+    bool late = false;
+    if (self->hmd_texture && self->represent_state && self->represent_scratch && self->pipeline->drained())
+    {
+        self->represent_deadline.presented(last_present);
+        late = self->represent_deadline.missed(now);
+        if (late)
+        {
+            self->represent(device);
+        }
+    }
+    LeaveCriticalSection(&self->represent_lock);
+    return late;
+}
+
+void Direct3DDevice9Hooks::represent (IDirect3DDevice9* device)
+{
+    // Set the game's frame in progress aside
+    this->represent_state->Capture();
+    IDirect3DSurface9* render_target = 0;
+    device->GetRenderTarget(0, &render_target);
+    IDirect3DSurface9* back_buffer;
+    device->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+    device->StretchRect(back_buffer, NULL, this->represent_scratch, NULL, D3DTEXF_POINT);
+
+    // Show the last completed frame again, turned to where the head is now
+    TrackingThread::pose_sample sample;
+    const ovrPosef* latest_pose = this->presented_pose;
+    if (this->tracking && this->tracking->latest(&sample))
+    {
+        latest_pose = sample.eye_pose;
+    }
+    ovrRecti eye_viewport[2] = {
+        { { 0, 0 }, { this->target_size.w / 2, this->target_size.h } },
+        { { this->target_size.w / 2, 0 }, { this->target_size.w / 2, this->target_size.h } },
+    };
+    device->SetRenderTarget(0, back_buffer);
+    device->BeginScene();
+    this->distortion->render_reprojected(device, this->hmd_texture, this->target_size, eye_viewport, this->presented_pose, latest_pose);
+    device->EndScene();
+    device->Present(NULL, NULL, NULL, NULL);
+    back_buffer->Release();
+
+    // Put the game's frame back into whichever buffer is now the back buffer
+    device->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &back_buffer);
+    device->StretchRect(this->represent_scratch, NULL, back_buffer, NULL, D3DTEXF_POINT);
+    back_buffer->Release();
+    device->SetRenderTarget(0, render_target);
+    if (render_target)
+    {
+        render_target->Release();
+    }
+    this->represent_state->Apply();
+
+    // Periodically report how often the game needed covering for
+    if (++this->represent_count % 300 == 0)
+    {
+        char message[128];
+        sprintf_s(message, "PinballVRcade: re-presented %u missed frames\n", this->represent_count);
+        OutputDebugStringA(message);
+    }
+}
+
+void Direct3DDevice9Hooks::begin_pacing_queries ()
+{
+    // Only one frame is measured at a time; while the last one's results
+    // are still outstanding this one just goes unmeasured
+    if (this->pacing_query_pending)
+    {
+        return;
+    }
+    this->pacing_disjoint->Issue(D3DISSUE_BEGIN);
+    this->pacing_begin->Issue(D3DISSUE_END);
+    this->pacing_measuring = true;
+}
+
+void Direct3DDevice9Hooks::issue_pacing_query ()
+{
+    if (!this->pacing_measuring)
+    {
+        return;
+    }
+    this->pacing_cpu_time = ovr_GetTimeInSeconds() - this->frame_start_time;
+    this->pacing_end->Issue(D3DISSUE_END);
+    this->pacing_frequency->Issue(D3DISSUE_END);
+    this->pacing_disjoint->Issue(D3DISSUE_END);
+    this->pacing_measuring = false;
+    this->pacing_query_pending = true;
+}
+
+void Direct3DDevice9Hooks::poll_pacing_query ()
+{
+    if (!this->pacing_query_pending)
+    {
+        return;
+    }
+    // Never flush, the whole point is not to wait on the GPU. The GPU time
+    // is counted on top of the CPU time as if none of it overlapped, which
+    // errs on the side of starting early.
+    BOOL disjoint;
+    UINT64 frequency, begin, end;
+    if (this->pacing_disjoint->GetData(&disjoint, sizeof(disjoint), 0) == S_OK &&
+        this->pacing_frequency->GetData(&frequency, sizeof(frequency), 0) == S_OK &&
+        this->pacing_begin->GetData(&begin, sizeof(begin), 0) == S_OK &&
+        this->pacing_end->GetData(&end, sizeof(end), 0) == S_OK)
+    {
+        if (!disjoint && frequency && end >= begin)
+        {
+            this->pacer.record(this->pacing_cpu_time, (double)(end - begin) / frequency);
+        }
+        this->pacing_query_pending = false;
+    }
+}
+
+void Direct3DDevice9Hooks::wait_for_frame_start (const ovrFrameTiming& frame_timing)
+{
+    // Hold the game back so the frame it's about to start finishes just
+    // before its refresh, instead of starting straight away and showing
+    // input and a pose that have gone stale in the meantime
+    this->poll_pacing_query();
+    double now = ovr_GetTimeInSeconds();
+    double delay = this->pacer.start_delay(frame_timing.NextFrameSeconds - now);
+    double start = now + delay;
+    while (now < start)
+    {
+        if (start - now > 0.002)
+        {
+            Sleep(1);
         }
         else
         {
-            this->inner->CreateTexture(
-                this->present_parameters.BackBufferWidth,
-                this->present_parameters.BackBufferHeight,
-                1,  // Levels
-                D3DUSAGE_RENDERTARGET,
-                this->present_parameters.BackBufferFormat,
-                D3DPOOL_DEFAULT,
-                &this->hmd_texture,
-                NULL // pSharedHandle
-            );
-
-            // As Pinball Arcade gets patched, its code is likely to move around, so
-            // we keep a fingerprint hash of some stable code close to the matrix
-            // call site we need to patch. We can search the code segment for things
-            // matching this fingerprint and rediscover the location of the code we
-            // want to patch.
-            rolling_crc VIEW_PROJECTION_MULTIPLY_FINGERPRINT;
-            VIEW_PROJECTION_MULTIPLY_FINGERPRINT.block_size = 0x18;
-            VIEW_PROJECTION_MULTIPLY_FINGERPRINT.a = 0x0f20;
-            VIEW_PROJECTION_MULTIPLY_FINGERPRINT.b = 0xb638;
-            size_t VIEW_PROJECTION_MULTIPLY_FINGERPRINT_OFFSET = 0x25;
-
-            // Create a patch that loads two identity matrices instead of the view and
-            // projection matrices so that when C_WORLDVIEWPROJ shader constants get set,
-            // get only the WORLD part of the transformation and can apply our own
-            // view and projection matrices
-            unsigned char patch[10];
-            patch[0] = 0xB8; // MOV eax
-            *(uintptr_t*)&patch[1] = (uintptr_t)s_identity_matrix;
-            patch[5] = 0xB9; // MOV ecx
-            *(uintptr_t*)&patch[6] = (uintptr_t)s_identity_matrix;
-
-            uintptr_t address = find_fingerprint(VIEW_PROJECTION_MULTIPLY_FINGERPRINT);
-            install_patch(address + VIEW_PROJECTION_MULTIPLY_FINGERPRINT_OFFSET, sizeof(patch), patch);
+            SwitchToThread();
+        }
+        this->poll_pacing_query();
+        now = ovr_GetTimeInSeconds();
+    }
+    this->frame_start_time = now;
+    this->begin_pacing_queries();
+
+    // Periodically report how much later frames start than they used to
+    this->pacing_delay_total += delay;
+    if (++this->pacing_frames >= 300)
+    {
+        char message[128];
+        sprintf_s(message, "PinballVRcade: frame starts held back %.2f ms on average, worst frame cost %.2f ms\n",
+            1000.0 * this->pacing_delay_total / this->pacing_frames,
+            1000.0 * this->pacer.predicted_cost());
+        OutputDebugStringA(message);
+        this->pacing_delay_total = 0;
+        this->pacing_frames = 0;
+    }
+}
+
+void Direct3DDevice9Hooks::profile (const char* scope)
+{
+    if (this->profiler)
+    {
+        this->profiler->mark(scope);
+    }
+}
+
+void Direct3DDevice9Hooks::flush_pipeline ()
+{
+    if (this->pipeline)
+    {
+        this->pipeline->fence();
+    }
+}
+
+void Direct3DDevice9Hooks::create_stereo_quad_buffer ()
+{
+    this->stereo_quad_buffer_offset = 0;
+    this->inner->CreateVertexBuffer(
+        this->stereo_quad_buffer_length,
+        this->stereo_quad_buffer_usage,
+        this->stereo_quad_buffer_fvf,
+        this->stereo_quad_buffer_pool,
+        &this->stereo_quad_buffer,
+        NULL // pSharedHandle
+    );
+    this->update_draw_dispatch();
+}
+
+void Direct3DDevice9Hooks::set_stereo (bool stereo)
+{
+    this->stereo = stereo;
+    this->update_draw_dispatch();
+}
+
+void Direct3DDevice9Hooks::update_draw_dispatch ()
+{
+    // UI quads can only be duplicated once we have a buffer to put them in
+    if (this->stereo_quad_buffer)
+    {
+        this->stereo_draws.draw_primitive_device = this;
+        this->stereo_draws.draw_primitive = &Direct3DDevice9Hooks::draw_stereo_ui;
+    }
+    else
+    {
+        this->stereo_draws.draw_primitive_device = this->mono_draws.draw_primitive_device;
+        this->stereo_draws.draw_primitive = this->mono_draws.draw_primitive;
+    }
+    this->stereo_draws.draw_indexed_primitive_device = this;
+    this->stereo_draws.draw_indexed_primitive = &Direct3DDevice9Hooks::draw_stereo_scene;
+    this->draws = this->stereo ? &this->stereo_draws : &this->mono_draws;
+}
+
+const ovrPosef& Direct3DDevice9Hooks::latch_head_pose (ovrEyeType eye)
+{
+    // Take the newest predicted pose for this eye at most once per frame, as
+    // late as possible. The same pose is later passed to ovrHmd_EndFrame so
+    // that timewarp corrects from exactly what the scene was rendered with.
+    // The pose comes from the tracking thread, so this never calls into LibOVR.
+    if (!this->head_pose_latched[eye])
+    {
+        TrackingThread::pose_sample sample;
+        if (this->tracking && this->tracking->latest(&sample))
+        {
+            this->head_pose[eye] = sample.eye_pose[eye];
+            this->head_pose_time[eye] = sample.sample_time;
         }
+        this->head_pose_latched[eye] = true;
+    }
+    return this->head_pose[eye];
+}
+
+void Direct3DDevice9Hooks::update_simulation_rate ()
+{
+    // Retune the physics whenever the display mode asks for a different
+    // rate. The patch always starts from the original game values, so
+    // switching back and forth is safe.
+    D3DDISPLAYMODE display_mode;
+    this->inner->GetDisplayMode(0, &display_mode);
+    double rate = timestep_patch_target_rate(display_mode.RefreshRate, this->present_parameters.Windowed == 0);
+    if (rate != timestep_patch_rate())
+    {
+        timestep_patch_apply(rate);
     }
 }
 
@@ -225,7 +986,63 @@ UINT Direct3DDevice9Hooks::GetNumberOfSwapChains ()
 
 HRESULT Direct3DDevice9Hooks::Reset (D3DPRESENT_PARAMETERS* pPresentationParameters)
 {
-    return this->inner->Reset(pPresentationParameters);
+    // Let go of everything that pins the old back buffer or lives in the
+    // default pool, otherwise the reset fails
+    if (this->back_buffer_surface)
+    {
+        this->back_buffer_surface->Release();
+        this->back_buffer_surface = 0;
+    }
+    if (this->stereo_quad_buffer && this->stereo_quad_buffer_pool == D3DPOOL_DEFAULT)
+    {
+        this->stereo_quad_buffer->Release();
+        this->stereo_quad_buffer = 0;
+        this->update_draw_dispatch();
+    }
+    if (this->hmd)
+    {
+        this->release_hmd_resources();
+    }
+
+    HRESULT result = this->inner->Reset(pPresentationParameters);
+    if (FAILED(result))
+    {
+        // The game will retry once the device can be reset
+        return result;
+    }
+
+    // Rebuild at the new size before the next frame is drawn
+    this->present_parameters = *pPresentationParameters;
+    this->inner->GetRenderTarget(0, &this->back_buffer_surface);
+    if (this->stereo_quad_buffer_length && !this->stereo_quad_buffer)
+    {
+        this->create_stereo_quad_buffer();
+    }
+    if (this->hmd)
+    {
+        this->create_hmd_resources();
+    }
+    this->set_stereo(false);
+    this->pacing_measuring = false;
+    this->pacing_query_pending = false;
+    if (this->profiler)
+    {
+        this->profiler->reset();
+    }
+    if (this->capture)
+    {
+        this->capture->reset();
+    }
+    this->release_bound_textures();
+
+    // Reset puts the transforms back to identity and unbinds the shaders
+    D3DXMatrixIdentity(&this->fixed_world);
+    D3DXMatrixIdentity(&this->fixed_view);
+    D3DXMatrixIdentity(&this->fixed_projection);
+    this->track_vertex_shader(0);
+    this->track_pixel_shader(0);
+    this->update_simulation_rate();
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
@@ -233,16 +1050,37 @@ HRESULT Direct3DDevice9Hooks::Present (CONST RECT* pSourceRect,CONST RECT* pDest
     if (this->hmd && this->render_distorted)
     {
         // Wrap up the previous frame
-        if (this->frame_index != 0)
+        if (this->frame_index != 0 && this->hmd_texture)
         {
             // Dismiss the health and saftey warning
             ovrHmd_DismissHSWDisplay(this->hmd);
 
-            // Copy the back buffer into the hmd surface
+            // Copy the back buffer into the hmd surface. References are dropped
+            // straight away so nothing keeps the swap chain alive across a Reset.
+            // The render thread mustn't re-present until the new pose goes with it.
+            EnterCriticalSection(&this->represent_lock);
+            this->finish_far_layer();
+            this->far_field.presented();
+            this->composite_ui_layer();
+            this->profile("back buffer copy");
+            if (this->back_buffer_surface)
+            {
+                this->back_buffer_surface->Release();
+            }
             this->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &this->back_buffer_surface);
             IDirect3DSurface9* hmd_surface;
             this->hmd_texture->GetSurfaceLevel(0, &hmd_surface);
-            HRESULT result = this->StretchRect(this->back_buffer_surface, NULL, hmd_surface, NULL, D3DTEXF_LINEAR);
+            IDirect3DSurface9* frame_surface = this->eye_target_surface ? this->eye_target_surface : this->back_buffer_surface;
+            HRESULT result = this->StretchRect(frame_surface, NULL, hmd_surface, NULL, D3DTEXF_LINEAR);
+            if (this->capture && !(this->capture_distorted && this->distortion))
+            {
+                this->capture->capture(hmd_surface, ovr_GetTimeInSeconds());
+            }
+            hmd_surface->Release();
+            if (this->just_in_time)
+            {
+                this->issue_pacing_query();
+            }
 
             // Hand over the surface to ovr for distortion
             ovrD3D9Texture eye_textures[2];
@@ -255,7 +1093,49 @@ HRESULT Direct3DDevice9Hooks::Present (CONST RECT* pSourceRect,CONST RECT* pDest
             eye_textures[0].D3D9.pTexture = this->hmd_texture;
             eye_textures[1] = eye_textures[0];
             eye_textures[1].D3D9.Header.RenderViewport.Pos.x = this->target_size.w / 2;
-            ovrHmd_EndFrame(this->hmd, this->head_pose, &eye_textures[0].Texture);
+
+            // Make sure both eyes have a pose even if nothing was drawn in stereo,
+            // then hand timewarp the exact poses the view matrices were built from
+            this->latch_head_pose(ovrEye_Left);
+            this->latch_head_pose(ovrEye_Right);
+            double now = ovr_GetTimeInSeconds();
+            this->pose_age_total += (now - this->head_pose_time[0]) + (now - this->head_pose_time[1]);
+            this->pose_age_samples += 2;
+            this->profile("distortion");
+            if (this->distortion)
+            {
+                this->present_client_distortion(eye_textures[0].D3D9.Header.RenderViewport, eye_textures[1].D3D9.Header.RenderViewport);
+            }
+            else
+            {
+                this->flush_pipeline();
+                ovrHmd_EndFrame(this->hmd, this->head_pose, &eye_textures[0].Texture);
+            }
+            LeaveCriticalSection(&this->represent_lock);
+            if (this->eye_target_surface)
+            {
+                // The distortion pass left the window bound, and the game
+                // doesn't expect Present to change its targets
+                D3DVIEWPORT9 viewport = this->game_viewport;
+                this->bind_game_render_target();
+                this->bind_game_depth_stencil();
+                this->SetViewport(&viewport);
+            }
+            if (this->profiler)
+            {
+                this->profiler->end_frame();
+            }
+            startup_timeline_first_frame();
+
+            // Periodically report how old the poses were when the frame was submitted
+            if (this->pose_age_samples >= 600)
+            {
+                char message[128];
+                sprintf_s(message, "PinballVRcade: average pose age at EndFrame %.2f ms\n", 1000.0 * this->pose_age_total / this->pose_age_samples);
+                OutputDebugStringA(message);
+                this->pose_age_total = 0;
+                this->pose_age_samples = 0;
+            }
         }
         if (GetAsyncKeyState(VK_F12) != 0)
         {
@@ -270,15 +1150,61 @@ HRESULT Direct3DDevice9Hooks::Present (CONST RECT* pSourceRect,CONST RECT* pDest
             this->reset_pressed = false;
         }
 
-        ovrHmd_BeginFrame(this->hmd, this->frame_index++);
-        this->head_pose[ovrEye_Left] = ovrHmd_GetEyePose(this->hmd, ovrEye_Left);
-        this->head_pose[ovrEye_Right] = ovrHmd_GetEyePose(this->hmd, ovrEye_Right);
+        // Periodically report how many stereo scene draws each eye skipped
+        if (++this->cull_frames >= 300)
+        {
+            if (this->cull_draws)
+            {
+                char message[160];
+                sprintf_s(message, "PinballVRcade: %.1f stereo draws per frame, culled left %.1f%% right %.1f%%, far field %.1f%%\n",
+                    (float)this->cull_draws / this->cull_frames,
+                    100.0f * this->cull_skipped[ovrEye_Left] / this->cull_draws,
+                    100.0f * this->cull_skipped[ovrEye_Right] / this->cull_draws,
+                    100.0f * this->far_draws / this->cull_draws);
+                OutputDebugStringA(message);
+            }
+            this->cull_frames = 0;
+            this->cull_draws = 0;
+            this->cull_skipped[0] = this->cull_skipped[1] = 0;
+            this->far_draws = 0;
+
+            // Tables load their textures up front, so this reports once
+            // per table
+            if (this->texture_dedup && Direct3DTexture9Hooks::saved_bytes() != this->reported_saved_bytes)
+            {
+                this->reported_saved_bytes = Direct3DTexture9Hooks::saved_bytes();
+                char message[128];
+                sprintf_s(message, "PinballVRcade: %u textures share an identical one, saving %.1f MB\n",
+                    Direct3DTexture9Hooks::shared_count(), this->reported_saved_bytes / (1024.0 * 1024.0));
+                OutputDebugStringA(message);
+            }
+        }
+
+        // Poses are sampled lazily right before each eye's first scene draw
+        ovrFrameTiming frame_timing = this->distortion
+            ? ovrHmd_BeginFrameTiming(this->hmd, this->frame_index++)
+            : ovrHmd_BeginFrame(this->hmd, this->frame_index++);
+        if (this->just_in_time)
+        {
+            this->wait_for_frame_start(frame_timing);
+        }
+        this->tracking->set_prediction_targets(frame_timing.EyeScanoutSeconds);
+        if (this->profiler)
+        {
+            this->profiler->begin_frame();
+        }
+        this->head_pose_latched[ovrEye_Left] = false;
+        this->head_pose_latched[ovrEye_Right] = false;
         return D3D_OK;
     }
     else
     {
         HRESULT result = this->inner->Present(pSourceRect, pDestRect, hDestWindowOverride, pDirtyRegion);
-        this->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &this->back_buffer_surface);
+        startup_timeline_first_frame();
+        if (this->back_buffer_surface)
+        {
+            this->back_buffer_surface->Release();
+        }
         this->inner->GetRenderTarget(0, &this->back_buffer_surface);
         return result;
     }
@@ -311,7 +1237,19 @@ void Direct3DDevice9Hooks::GetGammaRamp (UINT iSwapChain,D3DGAMMARAMP* pRamp)
 
 HRESULT Direct3DDevice9Hooks::CreateTexture (UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle)
 {
-    return this->inner->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+    // Only managed textures keep a copy of their contents we can read and
+    // fall back on; the driver fills mipmaps it generates itself
+    if (!this->wrap_textures || Pool != D3DPOOL_MANAGED || (Usage & (D3DUSAGE_DYNAMIC | D3DUSAGE_AUTOGENMIPMAP)))
+    {
+        return this->inner->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+    }
+    IDirect3DTexture9* texture;
+    HRESULT result = this->inner->CreateTexture(Width, Height, Levels, Usage, Format, Pool, &texture, pSharedHandle);
+    if (SUCCEEDED(result))
+    {
+        *ppTexture = new Direct3DTexture9Hooks(this, texture, this->texture_dedup);
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::CreateVolumeTexture (UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle)
@@ -326,20 +1264,23 @@ HRESULT Direct3DDevice9Hooks::CreateCubeTexture (UINT EdgeLength,UINT Levels,DWO
 
 HRESULT Direct3DDevice9Hooks::CreateVertexBuffer (UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle)
 {
-    if (!this->stereo_quad_buffer)
+    if (!this->stereo_quad_buffer_length)
     {
-        this->stereo_quad_buffer_offset = 0;
+        // Mirror the game's first vertex buffer, which holds its UI quads
         this->stereo_quad_buffer_length = Length;
-        this->inner->CreateVertexBuffer(
-            Length,
-            Usage,
-            FVF,
-            Pool,
-            &this->stereo_quad_buffer,
-            pSharedHandle
-        );
+        this->stereo_quad_buffer_usage = Usage;
+        this->stereo_quad_buffer_fvf = FVF;
+        this->stereo_quad_buffer_pool = Pool;
+        this->create_stereo_quad_buffer();
     }
-    return this->inner->CreateVertexBuffer(Length,Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+    // Wrap the game's buffers so we can see what gets written to them
+    IDirect3DVertexBuffer9* buffer;
+    HRESULT result = this->inner->CreateVertexBuffer(Length,Usage, FVF, Pool, &buffer, pSharedHandle);
+    if (SUCCEEDED(result))
+    {
+        *ppVertexBuffer = new Direct3DVertexBuffer9Hooks(this, buffer, Length, Usage, this->pipeline);
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::CreateIndexBuffer (UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle)
@@ -366,11 +1307,21 @@ HRESULT Direct3DDevice9Hooks::CreateDepthStencilSurface (UINT Width,UINT Height,
 
 HRESULT Direct3DDevice9Hooks::UpdateSurface (IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint)
 {
+    IDirect3DBaseTexture9* container;
+    if (pDestinationSurface && SUCCEEDED(pDestinationSurface->GetContainer(IID_IDirect3DBaseTexture9, (void**)&container)))
+    {
+        Direct3DTexture9Hooks::note_write(container);
+        container->Release();
+    }
     return this->inner->UpdateSurface(pSourceSurface, pSourceRect, pDestinationSurface, pDestPoint);
 }
 
 HRESULT Direct3DDevice9Hooks::UpdateTexture (IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture)
 {
+    if (pDestinationTexture)
+    {
+        Direct3DTexture9Hooks::note_write(pDestinationTexture);
+    }
     return this->inner->UpdateTexture(pSourceTexture, pDestinationTexture);
 }
 
@@ -401,31 +1352,98 @@ HRESULT Direct3DDevice9Hooks::CreateOffscreenPlainSurface (UINT Width,UINT Heigh
 
 HRESULT Direct3DDevice9Hooks::SetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget)
 {
-    this->stereo = this->hmd != 0;
-    if (this->stereo && pRenderTarget)
+    this->unbind_far_layer();
+
+    // Only back buffer sized targets are rendered in stereo
+    bool stereo = this->hmd != 0;
+    if (stereo && pRenderTarget)
     {
         D3DSURFACE_DESC desc;
         pRenderTarget->GetDesc(&desc);
         if (desc.Width != this->present_parameters.BackBufferWidth || desc.Height != this->present_parameters.BackBufferHeight)
         {
-            this->stereo = false;
+            stereo = false;
         }
     }
-    return this->inner->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+    if (stereo != this->stereo)
+    {
+        this->set_stereo(stereo);
+    }
+    if (RenderTargetIndex == 0)
+    {
+        this->profile(stereo ? "stereo target" : "offscreen target");
+    }
+    if (RenderTargetIndex != 0 || !this->eye_target_surface || !pRenderTarget)
+    {
+        return this->inner->SetRenderTarget(RenderTargetIndex, pRenderTarget);
+    }
+
+    // Moving on or off the back buffer swaps the depth buffer with it
+    pRenderTarget->AddRef();
+    if (this->game_render_target)
+    {
+        this->game_render_target->Release();
+    }
+    this->game_render_target = pRenderTarget;
+    bool was_redirected = this->redirected;
+    HRESULT result = this->bind_game_render_target();
+    if (this->redirected != was_redirected)
+    {
+        this->bind_game_depth_stencil();
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::GetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget)
 {
+    if (RenderTargetIndex == 0 && this->eye_target_surface)
+    {
+        *ppRenderTarget = this->game_render_target;
+        if (!this->game_render_target)
+        {
+            return D3DERR_NOTFOUND;
+        }
+        this->game_render_target->AddRef();
+        return D3D_OK;
+    }
     return this->inner->GetRenderTarget(RenderTargetIndex, ppRenderTarget);
 }
 
 HRESULT Direct3DDevice9Hooks::SetDepthStencilSurface (IDirect3DSurface9* pNewZStencil)
 {
+    this->unbind_far_layer();
+    if (this->eye_target_surface)
+    {
+        if (pNewZStencil)
+        {
+            pNewZStencil->AddRef();
+        }
+        if (this->game_depth_stencil)
+        {
+            this->game_depth_stencil->Release();
+        }
+        this->game_depth_stencil = pNewZStencil;
+        if (this->redirected && pNewZStencil && this->is_window_sized(pNewZStencil))
+        {
+            pNewZStencil = this->eye_depth;
+        }
+    }
+    this->hidden_area_bound = this->hidden_area_surface && pNewZStencil == this->hidden_area_surface;
     return this->inner->SetDepthStencilSurface(pNewZStencil);
 }
 
 HRESULT Direct3DDevice9Hooks::GetDepthStencilSurface (IDirect3DSurface9** ppZStencilSurface)
 {
+    if (this->eye_target_surface)
+    {
+        *ppZStencilSurface = this->game_depth_stencil;
+        if (!this->game_depth_stencil)
+        {
+            return D3DERR_NOTFOUND;
+        }
+        this->game_depth_stencil->AddRef();
+        return D3D_OK;
+    }
     return this->inner->GetDepthStencilSurface(ppZStencilSurface);
 }
 
@@ -441,12 +1459,51 @@ HRESULT Direct3DDevice9Hooks::EndScene ()
 
 HRESULT Direct3DDevice9Hooks::Clear (DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil)
 {
-    this->tracking_state = ovrHmd_GetTrackingState(this->hmd, ovr_GetTimeInSeconds());
-    return this->inner->Clear(Count, pRects, Flags, Color, Z, Stencil);
+    this->profile("clear");
+    this->unbind_far_layer();
+    if (this->stereo)
+    {
+        if (Flags & D3DCLEAR_TARGET)
+        {
+            this->last_clear_color = Color;
+            this->far_field.cleared();
+        }
+        if (Flags & D3DCLEAR_ZBUFFER)
+        {
+            this->last_clear_z = Z;
+        }
+    }
+    std::vector<D3DRECT> scaled_rects;
+    if (this->redirected && Count && pRects)
+    {
+        scaled_rects.resize(Count);
+        for (DWORD i = 0; i < Count; ++i)
+        {
+            scaled_rects[i].x1 = this->to_target_x(pRects[i].x1);
+            scaled_rects[i].y1 = this->to_target_y(pRects[i].y1);
+            scaled_rects[i].x2 = this->to_target_x(pRects[i].x2);
+            scaled_rects[i].y2 = this->to_target_y(pRects[i].y2);
+        }
+        pRects = &scaled_rects[0];
+    }
+    if (!this->hidden_area)
+    {
+        return this->inner->Clear(Count, pRects, Flags, Color, Z, Stencil);
+    }
+
+    // Partly cleared pixels count as visible until the mask is written again
+    HRESULT result = this->inner->Clear(Count, pRects, Flags, Color, Z, Stencil | this->hidden_area_bit);
+    this->mark_hidden_area(Count, Flags);
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::SetTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix)
 {
+    D3DXMATRIX* transform = this->fixed_transform(State);
+    if (transform && pMatrix)
+    {
+        *transform = *(const D3DXMATRIX*)pMatrix;
+    }
     return this->inner->SetTransform(State, pMatrix);
 }
 
@@ -457,16 +1514,87 @@ HRESULT Direct3DDevice9Hooks::GetTransform (D3DTRANSFORMSTATETYPE State,D3DMATRI
 
 HRESULT Direct3DDevice9Hooks::MultiplyTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix)
 {
+    D3DXMATRIX* transform = this->fixed_transform(State);
+    if (transform && pMatrix)
+    {
+        *transform = *(const D3DXMATRIX*)pMatrix * *transform;
+    }
     return this->inner->MultiplyTransform(State, pMatrix);
 }
 
+D3DXMATRIX* Direct3DDevice9Hooks::fixed_transform (D3DTRANSFORMSTATETYPE State)
+{
+    switch (State)
+    {
+    case D3DTS_WORLD:
+        return &this->fixed_world;
+    case D3DTS_VIEW:
+        return &this->fixed_view;
+    case D3DTS_PROJECTION:
+        return &this->fixed_projection;
+    default:
+        return 0;
+    }
+}
+
+void Direct3DDevice9Hooks::set_scene_transform (const D3DXMATRIX& transform, const D3DXMATRIX& view, const D3DXMATRIX& projection)
+{
+    if (this->current_vertex_shader)
+    {
+        this->inner->SetVertexShaderConstantF(this->wvp_register, (const float*)&transform, 4);
+        return;
+    }
+    // The game's world matrix stays, so lighting and fog still see the
+    // mesh in a real view space
+    this->inner->SetTransform(D3DTS_VIEW, &view);
+    this->inner->SetTransform(D3DTS_PROJECTION, &projection);
+}
+
+void Direct3DDevice9Hooks::restore_scene_transform ()
+{
+    // Put the game's own transform back for any mono draws that follow
+    if (this->current_vertex_shader)
+    {
+        this->inner->SetVertexShaderConstantF(this->wvp_register, (const float*)&this->model_matrix, 4);
+        return;
+    }
+    this->inner->SetTransform(D3DTS_VIEW, &this->fixed_view);
+    this->inner->SetTransform(D3DTS_PROJECTION, &this->fixed_projection);
+}
+
 HRESULT Direct3DDevice9Hooks::SetViewport (CONST D3DVIEWPORT9* pViewport)
 {
+    // Kept for every target, so it can go back in once far draws are done
+    // with the layer. Until then they use all of the layer.
+    if (pViewport)
+    {
+        this->game_viewport = *pViewport;
+    }
+    if (this->far_layer_bound)
+    {
+        return D3D_OK;
+    }
+    if (this->redirected && pViewport)
+    {
+        D3DVIEWPORT9 viewport = *pViewport;
+        // Scale the edges rather than the size, so a viewport covering the
+        // whole back buffer covers the whole target
+        viewport.X = this->to_target_x(pViewport->X);
+        viewport.Y = this->to_target_y(pViewport->Y);
+        viewport.Width = this->to_target_x(pViewport->X + pViewport->Width) - viewport.X;
+        viewport.Height = this->to_target_y(pViewport->Y + pViewport->Height) - viewport.Y;
+        return this->inner->SetViewport(&viewport);
+    }
     return this->inner->SetViewport(pViewport);
 }
 
 HRESULT Direct3DDevice9Hooks::GetViewport (D3DVIEWPORT9* pViewport)
 {
+    if ((this->redirected || this->far_layer_bound) && pViewport)
+    {
+        *pViewport = this->game_viewport;
+        return D3D_OK;
+    }
     return this->inner->GetViewport(pViewport);
 }
 
@@ -512,6 +1640,24 @@ HRESULT Direct3DDevice9Hooks::GetClipPlane (DWORD Index,float* pPlane)
 
 HRESULT Direct3DDevice9Hooks::SetRenderState (D3DRENDERSTATETYPE State,DWORD Value)
 {
+    for (int i = 0; i < 9; ++i)
+    {
+        if (s_stencil_states[i] == State)
+        {
+            this->stencil_state[i] = Value;
+            if (State == D3DRS_STENCILMASK || State == D3DRS_STENCILWRITEMASK)
+            {
+                Value &= ~this->hidden_area_bit;
+            }
+        }
+    }
+    for (int i = 0; i < 7; ++i)
+    {
+        if (s_ui_blend_states[i] == State)
+        {
+            this->ui_blend_state[i] = Value;
+        }
+    }
     return this->inner->SetRenderState(State, Value);
 }
 
@@ -522,7 +1668,13 @@ HRESULT Direct3DDevice9Hooks::GetRenderState (D3DRENDERSTATETYPE State,DWORD* pV
 
 HRESULT Direct3DDevice9Hooks::CreateStateBlock (D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB)
 {
-    return this->inner->CreateStateBlock(Type, ppSB);
+    IDirect3DStateBlock9* state_block;
+    HRESULT result = this->inner->CreateStateBlock(Type, &state_block);
+    if (SUCCEEDED(result))
+    {
+        *ppSB = new Direct3DStateBlock9Hooks(this, state_block);
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::BeginStateBlock ()
@@ -532,7 +1684,84 @@ HRESULT Direct3DDevice9Hooks::BeginStateBlock ()
 
 HRESULT Direct3DDevice9Hooks::EndStateBlock (IDirect3DStateBlock9** ppSB)
 {
-    return this->inner->EndStateBlock(ppSB);
+    IDirect3DStateBlock9* state_block;
+    HRESULT result = this->inner->EndStateBlock(&state_block);
+    if (SUCCEEDED(result))
+    {
+        *ppSB = new Direct3DStateBlock9Hooks(this, state_block);
+    }
+
+    // Calls made while recording went into the state block rather than
+    // the device, so what we tracked from them is wrong
+    this->reload_tracked_state();
+    return result;
+}
+
+void Direct3DDevice9Hooks::reload_tracked_state ()
+{
+    // Shaders come back as the driver's, so look up the game's wrappers.
+    // A pure device can't be asked, in which case we keep what we have.
+    IDirect3DVertexShader9* vertex_shader;
+    if (SUCCEEDED(this->inner->GetVertexShader(&vertex_shader)))
+    {
+        Direct3DVertexShader9Hooks* wrapper = vertex_shader ? this->shader_registry.wrapper_of(vertex_shader) : 0;
+        this->track_vertex_shader(wrapper);
+        if (wrapper)
+        {
+            wrapper->Release();
+        }
+        if (vertex_shader)
+        {
+            vertex_shader->Release();
+        }
+    }
+
+    IDirect3DPixelShader9* pixel_shader;
+    if (SUCCEEDED(this->inner->GetPixelShader(&pixel_shader)))
+    {
+        Direct3DPixelShader9Hooks* wrapper = pixel_shader ? this->shader_registry.wrapper_of(pixel_shader) : 0;
+        this->track_pixel_shader(wrapper);
+        if (wrapper)
+        {
+            wrapper->Release();
+        }
+        if (pixel_shader)
+        {
+            pixel_shader->Release();
+        }
+    }
+
+    this->inner->GetVertexShaderConstantF(0, (float*)this->vertex_constants, this->vertex_constant_count);
+
+    // Like SetStreamSource, track the game's wrapper without holding on to it
+    IDirect3DVertexBuffer9* stream_data;
+    UINT offset;
+    UINT stride;
+    if (SUCCEEDED(this->inner->GetStreamSource(0, &stream_data, &offset, &stride)))
+    {
+        Direct3DVertexBuffer9Hooks* wrapper = Direct3DVertexBuffer9Hooks::wrapper_of(stream_data);
+        this->current_stream.number = 0;
+        this->current_stream.data = wrapper ? wrapper : stream_data;
+        this->current_stream.offset = offset;
+        this->current_stream.stride = stride;
+        this->position_stream.buffer = this->current_stream.data;
+        this->position_stream.stream_offset = offset;
+        this->position_stream.stride = stride;
+        if (stream_data)
+        {
+            stream_data->Release();
+        }
+    }
+
+    IDirect3DIndexBuffer9* indices;
+    if (SUCCEEDED(this->inner->GetIndices(&indices)))
+    {
+        this->current_indices = indices;
+        if (indices)
+        {
+            indices->Release();
+        }
+    }
 }
 
 HRESULT Direct3DDevice9Hooks::SetClipStatus (CONST D3DCLIPSTATUS9* pClipStatus)
@@ -547,14 +1776,98 @@ HRESULT Direct3DDevice9Hooks::GetClipStatus (D3DCLIPSTATUS9* pClipStatus)
 
 HRESULT Direct3DDevice9Hooks::GetTexture (DWORD Stage,IDirect3DBaseTexture9** ppTexture)
 {
+    // Hand back the game's wrapper rather than whichever texture it shares
+    int slot = texture_slot(Stage);
+    if (slot >= 0 && this->bound_textures[slot])
+    {
+        this->bound_textures[slot]->AddRef();
+        *ppTexture = this->bound_textures[slot];
+        return D3D_OK;
+    }
     return this->inner->GetTexture(Stage, ppTexture);
 }
 
 HRESULT Direct3DDevice9Hooks::SetTexture (DWORD Stage,IDirect3DBaseTexture9* pTexture)
 {
+    if (Stage == 0)
+    {
+        this->current_texture = pTexture;
+    }
+    if (!this->wrap_textures)
+    {
+        return this->inner->SetTexture(Stage, pTexture);
+    }
+
+    // Like the device, hold on to what's bound
+    Direct3DTexture9Hooks* wrapper = Direct3DTexture9Hooks::wrapper_of(pTexture);
+    int slot = texture_slot(Stage);
+    if (slot >= 0 && this->bound_textures[slot] != wrapper)
+    {
+        Direct3DTexture9Hooks* previous = this->bound_textures[slot];
+        if (wrapper)
+        {
+            wrapper->AddRef();
+        }
+        this->bound_textures[slot] = wrapper;
+        if (previous)
+        {
+            previous->Release();
+        }
+    }
+    if (wrapper)
+    {
+        if (this->texture_dedup)
+        {
+            wrapper->deduplicate();
+        }
+        pTexture = wrapper->active();
+    }
     return this->inner->SetTexture(Stage, pTexture);
 }
 
+void Direct3DDevice9Hooks::forget_vertex_buffer (Direct3DVertexBuffer9Hooks* buffer)
+{
+    this->mesh_bounds_cache.evict(buffer);
+}
+
+int Direct3DDevice9Hooks::texture_slot (DWORD Stage)
+{
+    if (Stage < 16)
+    {
+        return Stage;
+    }
+    if (Stage >= D3DVERTEXTEXTURESAMPLER0 && Stage <= D3DVERTEXTEXTURESAMPLER3)
+    {
+        return 16 + Stage - D3DVERTEXTEXTURESAMPLER0;
+    }
+    return -1;
+}
+
+void Direct3DDevice9Hooks::rebind_texture (Direct3DTexture9Hooks* texture)
+{
+    for (int slot = 0; slot < 20; ++slot)
+    {
+        if (this->bound_textures[slot] == texture)
+        {
+            DWORD stage = slot < 16 ? slot : D3DVERTEXTEXTURESAMPLER0 + slot - 16;
+            this->inner->SetTexture(stage, texture->active());
+        }
+    }
+}
+
+void Direct3DDevice9Hooks::release_bound_textures ()
+{
+    for (int slot = 0; slot < 20; ++slot)
+    {
+        Direct3DTexture9Hooks* texture = this->bound_textures[slot];
+        this->bound_textures[slot] = 0;
+        if (texture)
+        {
+            texture->Release();
+        }
+    }
+}
+
 HRESULT Direct3DDevice9Hooks::GetTextureStageState (DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue)
 {
     return this->inner->GetTextureStageState(Stage, Type, pValue);
@@ -602,11 +1915,33 @@ HRESULT Direct3DDevice9Hooks::GetCurrentTexturePalette (UINT *PaletteNumber)
 
 HRESULT Direct3DDevice9Hooks::SetScissorRect (CONST RECT* pRect)
 {
+    if (pRect)
+    {
+        this->game_scissor = *pRect;
+    }
+    if (this->far_layer_bound)
+    {
+        return D3D_OK;
+    }
+    if (this->redirected && pRect)
+    {
+        RECT rect;
+        rect.left = this->to_target_x(pRect->left);
+        rect.top = this->to_target_y(pRect->top);
+        rect.right = this->to_target_x(pRect->right);
+        rect.bottom = this->to_target_y(pRect->bottom);
+        return this->inner->SetScissorRect(&rect);
+    }
     return this->inner->SetScissorRect(pRect);
 }
 
 HRESULT Direct3DDevice9Hooks::GetScissorRect (RECT* pRect)
 {
+    if ((this->redirected || this->far_layer_bound) && pRect)
+    {
+        *pRect = this->game_scissor;
+        return D3D_OK;
+    }
     return this->inner->GetScissorRect(pRect);
 }
 
@@ -632,10 +1967,18 @@ float Direct3DDevice9Hooks::GetNPatchMode ()
 
 HRESULT Direct3DDevice9Hooks::DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount)
 {
-    if (!this->stereo)
-    {
-        return this->inner->DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount);
-    }
+    return this->draws->draw_primitive(this->draws->draw_primitive_device, PrimitiveType, StartVertex, PrimitiveCount);
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice9Hooks::draw_stereo_ui (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+{
+    return static_cast<Direct3DDevice9Hooks*>(device)->draw_ui_quad_both_eyes(PrimitiveType, StartVertex, PrimitiveCount);
+}
+
+HRESULT Direct3DDevice9Hooks::draw_ui_quad_both_eyes (D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount)
+{
+    this->profile("eye ui");
+    this->unbind_far_layer();
 
     // Get the current viewport
     D3DVIEWPORT9 viewport;
@@ -649,20 +1992,29 @@ HRESULT Direct3DDevice9Hooks::DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT
     memcpy(copy, vertices, sizeof(copy));
     this->current_stream.data->Unlock();
     vertices = copy;
+    if (this->ui_layer)
+    {
+        return this->draw_ui_into_layer(PrimitiveType, StartVertex, PrimitiveCount, viewport, copy);
+    }
+    this->finish_far_layer();
+
+    // Quads are in the game's pixels, which the eye targets may outnumber
+    float scale_x = 0.5f * (this->redirected ? this->frame_scale_x : 1.0f);
+    float scale_y = 0.5f * (this->redirected ? this->frame_scale_y : 1.0f);
 
     // Lock our quad buffer
     ui_vertex* quad_vertices;
     this->stereo_quad_buffer->Lock(this->stereo_quad_buffer_offset, sizeof(ui_vertex) * 8, (void**)&quad_vertices, D3DLOCK_NOOVERWRITE);
     memcpy(quad_vertices, vertices, sizeof(ui_vertex) * 4);
     memcpy(quad_vertices + 4, vertices, sizeof(ui_vertex) * 4);
-    quad_vertices[0].position.x = (vertices[0].position.x + 0.5f) * 0.5f + -0.5f + viewport.X;
-    quad_vertices[0].position.y = (vertices[0].position.y + 0.5f) * 0.5f + -0.5f + viewport.Y + viewport.Height * 0.25f;
-    quad_vertices[1].position.x = (vertices[1].position.x + 0.5f) * 0.5f + -0.5f + viewport.X;
-    quad_vertices[1].position.y = (vertices[1].position.y + 0.5f) * 0.5f + -0.5f + viewport.Y + viewport.Height * 0.25f;
-    quad_vertices[2].position.x = (vertices[2].position.x + 0.5f) * 0.5f + -0.5f + viewport.X;
-    quad_vertices[2].position.y = (vertices[2].position.y + 0.5f) * 0.5f + -0.5f + viewport.Y + viewport.Height * 0.25f;
-    quad_vertices[3].position.x = (vertices[3].position.x + 0.5f) * 0.5f + -0.5f + viewport.X;
-    quad_vertices[3].position.y = (vertices[3].position.y + 0.5f) * 0.5f + -0.5f + viewport.Y + viewport.Height * 0.25f;
+    quad_vertices[0].position.x = (vertices[0].position.x + 0.5f) * scale_x + -0.5f + viewport.X;
+    quad_vertices[0].position.y = (vertices[0].position.y + 0.5f) * scale_y + -0.5f + viewport.Y + viewport.Height * 0.25f;
+    quad_vertices[1].position.x = (vertices[1].position.x + 0.5f) * scale_x + -0.5f + viewport.X;
+    quad_vertices[1].position.y = (vertices[1].position.y + 0.5f) * scale_y + -0.5f + viewport.Y + viewport.Height * 0.25f;
+    quad_vertices[2].position.x = (vertices[2].position.x + 0.5f) * scale_x + -0.5f + viewport.X;
+    quad_vertices[2].position.y = (vertices[2].position.y + 0.5f) * scale_y + -0.5f + viewport.Y + viewport.Height * 0.25f;
+    quad_vertices[3].position.x = (vertices[3].position.x + 0.5f) * scale_x + -0.5f + viewport.X;
+    quad_vertices[3].position.y = (vertices[3].position.y + 0.5f) * scale_y + -0.5f + viewport.Y + viewport.Height * 0.25f;
     quad_vertices[4].position.x = quad_vertices[0].position.x + viewport.Width * 0.5f;
     quad_vertices[4].position.y = quad_vertices[0].position.y;
     quad_vertices[5].position.x = quad_vertices[1].position.x + viewport.Width * 0.5f;
@@ -694,18 +2046,451 @@ HRESULT Direct3DDevice9Hooks::DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT
     this->inner->DrawPrimitive(PrimitiveType, 4, PrimitiveCount);
 
     // Restore the original viewport
-    this->inner->SetStreamSource(current_stream.number, current_stream.data, current_stream.offset, current_stream.stride); 
+    this->inner->SetStreamSource(current_stream.number, Direct3DVertexBuffer9Hooks::unwrap(current_stream.data), current_stream.offset, current_stream.stride);
     this->inner->SetViewport(&viewport);
     return D3D_OK;
 }
 
 HRESULT Direct3DDevice9Hooks::DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount)
 {
-    if (!this->stereo)
+    return this->draws->draw_indexed_primitive(this->draws->draw_indexed_primitive_device, PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+}
+
+HRESULT Direct3DDevice9Hooks::draw_ui_into_layer (D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount, const D3DVIEWPORT9& viewport, const ui_vertex vertices[4])
+{
+    // Everything that decides what this quad looks like goes into the hash
+    unsigned __int64 hash = this->ui_stream_hash;
+    hash = hash_bytes(hash, vertices, sizeof(ui_vertex) * 4);
+    hash = hash_bytes(hash, &PrimitiveType, sizeof(PrimitiveType));
+    hash = hash_bytes(hash, &PrimitiveCount, sizeof(PrimitiveCount));
+    hash = hash_bytes(hash, &this->current_texture, sizeof(this->current_texture));
+    if (this->current_texture)
+    {
+        // Rewriting the same texture changes the quad as much as binding
+        // another one does
+        DWORD version = Direct3DTexture9Hooks::write_version(this->current_texture);
+        hash = hash_bytes(hash, &version, sizeof(version));
+    }
+    hash = hash_bytes(hash, &this->current_vertex_shader, sizeof(this->current_vertex_shader));
+    hash = hash_bytes(hash, &this->current_pixel_shader, sizeof(this->current_pixel_shader));
+    hash = hash_bytes(hash, this->ui_blend_state, sizeof(this->ui_blend_state));
+    this->ui_stream_hash = hash;
+    ++this->ui_layer_draws;
+
+    // Dynamic and render target textures can change without the stream
+    // changing, so the layer can't be trusted while one is in use. Nor
+    // can it once the game writes a texture through one of its surfaces.
+    Direct3DTexture9Hooks* wrapper = Direct3DTexture9Hooks::wrapper_of(this->current_texture);
+    if (wrapper && wrapper->has_escaped())
+    {
+        this->ui_layer_volatile = true;
+    }
+    if (this->current_texture && this->current_texture->GetType() == D3DRTYPE_TEXTURE)
+    {
+        D3DSURFACE_DESC desc;
+        static_cast<IDirect3DTexture9*>(this->current_texture)->GetLevelDesc(0, &desc);
+        if ((desc.Usage & D3DUSAGE_RENDERTARGET) ||
+            ((desc.Usage & D3DUSAGE_DYNAMIC) && !is_emulated_managed(this->current_texture)))
+        {
+            this->ui_layer_volatile = true;
+        }
+    }
+
+    // The layer holds last frame's quads. If this one differs, Present
+    // notices from the hash and the layer is redrawn next frame.
+    if (!this->ui_layer_rebuild)
+    {
+        return D3D_OK;
+    }
+
+    IDirect3DSurface9* render_target;
+    IDirect3DSurface9* layer_surface;
+    this->inner->GetRenderTarget(0, &render_target);
+    this->ui_layer->GetSurfaceLevel(0, &layer_surface);
+    if (!this->ui_layer_cleared)
+    {
+        this->inner->ColorFill(layer_surface, NULL, D3DCOLOR_ARGB(0, 0, 0, 0));
+        this->ui_layer_cleared = true;
+    }
+    // The layer is window sized, like the quad's coordinates
+    D3DVIEWPORT9 layer_viewport = this->redirected ? this->game_viewport : viewport;
+    this->inner->SetRenderTarget(0, layer_surface);
+    this->inner->SetViewport(&layer_viewport);
+
+    // Accumulate coverage in alpha so the layer composites as premultiplied
+    this->inner->SetRenderState(D3DRS_SEPARATEALPHABLENDENABLE, TRUE);
+    this->inner->SetRenderState(D3DRS_SRCBLENDALPHA, D3DBLEND_ONE);
+    this->inner->SetRenderState(D3DRS_DESTBLENDALPHA, D3DBLEND_INVSRCALPHA);
+    HRESULT result = this->inner->DrawPrimitive(PrimitiveType, StartVertex, PrimitiveCount);
+    this->inner->SetRenderState(D3DRS_SEPARATEALPHABLENDENABLE, FALSE);
+
+    this->inner->SetRenderTarget(0, render_target);
+    this->inner->SetViewport(&viewport);
+    render_target->Release();
+    layer_surface->Release();
+    return result;
+}
+
+void Direct3DDevice9Hooks::composite_ui_layer ()
+{
+    if (!this->ui_layer || !this->ui_layer_state)
+    {
+        return;
+    }
+
+    // A rebuilt layer now holds this frame's stream; a frame without UI
+    // leaves nothing to show
+    if (this->ui_layer_rebuild)
+    {
+        this->ui_layer_hash = this->ui_stream_hash;
+        this->ui_layer_empty = this->ui_layer_draws == 0;
+    }
+
+    if (!this->ui_layer_empty)
+    {
+        // The frame gets the layer scaled into the middle of each eye,
+        // where the stereo UI path used to put each quad
+        this->ui_layer_state->Capture();
+        IDirect3DSurface9* render_target;
+        IDirect3DSurface9* frame_surface = this->get_frame_surface();
+        this->inner->GetRenderTarget(0, &render_target);
+        this->inner->SetRenderTarget(0, frame_surface);
+
+        this->inner->SetVertexShader(NULL);
+        this->inner->SetPixelShader(NULL);
+        this->inner->SetFVF(D3DFVF_XYZRHW | D3DFVF_TEX1);
+        this->inner->SetTexture(0, this->ui_layer);
+        this->inner->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+        this->inner->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+        this->inner->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+        this->inner->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+        this->inner->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+        this->inner->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+        this->inner->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+        this->inner->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+        this->inner->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+        this->inner->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+        this->inner->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+        this->inner->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+        this->inner->SetRenderState(D3DRS_SCISSORTESTENABLE, FALSE);
+        this->inner->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+        this->inner->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+        this->inner->SetRenderState(D3DRS_SEPARATEALPHABLENDENABLE, FALSE);
+        this->inner->SetRenderState(D3DRS_BLENDOP, D3DBLENDOP_ADD);
+        this->inner->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_ONE);
+        this->inner->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+        this->inner->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF);
+        this->inner->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
+
+        struct layer_vertex {
+            float x, y, z, rhw;
+            float u, v;
+        };
+        float width = (float)this->target_size.w;
+        float height = (float)this->target_size.h;
+        float top = height * 0.25f - 0.5f;
+        float bottom = height * 0.75f - 0.5f;
+        layer_vertex quads[12];
+        for (int eye = 0; eye < 2; ++eye)
+        {
+            float left = width * 0.5f * eye - 0.5f;
+            float right = left + width * 0.5f;
+            layer_vertex corners[4] = {
+                { left, top, 0, 1, 0, 0 },
+                { right, top, 0, 1, 1, 0 },
+                { left, bottom, 0, 1, 0, 1 },
+                { right, bottom, 0, 1, 1, 1 },
+            };
+            layer_vertex* triangles = quads + eye * 6;
+            triangles[0] = corners[0];
+            triangles[1] = corners[1];
+            triangles[2] = corners[2];
+            triangles[3] = corners[2];
+            triangles[4] = corners[1];
+            triangles[5] = corners[3];
+        }
+        this->inner->DrawPrimitiveUP(D3DPT_TRIANGLELIST, 4, quads, sizeof(layer_vertex));
+
+        this->inner->SetRenderTarget(0, render_target);
+        render_target->Release();
+        frame_surface->Release();
+        this->ui_layer_state->Apply();
+    }
+
+    // Keep redrawing until two frames in a row drew the same UI, and
+    // redraw straight away if the layer went stale this frame
+    this->ui_layer_rebuild =
+        this->ui_layer_volatile ||
+        this->ui_stream_hash != this->ui_previous_hash ||
+        this->ui_stream_hash != this->ui_layer_hash;
+    this->ui_previous_hash = this->ui_stream_hash;
+    this->ui_stream_hash = s_empty_hash;
+    this->ui_layer_draws = 0;
+    this->ui_layer_cleared = false;
+    this->ui_layer_volatile = false;
+}
+
+void Direct3DDevice9Hooks::set_hidden_area_bit (DWORD bit)
+{
+    if (bit == this->hidden_area_bit)
+    {
+        return;
+    }
+    this->hidden_area_bit = bit;
+    this->inner->SetRenderState(D3DRS_STENCILMASK, this->stencil_state[1] & ~bit);
+    this->inner->SetRenderState(D3DRS_STENCILWRITEMASK, this->stencil_state[2] & ~bit);
+}
+
+void Direct3DDevice9Hooks::mark_hidden_area (DWORD Count, DWORD Flags)
+{
+    // Only a clear of the whole stereo target starts a new frame's mask
+    if (!this->stereo || Count != 0 || !(Flags & (D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL)))
+    {
+        return;
+    }
+    D3DVIEWPORT9 viewport;
+    this->inner->GetViewport(&viewport);
+    if (viewport.X != 0 || viewport.Y != 0 || viewport.Width != (DWORD)this->target_size.w || viewport.Height != (DWORD)this->target_size.h)
+    {
+        return;
+    }
+
+    IDirect3DSurface9* depth_stencil = 0;
+    this->inner->GetDepthStencilSurface(&depth_stencil);
+    if (!depth_stencil)
+    {
+        return;
+    }
+    D3DSURFACE_DESC desc;
+    depth_stencil->GetDesc(&desc);
+    depth_stencil->Release();
+    DWORD bit = stencil_top_bit(desc.Format);
+    if (!bit)
+    {
+        this->hidden_area_bound = false;
+        return;
+    }
+    this->set_hidden_area_bit(bit);
+    this->hidden_area_surface = depth_stencil;
+    this->hidden_area_bound = true;
+    this->hidden_area_pending = true;
+}
+
+void Direct3DDevice9Hooks::write_hidden_area ()
+{
+    this->hidden_area_pending = false;
+    D3DVIEWPORT9 eye_viewport[2];
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        D3DVIEWPORT9 viewport = { 0, 0, this->target_size.w / 2, this->target_size.h, 0.0f, 1.0f };
+        viewport.X = eye * viewport.Width;
+        eye_viewport[eye] = viewport;
+    }
+    this->hidden_area_state->Capture();
+    this->hidden_area->draw(this->inner, eye_viewport, this->hidden_area_bit);
+    this->hidden_area_state->Apply();
+}
+
+void Direct3DDevice9Hooks::force_hidden_area_test ()
+{
+    this->inner->SetRenderState(D3DRS_STENCILENABLE, TRUE);
+    this->inner->SetRenderState(D3DRS_STENCILMASK, this->hidden_area_bit);
+    this->inner->SetRenderState(D3DRS_STENCILWRITEMASK, 0);
+    this->inner->SetRenderState(D3DRS_STENCILFUNC, D3DCMP_EQUAL);
+    this->inner->SetRenderState(D3DRS_STENCILREF, this->hidden_area_bit);
+    this->inner->SetRenderState(D3DRS_STENCILFAIL, D3DSTENCILOP_KEEP);
+    this->inner->SetRenderState(D3DRS_STENCILZFAIL, D3DSTENCILOP_KEEP);
+    this->inner->SetRenderState(D3DRS_STENCILPASS, D3DSTENCILOP_KEEP);
+    this->inner->SetRenderState(D3DRS_TWOSIDEDSTENCILMODE, FALSE);
+}
+
+void Direct3DDevice9Hooks::restore_stencil_state ()
+{
+    for (int i = 0; i < 9; ++i)
+    {
+        DWORD value = this->stencil_state[i];
+        if (s_stencil_states[i] == D3DRS_STENCILMASK || s_stencil_states[i] == D3DRS_STENCILWRITEMASK)
+        {
+            value &= ~this->hidden_area_bit;
+        }
+        this->inner->SetRenderState(s_stencil_states[i], value);
+    }
+}
+
+D3DXMATRIX Direct3DDevice9Hooks::head_view (const ovrPosef& head_pose, const OVR::Vector3f& view_adjust) const
+{
+    OVR::Matrix4f axis_conversion = OVR::Matrix4f::AxisConversion(
+        OVR::WorldAxes(OVR::Axis_Right, OVR::Axis_Out, OVR::Axis_Down),
+        OVR::WorldAxes(OVR::Axis_Right, OVR::Axis_Up, OVR::Axis_Out)
+    );
+
+    OVR::Vector3f hmd_position = head_pose.Position;
+    OVR::Quatf hmd_orientation = head_pose.Orientation;
+
+    float unit_scale = 5000.0f;
+    OVR::Vector3f ovr_world_offset(0, 3000.0f, 5000.0f);
+    OVR::Matrix4f ovr_translation = OVR::Matrix4f::Translation(-ovr_world_offset - hmd_position * unit_scale);
+    OVR::Matrix4f ovr_view = OVR::Matrix4f(hmd_orientation.Inverted()) * ovr_translation;
+    OVR::Matrix4f ovr_eye_view = OVR::Matrix4f::Translation(view_adjust) * ovr_view * axis_conversion;
+
+    D3DXMATRIX view;
+    D3DXMatrixTranspose(&view, (D3DXMATRIX*)&ovr_eye_view);
+    return view;
+}
+
+HRESULT Direct3DDevice9Hooks::draw_far_field (const D3DXMATRIX& transform, const D3DXMATRIX& view, const D3DXMATRIX& projection, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
+{
+    // The layer stays bound across a run of far draws. Binding it also sets
+    // the viewport and scissor to cover all of it.
+    if (!this->far_layer_bound)
+    {
+        IDirect3DSurface9* layer_surface;
+        this->far_layer->GetSurfaceLevel(0, &layer_surface);
+        this->inner->SetRenderTarget(0, layer_surface);
+        this->inner->SetDepthStencilSurface(this->far_depth);
+        layer_surface->Release();
+        this->far_layer_bound = true;
+    }
+    if (this->far_field.begin_far_draw())
+    {
+        this->inner->Clear(0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, this->last_clear_color, this->last_clear_z, 0);
+    }
+    this->set_scene_transform(transform, view, projection);
+    HRESULT result = this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    this->restore_scene_transform();
+    return result;
+}
+
+void Direct3DDevice9Hooks::unbind_far_layer ()
+{
+    // Puts back the game's targets from what the hooks tracked, rather than
+    // asking the device, which would wait for the pipeline to drain
+    if (!this->far_layer_bound)
+    {
+        return;
+    }
+    this->far_layer_bound = false;
+    this->inner->SetRenderTarget(0, this->redirected ? this->eye_target_surface : this->game_render_target);
+    this->bind_game_depth_stencil();
+    D3DVIEWPORT9 viewport = this->game_viewport;
+    RECT scissor = this->game_scissor;
+    this->SetViewport(&viewport);
+    this->SetScissorRect(&scissor);
+}
+
+void Direct3DDevice9Hooks::composite_far_layer ()
+{
+    // Nothing has been drawn into the eyes yet, so the layer simply becomes
+    // their background. Depth is left at the clear value for the near
+    // meshes still to come.
+    this->far_layer_state->Capture();
+    IDirect3DSurface9* frame_surface = this->get_frame_surface();
+    this->inner->SetRenderTarget(0, frame_surface);
+
+    this->inner->SetVertexShader(NULL);
+    this->inner->SetPixelShader(NULL);
+    this->inner->SetFVF(D3DFVF_XYZRHW | D3DFVF_TEX1);
+    this->inner->SetTexture(0, this->far_layer);
+    this->inner->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG1);
+    this->inner->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    this->inner->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+    this->inner->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    this->inner->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    this->inner->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+    this->inner->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+    this->inner->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+    this->inner->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+    this->inner->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+    this->inner->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+    this->inner->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+    this->inner->SetRenderState(D3DRS_SCISSORTESTENABLE, FALSE);
+    this->inner->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    this->inner->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF);
+    this->inner->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
+
+    struct layer_vertex {
+        float x, y, z, rhw;
+        float u, v;
+    };
+    float eye_width = this->target_size.w * 0.5f;
+    float height = (float)this->target_size.h;
+    const ovrFovPort& layer_fov = this->far_field_fov;
+    float layer_width_tan = layer_fov.LeftTan + layer_fov.RightTan;
+    float layer_height_tan = layer_fov.UpTan + layer_fov.DownTan;
+    layer_vertex quads[12];
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        // Each eye sees the part of the shared field of view its own covers
+        const ovrFovPort& fov = this->eye_render_desc[eye].Fov;
+        float u0 = (layer_fov.LeftTan - fov.LeftTan) / layer_width_tan;
+        float u1 = (layer_fov.LeftTan + fov.RightTan) / layer_width_tan;
+        float v0 = (layer_fov.UpTan - fov.UpTan) / layer_height_tan;
+        float v1 = (layer_fov.UpTan + fov.DownTan) / layer_height_tan;
+        float left = eye_width * eye - 0.5f;
+        float right = left + eye_width;
+        float top = -0.5f;
+        float bottom = height - 0.5f;
+        layer_vertex corners[4] = {
+            { left, top, this->last_clear_z, 1, u0, v0 },
+            { right, top, this->last_clear_z, 1, u1, v0 },
+            { left, bottom, this->last_clear_z, 1, u0, v1 },
+            { right, bottom, this->last_clear_z, 1, u1, v1 },
+        };
+        layer_vertex* triangles = quads + eye * 6;
+        triangles[0] = corners[0];
+        triangles[1] = corners[1];
+        triangles[2] = corners[2];
+        triangles[3] = corners[2];
+        triangles[4] = corners[1];
+        triangles[5] = corners[3];
+    }
+    this->inner->DrawPrimitiveUP(D3DPT_TRIANGLELIST, 4, quads, sizeof(layer_vertex));
+
+    // The state block puts the viewport and scissor back
+    this->inner->SetRenderTarget(0, this->redirected ? this->eye_target_surface : this->game_render_target);
+    frame_surface->Release();
+    this->far_layer_state->Apply();
+}
+
+void Direct3DDevice9Hooks::finish_far_layer ()
+{
+    this->unbind_far_layer();
+    if (this->far_field.begin_near_draw())
+    {
+        this->composite_far_layer();
+    }
+}
+
+HRESULT STDMETHODCALLTYPE Direct3DDevice9Hooks::draw_stereo_scene (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
+{
+    return static_cast<Direct3DDevice9Hooks*>(device)->draw_scene_both_eyes(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+}
+
+HRESULT Direct3DDevice9Hooks::draw_scene_both_eyes (D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount)
+{
+    this->profile("eye scene");
+
+    // Shaders without a usable WVP register are drawn once, unchanged
+    if (this->current_vertex_shader && (this->wvp_register < 0 || this->wvp_register > 256 - 4))
     {
+        this->finish_far_layer();
         return this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
     }
 
+    // Because of our patch that keeps the viewprojection matrix at identity,
+    // the shader's WorldViewProjection matrix is actually just the model
+    // transform. The patch doesn't reach fixed function draws, whose view
+    // and projection are real; only their world matrix is the model
+    // transform, and the eyes' view and projection replace the game's.
+    if (this->current_vertex_shader)
+    {
+        this->model_matrix = *(const D3DXMATRIX*)&this->vertex_constants[this->wvp_register];
+    }
+    else
+    {
+        this->model_matrix = this->fixed_world;
+    }
+
     // Compose new view and projection matrices for each eye based on the head tracking
     // Oculus coordinate system:
     //    y  -z
@@ -724,32 +2509,73 @@ HRESULT Direct3DDevice9Hooks::DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveTy
     // (units are millimeters - ?)
     // p_v = (o_v.x, o_v.z, -o_v.y)
 
-    OVR::Matrix4f axis_conversion = OVR::Matrix4f::AxisConversion(
-        OVR::WorldAxes(OVR::Axis_Right, OVR::Axis_Out, OVR::Axis_Down),
-        OVR::WorldAxes(OVR::Axis_Right, OVR::Axis_Up, OVR::Axis_Out)
-    );
-
+    D3DXMATRIX views[2];
+    D3DXMATRIX projections[2];
     D3DXMATRIX transforms[2];
     for (int eye = 0; eye < 2; ++eye)
     {
-        ovrPosef head_pose = this->tracking_state.HeadPose.ThePose;
-        OVR::Vector3f hmd_position = head_pose.Position;
-        OVR::Quatf hmd_orientation = head_pose.Orientation;
+        const ovrPosef& head_pose = this->latch_head_pose((ovrEyeType)eye);
+        views[eye] = this->head_view(head_pose, this->eye_render_desc[eye].ViewAdjust);
+        D3DXMATRIX model_view = this->model_matrix * views[eye];
+
+        ovrMatrix4f ovr_projection = ovrMatrix4f_Projection(this->eye_render_desc[eye].Fov, 1.0f, 100000.0f, true);
+        D3DXMatrixTranspose(&projections[eye], (D3DXMATRIX*)&ovr_projection);
+        D3DXMatrixMultiply(&transforms[eye], &model_view, &projections[eye]);
+    }
+
+    // Skip the draw for any eye that can't see the mesh
+    bool visible[2] = { true, true };
+    bool bounded = false;
+    mesh_bounds bounds;
+    if (this->position_offset >= 0)
+    {
+        position_layout layout = this->position_stream;
+        layout.position_offset = this->position_offset;
+        bounded = this->mesh_bounds_cache.lookup(layout, this->current_indices, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount, &bounds);
+        if (bounded)
+        {
+            for (int eye = 0; eye < 2; ++eye)
+            {
+                visible[eye] = !bounds_outside_frustum(bounds, (const float*)&transforms[eye]);
+            }
+        }
+    }
+    ++this->cull_draws;
 
-        float unit_scale = 5000.0f;
-        OVR::Vector3f ovr_world_offset(0, 3000.0f, 5000.0f);
-        OVR::Matrix4f ovr_translation = OVR::Matrix4f::Translation(-ovr_world_offset - hmd_position * unit_scale);
-        OVR::Matrix4f ovr_view = OVR::Matrix4f(hmd_orientation.Inverted()) * ovr_translation;
-        OVR::Matrix4f ovr_eye_view = OVR::Matrix4f::Translation(this->eye_render_desc[eye].ViewAdjust) * ovr_view * axis_conversion;
+    // Meshes whose nearest point would land less than the disparity threshold
+    // apart in the two eyes go into the far field layer instead
+    if (bounded && this->far_layer && this->far_depth && this->far_layer_state && this->eye_target_surface && this->far_field.open())
+    {
+        D3DXMATRIX far_view = this->head_view(this->head_pose[ovrEye_Left], OVR::Vector3f(0, 0, 0));
+        D3DXMATRIX far_model_view = this->model_matrix * far_view;
+        if (this->far_field.is_far(bounds_nearest_depth(bounds, (const float*)&far_model_view)))
+        {
+            ovrMatrix4f ovr_projection = ovrMatrix4f_Projection(this->far_field_fov, 1.0f, 100000.0f, true);
+            D3DXMATRIX projection;
+            D3DXMatrixTranspose(&projection, (D3DXMATRIX*)&ovr_projection);
+            D3DXMATRIX far_transform;
+            D3DXMatrixMultiply(&far_transform, &far_model_view, &projection);
+            ++this->far_draws;
+            if (bounds_outside_frustum(bounds, (const float*)&far_transform))
+            {
+                return D3D_OK;
+            }
+            return this->draw_far_field(far_transform, far_view, projection, PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+        }
+    }
 
-        D3DXMATRIX view;
-        D3DXMatrixTranspose(&view, (D3DXMATRIX*)&ovr_eye_view);
-        D3DXMATRIX model_view = this->model_matrix * view;
+    this->finish_far_layer();
 
-        ovrMatrix4f ovr_projection = ovrMatrix4f_Projection(this->eye_render_desc[eye].Fov, 1.0f, 100000.0f, true);
-        D3DXMATRIX projection;
-        D3DXMatrixTranspose(&projection, (D3DXMATRIX*)&ovr_projection);
-        D3DXMatrixMultiply(&transforms[eye], &model_view, &projection);
+    // Leave pixels the lenses can't show unshaded, unless the game is
+    // using the stencil itself
+    bool masked = this->hidden_area_bound && this->hidden_area_state && !this->stencil_state[0];
+    if (masked)
+    {
+        if (this->hidden_area_pending)
+        {
+            this->write_hidden_area();
+        }
+        this->force_hidden_area_test();
     }
 
     // Get the current viewport
@@ -757,19 +2583,39 @@ HRESULT Direct3DDevice9Hooks::DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveTy
     this->inner->GetViewport(&viewport);
 
     // Render to the left viewport
-    D3DVIEWPORT9 left_viewport = viewport;
-    left_viewport.Width /= 2;
-    this->inner->SetViewport(&left_viewport);
-    this->inner->SetVertexShaderConstantF(11, (const float*)&transforms[ovrEye_Left], 4);
-    this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    if (visible[ovrEye_Left])
+    {
+        D3DVIEWPORT9 left_viewport = viewport;
+        left_viewport.Width /= 2;
+        this->inner->SetViewport(&left_viewport);
+        this->set_scene_transform(transforms[ovrEye_Left], views[ovrEye_Left], projections[ovrEye_Left]);
+        this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    }
+    else
+    {
+        ++this->cull_skipped[ovrEye_Left];
+    }
 
     // Render to the right viewport
-    D3DVIEWPORT9 right_viewport = viewport;
-    right_viewport.Width /= 2;
-    right_viewport.X += right_viewport.Width;
-    this->inner->SetViewport(&right_viewport);
-    this->inner->SetVertexShaderConstantF(11, (const float*)&transforms[ovrEye_Right], 4);
-    this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    if (visible[ovrEye_Right])
+    {
+        D3DVIEWPORT9 right_viewport = viewport;
+        right_viewport.Width /= 2;
+        right_viewport.X += right_viewport.Width;
+        this->inner->SetViewport(&right_viewport);
+        this->set_scene_transform(transforms[ovrEye_Right], views[ovrEye_Right], projections[ovrEye_Right]);
+        this->inner->DrawIndexedPrimitive(PrimitiveType, BaseVertexIndex, MinVertexIndex, NumVertices, startIndex, primCount);
+    }
+    else
+    {
+        ++this->cull_skipped[ovrEye_Right];
+    }
+
+    this->restore_scene_transform();
+    if (masked)
+    {
+        this->restore_stencil_state();
+    }
 
     // Restore the viewport
     this->inner->SetViewport(&viewport);
@@ -778,26 +2624,46 @@ HRESULT Direct3DDevice9Hooks::DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveTy
 
 HRESULT Direct3DDevice9Hooks::DrawPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
 {
+    this->finish_far_layer();
     return this->inner->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride);
 }
 
 HRESULT Direct3DDevice9Hooks::DrawIndexedPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
 {
+    this->finish_far_layer();
     return this->inner->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride);
 }
 
 HRESULT Direct3DDevice9Hooks::ProcessVertices (UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags)
 {
-    return this->inner->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags);
+    return this->inner->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, Direct3DVertexBuffer9Hooks::unwrap(pDestBuffer), pVertexDecl, Flags);
 }
 
 HRESULT Direct3DDevice9Hooks::CreateVertexDeclaration (CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl)
 {
-    return this->inner->CreateVertexDeclaration(pVertexElements, ppDecl);
+    HRESULT result = this->inner->CreateVertexDeclaration(pVertexElements, ppDecl);
+    if (SUCCEEDED(result))
+    {
+        // Remember where untransformed positions live for frustum culling
+        int offset = -1;
+        for (const D3DVERTEXELEMENT9* element = pVertexElements; element->Stream != 0xFF; ++element)
+        {
+            if (element->Usage == D3DDECLUSAGE_POSITION && element->UsageIndex == 0 && element->Stream == 0 &&
+                (element->Type == D3DDECLTYPE_FLOAT3 || element->Type == D3DDECLTYPE_FLOAT4))
+            {
+                offset = element->Offset;
+                break;
+            }
+        }
+        this->declaration_position_offsets[*ppDecl] = offset;
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::SetVertexDeclaration (IDirect3DVertexDeclaration9* pDecl)
 {
+    std::map<IDirect3DVertexDeclaration9*, int>::iterator found = this->declaration_position_offsets.find(pDecl);
+    this->position_offset = found != this->declaration_position_offsets.end() ? found->second : -1;
     return this->inner->SetVertexDeclaration(pDecl);
 }
 
@@ -808,6 +2674,7 @@ HRESULT Direct3DDevice9Hooks::GetVertexDeclaration (IDirect3DVertexDeclaration9*
 
 HRESULT Direct3DDevice9Hooks::SetFVF (DWORD FVF)
 {
+    this->position_offset = (FVF & D3DFVF_POSITION_MASK) == D3DFVF_XYZ ? 0 : -1;
     return this->inner->SetFVF(FVF);
 }
 
@@ -818,28 +2685,52 @@ HRESULT Direct3DDevice9Hooks::GetFVF (DWORD* pFVF)
 
 HRESULT Direct3DDevice9Hooks::CreateVertexShader (CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader)
 {
-    return this->inner->CreateVertexShader(pFunction, ppShader);
+    return this->shader_registry.create_vertex_shader(this, this->inner, pFunction, ppShader);
 }
 
 HRESULT Direct3DDevice9Hooks::SetVertexShader (IDirect3DVertexShader9* pShader)
 {
-    return this->inner->SetVertexShader(pShader);
+    this->track_vertex_shader(pShader);
+    return this->inner->SetVertexShader(Direct3DVertexShader9Hooks::unwrap(pShader));
+}
+
+void Direct3DDevice9Hooks::track_vertex_shader (IDirect3DVertexShader9* shader)
+{
+    if (shader)
+    {
+        shader->AddRef();
+    }
+    if (this->current_vertex_shader)
+    {
+        this->current_vertex_shader->Release();
+    }
+    this->current_vertex_shader = shader;
+
+    // The constant table tells us which registers this shader reads its
+    // transform from
+    this->wvp_register = shader ? static_cast<Direct3DVertexShader9Hooks*>(shader)->get_analysis().wvp_register : -1;
 }
 
 HRESULT Direct3DDevice9Hooks::GetVertexShader (IDirect3DVertexShader9** ppShader)
 {
-    return this->inner->GetVertexShader(ppShader);
+    // Hand back the game's wrapper rather than the driver's shader
+    *ppShader = this->current_vertex_shader;
+    if (*ppShader)
+    {
+        (*ppShader)->AddRef();
+    }
+    return D3D_OK;
 }
 
 HRESULT Direct3DDevice9Hooks::SetVertexShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
 {
-    // The ModelViewProjection matrix is stored in register slot 11 for all
-    // Pinball Arcade vertex shaders. Because of our patch that keeps the
-    // viewprojection matrix at identity, this matrix is actually just the
-    // model transform.
-    if (StartRegister == 11 && Vector4fCount == 4)
+    // Keep a copy of everything the game uploads. The transform register
+    // depends on the shader bound at draw time, and uploads can come before
+    // SetVertexShader or cover several matrices at once.
+    if (StartRegister < 256)
     {
-        this->model_matrix = *(D3DXMATRIX*)pConstantData;
+        UINT count = min(Vector4fCount, 256 - StartRegister);
+        memcpy(&this->vertex_constants[StartRegister], pConstantData, count * sizeof(D3DXVECTOR4));
     }
     return this->inner->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
 }
@@ -875,12 +2766,30 @@ HRESULT Direct3DDevice9Hooks::SetStreamSource (UINT StreamNumber,IDirect3DVertex
     current_stream.data = pStreamData;
     current_stream.offset = OffsetInBytes;
     current_stream.stride = Stride;
-    return this->inner->SetStreamSource(StreamNumber, pStreamData, OffsetInBytes, Stride);
+    if (StreamNumber == 0)
+    {
+        this->position_stream.buffer = pStreamData;
+        this->position_stream.stream_offset = OffsetInBytes;
+        this->position_stream.stride = Stride;
+    }
+    return this->inner->SetStreamSource(StreamNumber, Direct3DVertexBuffer9Hooks::unwrap(pStreamData), OffsetInBytes, Stride);
 }
 
 HRESULT Direct3DDevice9Hooks::GetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride)
 {
-    return this->inner->GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride);
+    HRESULT result = this->inner->GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride);
+    if (SUCCEEDED(result) && *ppStreamData)
+    {
+        // Hand back the game's wrapper rather than the real buffer
+        Direct3DVertexBuffer9Hooks* wrapper = Direct3DVertexBuffer9Hooks::wrapper_of(*ppStreamData);
+        if (wrapper)
+        {
+            wrapper->AddRef();
+            (*ppStreamData)->Release();
+            *ppStreamData = wrapper;
+        }
+    }
+    return result;
 }
 
 HRESULT Direct3DDevice9Hooks::SetStreamSourceFreq (UINT StreamNumber,UINT Setting)
@@ -895,6 +2804,7 @@ HRESULT Direct3DDevice9Hooks::GetStreamSourceFreq (UINT StreamNumber,UINT* pSett
 
 HRESULT Direct3DDevice9Hooks::SetIndices (IDirect3DIndexBuffer9* pIndexData)
 {
+    this->current_indices = pIndexData;
     return this->inner->SetIndices(pIndexData);
 }
 
@@ -905,17 +2815,37 @@ HRESULT Direct3DDevice9Hooks::GetIndices (IDirect3DIndexBuffer9** ppIndexData)
 
 HRESULT Direct3DDevice9Hooks::CreatePixelShader (CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader)
 {
-    return this->inner->CreatePixelShader(pFunction, ppShader);
+    return this->shader_registry.create_pixel_shader(this, this->inner, pFunction, ppShader);
 }
 
 HRESULT Direct3DDevice9Hooks::SetPixelShader (IDirect3DPixelShader9* pShader)
 {
-    return this->inner->SetPixelShader(pShader);
+    this->track_pixel_shader(pShader);
+    return this->inner->SetPixelShader(Direct3DPixelShader9Hooks::unwrap(pShader));
+}
+
+void Direct3DDevice9Hooks::track_pixel_shader (IDirect3DPixelShader9* shader)
+{
+    if (shader)
+    {
+        shader->AddRef();
+    }
+    if (this->current_pixel_shader)
+    {
+        this->current_pixel_shader->Release();
+    }
+    this->current_pixel_shader = shader;
 }
 
 HRESULT Direct3DDevice9Hooks::GetPixelShader (IDirect3DPixelShader9** ppShader)
 {
-    return this->inner->GetPixelShader(ppShader);
+    // Hand back the game's wrapper rather than the driver's shader
+    *ppShader = this->current_pixel_shader;
+    if (*ppShader)
+    {
+        (*ppShader)->AddRef();
+    }
+    return D3D_OK;
 }
 
 HRESULT Direct3DDevice9Hooks::SetPixelShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
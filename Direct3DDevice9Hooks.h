@@ -9,10 +9,24 @@
 #include <d3dx9.h>
 #include <OVR.h>
 
+#include "TrackingThread.h"
+#include "MeshBounds.h"
+#include "ShaderRegistry.h"
+#include "FramePacer.h"
+#include "Timewarp.h"
+#include "FarFieldSchedule.h"
+
+class Direct3DDevice9Pipeline;
+class DistortionRenderer;
+class HiddenAreaMask;
+class GpuProfiler;
+class FrameCapture;
+class Direct3DTexture9Hooks;
+
 class Direct3DDevice9Hooks : public IDirect3DDevice9
 {
 public:
-    Direct3DDevice9Hooks (IDirect3D9* parent, IDirect3DDevice9* inner, const D3DPRESENT_PARAMETERS& present_parameters, ovrHmd hmd);
+    Direct3DDevice9Hooks (IDirect3D9* parent, IDirect3DDevice9* inner, const D3DPRESENT_PARAMETERS& present_parameters, ovrHmd hmd, TrackingThread* tracking, Direct3DDevice9Pipeline* pipeline);
 
     /*** IUnknown methods ***/
     STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
@@ -137,6 +151,17 @@ public:
     STDMETHOD(DeletePatch)(THIS_ UINT Handle);
     STDMETHOD(CreateQuery)(THIS_ D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery);
 
+    // Rebinds a texture wherever it's bound after it starts or stops
+    // sharing another's storage
+    void rebind_texture (Direct3DTexture9Hooks* texture);
+
+    // Drops what was cached about a vertex buffer the game is destroying
+    void forget_vertex_buffer (Direct3DVertexBuffer9Hooks* buffer);
+
+    // Re-reads the state the hooks keep track of from the device after a
+    // state block changed it
+    void reload_tracked_state ();
+
 private:
 
     // DirectX state tracking
@@ -144,21 +169,115 @@ private:
     IDirect3DDevice9* inner;
     IDirect3DSurface9* back_buffer_surface;
     D3DPRESENT_PARAMETERS present_parameters;
+    void update_simulation_rate ();
+    bool create_hmd_resources ();
+    bool configure_sdk_rendering ();
+    void release_hmd_resources ();
+    void create_stereo_quad_buffer ();
+
+    // Set when inner is the pipelined device; flush before anything that
+    // uses the driver's device directly
+    Direct3DDevice9Pipeline* pipeline;
+    void flush_pipeline ();
 
     // OVR state tracking
     ovrHmd hmd;
-    ovrTrackingState tracking_state;
+    TrackingThread* tracking;
     ovrEyeRenderDesc eye_render_desc[2];
     ovrPosef head_pose[2];
 
+    // Late-latched pose helpers
+    bool head_pose_latched[2];
+    double head_pose_time[2];
+    double pose_age_total;
+    unsigned int pose_age_samples;
+    const ovrPosef& latch_head_pose (ovrEyeType eye);
+
+    // Just-in-time frame starts. Timestamp queries issued when the frame
+    // starts and once it's submitted tell how long the GPU spent on it,
+    // without ever waiting on them; the results come in while the next
+    // frame is held back.
+    bool just_in_time;
+    FramePacer pacer;
+    double frame_start_time;
+    IDirect3DQuery9* pacing_disjoint;
+    IDirect3DQuery9* pacing_frequency;
+    IDirect3DQuery9* pacing_begin;
+    IDirect3DQuery9* pacing_end;
+    bool pacing_measuring;
+    bool pacing_query_pending;
+    double pacing_cpu_time;
+    double pacing_delay_total;
+    unsigned int pacing_frames;
+    void begin_pacing_queries ();
+    void issue_pacing_query ();
+    void poll_pacing_query ();
+    void wait_for_frame_start (const ovrFrameTiming& frame_timing);
+
+    // GPU pass timings for [Debug] Instrument=1, null otherwise
+    GpuProfiler* profiler;
+    void profile (const char* scope);
+
+    // Set by [Debug] Capture. Distorted capture needs client distortion,
+    // since LibOVR presents its own pass straight away.
+    FrameCapture* capture;
+    bool capture_distorted;
+
     // Render target helpers
     bool stereo;
+    void set_stereo (bool stereo);
     bool render_distorted;
     bool reset_pressed;
     unsigned int frame_index;
     OVR::Sizei target_size;
     IDirect3DTexture9* hmd_texture;
 
+    // Native eye targets. With [Rendering] PixelDensity set, the frame is
+    // rendered at the size LibOVR recommends for the optics rather than the
+    // window's. Binding the back buffer binds eye_target instead, along with
+    // eye_depth in place of a window sized depth buffer, and viewports,
+    // scissor and clear rects are scaled to match. The game keeps seeing
+    // its own surfaces and viewport.
+    IDirect3DTexture9* eye_target;
+    IDirect3DSurface9* eye_target_surface;
+    IDirect3DSurface9* eye_depth;
+    IDirect3DSurface9* game_render_target;
+    IDirect3DSurface9* game_depth_stencil;
+    D3DVIEWPORT9 game_viewport;
+    RECT game_scissor;
+    bool redirected;
+    float frame_scale_x;
+    float frame_scale_y;
+    // Game pixels to eye target pixels, rounded, so edges the game lines
+    // up with the back buffer's stay lined up with the target's
+    LONG to_target_x (LONG x);
+    LONG to_target_y (LONG y);
+    void create_eye_targets (float pixel_density);
+    void release_eye_targets ();
+    bool is_back_buffer (IDirect3DSurface9* surface);
+    bool is_window_sized (IDirect3DSurface9* surface);
+    HRESULT bind_game_render_target ();
+    HRESULT bind_game_depth_stencil ();
+    IDirect3DSurface9* get_frame_surface ();
+
+    // Set when we draw the distortion pass instead of LibOVR
+    DistortionRenderer* distortion;
+    void present_client_distortion (const ovrRecti& left_viewport, const ovrRecti& right_viewport);
+
+    // Re-presenting the last frame from the render thread when the game
+    // misses a refresh. The lock keeps the eye texture and the pose it was
+    // rendered with in step; the scratch surface holds the game's half
+    // drawn back buffer while we borrow it.
+    CRITICAL_SECTION represent_lock;
+    FrameDeadline represent_deadline;
+    ovrPosef presented_pose[2];
+    IDirect3DStateBlock9* represent_state;
+    IDirect3DSurface9* represent_scratch;
+    unsigned int represent_count;
+    void create_represent_resources ();
+    static bool represent_when_late (void* context, IDirect3DDevice9* device, double now, double last_present);
+    void represent (IDirect3DDevice9* device);
+
     // UI stereo rendering helpers
     struct stream_source_info {
         UINT number;
@@ -172,9 +291,131 @@ private:
         D3DXVECTOR2 uv;
     };
     UINT stereo_quad_buffer_length;
+    DWORD stereo_quad_buffer_usage;
+    DWORD stereo_quad_buffer_fvf;
+    D3DPOOL stereo_quad_buffer_pool;
     UINT stereo_quad_buffer_offset;
     IDirect3DVertexBuffer9* stereo_quad_buffer;
 
-    // Scene stereo rendering helpers
+    // UI layer. Stereo UI quads are drawn once, unscaled, into a back
+    // buffer sized layer that Present composites into both eyes. The layer
+    // is only redrawn while the hash of the UI draw stream, which takes in
+    // how often each texture it samples has been written, keeps changing.
+    // Whether to redraw has to be settled before the first quad, but the
+    // hash is only known after the last one, so a change to a UI that was
+    // static reaches the eyes a frame late.
+    IDirect3DTexture9* ui_layer;
+    IDirect3DStateBlock9* ui_layer_state;
+    bool ui_layer_rebuild;
+    bool ui_layer_cleared;
+    bool ui_layer_volatile;
+    bool ui_layer_empty;
+    unsigned int ui_layer_draws;
+    unsigned __int64 ui_stream_hash;
+    unsigned __int64 ui_previous_hash;
+    unsigned __int64 ui_layer_hash;
+    IDirect3DBaseTexture9* current_texture;
+    DWORD ui_blend_state[7];
+    HRESULT draw_ui_into_layer (D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount, const D3DVIEWPORT9& viewport, const ui_vertex vertices[4]);
+    void composite_ui_layer ();
+
+    // Hidden area mask. A full clear of the stereo target's depth buffer
+    // has the next scene draw write the pixels the lenses can see into the
+    // depth format's top stencil bit, which the game's stencil masks are
+    // kept clear of. Scene draws that leave stencil off only pass there.
+    HiddenAreaMask* hidden_area;
+    IDirect3DStateBlock9* hidden_area_state;
+    IDirect3DSurface9* hidden_area_surface;
+    DWORD hidden_area_bit;
+    bool hidden_area_bound;
+    bool hidden_area_pending;
+    DWORD stencil_state[9];
+    void set_hidden_area_bit (DWORD bit);
+    void mark_hidden_area (DWORD Count, DWORD Flags);
+    void write_hidden_area ();
+    void force_hidden_area_test ();
+    void restore_stencil_state ();
+
+    // Draws go through the table for the current mode, swapped whenever
+    // the mode changes, so each draw runs straight-line code. In mono
+    // the table points at the inner device's own functions.
+    typedef HRESULT (STDMETHODCALLTYPE* draw_primitive_function)(IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount);
+    typedef HRESULT (STDMETHODCALLTYPE* draw_indexed_primitive_function)(IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount);
+    struct draw_dispatch {
+        IDirect3DDevice9* draw_primitive_device;
+        draw_primitive_function draw_primitive;
+        IDirect3DDevice9* draw_indexed_primitive_device;
+        draw_indexed_primitive_function draw_indexed_primitive;
+    };
+    draw_dispatch mono_draws;
+    draw_dispatch stereo_draws;
+    const draw_dispatch* draws;
+    void update_draw_dispatch ();
+    static HRESULT STDMETHODCALLTYPE draw_stereo_ui (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount);
+    static HRESULT STDMETHODCALLTYPE draw_stereo_scene (IDirect3DDevice9* device, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount);
+    HRESULT draw_ui_quad_both_eyes (D3DPRIMITIVETYPE PrimitiveType, UINT StartVertex, UINT PrimitiveCount);
+    HRESULT draw_scene_both_eyes (D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount);
+
+    // Scene stereo rendering helpers. Fixed function draws get their eye
+    // view and projection through the device's transforms instead of a
+    // shader constant.
     D3DXMATRIX model_matrix;
+    int wvp_register;
+    D3DXMATRIX fixed_world;
+    D3DXMATRIX fixed_view;
+    D3DXMATRIX fixed_projection;
+    D3DXMATRIX* fixed_transform (D3DTRANSFORMSTATETYPE State);
+    void set_scene_transform (const D3DXMATRIX& transform, const D3DXMATRIX& view, const D3DXMATRIX& projection);
+    void restore_scene_transform ();
+    D3DXVECTOR4 vertex_constants[256];
+    UINT vertex_constant_count;
+
+    // Deduplicated shaders and their analysis. Like the device, we hold a
+    // reference to the bound shaders.
+    ShaderRegistry shader_registry;
+    IDirect3DVertexShader9* current_vertex_shader;
+    IDirect3DPixelShader9* current_pixel_shader;
+    void track_vertex_shader (IDirect3DVertexShader9* shader);
+    void track_pixel_shader (IDirect3DPixelShader9* shader);
+
+    // Per-eye frustum culling helpers
+    position_layout position_stream;
+    int position_offset;
+    std::map<IDirect3DVertexDeclaration9*, int> declaration_position_offsets;
+    IDirect3DIndexBuffer9* current_indices;
+    MeshBoundsCache mesh_bounds_cache;
+    unsigned int cull_frames;
+    unsigned int cull_draws;
+    unsigned int cull_skipped[2];
+    D3DXMATRIX head_view (const ovrPosef& head_pose, const OVR::Vector3f& view_adjust) const;
+
+    // Far field layer. Meshes too far away for the eyes to see them apart
+    // are drawn once, from between the eyes, into an eye sized layer with
+    // its own depth buffer. The schedule says when it goes into the eyes.
+    IDirect3DTexture9* far_layer;
+    IDirect3DSurface9* far_depth;
+    IDirect3DStateBlock9* far_layer_state;
+    bool far_layer_bound; // The layer, not the game's targets, is bound for far draws
+    ovrFovPort far_field_fov;
+    FarFieldSchedule far_field;
+    D3DCOLOR last_clear_color;
+    float last_clear_z;
+    unsigned int far_draws;
+    void create_far_layer ();
+    HRESULT draw_far_field (const D3DXMATRIX& transform, const D3DXMATRIX& view, const D3DXMATRIX& projection, D3DPRIMITIVETYPE PrimitiveType, INT BaseVertexIndex, UINT MinVertexIndex, UINT NumVertices, UINT startIndex, UINT primCount);
+    void unbind_far_layer ();
+    void composite_far_layer ();
+    void finish_far_layer ();
+
+    // Texture sharing for [Rendering] TextureDedup=1. Wrapped textures are
+    // bound as whichever texture they share, so the device keeps the
+    // game's own per stage for GetTexture: pixel samplers 0-15 followed by
+    // the four vertex texture samplers. The UI layer also has managed
+    // textures wrapped, without sharing, to see when the game writes them.
+    bool texture_dedup;
+    bool wrap_textures;
+    Direct3DTexture9Hooks* bound_textures[20];
+    unsigned __int64 reported_saved_bytes;
+    static int texture_slot (DWORD Stage);
+    void release_bound_textures ();
 };
@@ -0,0 +1,1514 @@
+//====================================================================
+// Pipelined IDirect3DDevice9 interface implementation.
+//
+// The game thread encodes state changes and draws into a lock-free
+// ring and returns immediately; the render thread drains the ring into
+// the driver. Calls that return data or create resources fence the
+// ring and then run synchronously on the calling thread. The device
+// is created with D3DCREATE_MULTITHREADED in this mode, so resource
+// locks made directly by the game stay safe while the render thread
+// is busy.
+//
+// Objects referenced by a queued command are AddRef'd when encoded and
+// released after the command executes so the game can free them at
+// any time. Index buffers, lockable textures and queries are handed
+// out wrapped (see Direct3DResource9Pipeline.h) and unwrapped again
+// when they come back, so the ring only ever holds the real objects.
+//====================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Direct3DDevice9Pipeline.h"
+#include "Direct3DResource9Pipeline.h"
+#include "PipelineCommands.h"
+
+static double seconds_now ()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / frequency.QuadPart;
+}
+
+static void hold (IUnknown* object)
+{
+    if (object)
+    {
+        object->AddRef();
+    }
+}
+
+static void drop (IUnknown* object)
+{
+    if (object)
+    {
+        object->Release();
+    }
+}
+
+static BOOL copy_rect (const RECT* source, RECT* dest)
+{
+    if (!source)
+    {
+        return FALSE;
+    }
+    *dest = *source;
+    return TRUE;
+}
+
+static UINT vertex_count (D3DPRIMITIVETYPE type, UINT primitive_count)
+{
+    switch (type)
+    {
+        case D3DPT_POINTLIST: return primitive_count;
+        case D3DPT_LINELIST: return primitive_count * 2;
+        case D3DPT_LINESTRIP: return primitive_count + 1;
+        case D3DPT_TRIANGLELIST: return primitive_count * 3;
+        case D3DPT_TRIANGLESTRIP: return primitive_count + 2;
+        case D3DPT_TRIANGLEFAN: return primitive_count + 2;
+        default: return 0;
+    }
+}
+
+// State blocks write to the real device directly, so Capture and
+// Apply have to wait for the ring to drain first
+class Direct3DStateBlock9Pipeline : public IDirect3DStateBlock9
+{
+public:
+    Direct3DStateBlock9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DStateBlock9* inner)
+    {
+        this->pipeline = pipeline;
+        this->inner = inner;
+    }
+
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj)
+    {
+        return this->inner->QueryInterface(riid, ppvObj);
+    }
+
+    STDMETHOD_(ULONG,AddRef)(THIS)
+    {
+        return this->inner->AddRef();
+    }
+
+    STDMETHOD_(ULONG,Release)(THIS)
+    {
+        ULONG count = this->inner->Release();
+        if (count == 0)
+        {
+            delete this;
+        }
+        return count;
+    }
+
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice)
+    {
+        return this->inner->GetDevice(ppDevice);
+    }
+
+    STDMETHOD(Capture)(THIS)
+    {
+        this->pipeline->fence();
+        return this->inner->Capture();
+    }
+
+    STDMETHOD(Apply)(THIS)
+    {
+        this->pipeline->fence();
+        HRESULT result = this->inner->Apply();
+        this->pipeline->resync();
+        return result;
+    }
+
+private:
+    Direct3DDevice9Pipeline* pipeline;
+    IDirect3DStateBlock9* inner;
+};
+
+Direct3DDevice9Pipeline::Direct3DDevice9Pipeline (IDirect3DDevice9* device)
+    : ring(4 * 1024 * 1024)
+{
+    this->device = device;
+    this->stop = 0;
+    this->commands_submitted = 0;
+    this->commands_executed = 0;
+    this->presents_submitted = 0;
+    this->presents_executed = 0;
+    this->last_present_result = D3D_OK;
+    InitializeCriticalSection(&this->idle_lock);
+    this->idle_handler = 0;
+    this->idle_context = 0;
+    this->idle_period_ms = INFINITE;
+    this->direct_access = 0;
+    this->in_scene = false;
+    this->last_present_time = 0;
+    this->device->GetViewport(&this->viewport);
+    this->thread = CreateThread(NULL, 0, &Direct3DDevice9Pipeline::thread_main, this, 0, NULL);
+    SetThreadPriority(this->thread, THREAD_PRIORITY_ABOVE_NORMAL);
+}
+
+Direct3DDevice9Pipeline::~Direct3DDevice9Pipeline ()
+{
+    this->fence();
+    InterlockedExchange(&this->stop, 1);
+    this->ring.wake();
+    WaitForSingleObject(this->thread, INFINITE);
+    CloseHandle(this->thread);
+    DeleteCriticalSection(&this->idle_lock);
+}
+
+LONG Direct3DDevice9Pipeline::issue_query (IDirect3DQuery9* query, DWORD flags)
+{
+    command_issue_query_args* args = this->begin_command<command_issue_query_args>(COMMAND_ISSUE_QUERY);
+    args->query = query;
+    args->flags = flags;
+    hold(query);
+    this->end_command();
+    return this->commands_submitted;
+}
+
+void Direct3DDevice9Pipeline::set_idle_handler (pipeline_idle_handler handler, void* context, DWORD period_ms)
+{
+    EnterCriticalSection(&this->idle_lock);
+    this->idle_handler = handler;
+    this->idle_context = context;
+    this->idle_period_ms = handler ? period_ms : INFINITE;
+    LeaveCriticalSection(&this->idle_lock);
+    this->ring.wake();
+}
+
+void Direct3DDevice9Pipeline::resync ()
+{
+    this->fence();
+    this->device->GetViewport(&this->viewport);
+}
+
+void Direct3DDevice9Pipeline::end_command ()
+{
+    this->ring.commit();
+    InterlockedIncrement(&this->commands_submitted);
+    if (this->direct_access)
+    {
+        InterlockedExchange(&this->direct_access, 0);
+    }
+}
+
+void Direct3DDevice9Pipeline::fence ()
+{
+    while (this->commands_executed != this->commands_submitted)
+    {
+        this->ring.wake();
+        SwitchToThread();
+    }
+
+    // Taking the lock waits out an idle handler that is already running
+    EnterCriticalSection(&this->idle_lock);
+    InterlockedExchange(&this->direct_access, 1);
+    LeaveCriticalSection(&this->idle_lock);
+}
+
+void Direct3DDevice9Pipeline::idle ()
+{
+    EnterCriticalSection(&this->idle_lock);
+    if (this->idle_handler && !this->direct_access && this->ring.empty())
+    {
+        // The game may be stalled halfway through a frame
+        if (this->in_scene)
+        {
+            this->device->EndScene();
+        }
+        if (this->idle_handler(this->idle_context, this->device, seconds_now(), this->last_present_time))
+        {
+            this->last_present_time = seconds_now();
+        }
+        if (this->in_scene)
+        {
+            this->device->BeginScene();
+        }
+    }
+    LeaveCriticalSection(&this->idle_lock);
+}
+
+DWORD WINAPI Direct3DDevice9Pipeline::thread_main (LPVOID param)
+{
+    Direct3DDevice9Pipeline* self = (Direct3DDevice9Pipeline*)param;
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER report_start;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&report_start);
+    unsigned int executed = 0;
+    for (;;)
+    {
+        const command_header* command = self->ring.peek();
+        if (!command)
+        {
+            if (self->stop)
+            {
+                break;
+            }
+            self->ring.wait_for_work(self->idle_period_ms);
+            if (self->idle_handler && self->ring.empty())
+            {
+                self->idle();
+            }
+            continue;
+        }
+        self->execute(command);
+        self->ring.release(command);
+        InterlockedIncrement(&self->commands_executed);
+
+        // Periodically report how fast the ring drains
+        if (++executed == 100000)
+        {
+            LARGE_INTEGER now;
+            QueryPerformanceCounter(&now);
+            double seconds = (double)(now.QuadPart - report_start.QuadPart) / frequency.QuadPart;
+            char message[128];
+            sprintf_s(message, "PinballVRcade: render thread drained %.0f commands/s\n", executed / seconds);
+            OutputDebugStringA(message);
+            report_start = now;
+            executed = 0;
+        }
+    }
+    return 0;
+}
+
+void Direct3DDevice9Pipeline::execute (const command_header* command)
+{
+    switch (command->opcode)
+    {
+        case COMMAND_SET_RENDER_STATE:
+        {
+            const command_set_render_state_args* args = (const command_set_render_state_args*)(command + 1);
+            this->device->SetRenderState(args->State, args->Value);
+            break;
+        }
+        case COMMAND_SET_SAMPLER_STATE:
+        {
+            const command_set_sampler_state_args* args = (const command_set_sampler_state_args*)(command + 1);
+            this->device->SetSamplerState(args->Sampler, args->Type, args->Value);
+            break;
+        }
+        case COMMAND_SET_TEXTURE_STAGE_STATE:
+        {
+            const command_set_texture_stage_state_args* args = (const command_set_texture_stage_state_args*)(command + 1);
+            this->device->SetTextureStageState(args->Stage, args->Type, args->Value);
+            break;
+        }
+        case COMMAND_SET_TEXTURE:
+        {
+            const command_set_texture_args* args = (const command_set_texture_args*)(command + 1);
+            this->device->SetTexture(args->Stage, args->pTexture);
+            drop(args->pTexture);
+            break;
+        }
+        case COMMAND_SET_STREAM_SOURCE:
+        {
+            const command_set_stream_source_args* args = (const command_set_stream_source_args*)(command + 1);
+            this->device->SetStreamSource(args->StreamNumber, args->pStreamData, args->OffsetInBytes, args->Stride);
+            drop(args->pStreamData);
+            break;
+        }
+        case COMMAND_SET_STREAM_SOURCE_FREQ:
+        {
+            const command_set_stream_source_freq_args* args = (const command_set_stream_source_freq_args*)(command + 1);
+            this->device->SetStreamSourceFreq(args->StreamNumber, args->Setting);
+            break;
+        }
+        case COMMAND_SET_INDICES:
+        {
+            const command_set_indices_args* args = (const command_set_indices_args*)(command + 1);
+            this->device->SetIndices(args->pIndexData);
+            drop(args->pIndexData);
+            break;
+        }
+        case COMMAND_SET_VERTEX_DECLARATION:
+        {
+            const command_set_vertex_declaration_args* args = (const command_set_vertex_declaration_args*)(command + 1);
+            this->device->SetVertexDeclaration(args->pDecl);
+            drop(args->pDecl);
+            break;
+        }
+        case COMMAND_SET_FVF:
+        {
+            const command_set_fvf_args* args = (const command_set_fvf_args*)(command + 1);
+            this->device->SetFVF(args->FVF);
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER:
+        {
+            const command_set_vertex_shader_args* args = (const command_set_vertex_shader_args*)(command + 1);
+            this->device->SetVertexShader(args->pShader);
+            drop(args->pShader);
+            break;
+        }
+        case COMMAND_SET_PIXEL_SHADER:
+        {
+            const command_set_pixel_shader_args* args = (const command_set_pixel_shader_args*)(command + 1);
+            this->device->SetPixelShader(args->pShader);
+            drop(args->pShader);
+            break;
+        }
+        case COMMAND_LIGHT_ENABLE:
+        {
+            const command_light_enable_args* args = (const command_light_enable_args*)(command + 1);
+            this->device->LightEnable(args->Index, args->Enable);
+            break;
+        }
+        case COMMAND_BEGIN_SCENE:
+            this->device->BeginScene();
+            this->in_scene = true;
+            break;
+        case COMMAND_END_SCENE:
+            this->device->EndScene();
+            this->in_scene = false;
+            break;
+        case COMMAND_DRAW_PRIMITIVE:
+        {
+            const command_draw_primitive_args* args = (const command_draw_primitive_args*)(command + 1);
+            this->device->DrawPrimitive(args->PrimitiveType, args->StartVertex, args->PrimitiveCount);
+            break;
+        }
+        case COMMAND_DRAW_INDEXED_PRIMITIVE:
+        {
+            const command_draw_indexed_primitive_args* args = (const command_draw_indexed_primitive_args*)(command + 1);
+            this->device->DrawIndexedPrimitive(args->PrimitiveType, args->BaseVertexIndex, args->MinVertexIndex, args->NumVertices, args->startIndex, args->primCount);
+            break;
+        }
+        case COMMAND_SET_DEPTH_STENCIL_SURFACE:
+        {
+            const command_set_depth_stencil_surface_args* args = (const command_set_depth_stencil_surface_args*)(command + 1);
+            this->device->SetDepthStencilSurface(args->pNewZStencil);
+            drop(args->pNewZStencil);
+            break;
+        }
+        case COMMAND_SET_VIEWPORT:
+        {
+            const command_set_viewport_args* args = (const command_set_viewport_args*)(command + 1);
+            this->device->SetViewport(&args->value);
+            break;
+        }
+        case COMMAND_SET_SCISSOR_RECT:
+        {
+            const command_set_scissor_rect_args* args = (const command_set_scissor_rect_args*)(command + 1);
+            this->device->SetScissorRect(&args->value);
+            break;
+        }
+        case COMMAND_SET_TRANSFORM:
+        {
+            const command_set_transform_args* args = (const command_set_transform_args*)(command + 1);
+            this->device->SetTransform(args->State, &args->value);
+            break;
+        }
+        case COMMAND_SET_MATERIAL:
+        {
+            const command_set_material_args* args = (const command_set_material_args*)(command + 1);
+            this->device->SetMaterial(&args->value);
+            break;
+        }
+        case COMMAND_SET_LIGHT:
+        {
+            const command_set_light_args* args = (const command_set_light_args*)(command + 1);
+            this->device->SetLight(args->Index, &args->value);
+            break;
+        }
+        case COMMAND_SET_CLIP_PLANE:
+        {
+            const command_set_clip_plane_args* args = (const command_set_clip_plane_args*)(command + 1);
+            this->device->SetClipPlane(args->Index, args->plane);
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER_CONSTANT_F:
+        {
+            const command_set_vertex_shader_constant_f_args* args = (const command_set_vertex_shader_constant_f_args*)(command + 1);
+            this->device->SetVertexShaderConstantF(args->StartRegister, (const float*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER_CONSTANT_I:
+        {
+            const command_set_vertex_shader_constant_i_args* args = (const command_set_vertex_shader_constant_i_args*)(command + 1);
+            this->device->SetVertexShaderConstantI(args->StartRegister, (const int*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER_CONSTANT_B:
+        {
+            const command_set_vertex_shader_constant_b_args* args = (const command_set_vertex_shader_constant_b_args*)(command + 1);
+            this->device->SetVertexShaderConstantB(args->StartRegister, (const BOOL*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_PIXEL_SHADER_CONSTANT_F:
+        {
+            const command_set_pixel_shader_constant_f_args* args = (const command_set_pixel_shader_constant_f_args*)(command + 1);
+            this->device->SetPixelShaderConstantF(args->StartRegister, (const float*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_PIXEL_SHADER_CONSTANT_I:
+        {
+            const command_set_pixel_shader_constant_i_args* args = (const command_set_pixel_shader_constant_i_args*)(command + 1);
+            this->device->SetPixelShaderConstantI(args->StartRegister, (const int*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_PIXEL_SHADER_CONSTANT_B:
+        {
+            const command_set_pixel_shader_constant_b_args* args = (const command_set_pixel_shader_constant_b_args*)(command + 1);
+            this->device->SetPixelShaderConstantB(args->StartRegister, (const BOOL*)(args + 1), args->count);
+            break;
+        }
+        case COMMAND_SET_RENDER_TARGET:
+        {
+            const command_set_render_target_args* args = (const command_set_render_target_args*)(command + 1);
+            this->device->SetRenderTarget(args->RenderTargetIndex, args->pRenderTarget);
+            drop(args->pRenderTarget);
+            break;
+        }
+        case COMMAND_CLEAR:
+        {
+            const command_clear_args* args = (const command_clear_args*)(command + 1);
+            this->device->Clear(args->Count, args->Count ? (const D3DRECT*)(args + 1) : NULL, args->Flags, args->Color, args->Z, args->Stencil);
+            break;
+        }
+        case COMMAND_DRAW_PRIMITIVE_UP:
+        {
+            const command_draw_primitive_up_args* args = (const command_draw_primitive_up_args*)(command + 1);
+            this->device->DrawPrimitiveUP(args->PrimitiveType, args->PrimitiveCount, args + 1, args->VertexStreamZeroStride);
+            break;
+        }
+        case COMMAND_DRAW_INDEXED_PRIMITIVE_UP:
+        {
+            const command_draw_indexed_primitive_up_args* args = (const command_draw_indexed_primitive_up_args*)(command + 1);
+            const unsigned char* data = (const unsigned char*)(args + 1);
+            this->device->DrawIndexedPrimitiveUP(args->PrimitiveType, args->MinVertexIndex, args->NumVertices, args->PrimitiveCount, data, args->IndexDataFormat, data + args->index_bytes, args->VertexStreamZeroStride);
+            break;
+        }
+        case COMMAND_STRETCH_RECT:
+        {
+            const command_stretch_rect_args* args = (const command_stretch_rect_args*)(command + 1);
+            this->device->StretchRect(
+                args->pSourceSurface,
+                args->has_source_rect ? &args->source_rect : NULL,
+                args->pDestSurface,
+                args->has_dest_rect ? &args->dest_rect : NULL,
+                args->Filter
+            );
+            drop(args->pSourceSurface);
+            drop(args->pDestSurface);
+            break;
+        }
+        case COMMAND_COLOR_FILL:
+        {
+            const command_color_fill_args* args = (const command_color_fill_args*)(command + 1);
+            this->device->ColorFill(args->pSurface, args->has_rect ? &args->rect : NULL, args->color);
+            drop(args->pSurface);
+            break;
+        }
+        case COMMAND_PRESENT:
+        {
+            const command_present_args* args = (const command_present_args*)(command + 1);
+            this->last_present_result = this->device->Present(
+                args->has_source_rect ? &args->source_rect : NULL,
+                args->has_dest_rect ? &args->dest_rect : NULL,
+                args->hDestWindowOverride,
+                NULL
+            );
+            this->last_present_time = seconds_now();
+            InterlockedIncrement(&this->presents_executed);
+            break;
+        }
+        case COMMAND_ISSUE_QUERY:
+        {
+            const command_issue_query_args* args = (const command_issue_query_args*)(command + 1);
+            args->query->Issue(args->flags);
+            drop(args->query);
+            break;
+        }
+    }
+}
+
+HRESULT Direct3DDevice9Pipeline::QueryInterface (REFIID riid, void** ppvObj)
+{
+    return this->device->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DDevice9Pipeline::AddRef ()
+{
+    return this->device->AddRef();
+}
+
+ULONG Direct3DDevice9Pipeline::Release ()
+{
+    this->fence();
+    ULONG count = this->device->Release();
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+HRESULT Direct3DDevice9Pipeline::TestCooperativeLevel ()
+{
+    this->fence();
+    return this->device->TestCooperativeLevel();
+}
+
+UINT Direct3DDevice9Pipeline::GetAvailableTextureMem ()
+{
+    this->fence();
+    return this->device->GetAvailableTextureMem();
+}
+
+HRESULT Direct3DDevice9Pipeline::EvictManagedResources ()
+{
+    this->fence();
+    return this->device->EvictManagedResources();
+}
+
+HRESULT Direct3DDevice9Pipeline::GetDirect3D (IDirect3D9** ppD3D9)
+{
+    this->fence();
+    return this->device->GetDirect3D(ppD3D9);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetDeviceCaps (D3DCAPS9* pCaps)
+{
+    this->fence();
+    return this->device->GetDeviceCaps(pCaps);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetDisplayMode (UINT iSwapChain,D3DDISPLAYMODE* pMode)
+{
+    this->fence();
+    return this->device->GetDisplayMode(iSwapChain, pMode);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetCreationParameters (D3DDEVICE_CREATION_PARAMETERS *pParameters)
+{
+    this->fence();
+    return this->device->GetCreationParameters(pParameters);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetCursorProperties (UINT XHotSpot,UINT YHotSpot,IDirect3DSurface9* pCursorBitmap)
+{
+    this->fence();
+    return this->device->SetCursorProperties(XHotSpot, YHotSpot, Direct3DSurface9Pipeline::unwrap(pCursorBitmap));
+}
+
+void Direct3DDevice9Pipeline::SetCursorPosition (int X,int Y,DWORD Flags)
+{
+    this->fence();
+    return this->device->SetCursorPosition(X, Y, Flags);
+}
+
+BOOL Direct3DDevice9Pipeline::ShowCursor (BOOL bShow)
+{
+    this->fence();
+    return this->device->ShowCursor(bShow);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateAdditionalSwapChain (D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DSwapChain9** pSwapChain)
+{
+    this->fence();
+    return this->device->CreateAdditionalSwapChain(pPresentationParameters, pSwapChain);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetSwapChain (UINT iSwapChain,IDirect3DSwapChain9** pSwapChain)
+{
+    this->fence();
+    return this->device->GetSwapChain(iSwapChain, pSwapChain);
+}
+
+UINT Direct3DDevice9Pipeline::GetNumberOfSwapChains ()
+{
+    this->fence();
+    return this->device->GetNumberOfSwapChains();
+}
+
+HRESULT Direct3DDevice9Pipeline::Reset (D3DPRESENT_PARAMETERS* pPresentationParameters)
+{
+    this->fence();
+    HRESULT result = this->device->Reset(pPresentationParameters);
+    this->resync();
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::Present (CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion)
+{
+    // Dirty regions are only a hint, so they're dropped rather than copied
+    command_present_args* args = this->begin_command<command_present_args>(COMMAND_PRESENT);
+    args->has_source_rect = copy_rect(pSourceRect, &args->source_rect);
+    args->has_dest_rect = copy_rect(pDestRect, &args->dest_rect);
+    args->hDestWindowOverride = hDestWindowOverride;
+    this->end_command();
+
+    // Don't let the game get more than a frame ahead of the render thread. Errors
+    // like D3DERR_DEVICELOST surface one Present late, which the game's
+    // TestCooperativeLevel handling copes with.
+    InterlockedIncrement(&this->presents_submitted);
+    while (this->presents_submitted - this->presents_executed > 1)
+    {
+        SwitchToThread();
+    }
+    return this->last_present_result;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetBackBuffer (UINT iSwapChain,UINT iBackBuffer,D3DBACKBUFFER_TYPE Type,IDirect3DSurface9** ppBackBuffer)
+{
+    this->fence();
+    return this->device->GetBackBuffer(iSwapChain, iBackBuffer, Type, ppBackBuffer);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetRasterStatus (UINT iSwapChain,D3DRASTER_STATUS* pRasterStatus)
+{
+    this->fence();
+    return this->device->GetRasterStatus(iSwapChain, pRasterStatus);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetDialogBoxMode (BOOL bEnableDialogs)
+{
+    this->fence();
+    return this->device->SetDialogBoxMode(bEnableDialogs);
+}
+
+void Direct3DDevice9Pipeline::SetGammaRamp (UINT iSwapChain,DWORD Flags,CONST D3DGAMMARAMP* pRamp)
+{
+    this->fence();
+    return this->device->SetGammaRamp(iSwapChain, Flags, pRamp);
+}
+
+void Direct3DDevice9Pipeline::GetGammaRamp (UINT iSwapChain,D3DGAMMARAMP* pRamp)
+{
+    this->fence();
+    return this->device->GetGammaRamp(iSwapChain, pRamp);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateTexture (UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle)
+{
+    this->fence();
+    HRESULT result = this->device->CreateTexture(Width, Height, Levels, Usage, Format, Pool, ppTexture, pSharedHandle);
+    if (SUCCEEDED(result) && (Pool == D3DPOOL_MANAGED || (Usage & D3DUSAGE_DYNAMIC)))
+    {
+        *ppTexture = new Direct3DTexture9Pipeline(this, *ppTexture);
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateVolumeTexture (UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateVolumeTexture(Width, Height, Depth, Levels, Usage, Format, Pool, ppVolumeTexture, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateCubeTexture (UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateCubeTexture(EdgeLength, Levels, Usage, Format, Pool, ppCubeTexture, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateVertexBuffer (UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateVertexBuffer(Length, Usage, FVF, Pool, ppVertexBuffer, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateIndexBuffer (UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle)
+{
+    this->fence();
+    HRESULT result = this->device->CreateIndexBuffer(Length, Usage, Format, Pool, ppIndexBuffer, pSharedHandle);
+    if (SUCCEEDED(result))
+    {
+        *ppIndexBuffer = new Direct3DIndexBuffer9Pipeline(this, *ppIndexBuffer);
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateRenderTarget (UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Lockable,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateRenderTarget(Width, Height, Format, MultiSample, MultisampleQuality, Lockable, ppSurface, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateDepthStencilSurface (UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Discard,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateDepthStencilSurface(Width, Height, Format, MultiSample, MultisampleQuality, Discard, ppSurface, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::UpdateSurface (IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint)
+{
+    this->fence();
+    return this->device->UpdateSurface(Direct3DSurface9Pipeline::unwrap(pSourceSurface), pSourceRect, Direct3DSurface9Pipeline::unwrap(pDestinationSurface), pDestPoint);
+}
+
+HRESULT Direct3DDevice9Pipeline::UpdateTexture (IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture)
+{
+    this->fence();
+    return this->device->UpdateTexture(Direct3DTexture9Pipeline::unwrap(pSourceTexture), Direct3DTexture9Pipeline::unwrap(pDestinationTexture));
+}
+
+HRESULT Direct3DDevice9Pipeline::GetRenderTargetData (IDirect3DSurface9* pRenderTarget,IDirect3DSurface9* pDestSurface)
+{
+    this->fence();
+    return this->device->GetRenderTargetData(pRenderTarget, Direct3DSurface9Pipeline::unwrap(pDestSurface));
+}
+
+HRESULT Direct3DDevice9Pipeline::GetFrontBufferData (UINT iSwapChain,IDirect3DSurface9* pDestSurface)
+{
+    this->fence();
+    return this->device->GetFrontBufferData(iSwapChain, Direct3DSurface9Pipeline::unwrap(pDestSurface));
+}
+
+HRESULT Direct3DDevice9Pipeline::StretchRect (IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestSurface,CONST RECT* pDestRect,D3DTEXTUREFILTERTYPE Filter)
+{
+    pSourceSurface = Direct3DSurface9Pipeline::unwrap(pSourceSurface);
+    pDestSurface = Direct3DSurface9Pipeline::unwrap(pDestSurface);
+    command_stretch_rect_args* args = this->begin_command<command_stretch_rect_args>(COMMAND_STRETCH_RECT);
+    args->pSourceSurface = pSourceSurface;
+    args->pDestSurface = pDestSurface;
+    args->Filter = Filter;
+    args->has_source_rect = copy_rect(pSourceRect, &args->source_rect);
+    args->has_dest_rect = copy_rect(pDestRect, &args->dest_rect);
+    hold(pSourceSurface);
+    hold(pDestSurface);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::ColorFill (IDirect3DSurface9* pSurface,CONST RECT* pRect,D3DCOLOR color)
+{
+    pSurface = Direct3DSurface9Pipeline::unwrap(pSurface);
+    command_color_fill_args* args = this->begin_command<command_color_fill_args>(COMMAND_COLOR_FILL);
+    args->pSurface = pSurface;
+    args->has_rect = copy_rect(pRect, &args->rect);
+    args->color = color;
+    hold(pSurface);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateOffscreenPlainSurface (UINT Width,UINT Height,D3DFORMAT Format,D3DPOOL Pool,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle)
+{
+    this->fence();
+    return this->device->CreateOffscreenPlainSurface(Width, Height, Format, Pool, ppSurface, pSharedHandle);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget)
+{
+    // Setting render target 0 resets the viewport to cover it
+    if (RenderTargetIndex == 0 && pRenderTarget)
+    {
+        D3DSURFACE_DESC desc;
+        pRenderTarget->GetDesc(&desc);
+        this->viewport.X = 0;
+        this->viewport.Y = 0;
+        this->viewport.Width = desc.Width;
+        this->viewport.Height = desc.Height;
+        this->viewport.MinZ = 0.0f;
+        this->viewport.MaxZ = 1.0f;
+    }
+    command_set_render_target_args* args = this->begin_command<command_set_render_target_args>(COMMAND_SET_RENDER_TARGET);
+    args->RenderTargetIndex = RenderTargetIndex;
+    args->pRenderTarget = pRenderTarget;
+    hold(pRenderTarget);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetRenderTarget (DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget)
+{
+    this->fence();
+    return this->device->GetRenderTarget(RenderTargetIndex, ppRenderTarget);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetDepthStencilSurface (IDirect3DSurface9* pNewZStencil)
+{
+    command_set_depth_stencil_surface_args* args = this->begin_command<command_set_depth_stencil_surface_args>(COMMAND_SET_DEPTH_STENCIL_SURFACE);
+    args->pNewZStencil = pNewZStencil;
+    hold(pNewZStencil);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetDepthStencilSurface (IDirect3DSurface9** ppZStencilSurface)
+{
+    this->fence();
+    return this->device->GetDepthStencilSurface(ppZStencilSurface);
+}
+
+HRESULT Direct3DDevice9Pipeline::BeginScene ()
+{
+    this->ring.reserve(COMMAND_BEGIN_SCENE, sizeof(command_header));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::EndScene ()
+{
+    this->ring.reserve(COMMAND_END_SCENE, sizeof(command_header));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::Clear (DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil)
+{
+    DWORD rect_count = pRects ? Count : 0;
+    if (!this->fits(rect_count * sizeof(D3DRECT)))
+    {
+        this->fence();
+        return this->device->Clear(Count, pRects, Flags, Color, Z, Stencil);
+    }
+    command_clear_args* args = this->begin_command<command_clear_args>(COMMAND_CLEAR, rect_count * sizeof(D3DRECT));
+    args->Count = rect_count;
+    args->Flags = Flags;
+    args->Color = Color;
+    args->Z = Z;
+    args->Stencil = Stencil;
+    memcpy(args + 1, pRects, rect_count * sizeof(D3DRECT));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::SetTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix)
+{
+    command_set_transform_args* args = this->begin_command<command_set_transform_args>(COMMAND_SET_TRANSFORM);
+    args->State = State;
+    args->value = *pMatrix;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetTransform (D3DTRANSFORMSTATETYPE State,D3DMATRIX* pMatrix)
+{
+    this->fence();
+    return this->device->GetTransform(State, pMatrix);
+}
+
+HRESULT Direct3DDevice9Pipeline::MultiplyTransform (D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix)
+{
+    this->fence();
+    return this->device->MultiplyTransform(State, pMatrix);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetViewport (CONST D3DVIEWPORT9* pViewport)
+{
+    // Remember it so GetViewport doesn't need a round trip
+    this->viewport = *pViewport;
+    command_set_viewport_args* args = this->begin_command<command_set_viewport_args>(COMMAND_SET_VIEWPORT);
+    args->value = *pViewport;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetViewport (D3DVIEWPORT9* pViewport)
+{
+    *pViewport = this->viewport;
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::SetMaterial (CONST D3DMATERIAL9* pMaterial)
+{
+    command_set_material_args* args = this->begin_command<command_set_material_args>(COMMAND_SET_MATERIAL);
+    args->value = *pMaterial;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetMaterial (D3DMATERIAL9* pMaterial)
+{
+    this->fence();
+    return this->device->GetMaterial(pMaterial);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetLight (DWORD Index,CONST D3DLIGHT9* pLight)
+{
+    command_set_light_args* args = this->begin_command<command_set_light_args>(COMMAND_SET_LIGHT);
+    args->Index = Index;
+    args->value = *pLight;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetLight (DWORD Index,D3DLIGHT9* pLight)
+{
+    this->fence();
+    return this->device->GetLight(Index, pLight);
+}
+
+HRESULT Direct3DDevice9Pipeline::LightEnable (DWORD Index,BOOL Enable)
+{
+    command_light_enable_args* args = this->begin_command<command_light_enable_args>(COMMAND_LIGHT_ENABLE);
+    args->Index = Index;
+    args->Enable = Enable;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetLightEnable (DWORD Index,BOOL* pEnable)
+{
+    this->fence();
+    return this->device->GetLightEnable(Index, pEnable);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetClipPlane (DWORD Index,CONST float* pPlane)
+{
+    command_set_clip_plane_args* args = this->begin_command<command_set_clip_plane_args>(COMMAND_SET_CLIP_PLANE);
+    args->Index = Index;
+    memcpy(args->plane, pPlane, sizeof(args->plane));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetClipPlane (DWORD Index,float* pPlane)
+{
+    this->fence();
+    return this->device->GetClipPlane(Index, pPlane);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetRenderState (D3DRENDERSTATETYPE State,DWORD Value)
+{
+    command_set_render_state_args* args = this->begin_command<command_set_render_state_args>(COMMAND_SET_RENDER_STATE);
+    args->State = State;
+    args->Value = Value;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetRenderState (D3DRENDERSTATETYPE State,DWORD* pValue)
+{
+    this->fence();
+    return this->device->GetRenderState(State, pValue);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateStateBlock (D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB)
+{
+    this->fence();
+    HRESULT result = this->device->CreateStateBlock(Type, ppSB);
+    if (SUCCEEDED(result))
+    {
+        *ppSB = new Direct3DStateBlock9Pipeline(this, *ppSB);
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::BeginStateBlock ()
+{
+    this->fence();
+    return this->device->BeginStateBlock();
+}
+
+HRESULT Direct3DDevice9Pipeline::EndStateBlock (IDirect3DStateBlock9** ppSB)
+{
+    this->fence();
+    HRESULT result = this->device->EndStateBlock(ppSB);
+    if (SUCCEEDED(result))
+    {
+        *ppSB = new Direct3DStateBlock9Pipeline(this, *ppSB);
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::SetClipStatus (CONST D3DCLIPSTATUS9* pClipStatus)
+{
+    this->fence();
+    return this->device->SetClipStatus(pClipStatus);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetClipStatus (D3DCLIPSTATUS9* pClipStatus)
+{
+    this->fence();
+    return this->device->GetClipStatus(pClipStatus);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetTexture (DWORD Stage,IDirect3DBaseTexture9** ppTexture)
+{
+    this->fence();
+    HRESULT result = this->device->GetTexture(Stage, ppTexture);
+    if (SUCCEEDED(result) && *ppTexture)
+    {
+        Direct3DTexture9Pipeline* wrapper = Direct3DTexture9Pipeline::wrapper_of(*ppTexture);
+        if (wrapper)
+        {
+            wrapper->AddRef();
+            (*ppTexture)->Release();
+            *ppTexture = wrapper;
+        }
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::SetTexture (DWORD Stage,IDirect3DBaseTexture9* pTexture)
+{
+    pTexture = Direct3DTexture9Pipeline::unwrap(pTexture);
+    command_set_texture_args* args = this->begin_command<command_set_texture_args>(COMMAND_SET_TEXTURE);
+    args->Stage = Stage;
+    args->pTexture = pTexture;
+    hold(pTexture);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetTextureStageState (DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue)
+{
+    this->fence();
+    return this->device->GetTextureStageState(Stage, Type, pValue);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetTextureStageState (DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD Value)
+{
+    command_set_texture_stage_state_args* args = this->begin_command<command_set_texture_stage_state_args>(COMMAND_SET_TEXTURE_STAGE_STATE);
+    args->Stage = Stage;
+    args->Type = Type;
+    args->Value = Value;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetSamplerState (DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD* pValue)
+{
+    this->fence();
+    return this->device->GetSamplerState(Sampler, Type, pValue);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetSamplerState (DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value)
+{
+    command_set_sampler_state_args* args = this->begin_command<command_set_sampler_state_args>(COMMAND_SET_SAMPLER_STATE);
+    args->Sampler = Sampler;
+    args->Type = Type;
+    args->Value = Value;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::ValidateDevice (DWORD* pNumPasses)
+{
+    this->fence();
+    return this->device->ValidateDevice(pNumPasses);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetPaletteEntries (UINT PaletteNumber,CONST PALETTEENTRY* pEntries)
+{
+    this->fence();
+    return this->device->SetPaletteEntries(PaletteNumber, pEntries);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetPaletteEntries (UINT PaletteNumber,PALETTEENTRY* pEntries)
+{
+    this->fence();
+    return this->device->GetPaletteEntries(PaletteNumber, pEntries);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetCurrentTexturePalette (UINT PaletteNumber)
+{
+    this->fence();
+    return this->device->SetCurrentTexturePalette(PaletteNumber);
+}
+
+HRESULT Direct3DDevice9Pipeline::GetCurrentTexturePalette (UINT *PaletteNumber)
+{
+    this->fence();
+    return this->device->GetCurrentTexturePalette(PaletteNumber);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetScissorRect (CONST RECT* pRect)
+{
+    command_set_scissor_rect_args* args = this->begin_command<command_set_scissor_rect_args>(COMMAND_SET_SCISSOR_RECT);
+    args->value = *pRect;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetScissorRect (RECT* pRect)
+{
+    this->fence();
+    return this->device->GetScissorRect(pRect);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetSoftwareVertexProcessing (BOOL bSoftware)
+{
+    this->fence();
+    return this->device->SetSoftwareVertexProcessing(bSoftware);
+}
+
+BOOL Direct3DDevice9Pipeline::GetSoftwareVertexProcessing ()
+{
+    this->fence();
+    return this->device->GetSoftwareVertexProcessing();
+}
+
+HRESULT Direct3DDevice9Pipeline::SetNPatchMode (float nSegments)
+{
+    this->fence();
+    return this->device->SetNPatchMode(nSegments);
+}
+
+float Direct3DDevice9Pipeline::GetNPatchMode ()
+{
+    this->fence();
+    return this->device->GetNPatchMode();
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawPrimitive (D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount)
+{
+    command_draw_primitive_args* args = this->begin_command<command_draw_primitive_args>(COMMAND_DRAW_PRIMITIVE);
+    args->PrimitiveType = PrimitiveType;
+    args->StartVertex = StartVertex;
+    args->PrimitiveCount = PrimitiveCount;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawIndexedPrimitive (D3DPRIMITIVETYPE PrimitiveType,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount)
+{
+    command_draw_indexed_primitive_args* args = this->begin_command<command_draw_indexed_primitive_args>(COMMAND_DRAW_INDEXED_PRIMITIVE);
+    args->PrimitiveType = PrimitiveType;
+    args->BaseVertexIndex = BaseVertexIndex;
+    args->MinVertexIndex = MinVertexIndex;
+    args->NumVertices = NumVertices;
+    args->startIndex = startIndex;
+    args->primCount = primCount;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
+{
+    DWORD vertex_bytes = vertex_count(PrimitiveType, PrimitiveCount) * VertexStreamZeroStride;
+    if (!this->fits(vertex_bytes))
+    {
+        this->fence();
+        return this->device->DrawPrimitiveUP(PrimitiveType, PrimitiveCount, pVertexStreamZeroData, VertexStreamZeroStride);
+    }
+    command_draw_primitive_up_args* args = this->begin_command<command_draw_primitive_up_args>(COMMAND_DRAW_PRIMITIVE_UP, vertex_bytes);
+    args->PrimitiveType = PrimitiveType;
+    args->PrimitiveCount = PrimitiveCount;
+    args->VertexStreamZeroStride = VertexStreamZeroStride;
+    memcpy(args + 1, pVertexStreamZeroData, vertex_bytes);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawIndexedPrimitiveUP (D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride)
+{
+    // Indices are absolute, so copy every vertex up to the highest one used
+    DWORD index_bytes = vertex_count(PrimitiveType, PrimitiveCount) * (IndexDataFormat == D3DFMT_INDEX32 ? 4 : 2);
+    index_bytes = (index_bytes + 7) & ~7u;
+    DWORD vertex_bytes = (MinVertexIndex + NumVertices) * VertexStreamZeroStride;
+    if (!this->fits(index_bytes + vertex_bytes))
+    {
+        this->fence();
+        return this->device->DrawIndexedPrimitiveUP(PrimitiveType, MinVertexIndex, NumVertices, PrimitiveCount, pIndexData, IndexDataFormat, pVertexStreamZeroData, VertexStreamZeroStride);
+    }
+    command_draw_indexed_primitive_up_args* args = this->begin_command<command_draw_indexed_primitive_up_args>(COMMAND_DRAW_INDEXED_PRIMITIVE_UP, index_bytes + vertex_bytes);
+    args->PrimitiveType = PrimitiveType;
+    args->MinVertexIndex = MinVertexIndex;
+    args->NumVertices = NumVertices;
+    args->PrimitiveCount = PrimitiveCount;
+    args->IndexDataFormat = IndexDataFormat;
+    args->VertexStreamZeroStride = VertexStreamZeroStride;
+    args->index_bytes = index_bytes;
+    memcpy(args + 1, pIndexData, vertex_count(PrimitiveType, PrimitiveCount) * (IndexDataFormat == D3DFMT_INDEX32 ? 4 : 2));
+    memcpy((unsigned char*)(args + 1) + index_bytes, pVertexStreamZeroData, vertex_bytes);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::ProcessVertices (UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags)
+{
+    this->fence();
+    return this->device->ProcessVertices(SrcStartIndex, DestIndex, VertexCount, pDestBuffer, pVertexDecl, Flags);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateVertexDeclaration (CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl)
+{
+    this->fence();
+    return this->device->CreateVertexDeclaration(pVertexElements, ppDecl);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetVertexDeclaration (IDirect3DVertexDeclaration9* pDecl)
+{
+    command_set_vertex_declaration_args* args = this->begin_command<command_set_vertex_declaration_args>(COMMAND_SET_VERTEX_DECLARATION);
+    args->pDecl = pDecl;
+    hold(pDecl);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetVertexDeclaration (IDirect3DVertexDeclaration9** ppDecl)
+{
+    this->fence();
+    return this->device->GetVertexDeclaration(ppDecl);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetFVF (DWORD FVF)
+{
+    command_set_fvf_args* args = this->begin_command<command_set_fvf_args>(COMMAND_SET_FVF);
+    args->FVF = FVF;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetFVF (DWORD* pFVF)
+{
+    this->fence();
+    return this->device->GetFVF(pFVF);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateVertexShader (CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader)
+{
+    this->fence();
+    return this->device->CreateVertexShader(pFunction, ppShader);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetVertexShader (IDirect3DVertexShader9* pShader)
+{
+    command_set_vertex_shader_args* args = this->begin_command<command_set_vertex_shader_args>(COMMAND_SET_VERTEX_SHADER);
+    args->pShader = pShader;
+    hold(pShader);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetVertexShader (IDirect3DVertexShader9** ppShader)
+{
+    this->fence();
+    return this->device->GetVertexShader(ppShader);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetVertexShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
+{
+    if (!this->fits(Vector4fCount * 4 * sizeof(float)))
+    {
+        this->fence();
+        return this->device->SetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+    }
+    command_set_vertex_shader_constant_f_args* args = this->begin_command<command_set_vertex_shader_constant_f_args>(COMMAND_SET_VERTEX_SHADER_CONSTANT_F, Vector4fCount * 4 * sizeof(float));
+    args->StartRegister = StartRegister;
+    args->count = Vector4fCount;
+    memcpy(args + 1, pConstantData, Vector4fCount * 4 * sizeof(float));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetVertexShaderConstantF (UINT StartRegister,float* pConstantData,UINT Vector4fCount)
+{
+    this->fence();
+    return this->device->GetVertexShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetVertexShaderConstantI (UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount)
+{
+    if (!this->fits(Vector4iCount * 4 * sizeof(int)))
+    {
+        this->fence();
+        return this->device->SetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+    }
+    command_set_vertex_shader_constant_i_args* args = this->begin_command<command_set_vertex_shader_constant_i_args>(COMMAND_SET_VERTEX_SHADER_CONSTANT_I, Vector4iCount * 4 * sizeof(int));
+    args->StartRegister = StartRegister;
+    args->count = Vector4iCount;
+    memcpy(args + 1, pConstantData, Vector4iCount * 4 * sizeof(int));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetVertexShaderConstantI (UINT StartRegister,int* pConstantData,UINT Vector4iCount)
+{
+    this->fence();
+    return this->device->GetVertexShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetVertexShaderConstantB (UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount)
+{
+    if (!this->fits(BoolCount * sizeof(BOOL)))
+    {
+        this->fence();
+        return this->device->SetVertexShaderConstantB(StartRegister, pConstantData, BoolCount);
+    }
+    command_set_vertex_shader_constant_b_args* args = this->begin_command<command_set_vertex_shader_constant_b_args>(COMMAND_SET_VERTEX_SHADER_CONSTANT_B, BoolCount * sizeof(BOOL));
+    args->StartRegister = StartRegister;
+    args->count = BoolCount;
+    memcpy(args + 1, pConstantData, BoolCount * sizeof(BOOL));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetVertexShaderConstantB (UINT StartRegister,BOOL* pConstantData,UINT BoolCount)
+{
+    this->fence();
+    return this->device->GetVertexShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride)
+{
+    command_set_stream_source_args* args = this->begin_command<command_set_stream_source_args>(COMMAND_SET_STREAM_SOURCE);
+    args->StreamNumber = StreamNumber;
+    args->pStreamData = pStreamData;
+    args->OffsetInBytes = OffsetInBytes;
+    args->Stride = Stride;
+    hold(pStreamData);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetStreamSource (UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride)
+{
+    this->fence();
+    return this->device->GetStreamSource(StreamNumber, ppStreamData, pOffsetInBytes, pStride);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetStreamSourceFreq (UINT StreamNumber,UINT Setting)
+{
+    command_set_stream_source_freq_args* args = this->begin_command<command_set_stream_source_freq_args>(COMMAND_SET_STREAM_SOURCE_FREQ);
+    args->StreamNumber = StreamNumber;
+    args->Setting = Setting;
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetStreamSourceFreq (UINT StreamNumber,UINT* pSetting)
+{
+    this->fence();
+    return this->device->GetStreamSourceFreq(StreamNumber, pSetting);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetIndices (IDirect3DIndexBuffer9* pIndexData)
+{
+    pIndexData = Direct3DIndexBuffer9Pipeline::unwrap(pIndexData);
+    command_set_indices_args* args = this->begin_command<command_set_indices_args>(COMMAND_SET_INDICES);
+    args->pIndexData = pIndexData;
+    hold(pIndexData);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetIndices (IDirect3DIndexBuffer9** ppIndexData)
+{
+    this->fence();
+    HRESULT result = this->device->GetIndices(ppIndexData);
+    if (SUCCEEDED(result) && *ppIndexData)
+    {
+        Direct3DIndexBuffer9Pipeline* wrapper = Direct3DIndexBuffer9Pipeline::wrapper_of(*ppIndexData);
+        if (wrapper)
+        {
+            wrapper->AddRef();
+            (*ppIndexData)->Release();
+            *ppIndexData = wrapper;
+        }
+    }
+    return result;
+}
+
+HRESULT Direct3DDevice9Pipeline::CreatePixelShader (CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader)
+{
+    this->fence();
+    return this->device->CreatePixelShader(pFunction, ppShader);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetPixelShader (IDirect3DPixelShader9* pShader)
+{
+    command_set_pixel_shader_args* args = this->begin_command<command_set_pixel_shader_args>(COMMAND_SET_PIXEL_SHADER);
+    args->pShader = pShader;
+    hold(pShader);
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetPixelShader (IDirect3DPixelShader9** ppShader)
+{
+    this->fence();
+    return this->device->GetPixelShader(ppShader);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetPixelShaderConstantF (UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount)
+{
+    if (!this->fits(Vector4fCount * 4 * sizeof(float)))
+    {
+        this->fence();
+        return this->device->SetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+    }
+    command_set_pixel_shader_constant_f_args* args = this->begin_command<command_set_pixel_shader_constant_f_args>(COMMAND_SET_PIXEL_SHADER_CONSTANT_F, Vector4fCount * 4 * sizeof(float));
+    args->StartRegister = StartRegister;
+    args->count = Vector4fCount;
+    memcpy(args + 1, pConstantData, Vector4fCount * 4 * sizeof(float));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetPixelShaderConstantF (UINT StartRegister,float* pConstantData,UINT Vector4fCount)
+{
+    this->fence();
+    return this->device->GetPixelShaderConstantF(StartRegister, pConstantData, Vector4fCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetPixelShaderConstantI (UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount)
+{
+    if (!this->fits(Vector4iCount * 4 * sizeof(int)))
+    {
+        this->fence();
+        return this->device->SetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+    }
+    command_set_pixel_shader_constant_i_args* args = this->begin_command<command_set_pixel_shader_constant_i_args>(COMMAND_SET_PIXEL_SHADER_CONSTANT_I, Vector4iCount * 4 * sizeof(int));
+    args->StartRegister = StartRegister;
+    args->count = Vector4iCount;
+    memcpy(args + 1, pConstantData, Vector4iCount * 4 * sizeof(int));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetPixelShaderConstantI (UINT StartRegister,int* pConstantData,UINT Vector4iCount)
+{
+    this->fence();
+    return this->device->GetPixelShaderConstantI(StartRegister, pConstantData, Vector4iCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::SetPixelShaderConstantB (UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount)
+{
+    if (!this->fits(BoolCount * sizeof(BOOL)))
+    {
+        this->fence();
+        return this->device->SetPixelShaderConstantB(StartRegister, pConstantData, BoolCount);
+    }
+    command_set_pixel_shader_constant_b_args* args = this->begin_command<command_set_pixel_shader_constant_b_args>(COMMAND_SET_PIXEL_SHADER_CONSTANT_B, BoolCount * sizeof(BOOL));
+    args->StartRegister = StartRegister;
+    args->count = BoolCount;
+    memcpy(args + 1, pConstantData, BoolCount * sizeof(BOOL));
+    this->end_command();
+    return D3D_OK;
+}
+
+HRESULT Direct3DDevice9Pipeline::GetPixelShaderConstantB (UINT StartRegister,BOOL* pConstantData,UINT BoolCount)
+{
+    this->fence();
+    return this->device->GetPixelShaderConstantB(StartRegister, pConstantData, BoolCount);
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawRectPatch (UINT Handle,CONST float* pNumSegs,CONST D3DRECTPATCH_INFO* pRectPatchInfo)
+{
+    this->fence();
+    return this->device->DrawRectPatch(Handle, pNumSegs, pRectPatchInfo);
+}
+
+HRESULT Direct3DDevice9Pipeline::DrawTriPatch (UINT Handle,CONST float* pNumSegs,CONST D3DTRIPATCH_INFO* pTriPatchInfo)
+{
+    this->fence();
+    return this->device->DrawTriPatch(Handle, pNumSegs, pTriPatchInfo);
+}
+
+HRESULT Direct3DDevice9Pipeline::DeletePatch (UINT Handle)
+{
+    this->fence();
+    return this->device->DeletePatch(Handle);
+}
+
+HRESULT Direct3DDevice9Pipeline::CreateQuery (D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery)
+{
+    this->fence();
+    HRESULT result = this->device->CreateQuery(Type, ppQuery);
+
+    // A null ppQuery only asks whether the type is supported
+    if (SUCCEEDED(result) && ppQuery)
+    {
+        *ppQuery = new Direct3DQuery9Pipeline(this, *ppQuery);
+    }
+    return result;
+}
@@ -0,0 +1,215 @@
+//====================================================================
+// Pipelined IDirect3DDevice9 interface definition.
+//
+// Sits between Direct3DDevice9Hooks and the driver's device when the
+// [Rendering] Pipeline option is on. State changes and draws are
+// packed into a command ring and replayed on a dedicated render
+// thread; everything else waits for the ring to drain first.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+#include "CommandRing.h"
+
+// Called on the render thread when it runs out of work, with the
+// driver's device and times in seconds. Returns true if it presented.
+typedef bool (*pipeline_idle_handler)(void* context, IDirect3DDevice9* device, double now, double last_present);
+
+class Direct3DDevice9Pipeline : public IDirect3DDevice9
+{
+public:
+    Direct3DDevice9Pipeline (IDirect3DDevice9* device);
+    ~Direct3DDevice9Pipeline ();
+
+    // Blocks until the render thread has executed every queued command.
+    // Must be called before touching the real device from this thread.
+    void fence ();
+
+    // Fences and re-reads the state we shadow, for when the real device
+    // was changed behind our back (Reset, state blocks)
+    void resync ();
+
+    IDirect3DDevice9* driver_device () const { return this->device; }
+
+    // Issuing a driver query directly would overtake the commands still in
+    // the ring. This queues the Issue and returns a ticket; results mean
+    // nothing until executed(ticket). Used by the wrappers CreateQuery
+    // hands out.
+    LONG issue_query (IDirect3DQuery9* query, DWORD flags);
+    bool executed (LONG ticket) const { return this->commands_executed - ticket >= 0; }
+
+    // Polls the handler every period while the ring is empty. It is never
+    // run while this thread is using the real device after a fence, and
+    // any open scene is ended around it.
+    void set_idle_handler (pipeline_idle_handler handler, void* context, DWORD period_ms);
+
+    // True if nothing is queued. Only meaningful on the render thread.
+    bool drained () const { return this->ring.empty(); }
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DDevice9 methods ***/
+    STDMETHOD(TestCooperativeLevel)(THIS);
+    STDMETHOD_(UINT, GetAvailableTextureMem)(THIS);
+    STDMETHOD(EvictManagedResources)(THIS);
+    STDMETHOD(GetDirect3D)(THIS_ IDirect3D9** ppD3D9);
+    STDMETHOD(GetDeviceCaps)(THIS_ D3DCAPS9* pCaps);
+    STDMETHOD(GetDisplayMode)(THIS_ UINT iSwapChain,D3DDISPLAYMODE* pMode);
+    STDMETHOD(GetCreationParameters)(THIS_ D3DDEVICE_CREATION_PARAMETERS *pParameters);
+    STDMETHOD(SetCursorProperties)(THIS_ UINT XHotSpot,UINT YHotSpot,IDirect3DSurface9* pCursorBitmap);
+    STDMETHOD_(void, SetCursorPosition)(THIS_ int X,int Y,DWORD Flags);
+    STDMETHOD_(BOOL, ShowCursor)(THIS_ BOOL bShow);
+    STDMETHOD(CreateAdditionalSwapChain)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters,IDirect3DSwapChain9** pSwapChain);
+    STDMETHOD(GetSwapChain)(THIS_ UINT iSwapChain,IDirect3DSwapChain9** pSwapChain);
+    STDMETHOD_(UINT, GetNumberOfSwapChains)(THIS);
+    STDMETHOD(Reset)(THIS_ D3DPRESENT_PARAMETERS* pPresentationParameters);
+    STDMETHOD(Present)(THIS_ CONST RECT* pSourceRect,CONST RECT* pDestRect,HWND hDestWindowOverride,CONST RGNDATA* pDirtyRegion);
+    STDMETHOD(GetBackBuffer)(THIS_ UINT iSwapChain,UINT iBackBuffer,D3DBACKBUFFER_TYPE Type,IDirect3DSurface9** ppBackBuffer);
+    STDMETHOD(GetRasterStatus)(THIS_ UINT iSwapChain,D3DRASTER_STATUS* pRasterStatus);
+    STDMETHOD(SetDialogBoxMode)(THIS_ BOOL bEnableDialogs);
+    STDMETHOD_(void, SetGammaRamp)(THIS_ UINT iSwapChain,DWORD Flags,CONST D3DGAMMARAMP* pRamp);
+    STDMETHOD_(void, GetGammaRamp)(THIS_ UINT iSwapChain,D3DGAMMARAMP* pRamp);
+    STDMETHOD(CreateTexture)(THIS_ UINT Width,UINT Height,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DTexture9** ppTexture,HANDLE* pSharedHandle);
+    STDMETHOD(CreateVolumeTexture)(THIS_ UINT Width,UINT Height,UINT Depth,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DVolumeTexture9** ppVolumeTexture,HANDLE* pSharedHandle);
+    STDMETHOD(CreateCubeTexture)(THIS_ UINT EdgeLength,UINT Levels,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DCubeTexture9** ppCubeTexture,HANDLE* pSharedHandle);
+    STDMETHOD(CreateVertexBuffer)(THIS_ UINT Length,DWORD Usage,DWORD FVF,D3DPOOL Pool,IDirect3DVertexBuffer9** ppVertexBuffer,HANDLE* pSharedHandle);
+    STDMETHOD(CreateIndexBuffer)(THIS_ UINT Length,DWORD Usage,D3DFORMAT Format,D3DPOOL Pool,IDirect3DIndexBuffer9** ppIndexBuffer,HANDLE* pSharedHandle);
+    STDMETHOD(CreateRenderTarget)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Lockable,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle);
+    STDMETHOD(CreateDepthStencilSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DMULTISAMPLE_TYPE MultiSample,DWORD MultisampleQuality,BOOL Discard,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle);
+    STDMETHOD(UpdateSurface)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestinationSurface,CONST POINT* pDestPoint);
+    STDMETHOD(UpdateTexture)(THIS_ IDirect3DBaseTexture9* pSourceTexture,IDirect3DBaseTexture9* pDestinationTexture);
+    STDMETHOD(GetRenderTargetData)(THIS_ IDirect3DSurface9* pRenderTarget,IDirect3DSurface9* pDestSurface);
+    STDMETHOD(GetFrontBufferData)(THIS_ UINT iSwapChain,IDirect3DSurface9* pDestSurface);
+    STDMETHOD(StretchRect)(THIS_ IDirect3DSurface9* pSourceSurface,CONST RECT* pSourceRect,IDirect3DSurface9* pDestSurface,CONST RECT* pDestRect,D3DTEXTUREFILTERTYPE Filter);
+    STDMETHOD(ColorFill)(THIS_ IDirect3DSurface9* pSurface,CONST RECT* pRect,D3DCOLOR color);
+    STDMETHOD(CreateOffscreenPlainSurface)(THIS_ UINT Width,UINT Height,D3DFORMAT Format,D3DPOOL Pool,IDirect3DSurface9** ppSurface,HANDLE* pSharedHandle);
+    STDMETHOD(SetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9* pRenderTarget);
+    STDMETHOD(GetRenderTarget)(THIS_ DWORD RenderTargetIndex,IDirect3DSurface9** ppRenderTarget);
+    STDMETHOD(SetDepthStencilSurface)(THIS_ IDirect3DSurface9* pNewZStencil);
+    STDMETHOD(GetDepthStencilSurface)(THIS_ IDirect3DSurface9** ppZStencilSurface);
+    STDMETHOD(BeginScene)(THIS);
+    STDMETHOD(EndScene)(THIS);
+    STDMETHOD(Clear)(THIS_ DWORD Count,CONST D3DRECT* pRects,DWORD Flags,D3DCOLOR Color,float Z,DWORD Stencil);
+    STDMETHOD(SetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,CONST D3DMATRIX* pMatrix);
+    STDMETHOD(GetTransform)(THIS_ D3DTRANSFORMSTATETYPE State,D3DMATRIX* pMatrix);
+    STDMETHOD(MultiplyTransform)(THIS_ D3DTRANSFORMSTATETYPE,CONST D3DMATRIX*);
+    STDMETHOD(SetViewport)(THIS_ CONST D3DVIEWPORT9* pViewport);
+    STDMETHOD(GetViewport)(THIS_ D3DVIEWPORT9* pViewport);
+    STDMETHOD(SetMaterial)(THIS_ CONST D3DMATERIAL9* pMaterial);
+    STDMETHOD(GetMaterial)(THIS_ D3DMATERIAL9* pMaterial);
+    STDMETHOD(SetLight)(THIS_ DWORD Index,CONST D3DLIGHT9*);
+    STDMETHOD(GetLight)(THIS_ DWORD Index,D3DLIGHT9*);
+    STDMETHOD(LightEnable)(THIS_ DWORD Index,BOOL Enable);
+    STDMETHOD(GetLightEnable)(THIS_ DWORD Index,BOOL* pEnable);
+    STDMETHOD(SetClipPlane)(THIS_ DWORD Index,CONST float* pPlane);
+    STDMETHOD(GetClipPlane)(THIS_ DWORD Index,float* pPlane);
+    STDMETHOD(SetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD Value);
+    STDMETHOD(GetRenderState)(THIS_ D3DRENDERSTATETYPE State,DWORD* pValue);
+    STDMETHOD(CreateStateBlock)(THIS_ D3DSTATEBLOCKTYPE Type,IDirect3DStateBlock9** ppSB);
+    STDMETHOD(BeginStateBlock)(THIS);
+    STDMETHOD(EndStateBlock)(THIS_ IDirect3DStateBlock9** ppSB);
+    STDMETHOD(SetClipStatus)(THIS_ CONST D3DCLIPSTATUS9* pClipStatus);
+    STDMETHOD(GetClipStatus)(THIS_ D3DCLIPSTATUS9* pClipStatus);
+    STDMETHOD(GetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9** ppTexture);
+    STDMETHOD(SetTexture)(THIS_ DWORD Stage,IDirect3DBaseTexture9* pTexture);
+    STDMETHOD(GetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD* pValue);
+    STDMETHOD(SetTextureStageState)(THIS_ DWORD Stage,D3DTEXTURESTAGESTATETYPE Type,DWORD Value);
+    STDMETHOD(GetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD* pValue);
+    STDMETHOD(SetSamplerState)(THIS_ DWORD Sampler,D3DSAMPLERSTATETYPE Type,DWORD Value);
+    STDMETHOD(ValidateDevice)(THIS_ DWORD* pNumPasses);
+    STDMETHOD(SetPaletteEntries)(THIS_ UINT PaletteNumber,CONST PALETTEENTRY* pEntries);
+    STDMETHOD(GetPaletteEntries)(THIS_ UINT PaletteNumber,PALETTEENTRY* pEntries);
+    STDMETHOD(SetCurrentTexturePalette)(THIS_ UINT PaletteNumber);
+    STDMETHOD(GetCurrentTexturePalette)(THIS_ UINT *PaletteNumber);
+    STDMETHOD(SetScissorRect)(THIS_ CONST RECT* pRect);
+    STDMETHOD(GetScissorRect)(THIS_ RECT* pRect);
+    STDMETHOD(SetSoftwareVertexProcessing)(THIS_ BOOL bSoftware);
+    STDMETHOD_(BOOL, GetSoftwareVertexProcessing)(THIS);
+    STDMETHOD(SetNPatchMode)(THIS_ float nSegments);
+    STDMETHOD_(float, GetNPatchMode)(THIS);
+    STDMETHOD(DrawPrimitive)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT StartVertex,UINT PrimitiveCount);
+    STDMETHOD(DrawIndexedPrimitive)(THIS_ D3DPRIMITIVETYPE,INT BaseVertexIndex,UINT MinVertexIndex,UINT NumVertices,UINT startIndex,UINT primCount);
+    STDMETHOD(DrawPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT PrimitiveCount,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride);
+    STDMETHOD(DrawIndexedPrimitiveUP)(THIS_ D3DPRIMITIVETYPE PrimitiveType,UINT MinVertexIndex,UINT NumVertices,UINT PrimitiveCount,CONST void* pIndexData,D3DFORMAT IndexDataFormat,CONST void* pVertexStreamZeroData,UINT VertexStreamZeroStride);
+    STDMETHOD(ProcessVertices)(THIS_ UINT SrcStartIndex,UINT DestIndex,UINT VertexCount,IDirect3DVertexBuffer9* pDestBuffer,IDirect3DVertexDeclaration9* pVertexDecl,DWORD Flags);
+    STDMETHOD(CreateVertexDeclaration)(THIS_ CONST D3DVERTEXELEMENT9* pVertexElements,IDirect3DVertexDeclaration9** ppDecl);
+    STDMETHOD(SetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9* pDecl);
+    STDMETHOD(GetVertexDeclaration)(THIS_ IDirect3DVertexDeclaration9** ppDecl);
+    STDMETHOD(SetFVF)(THIS_ DWORD FVF);
+    STDMETHOD(GetFVF)(THIS_ DWORD* pFVF);
+    STDMETHOD(CreateVertexShader)(THIS_ CONST DWORD* pFunction,IDirect3DVertexShader9** ppShader);
+    STDMETHOD(SetVertexShader)(THIS_ IDirect3DVertexShader9* pShader);
+    STDMETHOD(GetVertexShader)(THIS_ IDirect3DVertexShader9** ppShader);
+    STDMETHOD(SetVertexShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount);
+    STDMETHOD(GetVertexShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount);
+    STDMETHOD(SetVertexShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount);
+    STDMETHOD(GetVertexShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount);
+    STDMETHOD(SetVertexShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount);
+    STDMETHOD(GetVertexShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount);
+    STDMETHOD(SetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9* pStreamData,UINT OffsetInBytes,UINT Stride);
+    STDMETHOD(GetStreamSource)(THIS_ UINT StreamNumber,IDirect3DVertexBuffer9** ppStreamData,UINT* pOffsetInBytes,UINT* pStride);
+    STDMETHOD(SetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT Setting);
+    STDMETHOD(GetStreamSourceFreq)(THIS_ UINT StreamNumber,UINT* pSetting);
+    STDMETHOD(SetIndices)(THIS_ IDirect3DIndexBuffer9* pIndexData);
+    STDMETHOD(GetIndices)(THIS_ IDirect3DIndexBuffer9** ppIndexData);
+    STDMETHOD(CreatePixelShader)(THIS_ CONST DWORD* pFunction,IDirect3DPixelShader9** ppShader);
+    STDMETHOD(SetPixelShader)(THIS_ IDirect3DPixelShader9* pShader);
+    STDMETHOD(GetPixelShader)(THIS_ IDirect3DPixelShader9** ppShader);
+    STDMETHOD(SetPixelShaderConstantF)(THIS_ UINT StartRegister,CONST float* pConstantData,UINT Vector4fCount);
+    STDMETHOD(GetPixelShaderConstantF)(THIS_ UINT StartRegister,float* pConstantData,UINT Vector4fCount);
+    STDMETHOD(SetPixelShaderConstantI)(THIS_ UINT StartRegister,CONST int* pConstantData,UINT Vector4iCount);
+    STDMETHOD(GetPixelShaderConstantI)(THIS_ UINT StartRegister,int* pConstantData,UINT Vector4iCount);
+    STDMETHOD(SetPixelShaderConstantB)(THIS_ UINT StartRegister,CONST BOOL* pConstantData,UINT  BoolCount);
+    STDMETHOD(GetPixelShaderConstantB)(THIS_ UINT StartRegister,BOOL* pConstantData,UINT BoolCount);
+    STDMETHOD(DrawRectPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DRECTPATCH_INFO* pRectPatchInfo);
+    STDMETHOD(DrawTriPatch)(THIS_ UINT Handle,CONST float* pNumSegs,CONST D3DTRIPATCH_INFO* pTriPatchInfo);
+    STDMETHOD(DeletePatch)(THIS_ UINT Handle);
+    STDMETHOD(CreateQuery)(THIS_ D3DQUERYTYPE Type,IDirect3DQuery9** ppQuery);
+
+private:
+    static DWORD WINAPI thread_main (LPVOID param);
+    void execute (const command_header* command);
+    void idle ();
+
+    template <typename T>
+    T* begin_command (DWORD opcode, DWORD extra_size = 0)
+    {
+        command_header* header = this->ring.reserve(opcode, sizeof(command_header) + sizeof(T) + extra_size);
+        return (T*)(header + 1);
+    }
+    void end_command ();
+
+    // Every variable sized payload is checked against this; larger ones
+    // go through the synchronous path rather than tie up the ring
+    bool fits (DWORD payload_size) const { return payload_size < this->ring.capacity() / 4; }
+
+    IDirect3DDevice9* device;
+    CommandRing ring;
+    HANDLE thread;
+    volatile LONG stop;
+
+    // Fence bookkeeping
+    volatile LONG commands_submitted;
+    volatile LONG commands_executed;
+    volatile LONG presents_submitted;
+    volatile LONG presents_executed;
+    volatile HRESULT last_present_result;
+
+    // Idle work. direct_access is set between a fence and the next queued
+    // command, while the game thread may be using the real device.
+    CRITICAL_SECTION idle_lock;
+    pipeline_idle_handler idle_handler;
+    void* idle_context;
+    DWORD idle_period_ms;
+    volatile LONG direct_access;
+    bool in_scene;
+    double last_present_time;
+
+    // State we answer Get* calls for without draining the ring
+    D3DVIEWPORT9 viewport;
+};
@@ -0,0 +1,558 @@
+//====================================================================
+// Pipelined resource implementations.
+//
+// Queued commands only ever read index buffers and lockable textures;
+// nothing in the ring writes to them except through calls that already
+// run synchronously. Read-only locks can therefore go ahead at once,
+// and only writes wait for the ring to drain. Discarding is a write
+// too: the driver renames the storage when the lock is taken, ahead of
+// any draws still in the ring that expect the old contents.
+//
+// Each wrapper tags the real object with a pointer back to itself, so
+// the pipeline can tell its own wrappers from the render targets and
+// other objects it hands out unwrapped.
+//====================================================================
+
+#include "Direct3DResource9Pipeline.h"
+#include "Direct3DDevice9Pipeline.h"
+
+// {8E41B3D2-5A7C-4F19-A06B-2C9D7E13F845}
+static const GUID s_index_buffer_guid = { 0x8e41b3d2, 0x5a7c, 0x4f19, { 0xa0, 0x6b, 0x2c, 0x9d, 0x7e, 0x13, 0xf8, 0x45 } };
+// {1D6F9A80-3B2E-4C57-9E14-A8F05C67D2B3}
+static const GUID s_texture_guid = { 0x1d6f9a80, 0x3b2e, 0x4c57, { 0x9e, 0x14, 0xa8, 0xf0, 0x5c, 0x67, 0xd2, 0xb3 } };
+// {C47E2B19-8D05-4A63-B2F8-61E3D90A5C7E}
+static const GUID s_surface_guid = { 0xc47e2b19, 0x8d05, 0x4a63, { 0xb2, 0xf8, 0x61, 0xe3, 0xd9, 0x0a, 0x5c, 0x7e } };
+
+template <typename Wrapper, typename Object>
+static Wrapper* tagged_wrapper (Object* object, REFGUID guid)
+{
+    if (!object)
+    {
+        return 0;
+    }
+    Wrapper* wrapper = 0;
+    DWORD size = sizeof(wrapper);
+    if (FAILED(object->GetPrivateData(guid, &wrapper, &size)))
+    {
+        return 0;
+    }
+    return wrapper;
+}
+
+static bool lock_writes (DWORD lock_flags)
+{
+    return !(lock_flags & D3DLOCK_READONLY);
+}
+
+//====================================================================
+// Index buffers
+//====================================================================
+
+Direct3DIndexBuffer9Pipeline::Direct3DIndexBuffer9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DIndexBuffer9* inner)
+{
+    this->pipeline = pipeline;
+    this->inner = inner;
+    this->ref_count = 1;
+    Direct3DIndexBuffer9Pipeline* self = this;
+    this->inner->SetPrivateData(s_index_buffer_guid, &self, sizeof(self), 0);
+}
+
+Direct3DIndexBuffer9Pipeline::~Direct3DIndexBuffer9Pipeline ()
+{
+    this->inner->FreePrivateData(s_index_buffer_guid);
+    this->inner->Release();
+}
+
+IDirect3DIndexBuffer9* Direct3DIndexBuffer9Pipeline::unwrap (IDirect3DIndexBuffer9* buffer)
+{
+    // A wrapper forwards the lookup to its real buffer, which points back at it
+    Direct3DIndexBuffer9Pipeline* wrapper = tagged_wrapper<Direct3DIndexBuffer9Pipeline>(buffer, s_index_buffer_guid);
+    return wrapper && static_cast<IDirect3DIndexBuffer9*>(wrapper) == buffer ? wrapper->inner : buffer;
+}
+
+Direct3DIndexBuffer9Pipeline* Direct3DIndexBuffer9Pipeline::wrapper_of (IDirect3DIndexBuffer9* inner)
+{
+    return tagged_wrapper<Direct3DIndexBuffer9Pipeline>(inner, s_index_buffer_guid);
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DIndexBuffer9Pipeline::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DResource9 || riid == IID_IDirect3DIndexBuffer9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DIndexBuffer9Pipeline::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DIndexBuffer9Pipeline::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DResource9 methods ***/
+HRESULT Direct3DIndexBuffer9Pipeline::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    this->pipeline->AddRef();
+    *ppDevice = this->pipeline;
+    return D3D_OK;
+}
+
+HRESULT Direct3DIndexBuffer9Pipeline::SetPrivateData (REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags)
+{
+    return this->inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+}
+
+HRESULT Direct3DIndexBuffer9Pipeline::GetPrivateData (REFGUID refguid,void* pData,DWORD* pSizeOfData)
+{
+    return this->inner->GetPrivateData(refguid, pData, pSizeOfData);
+}
+
+HRESULT Direct3DIndexBuffer9Pipeline::FreePrivateData (REFGUID refguid)
+{
+    return this->inner->FreePrivateData(refguid);
+}
+
+DWORD Direct3DIndexBuffer9Pipeline::SetPriority (DWORD PriorityNew)
+{
+    return this->inner->SetPriority(PriorityNew);
+}
+
+DWORD Direct3DIndexBuffer9Pipeline::GetPriority ()
+{
+    return this->inner->GetPriority();
+}
+
+void Direct3DIndexBuffer9Pipeline::PreLoad ()
+{
+    this->inner->PreLoad();
+}
+
+D3DRESOURCETYPE Direct3DIndexBuffer9Pipeline::GetType ()
+{
+    return this->inner->GetType();
+}
+
+/*** IDirect3DIndexBuffer9 methods ***/
+HRESULT Direct3DIndexBuffer9Pipeline::Lock (UINT OffsetToLock,UINT SizeToLock,void** ppbData,DWORD Flags)
+{
+    // No-overwrite promises not to touch anything the queued draws use
+    if (lock_writes(Flags) && !(Flags & D3DLOCK_NOOVERWRITE))
+    {
+        this->pipeline->fence();
+    }
+    return this->inner->Lock(OffsetToLock, SizeToLock, ppbData, Flags);
+}
+
+HRESULT Direct3DIndexBuffer9Pipeline::Unlock ()
+{
+    return this->inner->Unlock();
+}
+
+HRESULT Direct3DIndexBuffer9Pipeline::GetDesc (D3DINDEXBUFFER_DESC *pDesc)
+{
+    return this->inner->GetDesc(pDesc);
+}
+
+//====================================================================
+// Textures
+//====================================================================
+
+Direct3DTexture9Pipeline::Direct3DTexture9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DTexture9* inner)
+{
+    this->pipeline = pipeline;
+    this->inner = inner;
+    this->ref_count = 1;
+    this->levels.resize(inner->GetLevelCount(), 0);
+    Direct3DTexture9Pipeline* self = this;
+    this->inner->SetPrivateData(s_texture_guid, &self, sizeof(self), 0);
+}
+
+Direct3DTexture9Pipeline::~Direct3DTexture9Pipeline ()
+{
+    for (size_t i = 0; i < this->levels.size(); ++i)
+    {
+        delete this->levels[i];
+    }
+    this->inner->FreePrivateData(s_texture_guid);
+    this->inner->Release();
+}
+
+IDirect3DBaseTexture9* Direct3DTexture9Pipeline::unwrap (IDirect3DBaseTexture9* texture)
+{
+    Direct3DTexture9Pipeline* wrapper = tagged_wrapper<Direct3DTexture9Pipeline>(texture, s_texture_guid);
+    return wrapper && static_cast<IDirect3DBaseTexture9*>(wrapper) == texture ? wrapper->inner : texture;
+}
+
+Direct3DTexture9Pipeline* Direct3DTexture9Pipeline::wrapper_of (IDirect3DBaseTexture9* inner)
+{
+    return tagged_wrapper<Direct3DTexture9Pipeline>(inner, s_texture_guid);
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DTexture9Pipeline::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DResource9 || riid == IID_IDirect3DBaseTexture9 || riid == IID_IDirect3DTexture9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DTexture9Pipeline::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DTexture9Pipeline::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DResource9 methods ***/
+HRESULT Direct3DTexture9Pipeline::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    this->pipeline->AddRef();
+    *ppDevice = this->pipeline;
+    return D3D_OK;
+}
+
+HRESULT Direct3DTexture9Pipeline::SetPrivateData (REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags)
+{
+    return this->inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+}
+
+HRESULT Direct3DTexture9Pipeline::GetPrivateData (REFGUID refguid,void* pData,DWORD* pSizeOfData)
+{
+    return this->inner->GetPrivateData(refguid, pData, pSizeOfData);
+}
+
+HRESULT Direct3DTexture9Pipeline::FreePrivateData (REFGUID refguid)
+{
+    return this->inner->FreePrivateData(refguid);
+}
+
+DWORD Direct3DTexture9Pipeline::SetPriority (DWORD PriorityNew)
+{
+    return this->inner->SetPriority(PriorityNew);
+}
+
+DWORD Direct3DTexture9Pipeline::GetPriority ()
+{
+    return this->inner->GetPriority();
+}
+
+void Direct3DTexture9Pipeline::PreLoad ()
+{
+    this->inner->PreLoad();
+}
+
+D3DRESOURCETYPE Direct3DTexture9Pipeline::GetType ()
+{
+    return this->inner->GetType();
+}
+
+/*** IDirect3DBaseTexture9 methods ***/
+DWORD Direct3DTexture9Pipeline::SetLOD (DWORD LODNew)
+{
+    return this->inner->SetLOD(LODNew);
+}
+
+DWORD Direct3DTexture9Pipeline::GetLOD ()
+{
+    return this->inner->GetLOD();
+}
+
+DWORD Direct3DTexture9Pipeline::GetLevelCount ()
+{
+    return this->inner->GetLevelCount();
+}
+
+HRESULT Direct3DTexture9Pipeline::SetAutoGenFilterType (D3DTEXTUREFILTERTYPE FilterType)
+{
+    return this->inner->SetAutoGenFilterType(FilterType);
+}
+
+D3DTEXTUREFILTERTYPE Direct3DTexture9Pipeline::GetAutoGenFilterType ()
+{
+    return this->inner->GetAutoGenFilterType();
+}
+
+void Direct3DTexture9Pipeline::GenerateMipSubLevels ()
+{
+    this->inner->GenerateMipSubLevels();
+}
+
+/*** IDirect3DTexture9 methods ***/
+HRESULT Direct3DTexture9Pipeline::GetLevelDesc (UINT Level,D3DSURFACE_DESC *pDesc)
+{
+    return this->inner->GetLevelDesc(Level, pDesc);
+}
+
+HRESULT Direct3DTexture9Pipeline::GetSurfaceLevel (UINT Level,IDirect3DSurface9** ppSurfaceLevel)
+{
+    if (Level >= this->levels.size())
+    {
+        return this->inner->GetSurfaceLevel(Level, ppSurfaceLevel);
+    }
+    if (!this->levels[Level])
+    {
+        // The texture keeps its levels alive, so the wrapper doesn't need
+        // a reference of its own
+        IDirect3DSurface9* surface;
+        HRESULT result = this->inner->GetSurfaceLevel(Level, &surface);
+        if (FAILED(result))
+        {
+            return result;
+        }
+        surface->Release();
+        this->levels[Level] = new Direct3DSurface9Pipeline(this->pipeline, surface, this);
+    }
+    this->AddRef();
+    *ppSurfaceLevel = this->levels[Level];
+    return D3D_OK;
+}
+
+HRESULT Direct3DTexture9Pipeline::LockRect (UINT Level,D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags)
+{
+    if (lock_writes(Flags))
+    {
+        this->pipeline->fence();
+    }
+    return this->inner->LockRect(Level, pLockedRect, pRect, Flags);
+}
+
+HRESULT Direct3DTexture9Pipeline::UnlockRect (UINT Level)
+{
+    return this->inner->UnlockRect(Level);
+}
+
+HRESULT Direct3DTexture9Pipeline::AddDirtyRect (CONST RECT* pDirtyRect)
+{
+    return this->inner->AddDirtyRect(pDirtyRect);
+}
+
+//====================================================================
+// Texture levels
+//====================================================================
+
+Direct3DSurface9Pipeline::Direct3DSurface9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DSurface9* inner, Direct3DTexture9Pipeline* container)
+{
+    this->pipeline = pipeline;
+    this->inner = inner;
+    this->container = container;
+    Direct3DSurface9Pipeline* self = this;
+    this->inner->SetPrivateData(s_surface_guid, &self, sizeof(self), 0);
+}
+
+Direct3DSurface9Pipeline::~Direct3DSurface9Pipeline ()
+{
+    this->inner->FreePrivateData(s_surface_guid);
+}
+
+IDirect3DSurface9* Direct3DSurface9Pipeline::unwrap (IDirect3DSurface9* surface)
+{
+    Direct3DSurface9Pipeline* wrapper = tagged_wrapper<Direct3DSurface9Pipeline>(surface, s_surface_guid);
+    return wrapper && static_cast<IDirect3DSurface9*>(wrapper) == surface ? wrapper->inner : surface;
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DSurface9Pipeline::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DResource9 || riid == IID_IDirect3DSurface9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DSurface9Pipeline::AddRef ()
+{
+    return this->container->AddRef();
+}
+
+ULONG Direct3DSurface9Pipeline::Release ()
+{
+    return this->container->Release();
+}
+
+/*** IDirect3DResource9 methods ***/
+HRESULT Direct3DSurface9Pipeline::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    this->pipeline->AddRef();
+    *ppDevice = this->pipeline;
+    return D3D_OK;
+}
+
+HRESULT Direct3DSurface9Pipeline::SetPrivateData (REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags)
+{
+    return this->inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+}
+
+HRESULT Direct3DSurface9Pipeline::GetPrivateData (REFGUID refguid,void* pData,DWORD* pSizeOfData)
+{
+    return this->inner->GetPrivateData(refguid, pData, pSizeOfData);
+}
+
+HRESULT Direct3DSurface9Pipeline::FreePrivateData (REFGUID refguid)
+{
+    return this->inner->FreePrivateData(refguid);
+}
+
+DWORD Direct3DSurface9Pipeline::SetPriority (DWORD PriorityNew)
+{
+    return this->inner->SetPriority(PriorityNew);
+}
+
+DWORD Direct3DSurface9Pipeline::GetPriority ()
+{
+    return this->inner->GetPriority();
+}
+
+void Direct3DSurface9Pipeline::PreLoad ()
+{
+    this->inner->PreLoad();
+}
+
+D3DRESOURCETYPE Direct3DSurface9Pipeline::GetType ()
+{
+    return this->inner->GetType();
+}
+
+/*** IDirect3DSurface9 methods ***/
+HRESULT Direct3DSurface9Pipeline::GetContainer (REFIID riid,void** ppContainer)
+{
+    return this->container->QueryInterface(riid, ppContainer);
+}
+
+HRESULT Direct3DSurface9Pipeline::GetDesc (D3DSURFACE_DESC *pDesc)
+{
+    return this->inner->GetDesc(pDesc);
+}
+
+HRESULT Direct3DSurface9Pipeline::LockRect (D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags)
+{
+    if (lock_writes(Flags))
+    {
+        this->pipeline->fence();
+    }
+    return this->inner->LockRect(pLockedRect, pRect, Flags);
+}
+
+HRESULT Direct3DSurface9Pipeline::UnlockRect ()
+{
+    return this->inner->UnlockRect();
+}
+
+HRESULT Direct3DSurface9Pipeline::GetDC (HDC *phdc)
+{
+    this->pipeline->fence();
+    return this->inner->GetDC(phdc);
+}
+
+HRESULT Direct3DSurface9Pipeline::ReleaseDC (HDC hdc)
+{
+    return this->inner->ReleaseDC(hdc);
+}
+
+//====================================================================
+// Queries
+//====================================================================
+
+Direct3DQuery9Pipeline::Direct3DQuery9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DQuery9* inner)
+{
+    this->pipeline = pipeline;
+    this->inner = inner;
+    this->ref_count = 1;
+    this->ticket = 0;
+    this->issued = false;
+}
+
+Direct3DQuery9Pipeline::~Direct3DQuery9Pipeline ()
+{
+    this->inner->Release();
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DQuery9Pipeline::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DQuery9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DQuery9Pipeline::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DQuery9Pipeline::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DQuery9 methods ***/
+HRESULT Direct3DQuery9Pipeline::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    this->pipeline->AddRef();
+    *ppDevice = this->pipeline;
+    return D3D_OK;
+}
+
+D3DQUERYTYPE Direct3DQuery9Pipeline::GetType ()
+{
+    return this->inner->GetType();
+}
+
+DWORD Direct3DQuery9Pipeline::GetDataSize ()
+{
+    return this->inner->GetDataSize();
+}
+
+HRESULT Direct3DQuery9Pipeline::Issue (DWORD dwIssueFlags)
+{
+    this->ticket = this->pipeline->issue_query(this->inner, dwIssueFlags);
+    this->issued = true;
+    return D3D_OK;
+}
+
+HRESULT Direct3DQuery9Pipeline::GetData (void* pData,DWORD dwSize,DWORD dwGetDataFlags)
+{
+    // Until the render thread gets to the Issue, the driver would answer
+    // for the one before it
+    if (this->issued && !this->pipeline->executed(this->ticket))
+    {
+        return S_FALSE;
+    }
+    return this->inner->GetData(pData, dwSize, dwGetDataFlags);
+}
@@ -0,0 +1,175 @@
+//====================================================================
+// Resources handed out by the pipelined device.
+//
+// Commands in the ring still refer to index buffers, textures and
+// queries the game can lock or poll at any moment from its own thread.
+// These wrappers make each such access wait for, or go through, the
+// ring so it sees the state the game expects. The pipeline unwraps
+// them before anything reaches the driver.
+//====================================================================
+
+#pragma once
+
+#include <vector>
+
+#include <d3d9.h>
+
+class Direct3DDevice9Pipeline;
+class Direct3DSurface9Pipeline;
+
+class Direct3DIndexBuffer9Pipeline : public IDirect3DIndexBuffer9
+{
+public:
+    Direct3DIndexBuffer9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DIndexBuffer9* inner);
+
+    // Map between wrapped buffers and the real ones. Both accept null;
+    // unwrap passes anything that isn't ours straight through.
+    static IDirect3DIndexBuffer9* unwrap (IDirect3DIndexBuffer9* buffer);
+    static Direct3DIndexBuffer9Pipeline* wrapper_of (IDirect3DIndexBuffer9* inner);
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DResource9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags);
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid,void* pData,DWORD* pSizeOfData);
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid);
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew);
+    STDMETHOD_(DWORD, GetPriority)(THIS);
+    STDMETHOD_(void, PreLoad)(THIS);
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS);
+
+    /*** IDirect3DIndexBuffer9 methods ***/
+    STDMETHOD(Lock)(THIS_ UINT OffsetToLock,UINT SizeToLock,void** ppbData,DWORD Flags);
+    STDMETHOD(Unlock)(THIS);
+    STDMETHOD(GetDesc)(THIS_ D3DINDEXBUFFER_DESC *pDesc);
+
+private:
+    ~Direct3DIndexBuffer9Pipeline ();
+
+    Direct3DDevice9Pipeline* pipeline;
+    IDirect3DIndexBuffer9* inner;
+    ULONG ref_count;
+};
+
+// Only textures the game can lock are wrapped: managed and dynamic ones
+class Direct3DTexture9Pipeline : public IDirect3DTexture9
+{
+public:
+    Direct3DTexture9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DTexture9* inner);
+
+    static IDirect3DBaseTexture9* unwrap (IDirect3DBaseTexture9* texture);
+    static Direct3DTexture9Pipeline* wrapper_of (IDirect3DBaseTexture9* inner);
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DResource9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags);
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid,void* pData,DWORD* pSizeOfData);
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid);
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew);
+    STDMETHOD_(DWORD, GetPriority)(THIS);
+    STDMETHOD_(void, PreLoad)(THIS);
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS);
+
+    /*** IDirect3DBaseTexture9 methods ***/
+    STDMETHOD_(DWORD, SetLOD)(THIS_ DWORD LODNew);
+    STDMETHOD_(DWORD, GetLOD)(THIS);
+    STDMETHOD_(DWORD, GetLevelCount)(THIS);
+    STDMETHOD(SetAutoGenFilterType)(THIS_ D3DTEXTUREFILTERTYPE FilterType);
+    STDMETHOD_(D3DTEXTUREFILTERTYPE, GetAutoGenFilterType)(THIS);
+    STDMETHOD_(void, GenerateMipSubLevels)(THIS);
+
+    /*** IDirect3DTexture9 methods ***/
+    STDMETHOD(GetLevelDesc)(THIS_ UINT Level,D3DSURFACE_DESC *pDesc);
+    STDMETHOD(GetSurfaceLevel)(THIS_ UINT Level,IDirect3DSurface9** ppSurfaceLevel);
+    STDMETHOD(LockRect)(THIS_ UINT Level,D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags);
+    STDMETHOD(UnlockRect)(THIS_ UINT Level);
+    STDMETHOD(AddDirtyRect)(THIS_ CONST RECT* pDirtyRect);
+
+private:
+    ~Direct3DTexture9Pipeline ();
+
+    Direct3DDevice9Pipeline* pipeline;
+    IDirect3DTexture9* inner;
+    ULONG ref_count;
+
+    // Wrappers for the levels handed out so far. They live as long as the
+    // texture does and share its reference count, like the real ones.
+    std::vector<Direct3DSurface9Pipeline*> levels;
+};
+
+class Direct3DSurface9Pipeline : public IDirect3DSurface9
+{
+public:
+    Direct3DSurface9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DSurface9* inner, Direct3DTexture9Pipeline* container);
+
+    static IDirect3DSurface9* unwrap (IDirect3DSurface9* surface);
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DResource9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags);
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid,void* pData,DWORD* pSizeOfData);
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid);
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew);
+    STDMETHOD_(DWORD, GetPriority)(THIS);
+    STDMETHOD_(void, PreLoad)(THIS);
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS);
+
+    /*** IDirect3DSurface9 methods ***/
+    STDMETHOD(GetContainer)(THIS_ REFIID riid,void** ppContainer);
+    STDMETHOD(GetDesc)(THIS_ D3DSURFACE_DESC *pDesc);
+    STDMETHOD(LockRect)(THIS_ D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags);
+    STDMETHOD(UnlockRect)(THIS);
+    STDMETHOD(GetDC)(THIS_ HDC *phdc);
+    STDMETHOD(ReleaseDC)(THIS_ HDC hdc);
+
+private:
+    friend class Direct3DTexture9Pipeline;
+    ~Direct3DSurface9Pipeline ();
+
+    Direct3DDevice9Pipeline* pipeline;
+    IDirect3DSurface9* inner;
+    Direct3DTexture9Pipeline* container;
+};
+
+// Issue goes through the ring behind the commands the game queued
+// before it, and GetData reports nothing until it has been run
+class Direct3DQuery9Pipeline : public IDirect3DQuery9
+{
+public:
+    Direct3DQuery9Pipeline (Direct3DDevice9Pipeline* pipeline, IDirect3DQuery9* inner);
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DQuery9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD_(D3DQUERYTYPE, GetType)(THIS);
+    STDMETHOD_(DWORD, GetDataSize)(THIS);
+    STDMETHOD(Issue)(THIS_ DWORD dwIssueFlags);
+    STDMETHOD(GetData)(THIS_ void* pData,DWORD dwSize,DWORD dwGetDataFlags);
+
+private:
+    ~Direct3DQuery9Pipeline ();
+
+    Direct3DDevice9Pipeline* pipeline;
+    IDirect3DQuery9* inner;
+    ULONG ref_count;
+    LONG ticket;
+    bool issued;
+};
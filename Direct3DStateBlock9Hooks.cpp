@@ -0,0 +1,71 @@
+//====================================================================
+// Hooked IDirect3DStateBlock9 interface implementation.
+//
+// Applying a state block changes device state behind the hooks' back,
+// so the device re-reads what it keeps track of afterwards.
+//====================================================================
+
+#include "Direct3DStateBlock9Hooks.h"
+#include "Direct3DDevice9Hooks.h"
+
+Direct3DStateBlock9Hooks::Direct3DStateBlock9Hooks (Direct3DDevice9Hooks* device, IDirect3DStateBlock9* inner)
+{
+    this->device = device;
+    this->inner = inner;
+    this->ref_count = 1;
+}
+
+Direct3DStateBlock9Hooks::~Direct3DStateBlock9Hooks ()
+{
+    this->inner->Release();
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DStateBlock9Hooks::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DStateBlock9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DStateBlock9Hooks::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DStateBlock9Hooks::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DStateBlock9 methods ***/
+HRESULT Direct3DStateBlock9Hooks::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    this->device->AddRef();
+    *ppDevice = this->device;
+    return D3D_OK;
+}
+
+HRESULT Direct3DStateBlock9Hooks::Capture ()
+{
+    return this->inner->Capture();
+}
+
+HRESULT Direct3DStateBlock9Hooks::Apply ()
+{
+    HRESULT result = this->inner->Apply();
+    if (SUCCEEDED(result))
+    {
+        this->device->reload_tracked_state();
+    }
+    return result;
+}
@@ -0,0 +1,32 @@
+//====================================================================
+// Hooked IDirect3DStateBlock9 interface definition.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+class Direct3DDevice9Hooks;
+
+class Direct3DStateBlock9Hooks : public IDirect3DStateBlock9
+{
+public:
+    Direct3DStateBlock9Hooks (Direct3DDevice9Hooks* device, IDirect3DStateBlock9* inner);
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DStateBlock9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(Capture)(THIS);
+    STDMETHOD(Apply)(THIS);
+
+private:
+    ~Direct3DStateBlock9Hooks ();
+
+    Direct3DDevice9Hooks* device;
+    IDirect3DStateBlock9* inner;
+    ULONG ref_count;
+};
@@ -0,0 +1,515 @@
+//====================================================================
+// Hooked IDirect3DTexture9 interface implementation.
+//
+// Managed textures with identical contents share storage. Each level is
+// hashed when the game unlocks it after writing the whole level, and
+// when a texture is bound its contents are looked up among the others;
+// on a match it binds the existing texture instead of its own. Since
+// its own is never bound it never takes up video memory, while its
+// system memory copy stays intact, so a texture that is locked for
+// writing again simply goes back to binding its own.
+//====================================================================
+
+#include <map>
+#include <string.h>
+
+#include "Direct3DTexture9Hooks.h"
+#include "Direct3DDevice9Hooks.h"
+#include "ContentHash.h"
+
+// Textures with identical contents. The first user's own texture is the
+// one they all bind.
+struct shared_texture {
+    unsigned __int64 hash;
+    unsigned __int64 bytes;
+    std::vector<Direct3DTexture9Hooks*> users;
+};
+
+// Only ever touched from the game's rendering thread
+static std::multimap<unsigned __int64, shared_texture*> s_shared_textures;
+static unsigned int s_shared_count = 0;
+static unsigned __int64 s_saved_bytes = 0;
+
+// {8E3B6D21-4A7C-4F19-A5D2-6C0E9B1F3A84}
+static const GUID s_wrapper_guid = { 0x8e3b6d21, 0x4a7c, 0x4f19, { 0xa5, 0xd2, 0x6c, 0x0e, 0x9b, 0x1f, 0x3a, 0x84 } };
+
+// {5B1E7F93-2C48-4D6A-9E07-A3F8C14D6B52}
+static const GUID s_write_version_guid = { 0x5b1e7f93, 0x2c48, 0x4d6a, { 0x9e, 0x07, 0xa3, 0xf8, 0xc1, 0x4d, 0x6b, 0x52 } };
+
+// Bytes per row and number of rows of a level, counting compressed
+// formats in blocks. False for formats we don't know the layout of.
+static bool level_layout (const D3DSURFACE_DESC& desc, UINT* row_bytes, UINT* rows)
+{
+    UINT block_bytes = 0;
+    UINT pixel_bytes = 0;
+    switch (desc.Format)
+    {
+    case D3DFMT_DXT1:
+        block_bytes = 8;
+        break;
+    case D3DFMT_DXT2:
+    case D3DFMT_DXT3:
+    case D3DFMT_DXT4:
+    case D3DFMT_DXT5:
+        block_bytes = 16;
+        break;
+    case D3DFMT_A8:
+    case D3DFMT_L8:
+        pixel_bytes = 1;
+        break;
+    case D3DFMT_R5G6B5:
+    case D3DFMT_X1R5G5B5:
+    case D3DFMT_A1R5G5B5:
+    case D3DFMT_A4R4G4B4:
+    case D3DFMT_X4R4G4B4:
+    case D3DFMT_A8L8:
+    case D3DFMT_L16:
+    case D3DFMT_V8U8:
+    case D3DFMT_R16F:
+        pixel_bytes = 2;
+        break;
+    case D3DFMT_R8G8B8:
+        pixel_bytes = 3;
+        break;
+    case D3DFMT_A8R8G8B8:
+    case D3DFMT_X8R8G8B8:
+    case D3DFMT_A8B8G8R8:
+    case D3DFMT_X8B8G8R8:
+    case D3DFMT_A2R10G10B10:
+    case D3DFMT_A2B10G10R10:
+    case D3DFMT_G16R16:
+    case D3DFMT_G16R16F:
+    case D3DFMT_R32F:
+        pixel_bytes = 4;
+        break;
+    case D3DFMT_A16B16G16R16:
+    case D3DFMT_A16B16G16R16F:
+    case D3DFMT_G32R32F:
+        pixel_bytes = 8;
+        break;
+    case D3DFMT_A32B32G32R32F:
+        pixel_bytes = 16;
+        break;
+    default:
+        return false;
+    }
+    if (block_bytes)
+    {
+        *row_bytes = (desc.Width + 3) / 4 * block_bytes;
+        *rows = (desc.Height + 3) / 4;
+    }
+    else
+    {
+        *row_bytes = desc.Width * pixel_bytes;
+        *rows = desc.Height;
+    }
+    return true;
+}
+
+Direct3DTexture9Hooks::Direct3DTexture9Hooks (Direct3DDevice9Hooks* device, IDirect3DTexture9* inner, bool dedup)
+{
+    this->device = device;
+    this->inner = inner;
+    this->ref_count = 1;
+    level_state unhashed;
+    memset(&unhashed, 0, sizeof(unhashed));
+    this->levels.resize(inner->GetLevelCount(), unhashed);
+    this->shared = 0;
+    this->dirty = true;
+    this->dedup = dedup;
+    this->escaped = false;
+
+    // Tag the real texture so we can find our wrapper from it later
+    Direct3DTexture9Hooks* self = this;
+    this->inner->SetPrivateData(s_wrapper_guid, &self, sizeof(self), 0);
+}
+
+Direct3DTexture9Hooks::~Direct3DTexture9Hooks ()
+{
+    this->leave_shared();
+    this->inner->FreePrivateData(s_wrapper_guid);
+    this->inner->Release();
+}
+
+Direct3DTexture9Hooks* Direct3DTexture9Hooks::wrapper_of (IDirect3DBaseTexture9* texture)
+{
+    if (!texture)
+    {
+        return 0;
+    }
+    Direct3DTexture9Hooks* wrapper = 0;
+    DWORD size = sizeof(wrapper);
+    if (FAILED(texture->GetPrivateData(s_wrapper_guid, &wrapper, &size)))
+    {
+        return 0;
+    }
+    return wrapper;
+}
+
+IDirect3DTexture9* Direct3DTexture9Hooks::active () const
+{
+    return this->shared ? this->shared->users[0]->inner : this->inner;
+}
+
+unsigned int Direct3DTexture9Hooks::shared_count ()
+{
+    return s_shared_count;
+}
+
+unsigned __int64 Direct3DTexture9Hooks::saved_bytes ()
+{
+    return s_saved_bytes;
+}
+
+void Direct3DTexture9Hooks::note_write (IDirect3DBaseTexture9* texture)
+{
+    DWORD version = write_version(texture) + 1;
+    texture->SetPrivateData(s_write_version_guid, &version, sizeof(version), 0);
+}
+
+DWORD Direct3DTexture9Hooks::write_version (IDirect3DBaseTexture9* texture)
+{
+    DWORD version = 0;
+    DWORD size = sizeof(version);
+    if (FAILED(texture->GetPrivateData(s_write_version_guid, &version, &size)))
+    {
+        return 0;
+    }
+    return version;
+}
+
+bool Direct3DTexture9Hooks::has_escaped () const
+{
+    return this->escaped;
+}
+
+bool Direct3DTexture9Hooks::hash_level (UINT level, const D3DLOCKED_RECT& locked, unsigned __int64* hash)
+{
+    D3DSURFACE_DESC desc;
+    UINT row_bytes, rows;
+    if (FAILED(this->inner->GetLevelDesc(level, &desc)) || !level_layout(desc, &row_bytes, &rows))
+    {
+        return false;
+    }
+    unsigned __int64 h = s_empty_hash;
+    const unsigned char* row = (const unsigned char*)locked.pBits;
+    for (UINT y = 0; y < rows; ++y, row += locked.Pitch)
+    {
+        h = hash_bytes(h, row, row_bytes);
+    }
+    *hash = h;
+    return true;
+}
+
+bool Direct3DTexture9Hooks::read_level_hash (UINT level)
+{
+    // Only needed when the game wrote part of a level, or not at all
+    level_state& state = this->levels[level];
+    D3DLOCKED_RECT locked;
+    if (FAILED(this->inner->LockRect(level, &locked, NULL, D3DLOCK_READONLY)))
+    {
+        return false;
+    }
+    state.hashed = this->hash_level(level, locked, &state.hash);
+    this->inner->UnlockRect(level);
+    return state.hashed;
+}
+
+bool Direct3DTexture9Hooks::same_contents (Direct3DTexture9Hooks* other)
+{
+    // The hashes matched, so this only rules out collisions
+    D3DSURFACE_DESC desc, other_desc;
+    this->inner->GetLevelDesc(0, &desc);
+    other->inner->GetLevelDesc(0, &other_desc);
+    if (desc.Format != other_desc.Format || desc.Width != other_desc.Width || desc.Height != other_desc.Height ||
+        this->levels.size() != other->levels.size())
+    {
+        return false;
+    }
+    bool same = true;
+    for (UINT level = 0; same && level < this->levels.size(); ++level)
+    {
+        UINT row_bytes, rows;
+        D3DLOCKED_RECT mine, theirs;
+        this->inner->GetLevelDesc(level, &desc);
+        if (!level_layout(desc, &row_bytes, &rows) || FAILED(this->inner->LockRect(level, &mine, NULL, D3DLOCK_READONLY)))
+        {
+            return false;
+        }
+        if (FAILED(other->inner->LockRect(level, &theirs, NULL, D3DLOCK_READONLY)))
+        {
+            this->inner->UnlockRect(level);
+            return false;
+        }
+        for (UINT y = 0; same && y < rows; ++y)
+        {
+            same = memcmp((const unsigned char*)mine.pBits + y * mine.Pitch, (const unsigned char*)theirs.pBits + y * theirs.Pitch, row_bytes) == 0;
+        }
+        other->inner->UnlockRect(level);
+        this->inner->UnlockRect(level);
+    }
+    return same;
+}
+
+void Direct3DTexture9Hooks::deduplicate ()
+{
+    if (!this->dirty || this->escaped || this->shared)
+    {
+        return;
+    }
+    this->dirty = false;
+
+    D3DSURFACE_DESC desc;
+    this->inner->GetLevelDesc(0, &desc);
+    unsigned __int64 hash = s_empty_hash;
+    hash = hash_bytes(hash, &desc.Format, sizeof(desc.Format));
+    hash = hash_bytes(hash, &desc.Width, sizeof(desc.Width));
+    hash = hash_bytes(hash, &desc.Height, sizeof(desc.Height));
+    unsigned __int64 bytes = 0;
+    for (UINT level = 0; level < this->levels.size(); ++level)
+    {
+        level_state& state = this->levels[level];
+        if (!state.hashed && !this->read_level_hash(level))
+        {
+            return;
+        }
+        hash = hash_bytes(hash, &state.hash, sizeof(state.hash));
+
+        D3DSURFACE_DESC level_desc;
+        UINT row_bytes, rows;
+        this->inner->GetLevelDesc(level, &level_desc);
+        level_layout(level_desc, &row_bytes, &rows);
+        bytes += (unsigned __int64)row_bytes * rows;
+    }
+
+    typedef std::multimap<unsigned __int64, shared_texture*>::iterator iterator;
+    std::pair<iterator, iterator> matches = s_shared_textures.equal_range(hash);
+    for (iterator i = matches.first; i != matches.second; ++i)
+    {
+        shared_texture* candidate = i->second;
+        if (this->same_contents(candidate->users[0]))
+        {
+            candidate->users.push_back(this);
+            this->shared = candidate;
+            ++s_shared_count;
+            s_saved_bytes += candidate->bytes;
+            return;
+        }
+    }
+
+    // First of its kind; others can share it from now on
+    shared_texture* created = new shared_texture;
+    created->hash = hash;
+    created->bytes = bytes;
+    created->users.push_back(this);
+    s_shared_textures.insert(std::make_pair(hash, created));
+    this->shared = created;
+}
+
+void Direct3DTexture9Hooks::leave_shared ()
+{
+    shared_texture* shared = this->shared;
+    if (!shared)
+    {
+        return;
+    }
+    this->shared = 0;
+    this->dirty = true;
+
+    bool was_first = shared->users[0] == this;
+    for (size_t i = 0; i < shared->users.size(); ++i)
+    {
+        if (shared->users[i] == this)
+        {
+            shared->users.erase(shared->users.begin() + i);
+            break;
+        }
+    }
+    if (shared->users.empty())
+    {
+        typedef std::multimap<unsigned __int64, shared_texture*>::iterator iterator;
+        std::pair<iterator, iterator> matches = s_shared_textures.equal_range(shared->hash);
+        for (iterator i = matches.first; i != matches.second; ++i)
+        {
+            if (i->second == shared)
+            {
+                s_shared_textures.erase(i);
+                break;
+            }
+        }
+        delete shared;
+        return;
+    }
+    --s_shared_count;
+    s_saved_bytes -= shared->bytes;
+
+    // Everyone else now binds the next user's identical texture
+    if (was_first)
+    {
+        for (size_t i = 0; i < shared->users.size(); ++i)
+        {
+            this->device->rebind_texture(shared->users[i]);
+        }
+    }
+    else
+    {
+        this->device->rebind_texture(this);
+    }
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DTexture9Hooks::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DResource9 || riid == IID_IDirect3DBaseTexture9 || riid == IID_IDirect3DTexture9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DTexture9Hooks::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DTexture9Hooks::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DResource9 methods ***/
+HRESULT Direct3DTexture9Hooks::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    IDirect3DDevice9* device = this->device;
+    device->AddRef();
+    *ppDevice = device;
+    return D3D_OK;
+}
+
+HRESULT Direct3DTexture9Hooks::SetPrivateData (REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags)
+{
+    return this->inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+}
+
+HRESULT Direct3DTexture9Hooks::GetPrivateData (REFGUID refguid,void* pData,DWORD* pSizeOfData)
+{
+    return this->inner->GetPrivateData(refguid, pData, pSizeOfData);
+}
+
+HRESULT Direct3DTexture9Hooks::FreePrivateData (REFGUID refguid)
+{
+    return this->inner->FreePrivateData(refguid);
+}
+
+DWORD Direct3DTexture9Hooks::SetPriority (DWORD PriorityNew)
+{
+    return this->inner->SetPriority(PriorityNew);
+}
+
+DWORD Direct3DTexture9Hooks::GetPriority ()
+{
+    return this->inner->GetPriority();
+}
+
+void Direct3DTexture9Hooks::PreLoad ()
+{
+    // Loading our own copy while sharing would spend the memory we saved
+    return this->active()->PreLoad();
+}
+
+D3DRESOURCETYPE Direct3DTexture9Hooks::GetType ()
+{
+    return this->inner->GetType();
+}
+
+/*** IDirect3DBaseTexture9 methods ***/
+DWORD Direct3DTexture9Hooks::SetLOD (DWORD LODNew)
+{
+    return this->inner->SetLOD(LODNew);
+}
+
+DWORD Direct3DTexture9Hooks::GetLOD ()
+{
+    return this->inner->GetLOD();
+}
+
+DWORD Direct3DTexture9Hooks::GetLevelCount ()
+{
+    return this->inner->GetLevelCount();
+}
+
+HRESULT Direct3DTexture9Hooks::SetAutoGenFilterType (D3DTEXTUREFILTERTYPE FilterType)
+{
+    return this->inner->SetAutoGenFilterType(FilterType);
+}
+
+D3DTEXTUREFILTERTYPE Direct3DTexture9Hooks::GetAutoGenFilterType ()
+{
+    return this->inner->GetAutoGenFilterType();
+}
+
+void Direct3DTexture9Hooks::GenerateMipSubLevels ()
+{
+    return this->inner->GenerateMipSubLevels();
+}
+
+/*** IDirect3DTexture9 methods ***/
+HRESULT Direct3DTexture9Hooks::GetLevelDesc (UINT Level,D3DSURFACE_DESC *pDesc)
+{
+    return this->inner->GetLevelDesc(Level, pDesc);
+}
+
+HRESULT Direct3DTexture9Hooks::GetSurfaceLevel (UINT Level,IDirect3DSurface9** ppSurfaceLevel)
+{
+    this->leave_shared();
+    this->escaped = true;
+    return this->inner->GetSurfaceLevel(Level, ppSurfaceLevel);
+}
+
+HRESULT Direct3DTexture9Hooks::LockRect (UINT Level,D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags)
+{
+    bool writing = !(Flags & D3DLOCK_READONLY);
+    if (writing)
+    {
+        this->leave_shared();
+    }
+    HRESULT result = this->inner->LockRect(Level, pLockedRect, pRect, Flags);
+    if (SUCCEEDED(result) && writing)
+    {
+        note_write(this->inner);
+    }
+    if (SUCCEEDED(result) && writing && this->dedup && Level < this->levels.size())
+    {
+        level_state& state = this->levels[Level];
+        state.writing = true;
+        state.whole = pRect == NULL;
+        state.locked = *pLockedRect;
+    }
+    return result;
+}
+
+HRESULT Direct3DTexture9Hooks::UnlockRect (UINT Level)
+{
+    if (Level < this->levels.size() && this->levels[Level].writing)
+    {
+        // Hash while the game's own lock still gives us the pixels. Part of
+        // a level can't be hashed on its own, so that's left for later.
+        level_state& state = this->levels[Level];
+        state.writing = false;
+        state.hashed = state.whole && this->hash_level(Level, state.locked, &state.hash);
+        this->dirty = true;
+    }
+    return this->inner->UnlockRect(Level);
+}
+
+HRESULT Direct3DTexture9Hooks::AddDirtyRect (CONST RECT* pDirtyRect)
+{
+    return this->inner->AddDirtyRect(pDirtyRect);
+}
@@ -0,0 +1,106 @@
+//====================================================================
+// Hooked IDirect3DTexture9 interface definition.
+//====================================================================
+
+#pragma once
+
+#include <vector>
+
+#include <d3d9.h>
+
+class Direct3DDevice9Hooks;
+struct shared_texture;
+
+class Direct3DTexture9Hooks : public IDirect3DTexture9
+{
+public:
+    // Levels are only hashed, and so the texture only ever shared, when
+    // dedup is set
+    Direct3DTexture9Hooks (Direct3DDevice9Hooks* device, IDirect3DTexture9* inner, bool dedup);
+
+    // The wrapper behind a texture the game handed us, or null if it isn't
+    // one of ours. Accepts null.
+    static Direct3DTexture9Hooks* wrapper_of (IDirect3DBaseTexture9* texture);
+
+    // What the device should bind in place of this texture: its own, or
+    // an identical one it's sharing with
+    IDirect3DTexture9* active () const;
+
+    // Shares with an identical texture if the contents changed since the
+    // last time and there is one. Called before the texture is bound.
+    void deduplicate ();
+
+    // Across all textures, how many are sharing another's storage and how
+    // much that saves
+    static unsigned int shared_count ();
+    static unsigned __int64 saved_bytes ();
+
+    // Counts the writes we see to a texture, wrapped or not. It's kept with
+    // the real texture and stays zero until the first write.
+    static void note_write (IDirect3DBaseTexture9* texture);
+    static DWORD write_version (IDirect3DBaseTexture9* texture);
+
+    // Once a surface has been handed out, writes can no longer be counted
+    bool has_escaped () const;
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DResource9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags);
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid,void* pData,DWORD* pSizeOfData);
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid);
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew);
+    STDMETHOD_(DWORD, GetPriority)(THIS);
+    STDMETHOD_(void, PreLoad)(THIS);
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS);
+
+    /*** IDirect3DBaseTexture9 methods ***/
+    STDMETHOD_(DWORD, SetLOD)(THIS_ DWORD LODNew);
+    STDMETHOD_(DWORD, GetLOD)(THIS);
+    STDMETHOD_(DWORD, GetLevelCount)(THIS);
+    STDMETHOD(SetAutoGenFilterType)(THIS_ D3DTEXTUREFILTERTYPE FilterType);
+    STDMETHOD_(D3DTEXTUREFILTERTYPE, GetAutoGenFilterType)(THIS);
+    STDMETHOD_(void, GenerateMipSubLevels)(THIS);
+
+    /*** IDirect3DTexture9 methods ***/
+    STDMETHOD(GetLevelDesc)(THIS_ UINT Level,D3DSURFACE_DESC *pDesc);
+    STDMETHOD(GetSurfaceLevel)(THIS_ UINT Level,IDirect3DSurface9** ppSurfaceLevel);
+    STDMETHOD(LockRect)(THIS_ UINT Level,D3DLOCKED_RECT* pLockedRect,CONST RECT* pRect,DWORD Flags);
+    STDMETHOD(UnlockRect)(THIS_ UINT Level);
+    STDMETHOD(AddDirtyRect)(THIS_ CONST RECT* pDirtyRect);
+
+private:
+    ~Direct3DTexture9Hooks ();
+
+    struct level_state {
+        unsigned __int64 hash;
+        bool hashed;
+        bool writing;
+        bool whole;
+        D3DLOCKED_RECT locked;
+    };
+
+    bool hash_level (UINT level, const D3DLOCKED_RECT& locked, unsigned __int64* hash);
+    bool read_level_hash (UINT level);
+    bool same_contents (Direct3DTexture9Hooks* other);
+
+    // Stops sharing before the game writes, so the write only reaches
+    // this texture
+    void leave_shared ();
+
+    Direct3DDevice9Hooks* device;
+    IDirect3DTexture9* inner;
+    ULONG ref_count;
+    std::vector<level_state> levels;
+    shared_texture* shared;
+    bool dirty;
+    bool dedup;
+
+    // Set once a surface has been handed out; writes through it can't be
+    // seen, so the texture is never shared again
+    bool escaped;
+};
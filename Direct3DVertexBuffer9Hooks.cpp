@@ -0,0 +1,201 @@
+//====================================================================
+// Hooked IDirect3DVertexBuffer9 interface implementation.
+//
+// Static vertex buffers are mirrored in system memory so that we can
+// inspect mesh data (e.g. to compute bounds) without ever reading back
+// from the GPU. Dynamic buffers are straight thunks.
+//====================================================================
+
+#include "Direct3DVertexBuffer9Hooks.h"
+#include "Direct3DDevice9Hooks.h"
+#include "Direct3DDevice9Pipeline.h"
+
+// Versions are unique across all buffers so a recycled buffer address
+// never looks like unchanged contents
+static volatile LONG s_next_version = 0;
+
+// {5C2F1A4E-7D0B-4F5E-9B8E-3A6D2C1F0B71}
+static const GUID s_wrapper_guid = { 0x5c2f1a4e, 0x7d0b, 0x4f5e, { 0x9b, 0x8e, 0x3a, 0x6d, 0x2c, 0x1f, 0x0b, 0x71 } };
+
+Direct3DVertexBuffer9Hooks::Direct3DVertexBuffer9Hooks (Direct3DDevice9Hooks* device, IDirect3DVertexBuffer9* inner, UINT length, DWORD usage, Direct3DDevice9Pipeline* pipeline)
+{
+    this->device = device;
+    this->inner = inner;
+    this->pipeline = pipeline;
+    this->ref_count = 1;
+    this->buffer_length = length;
+    this->content_version = InterlockedIncrement(&s_next_version);
+    this->shadow_locked = false;
+    if (!(usage & D3DUSAGE_DYNAMIC))
+    {
+        this->shadow.resize(length);
+    }
+
+    // Tag the real buffer so we can find our wrapper from it later
+    Direct3DVertexBuffer9Hooks* self = this;
+    this->inner->SetPrivateData(s_wrapper_guid, &self, sizeof(self), 0);
+}
+
+Direct3DVertexBuffer9Hooks::~Direct3DVertexBuffer9Hooks ()
+{
+    this->device->forget_vertex_buffer(this);
+    this->inner->FreePrivateData(s_wrapper_guid);
+    this->inner->Release();
+}
+
+void Direct3DVertexBuffer9Hooks::flush_pipeline (DWORD lock_flags)
+{
+    // No-overwrite promises not to touch anything the queued draws use.
+    // Discarding would hand the game a fresh buffer, but the rename
+    // happens now, ahead of draws still in the ring that read the old
+    // contents, so those locks have to wait too.
+    if (this->pipeline && !(lock_flags & D3DLOCK_NOOVERWRITE))
+    {
+        this->pipeline->fence();
+    }
+}
+
+IDirect3DVertexBuffer9* Direct3DVertexBuffer9Hooks::unwrap (IDirect3DVertexBuffer9* buffer)
+{
+    return buffer ? static_cast<Direct3DVertexBuffer9Hooks*>(buffer)->inner : 0;
+}
+
+Direct3DVertexBuffer9Hooks* Direct3DVertexBuffer9Hooks::wrapper_of (IDirect3DVertexBuffer9* inner)
+{
+    if (!inner)
+    {
+        return 0;
+    }
+    Direct3DVertexBuffer9Hooks* wrapper = 0;
+    DWORD size = sizeof(wrapper);
+    if (FAILED(inner->GetPrivateData(s_wrapper_guid, &wrapper, &size)))
+    {
+        return 0;
+    }
+    return wrapper;
+}
+
+const unsigned char* Direct3DVertexBuffer9Hooks::shadow_data () const
+{
+    return this->shadow.empty() ? 0 : &this->shadow[0];
+}
+
+/*** IUnknown methods ***/
+HRESULT Direct3DVertexBuffer9Hooks::QueryInterface (REFIID riid, void** ppvObj)
+{
+    if (riid == IID_IUnknown || riid == IID_IDirect3DResource9 || riid == IID_IDirect3DVertexBuffer9)
+    {
+        this->AddRef();
+        *ppvObj = this;
+        return S_OK;
+    }
+    return this->inner->QueryInterface(riid, ppvObj);
+}
+
+ULONG Direct3DVertexBuffer9Hooks::AddRef ()
+{
+    return InterlockedIncrement((LONG*)&this->ref_count);
+}
+
+ULONG Direct3DVertexBuffer9Hooks::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        delete this;
+    }
+    return count;
+}
+
+/*** IDirect3DResource9 methods ***/
+HRESULT Direct3DVertexBuffer9Hooks::GetDevice (IDirect3DDevice9** ppDevice)
+{
+    IDirect3DDevice9* device = this->device;
+    device->AddRef();
+    *ppDevice = device;
+    return D3D_OK;
+}
+
+HRESULT Direct3DVertexBuffer9Hooks::SetPrivateData (REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags)
+{
+    return this->inner->SetPrivateData(refguid, pData, SizeOfData, Flags);
+}
+
+HRESULT Direct3DVertexBuffer9Hooks::GetPrivateData (REFGUID refguid,void* pData,DWORD* pSizeOfData)
+{
+    return this->inner->GetPrivateData(refguid, pData, pSizeOfData);
+}
+
+HRESULT Direct3DVertexBuffer9Hooks::FreePrivateData (REFGUID refguid)
+{
+    return this->inner->FreePrivateData(refguid);
+}
+
+DWORD Direct3DVertexBuffer9Hooks::SetPriority (DWORD PriorityNew)
+{
+    return this->inner->SetPriority(PriorityNew);
+}
+
+DWORD Direct3DVertexBuffer9Hooks::GetPriority ()
+{
+    return this->inner->GetPriority();
+}
+
+void Direct3DVertexBuffer9Hooks::PreLoad ()
+{
+    return this->inner->PreLoad();
+}
+
+D3DRESOURCETYPE Direct3DVertexBuffer9Hooks::GetType ()
+{
+    return this->inner->GetType();
+}
+
+/*** IDirect3DVertexBuffer9 methods ***/
+HRESULT Direct3DVertexBuffer9Hooks::Lock (UINT OffsetToLock,UINT SizeToLock,void** ppbData,DWORD Flags)
+{
+    if (this->shadow.empty() || (Flags & D3DLOCK_READONLY) || this->shadow_locked)
+    {
+        this->flush_pipeline(Flags);
+        return this->inner->Lock(OffsetToLock, SizeToLock, ppbData, Flags);
+    }
+
+    // Zero sized locks mean the whole buffer
+    if (SizeToLock == 0 || OffsetToLock + SizeToLock > this->buffer_length)
+    {
+        SizeToLock = this->buffer_length - min(OffsetToLock, this->buffer_length);
+    }
+
+    // Hand out the shadow, the real buffer is written on Unlock
+    this->shadow_locked = true;
+    this->locked_offset = OffsetToLock;
+    this->locked_size = SizeToLock;
+    this->locked_flags = Flags;
+    *ppbData = &this->shadow[0] + OffsetToLock;
+    return D3D_OK;
+}
+
+HRESULT Direct3DVertexBuffer9Hooks::Unlock ()
+{
+    if (!this->shadow_locked)
+    {
+        return this->inner->Unlock();
+    }
+    this->shadow_locked = false;
+    this->content_version = InterlockedIncrement(&s_next_version);
+
+    void* data;
+    this->flush_pipeline(this->locked_flags);
+    HRESULT result = this->inner->Lock(this->locked_offset, this->locked_size, &data, this->locked_flags);
+    if (FAILED(result))
+    {
+        return result;
+    }
+    memcpy(data, &this->shadow[0] + this->locked_offset, this->locked_size);
+    return this->inner->Unlock();
+}
+
+HRESULT Direct3DVertexBuffer9Hooks::GetDesc (D3DVERTEXBUFFER_DESC *pDesc)
+{
+    return this->inner->GetDesc(pDesc);
+}
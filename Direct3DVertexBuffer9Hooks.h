@@ -0,0 +1,71 @@
+//====================================================================
+// Hooked IDirect3DVertexBuffer9 interface definition.
+//====================================================================
+
+#pragma once
+
+#include <vector>
+
+#include <d3d9.h>
+
+class Direct3DDevice9Hooks;
+class Direct3DDevice9Pipeline;
+
+class Direct3DVertexBuffer9Hooks : public IDirect3DVertexBuffer9
+{
+public:
+    Direct3DVertexBuffer9Hooks (Direct3DDevice9Hooks* device, IDirect3DVertexBuffer9* inner, UINT length, DWORD usage, Direct3DDevice9Pipeline* pipeline);
+
+    // Map between hooked buffers and the real ones. Both accept null.
+    static IDirect3DVertexBuffer9* unwrap (IDirect3DVertexBuffer9* buffer);
+    static Direct3DVertexBuffer9Hooks* wrapper_of (IDirect3DVertexBuffer9* inner);
+
+    // System memory copy of the buffer contents, or null for dynamic
+    // buffers which get rewritten too often to be worth mirroring.
+    const unsigned char* shadow_data () const;
+    UINT length () const { return this->buffer_length; }
+
+    // Bumped every time the game writes to the buffer.
+    unsigned int version () const { return this->content_version; }
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj);
+    STDMETHOD_(ULONG,AddRef)(THIS);
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DResource9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice);
+    STDMETHOD(SetPrivateData)(THIS_ REFGUID refguid,CONST void* pData,DWORD SizeOfData,DWORD Flags);
+    STDMETHOD(GetPrivateData)(THIS_ REFGUID refguid,void* pData,DWORD* pSizeOfData);
+    STDMETHOD(FreePrivateData)(THIS_ REFGUID refguid);
+    STDMETHOD_(DWORD, SetPriority)(THIS_ DWORD PriorityNew);
+    STDMETHOD_(DWORD, GetPriority)(THIS);
+    STDMETHOD_(void, PreLoad)(THIS);
+    STDMETHOD_(D3DRESOURCETYPE, GetType)(THIS);
+
+    /*** IDirect3DVertexBuffer9 methods ***/
+    STDMETHOD(Lock)(THIS_ UINT OffsetToLock,UINT SizeToLock,void** ppbData,DWORD Flags);
+    STDMETHOD(Unlock)(THIS);
+    STDMETHOD(GetDesc)(THIS_ D3DVERTEXBUFFER_DESC *pDesc);
+
+private:
+    ~Direct3DVertexBuffer9Hooks ();
+
+    Direct3DDevice9Hooks* device;
+    IDirect3DVertexBuffer9* inner;
+    Direct3DDevice9Pipeline* pipeline;
+    ULONG ref_count;
+    UINT buffer_length;
+    unsigned int content_version;
+
+    // Writes to static buffers land in the shadow first and are copied
+    // to the real buffer on Unlock
+    std::vector<unsigned char> shadow;
+    bool shadow_locked;
+    UINT locked_offset;
+    UINT locked_size;
+    DWORD locked_flags;
+
+    // Waits for queued draws that may still read the real buffer
+    void flush_pipeline (DWORD lock_flags);
+};
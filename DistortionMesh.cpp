@@ -0,0 +1,188 @@
+//====================================================================
+// Cached lens distortion mesh implementation.
+//====================================================================
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "DistortionMesh.h"
+
+static const char s_dump_magic[8] = { 'P', 'V', 'R', 'M', 'E', 'S', 'H', '1' };
+
+// Attributes per vertex, all floats
+static const int s_vertex_floats = sizeof(distortion_vertex) / sizeof(float);
+
+static void put_u32 (std::vector<unsigned char>& out, unsigned int value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out.push_back((unsigned char)(value >> (i * 8)));
+    }
+}
+
+static bool get_u32 (const unsigned char*& data, const unsigned char* end, unsigned int* value)
+{
+    if (end - data < 4)
+    {
+        return false;
+    }
+    *value = data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24);
+    data += 4;
+    return true;
+}
+
+static bool valid_triangles (const unsigned short* indices, unsigned int index_count, unsigned int vertex_count)
+{
+    if (index_count % 3 != 0)
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < index_count; ++i)
+    {
+        if (indices[i] >= vertex_count)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+DistortionMesh::DistortionMesh ()
+{
+}
+
+bool DistortionMesh::assign (const distortion_vertex* vertices, unsigned int vertex_count, const unsigned short* indices, unsigned int index_count)
+{
+    this->vertex_data.clear();
+    this->index_data.clear();
+    if (!valid_triangles(indices, index_count, vertex_count))
+    {
+        return false;
+    }
+    this->vertex_data.assign(vertices, vertices + vertex_count);
+    this->index_data.assign(indices, indices + index_count);
+    return true;
+}
+
+bool DistortionMesh::empty () const
+{
+    return this->index_data.empty();
+}
+
+unsigned int DistortionMesh::vertex_count () const
+{
+    return (unsigned int)this->vertex_data.size();
+}
+
+unsigned int DistortionMesh::index_count () const
+{
+    return (unsigned int)this->index_data.size();
+}
+
+const distortion_vertex* DistortionMesh::vertices () const
+{
+    return this->vertex_data.empty() ? 0 : &this->vertex_data[0];
+}
+
+const unsigned short* DistortionMesh::indices () const
+{
+    return this->index_data.empty() ? 0 : &this->index_data[0];
+}
+
+void DistortionMesh::write (std::vector<unsigned char>& out) const
+{
+    out.insert(out.end(), s_dump_magic, s_dump_magic + sizeof(s_dump_magic));
+    put_u32(out, this->vertex_count());
+    put_u32(out, this->index_count());
+    for (size_t i = 0; i < this->vertex_data.size(); ++i)
+    {
+        const float* attributes = &this->vertex_data[i].screen_pos[0];
+        for (int j = 0; j < s_vertex_floats; ++j)
+        {
+            unsigned int bits;
+            memcpy(&bits, &attributes[j], sizeof(bits));
+            put_u32(out, bits);
+        }
+    }
+    for (size_t i = 0; i < this->index_data.size(); ++i)
+    {
+        out.push_back((unsigned char)this->index_data[i]);
+        out.push_back((unsigned char)(this->index_data[i] >> 8));
+    }
+}
+
+bool DistortionMesh::read (const unsigned char*& data, const unsigned char* end)
+{
+    this->vertex_data.clear();
+    this->index_data.clear();
+
+    const unsigned char* in = data;
+    unsigned int vertex_count;
+    unsigned int index_count;
+    if (end - in < (ptrdiff_t)sizeof(s_dump_magic) || memcmp(in, s_dump_magic, sizeof(s_dump_magic)) != 0)
+    {
+        return false;
+    }
+    in += sizeof(s_dump_magic);
+    if (!get_u32(in, end, &vertex_count) || !get_u32(in, end, &index_count))
+    {
+        return false;
+    }
+
+    // Check the size up front rather than trust the counts with memory
+    unsigned long long size = (unsigned long long)vertex_count * s_vertex_floats * 4 + (unsigned long long)index_count * 2;
+    if ((unsigned long long)(end - in) < size)
+    {
+        return false;
+    }
+
+    std::vector<distortion_vertex> vertices(vertex_count);
+    for (unsigned int i = 0; i < vertex_count; ++i)
+    {
+        float* attributes = &vertices[i].screen_pos[0];
+        for (int j = 0; j < s_vertex_floats; ++j)
+        {
+            unsigned int bits;
+            get_u32(in, end, &bits);
+            memcpy(&attributes[j], &bits, sizeof(bits));
+        }
+    }
+    std::vector<unsigned short> indices(index_count);
+    for (unsigned int i = 0; i < index_count; ++i)
+    {
+        indices[i] = (unsigned short)(in[0] | (in[1] << 8));
+        in += 2;
+    }
+    if (!valid_triangles(index_count ? &indices[0] : 0, index_count, vertex_count))
+    {
+        return false;
+    }
+
+    this->vertex_data.swap(vertices);
+    this->index_data.swap(indices);
+    data = in;
+    return true;
+}
+
+bool DistortionMesh::matches (const DistortionMesh& reference, float tolerance) const
+{
+    if (this->vertex_data.size() != reference.vertex_data.size() || this->index_data != reference.index_data)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < this->vertex_data.size(); ++i)
+    {
+        const float* attributes = &this->vertex_data[i].screen_pos[0];
+        const float* expected = &reference.vertex_data[i].screen_pos[0];
+        for (int j = 0; j < s_vertex_floats; ++j)
+        {
+            // Written so a NaN on either side never matches
+            if (!(fabs(attributes[j] - expected[j]) <= tolerance))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
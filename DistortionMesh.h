@@ -0,0 +1,59 @@
+//====================================================================
+// Cached lens distortion mesh and its dump format.
+//
+// Holds a copy of one eye's mesh as LibOVR generated it, which is what
+// gets uploaded, and can write it out and read it back so meshes from
+// a headset can be kept as references and compared against later.
+// Deliberately free of Windows, Direct3D and LibOVR types so dumps can
+// be checked offline.
+//
+// Dump layout, little endian:
+//
+//     "PVRMESH1"
+//     vertex count u32, index count u32
+//     per vertex: 10 f32 in distortion_vertex order
+//     per index: u16
+//====================================================================
+
+#pragma once
+
+#include <vector>
+
+// Same layout as ovrDistortionVertex
+struct distortion_vertex {
+    float screen_pos[2];
+    float timewarp_factor;
+    float vignette_factor;
+    float tan_eye_angles[3][2]; // red, green, blue
+};
+
+class DistortionMesh
+{
+public:
+    DistortionMesh ();
+
+    // Takes a copy. False, leaving the mesh empty, unless the indices
+    // make whole triangles of the given vertices.
+    bool assign (const distortion_vertex* vertices, unsigned int vertex_count, const unsigned short* indices, unsigned int index_count);
+
+    bool empty () const;
+    unsigned int vertex_count () const;
+    unsigned int index_count () const;
+    const distortion_vertex* vertices () const;
+    const unsigned short* indices () const;
+
+    // Appends the dump
+    void write (std::vector<unsigned char>& out) const;
+
+    // Consumes one dump from the front of [data, end). False on a short
+    // or malformed dump.
+    bool read (const unsigned char*& data, const unsigned char* end);
+
+    // True if both have the same triangles and no vertex attribute is
+    // further than tolerance from the reference's
+    bool matches (const DistortionMesh& reference, float tolerance) const;
+
+private:
+    std::vector<distortion_vertex> vertex_data;
+    std::vector<unsigned short> index_data;
+};
@@ -0,0 +1,330 @@
+//====================================================================
+// Client-side lens distortion implementation.
+//
+// The meshes come straight from ovrHmd_CreateDistortionMesh and are
+// uploaded as-is, so the vertex declaration mirrors
+// ovrDistortionVertex. Shader constants use fixed registers:
+//
+//     c0      eye texture UV scale (xy) and offset (zw)
+//     c1      half pixel offset for D3D9 rasterization
+//     c2-c5   timewarp rotation at the start of scanout
+//     c6-c9   timewarp rotation at the end of scanout
+//====================================================================
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <d3dx9.h>
+
+#include "DistortionRenderer.h"
+#include "Timewarp.h"
+
+static const char s_vertex_shader_source[] =
+    "float4 EyeToSourceUVScaleOffset : register(c0);\n"
+    "float4 PixelOffset : register(c1);\n"
+    "row_major float4x4 EyeRotationStart : register(c2);\n"
+    "row_major float4x4 EyeRotationEnd : register(c6);\n"
+    "\n"
+    "float2 timewarp (float2 tan_eye_angles, float4x4 rotation)\n"
+    "{\n"
+    "    float3 transformed = mul(rotation, float4(tan_eye_angles, 1, 1)).xyz;\n"
+    "    float2 flattened = transformed.xy / transformed.z;\n"
+    "    return flattened * EyeToSourceUVScaleOffset.xy + EyeToSourceUVScaleOffset.zw;\n"
+    "}\n"
+    "\n"
+    "void main (\n"
+    "    in float2 position : POSITION0,\n"
+    "    in float2 factors : TEXCOORD0,\n"
+    "    in float2 tan_eye_angles_r : TEXCOORD1,\n"
+    "    in float2 tan_eye_angles_g : TEXCOORD2,\n"
+    "    in float2 tan_eye_angles_b : TEXCOORD3,\n"
+    "    out float4 out_position : POSITION,\n"
+    "    out float4 out_vignette : COLOR0,\n"
+    "    out float2 out_uv_r : TEXCOORD0,\n"
+    "    out float2 out_uv_g : TEXCOORD1,\n"
+    "    out float2 out_uv_b : TEXCOORD2)\n"
+    "{\n"
+    "    float4x4 rotation = lerp(EyeRotationStart, EyeRotationEnd, factors.x);\n"
+    "    out_uv_r = timewarp(tan_eye_angles_r, rotation);\n"
+    "    out_uv_g = timewarp(tan_eye_angles_g, rotation);\n"
+    "    out_uv_b = timewarp(tan_eye_angles_b, rotation);\n"
+    "    out_position = float4(position + PixelOffset.xy, 0.5, 1.0);\n"
+    "    out_vignette = factors.yyyy;\n"
+    "}\n";
+
+static const char s_pixel_shader_source[] =
+    "sampler EyeTexture : register(s0);\n"
+    "\n"
+    "float4 main (\n"
+    "    in float4 vignette : COLOR0,\n"
+    "    in float2 uv_r : TEXCOORD0,\n"
+    "    in float2 uv_g : TEXCOORD1,\n"
+    "    in float2 uv_b : TEXCOORD2) : COLOR\n"
+    "{\n"
+    "    float r = tex2D(EyeTexture, uv_r).r;\n"
+    "    float g = tex2D(EyeTexture, uv_g).g;\n"
+    "    float b = tex2D(EyeTexture, uv_b).b;\n"
+    "    return float4(r, g, b, 1) * vignette;\n"
+    "}\n";
+
+static const D3DVERTEXELEMENT9 s_vertex_elements[] = {
+    { 0, offsetof(ovrDistortionVertex, ScreenPosNDC), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+    { 0, offsetof(ovrDistortionVertex, TimeWarpFactor), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 0 },
+    { 0, offsetof(ovrDistortionVertex, TanEyeAnglesR), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 1 },
+    { 0, offsetof(ovrDistortionVertex, TanEyeAnglesG), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 2 },
+    { 0, offsetof(ovrDistortionVertex, TanEyeAnglesB), D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_TEXCOORD, 3 },
+    D3DDECL_END()
+};
+
+// TimeWarpFactor and VignetteFactor are read as one float2
+C_ASSERT(offsetof(ovrDistortionVertex, VignetteFactor) == offsetof(ovrDistortionVertex, TimeWarpFactor) + sizeof(float));
+
+// The cache holds LibOVR's vertices as they are
+C_ASSERT(sizeof(distortion_vertex) == sizeof(ovrDistortionVertex));
+C_ASSERT(offsetof(distortion_vertex, timewarp_factor) == offsetof(ovrDistortionVertex, TimeWarpFactor));
+C_ASSERT(offsetof(distortion_vertex, tan_eye_angles) == offsetof(ovrDistortionVertex, TanEyeAnglesR));
+C_ASSERT(offsetof(distortion_vertex, tan_eye_angles[2]) == offsetof(ovrDistortionVertex, TanEyeAnglesB));
+
+static bool compile_shader (const char source[], const char profile[], ID3DXBuffer** code)
+{
+    ID3DXBuffer* errors = 0;
+    HRESULT result = D3DXCompileShader(source, (UINT)strlen(source), NULL, NULL, "main", profile, 0, code, &errors, NULL);
+    if (errors)
+    {
+        OutputDebugStringA((const char*)errors->GetBufferPointer());
+        errors->Release();
+    }
+    return SUCCEEDED(result);
+}
+
+DistortionRenderer::DistortionRenderer (ovrHmd hmd, const ovrFovPort eye_fov[2])
+{
+    this->hmd = hmd;
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        this->eye_fov[eye] = eye_fov[eye];
+        this->vertex_buffer[eye] = 0;
+        this->index_buffer[eye] = 0;
+        this->vertex_count[eye] = 0;
+        this->index_count[eye] = 0;
+    }
+    this->declaration = 0;
+    this->vertex_shader = 0;
+    this->pixel_shader = 0;
+}
+
+DistortionRenderer::~DistortionRenderer ()
+{
+    this->release();
+}
+
+void DistortionRenderer::release ()
+{
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        if (this->vertex_buffer[eye])
+        {
+            this->vertex_buffer[eye]->Release();
+            this->vertex_buffer[eye] = 0;
+        }
+        if (this->index_buffer[eye])
+        {
+            this->index_buffer[eye]->Release();
+            this->index_buffer[eye] = 0;
+        }
+    }
+    if (this->declaration)
+    {
+        this->declaration->Release();
+        this->declaration = 0;
+    }
+    if (this->vertex_shader)
+    {
+        this->vertex_shader->Release();
+        this->vertex_shader = 0;
+    }
+    if (this->pixel_shader)
+    {
+        this->pixel_shader->Release();
+        this->pixel_shader = 0;
+    }
+}
+
+bool DistortionRenderer::create (IDirect3DDevice9* device)
+{
+    this->release();
+
+    // Generate each eye's mesh only the first time round, then upload the
+    // cached copy into buffers of its own
+    unsigned int caps = ovrDistortionCap_Chromatic | ovrDistortionCap_TimeWarp | ovrDistortionCap_Vignette;
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        if (this->mesh[eye].empty())
+        {
+            ovrDistortionMesh generated;
+            if (!ovrHmd_CreateDistortionMesh(this->hmd, (ovrEyeType)eye, this->eye_fov[eye], caps, &generated))
+            {
+                OutputDebugStringA("PinballVRcade: couldn't create distortion mesh\n");
+                this->release();
+                return false;
+            }
+            bool cached = this->mesh[eye].assign((const distortion_vertex*)generated.pVertexData, generated.VertexCount, generated.pIndexData, generated.IndexCount);
+            ovrHmd_DestroyDistortionMesh(&generated);
+            if (!cached)
+            {
+                OutputDebugStringA("PinballVRcade: distortion mesh isn't made of whole triangles\n");
+                this->release();
+                return false;
+            }
+        }
+
+        UINT vertex_bytes = this->mesh[eye].vertex_count() * sizeof(distortion_vertex);
+        UINT index_bytes = this->mesh[eye].index_count() * sizeof(unsigned short);
+        void* data;
+        bool uploaded =
+            SUCCEEDED(device->CreateVertexBuffer(vertex_bytes, D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &this->vertex_buffer[eye], NULL)) &&
+            SUCCEEDED(device->CreateIndexBuffer(index_bytes, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, &this->index_buffer[eye], NULL));
+        if (uploaded && SUCCEEDED(this->vertex_buffer[eye]->Lock(0, vertex_bytes, &data, 0)))
+        {
+            memcpy(data, this->mesh[eye].vertices(), vertex_bytes);
+            this->vertex_buffer[eye]->Unlock();
+        }
+        if (uploaded && SUCCEEDED(this->index_buffer[eye]->Lock(0, index_bytes, &data, 0)))
+        {
+            memcpy(data, this->mesh[eye].indices(), index_bytes);
+            this->index_buffer[eye]->Unlock();
+        }
+        this->vertex_count[eye] = this->mesh[eye].vertex_count();
+        this->index_count[eye] = this->mesh[eye].index_count();
+        if (!uploaded)
+        {
+            this->release();
+            return false;
+        }
+    }
+
+    // Compile the shader pair
+    ID3DXBuffer* vertex_code = 0;
+    ID3DXBuffer* pixel_code = 0;
+    bool compiled =
+        compile_shader(s_vertex_shader_source, "vs_2_0", &vertex_code) &&
+        compile_shader(s_pixel_shader_source, "ps_2_0", &pixel_code);
+    bool created = compiled &&
+        SUCCEEDED(device->CreateVertexShader((const DWORD*)vertex_code->GetBufferPointer(), &this->vertex_shader)) &&
+        SUCCEEDED(device->CreatePixelShader((const DWORD*)pixel_code->GetBufferPointer(), &this->pixel_shader)) &&
+        SUCCEEDED(device->CreateVertexDeclaration(s_vertex_elements, &this->declaration));
+    if (vertex_code)
+    {
+        vertex_code->Release();
+    }
+    if (pixel_code)
+    {
+        pixel_code->Release();
+    }
+    if (!created)
+    {
+        this->release();
+        return false;
+    }
+    return true;
+}
+
+bool DistortionRenderer::dump (const char path[]) const
+{
+    std::vector<unsigned char> out;
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        this->mesh[eye].write(out);
+    }
+    FILE* file;
+    if (fopen_s(&file, path, "wb") != 0)
+    {
+        OutputDebugStringA("PinballVRcade: couldn't open the distortion mesh dump\n");
+        return false;
+    }
+    bool written = fwrite(&out[0], 1, out.size(), file) == out.size();
+    fclose(file);
+    return written;
+}
+
+void DistortionRenderer::render (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrPosef render_pose[2])
+{
+    // Start and end of scanout rotations
+    ovrMatrix4f timewarp[2][2];
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        ovrHmd_GetEyeTimewarpMatrices(this->hmd, (ovrEyeType)eye, render_pose[eye], timewarp[eye]);
+    }
+    this->draw(device, eye_texture, texture_size, eye_viewport, timewarp);
+}
+
+void DistortionRenderer::render_reprojected (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrPosef render_pose[2], const ovrPosef latest_pose[2])
+{
+    // The latest pose is already as fresh as it gets, so scanout start
+    // and end share one rotation
+    ovrMatrix4f timewarp[2][2];
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        const ovrQuatf& rendered = render_pose[eye].Orientation;
+        const ovrQuatf& latest = latest_pose[eye].Orientation;
+        timewarp_quat rendered_quat = { rendered.x, rendered.y, rendered.z, rendered.w };
+        timewarp_quat latest_quat = { latest.x, latest.y, latest.z, latest.w };
+        timewarp_orientation_matrix(rendered_quat, latest_quat, timewarp[eye][0].M);
+        timewarp[eye][1] = timewarp[eye][0];
+    }
+    this->draw(device, eye_texture, texture_size, eye_viewport, timewarp);
+}
+
+void DistortionRenderer::draw (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrMatrix4f timewarp[2][2])
+{
+    // Cover the whole target; the meshes don't reach into the corners
+    IDirect3DSurface9* target;
+    device->GetRenderTarget(0, &target);
+    D3DSURFACE_DESC desc;
+    target->GetDesc(&desc);
+    target->Release();
+    D3DVIEWPORT9 viewport = { 0, 0, desc.Width, desc.Height, 0.0f, 1.0f };
+    device->SetViewport(&viewport);
+    device->Clear(0, NULL, D3DCLEAR_TARGET, D3DCOLOR_XRGB(0, 0, 0), 1.0f, 0);
+
+    // Only the state this pass depends on; the game sets everything it
+    // needs at the start of each frame
+    device->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+    device->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+    device->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+    device->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+    device->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+    device->SetRenderState(D3DRS_SCISSORTESTENABLE, FALSE);
+    device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    device->SetRenderState(D3DRS_COLORWRITEENABLE, 0xF);
+    device->SetRenderState(D3DRS_SRGBWRITEENABLE, FALSE);
+    device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+    device->SetSamplerState(0, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
+    device->SetSamplerState(0, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
+    device->SetSamplerState(0, D3DSAMP_SRGBTEXTURE, FALSE);
+    device->SetTexture(0, eye_texture);
+    device->SetVertexDeclaration(this->declaration);
+    device->SetVertexShader(this->vertex_shader);
+    device->SetPixelShader(this->pixel_shader);
+
+    float pixel_offset[4] = { -1.0f / desc.Width, 1.0f / desc.Height, 0.0f, 0.0f };
+    device->SetVertexShaderConstantF(1, pixel_offset, 1);
+
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        ovrVector2f uv_scale_offset[2];
+        ovrHmd_GetRenderScaleAndOffset(this->eye_fov[eye], texture_size, eye_viewport[eye], uv_scale_offset);
+        float scale_offset[4] = { uv_scale_offset[0].x, uv_scale_offset[0].y, uv_scale_offset[1].x, uv_scale_offset[1].y };
+        device->SetVertexShaderConstantF(0, scale_offset, 1);
+
+        // Rows map straight onto registers
+        device->SetVertexShaderConstantF(2, &timewarp[eye][0].M[0][0], 4);
+        device->SetVertexShaderConstantF(6, &timewarp[eye][1].M[0][0], 4);
+
+        device->SetStreamSource(0, this->vertex_buffer[eye], 0, sizeof(ovrDistortionVertex));
+        device->SetIndices(this->index_buffer[eye]);
+        device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, this->vertex_count[eye], 0, this->index_count[eye] / 3);
+    }
+}
@@ -0,0 +1,61 @@
+//====================================================================
+// Client-side lens distortion.
+//
+// Replaces LibOVR's SDK-rendered distortion pass. The per-eye meshes
+// are generated once through the LibOVR mesh API, cached, and kept in
+// managed vertex and index buffers, and each frame is drawn with our
+// own small shader pair and only the render state it actually depends
+// on.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+#include <OVR.h>
+
+#include "DistortionMesh.h"
+
+class DistortionRenderer
+{
+public:
+    DistortionRenderer (ovrHmd hmd, const ovrFovPort eye_fov[2]);
+    ~DistortionRenderer ();
+
+    // Builds the meshes, shaders and vertex declaration. Everything lives
+    // in the managed pool or is pool independent, so nothing needs to be
+    // recreated around a Reset.
+    bool create (IDirect3DDevice9* device);
+
+    // Writes both eyes' cached meshes, left first, as reference dumps
+    bool dump (const char path[]) const;
+
+    // Draws both eyes from the eye texture into the current render target,
+    // timewarping from the poses the eyes were rendered with. Must be
+    // called inside BeginScene/EndScene.
+    void render (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrPosef render_pose[2]);
+
+    // Same, but rotates straight from the render orientations to the given
+    // latest ones without asking LibOVR, for re-presenting an old frame
+    // outside of its frame timing
+    void render_reprojected (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrPosef render_pose[2], const ovrPosef latest_pose[2]);
+
+private:
+    DistortionRenderer (const DistortionRenderer&);
+    DistortionRenderer& operator= (const DistortionRenderer&);
+
+    void release ();
+    void draw (IDirect3DDevice9* device, IDirect3DTexture9* eye_texture, const ovrSizei& texture_size, const ovrRecti eye_viewport[2], const ovrMatrix4f timewarp[2][2]);
+
+    ovrHmd hmd;
+    ovrFovPort eye_fov[2];
+    DistortionMesh mesh[2];
+
+    IDirect3DVertexBuffer9* vertex_buffer[2];
+    IDirect3DIndexBuffer9* index_buffer[2];
+    UINT vertex_count[2];
+    UINT index_count[2];
+
+    IDirect3DVertexDeclaration9* declaration;
+    IDirect3DVertexShader9* vertex_shader;
+    IDirect3DPixelShader9* pixel_shader;
+};
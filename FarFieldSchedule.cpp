@@ -0,0 +1,62 @@
+//====================================================================
+// Far field layer scheduling implementation.
+//====================================================================
+
+#include "FarFieldSchedule.h"
+
+FarFieldSchedule::FarFieldSchedule ()
+{
+    this->depth = 0;
+    this->layer_drawn = false;
+    this->composited = false;
+}
+
+void FarFieldSchedule::configure (float depth)
+{
+    this->depth = depth;
+    this->layer_drawn = false;
+    this->composited = false;
+}
+
+bool FarFieldSchedule::open () const
+{
+    return this->depth > 0 && !this->composited;
+}
+
+bool FarFieldSchedule::is_far (float nearest_depth) const
+{
+    return this->open() && nearest_depth > this->depth;
+}
+
+bool FarFieldSchedule::begin_far_draw ()
+{
+    bool clear = !this->layer_drawn;
+    this->layer_drawn = true;
+    return clear;
+}
+
+bool FarFieldSchedule::begin_near_draw ()
+{
+    // Only the first near draw of a frame finds the eyes still empty
+    if (this->composited)
+    {
+        return false;
+    }
+    this->composited = true;
+    bool drawn = this->layer_drawn;
+    this->layer_drawn = false;
+    return drawn;
+}
+
+void FarFieldSchedule::cleared ()
+{
+    // Whatever the layer held is cleared away too; what's drawn into it
+    // from here on goes under the next near draw
+    this->layer_drawn = false;
+    this->composited = false;
+}
+
+void FarFieldSchedule::presented ()
+{
+    this->composited = false;
+}
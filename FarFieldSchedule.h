@@ -0,0 +1,51 @@
+//====================================================================
+// When scene draws go into the far field layer, and when the layer
+// has to be cleared and composited into the eyes.
+//
+// Meshes too far away for the eyes to see them apart are drawn once
+// into a shared layer, which becomes the eyes' background just before
+// the first thing that draws into them; far meshes that turn up after
+// that are drawn in stereo as usual. All of that follows from the
+// order of the game's calls alone, so this is deliberately free of
+// Windows and Direct3D types and can be replayed against recorded
+// call traces.
+//====================================================================
+
+#pragma once
+
+class FarFieldSchedule
+{
+public:
+    FarFieldSchedule ();
+
+    // Meshes whose nearest point is further away than depth are far. Zero
+    // keeps everything in stereo.
+    void configure (float depth);
+
+    // False once the layer has gone into the eyes, until they're cleared
+    // or the frame is presented
+    bool open () const;
+
+    // True if a mesh whose nearest point is this far away goes into the
+    // layer
+    bool is_far (float nearest_depth) const;
+
+    // A far mesh is about to be drawn into the layer. True if the layer
+    // has to be cleared first.
+    bool begin_far_draw ();
+
+    // Something is about to be drawn into the eyes. True if the layer has
+    // to be composited into them first.
+    bool begin_near_draw ();
+
+    // The eyes were cleared, along with anything already composited
+    void cleared ();
+
+    // The frame went out after a final begin_near_draw
+    void presented ();
+
+private:
+    float depth;
+    bool layer_drawn;
+    bool composited;
+};
@@ -0,0 +1,238 @@
+//====================================================================
+// Stall-free frame capture implementation.
+//====================================================================
+
+#include <string.h>
+
+#include "FrameCapture.h"
+
+FrameCapture::FrameCapture (IDirect3DDevice9* device, const char* path)
+{
+    this->device = device;
+    memset(this->slots, 0, sizeof(this->slots));
+    this->current = 0;
+    this->width = 0;
+    this->height = 0;
+    this->format = D3DFMT_UNKNOWN;
+    InitializeCriticalSection(&this->lock);
+    this->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    this->thread = 0;
+    this->stop = 0;
+    this->queue_head = 0;
+    this->queue_count = 0;
+    this->captured_frames = 0;
+    this->dropped_frames = 0;
+
+    if (fopen_s(&this->file, path, "wb") != 0)
+    {
+        this->file = 0;
+        OutputDebugStringA("PinballVRcade: couldn't open the capture file, capture disabled\n");
+        return;
+    }
+    this->encoder.begin(this->encoded);
+    fwrite(&this->encoded[0], 1, this->encoded.size(), this->file);
+    this->encoded.clear();
+
+    // Encoding must never take time from the game's threads
+    this->thread = CreateThread(NULL, 0, &FrameCapture::thread_main, this, 0, NULL);
+    if (this->thread)
+    {
+        SetThreadPriority(this->thread, THREAD_PRIORITY_BELOW_NORMAL);
+    }
+}
+
+FrameCapture::~FrameCapture ()
+{
+    // Whatever is already queued still gets written
+    if (this->thread)
+    {
+        InterlockedExchange(&this->stop, 1);
+        SetEvent(this->wake);
+        WaitForSingleObject(this->thread, INFINITE);
+        CloseHandle(this->thread);
+    }
+    if (this->file)
+    {
+        fclose(this->file);
+    }
+    CloseHandle(this->wake);
+    DeleteCriticalSection(&this->lock);
+    this->release_slots();
+}
+
+void FrameCapture::release_slots ()
+{
+    for (int i = 0; i < FRAME_CAPTURE_RING; ++i)
+    {
+        slot& s = this->slots[i];
+        if (s.copy)
+        {
+            s.copy->Release();
+            s.copy = 0;
+        }
+        if (s.surface)
+        {
+            s.surface->Release();
+            s.surface = 0;
+        }
+        if (s.done)
+        {
+            s.done->Release();
+            s.done = 0;
+        }
+        s.pending = false;
+    }
+    this->width = 0;
+    this->height = 0;
+}
+
+bool FrameCapture::create_slots (const D3DSURFACE_DESC& desc)
+{
+    this->release_slots();
+    if (desc.Format != D3DFMT_X8R8G8B8 && desc.Format != D3DFMT_A8R8G8B8)
+    {
+        return false;
+    }
+    bool created = true;
+    for (int i = 0; created && i < FRAME_CAPTURE_RING; ++i)
+    {
+        slot& s = this->slots[i];
+        created =
+            SUCCEEDED(this->device->CreateRenderTarget(desc.Width, desc.Height, desc.Format, D3DMULTISAMPLE_NONE, 0, FALSE, &s.copy, NULL)) &&
+            SUCCEEDED(this->device->CreateOffscreenPlainSurface(desc.Width, desc.Height, desc.Format, D3DPOOL_SYSTEMMEM, &s.surface, NULL)) &&
+            SUCCEEDED(this->device->CreateQuery(D3DQUERYTYPE_EVENT, &s.done));
+    }
+    if (!created)
+    {
+        OutputDebugStringA("PinballVRcade: couldn't create capture surfaces\n");
+        this->release_slots();
+        return false;
+    }
+    this->width = desc.Width;
+    this->height = desc.Height;
+    this->format = desc.Format;
+    return true;
+}
+
+void FrameCapture::capture (IDirect3DSurface9* source, double time)
+{
+    if (!this->valid())
+    {
+        return;
+    }
+    D3DSURFACE_DESC desc;
+    source->GetDesc(&desc);
+    if (desc.MultiSampleType != D3DMULTISAMPLE_NONE)
+    {
+        return;
+    }
+    if ((desc.Width != this->width || desc.Height != this->height || desc.Format != this->format) && !this->create_slots(desc))
+    {
+        return;
+    }
+
+    // The slot we're about to reuse was copied into FRAME_CAPTURE_RING frames ago
+    slot& s = this->slots[this->current];
+    if (s.pending)
+    {
+        this->collect(s);
+        s.pending = false;
+    }
+    if (FAILED(this->device->StretchRect(source, NULL, s.copy, NULL, D3DTEXF_NONE)) ||
+        FAILED(this->device->GetRenderTargetData(s.copy, s.surface)))
+    {
+        return;
+    }
+    s.done->Issue(D3DISSUE_END);
+    s.time = time;
+    s.pending = true;
+    this->current = (this->current + 1) % FRAME_CAPTURE_RING;
+}
+
+void FrameCapture::reset ()
+{
+    this->release_slots();
+    this->current = 0;
+}
+
+void FrameCapture::collect (slot& s)
+{
+    // Never flush; a readback that isn't done yet is dropped, as is a
+    // frame the worker has no room for. Once the query behind it has
+    // signalled, the lock doesn't wait for anything.
+    BOOL done;
+    bool ready = s.done->GetData(&done, sizeof(done), 0) == S_OK;
+    EnterCriticalSection(&this->lock);
+    bool room = this->queue_count < FRAME_CAPTURE_QUEUE;
+    LeaveCriticalSection(&this->lock);
+    D3DLOCKED_RECT locked;
+    if (!ready || !room || FAILED(s.surface->LockRect(&locked, NULL, D3DLOCK_READONLY)))
+    {
+        ++this->dropped_frames;
+    }
+    else
+    {
+        this->staging.resize((size_t)locked.Pitch * this->height);
+        memcpy(&this->staging[0], locked.pBits, this->staging.size());
+        s.surface->UnlockRect();
+
+        EnterCriticalSection(&this->lock);
+        queued_frame& f = this->queue[(this->queue_head + this->queue_count) % FRAME_CAPTURE_QUEUE];
+        f.pixels.swap(this->staging);
+        f.width = this->width;
+        f.height = this->height;
+        f.pitch = locked.Pitch;
+        f.time = s.time;
+        ++this->queue_count;
+        LeaveCriticalSection(&this->lock);
+        SetEvent(this->wake);
+        ++this->captured_frames;
+    }
+
+    if (this->captured_frames + this->dropped_frames >= 300)
+    {
+        char message[128];
+        sprintf_s(message, "PinballVRcade: captured %u frames, dropped %u\n", this->captured_frames, this->dropped_frames);
+        OutputDebugStringA(message);
+        this->captured_frames = 0;
+        this->dropped_frames = 0;
+    }
+}
+
+DWORD WINAPI FrameCapture::thread_main (LPVOID param)
+{
+    FrameCapture* self = (FrameCapture*)param;
+    while (!self->stop)
+    {
+        WaitForSingleObject(self->wake, INFINITE);
+        self->encode_queued();
+    }
+    self->encode_queued();
+    return 0;
+}
+
+void FrameCapture::encode_queued ()
+{
+    for (;;)
+    {
+        EnterCriticalSection(&this->lock);
+        if (this->queue_count == 0)
+        {
+            LeaveCriticalSection(&this->lock);
+            return;
+        }
+        queued_frame& f = this->queue[this->queue_head];
+        this->working.swap(f.pixels);
+        unsigned int width = f.width;
+        unsigned int height = f.height;
+        unsigned int pitch = f.pitch;
+        double time = f.time;
+        this->queue_head = (this->queue_head + 1) % FRAME_CAPTURE_QUEUE;
+        --this->queue_count;
+        LeaveCriticalSection(&this->lock);
+
+        this->encoded.clear();
+        this->encoder.encode(&this->working[0], width, height, pitch, time, this->encoded);
+        fwrite(&this->encoded[0], 1, this->encoded.size(), this->file);
+    }
+}
@@ -0,0 +1,94 @@
+//====================================================================
+// Stall-free frame capture to a lossless stream file.
+//
+// Each captured frame is copied on the GPU into one of a ring of video
+// memory render targets, its readback into system memory is queued
+// right behind the copy, and an event query is issued behind both.
+// The system memory surface is only locked once the ring comes round
+// to it again and its query has signalled, so locking never waits on
+// the GPU finishing a frame.
+// Pixels are handed to a worker thread that encodes and writes them;
+// if it falls behind, frames are dropped rather than queued without
+// bound.
+//====================================================================
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <Windows.h>
+#include <d3d9.h>
+
+#include "CaptureCodec.h"
+
+#define FRAME_CAPTURE_RING 4
+#define FRAME_CAPTURE_QUEUE 8
+
+class FrameCapture
+{
+public:
+    FrameCapture (IDirect3DDevice9* device, const char* path);
+    ~FrameCapture ();
+
+    // False if the file couldn't be opened
+    bool valid () const { return this->thread != 0; }
+
+    // Starts copying a render target that isn't multisampled back, and
+    // passes on the frame whose slot it reuses if that copy has finished
+    void capture (IDirect3DSurface9* source, double time);
+
+    // Copies in flight are lost across a Reset
+    void reset ();
+
+private:
+    FrameCapture (const FrameCapture&);
+    FrameCapture& operator= (const FrameCapture&);
+
+    struct slot {
+        IDirect3DSurface9* copy;
+        IDirect3DSurface9* surface;
+        IDirect3DQuery9* done;
+        double time;
+        bool pending;
+    };
+    struct queued_frame {
+        std::vector<unsigned char> pixels;
+        unsigned int width;
+        unsigned int height;
+        unsigned int pitch;
+        double time;
+    };
+
+    void release_slots ();
+    bool create_slots (const D3DSURFACE_DESC& desc);
+    void collect (slot& s);
+    static DWORD WINAPI thread_main (LPVOID param);
+    void encode_queued ();
+
+    IDirect3DDevice9* device;
+    slot slots[FRAME_CAPTURE_RING];
+    unsigned int current;
+    UINT width;
+    UINT height;
+    D3DFORMAT format;
+
+    // Pixel buffers change hands by swapping under the lock, so neither
+    // side copies a frame while holding it
+    std::vector<unsigned char> staging;
+    CRITICAL_SECTION lock;
+    HANDLE wake;
+    HANDLE thread;
+    volatile LONG stop;
+    queued_frame queue[FRAME_CAPTURE_QUEUE];
+    unsigned int queue_head;
+    unsigned int queue_count;
+
+    // Worker only
+    std::vector<unsigned char> working;
+    FILE* file;
+    CaptureEncoder encoder;
+    std::vector<unsigned char> encoded;
+
+    unsigned int captured_frames;
+    unsigned int dropped_frames;
+};
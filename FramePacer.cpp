@@ -0,0 +1,52 @@
+//====================================================================
+// Just-in-time frame start pacing.
+//====================================================================
+
+#include "FramePacer.h"
+
+FramePacer::FramePacer ()
+{
+    this->count = 0;
+    this->next = 0;
+    this->margin = 0;
+}
+
+void FramePacer::configure (double margin)
+{
+    this->margin = margin;
+}
+
+void FramePacer::record (double cpu_seconds, double gpu_seconds)
+{
+    this->cost[this->next] = cpu_seconds + gpu_seconds;
+    this->next = (this->next + 1) % FRAME_PACER_HISTORY;
+    if (this->count < FRAME_PACER_HISTORY)
+    {
+        ++this->count;
+    }
+}
+
+double FramePacer::predicted_cost () const
+{
+    // The worst recent frame rather than an average: starting a little
+    // early costs a millisecond of latency, starting late costs a frame
+    double worst = 0;
+    for (unsigned int i = 0; i < this->count; ++i)
+    {
+        if (this->cost[i] > worst)
+        {
+            worst = this->cost[i];
+        }
+    }
+    return worst;
+}
+
+double FramePacer::start_delay (double time_left) const
+{
+    if (this->count < FRAME_PACER_HISTORY / 4)
+    {
+        return 0;
+    }
+    double delay = time_left - this->predicted_cost() - this->margin;
+    return delay > 0 ? delay : 0;
+}
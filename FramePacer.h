@@ -0,0 +1,40 @@
+//====================================================================
+// Just-in-time frame start pacing.
+//
+// Learns what recent frames cost from their start to the GPU being
+// done with them, and holds the next frame back so it finishes just
+// before its refresh instead of idling there with stale input and
+// pose. Deliberately free of Windows, Direct3D and LibOVR types so it
+// can be simulated offline against recorded frame timings.
+//====================================================================
+
+#pragma once
+
+#define FRAME_PACER_HISTORY 32
+
+class FramePacer
+{
+public:
+    FramePacer ();
+
+    // Margin is how much earlier than strictly predicted a frame should
+    // finish, in seconds
+    void configure (double margin);
+
+    // A frame took cpu_seconds from its start until it was submitted and
+    // the GPU finished it gpu_seconds after that
+    void record (double cpu_seconds, double gpu_seconds);
+
+    // How long to hold back the start of a frame that has time_left
+    // seconds until its refresh. Zero until enough frames were seen.
+    double start_delay (double time_left) const;
+
+    // The worst total cost in the history window
+    double predicted_cost () const;
+
+private:
+    double cost[FRAME_PACER_HISTORY];
+    unsigned int count;
+    unsigned int next;
+    double margin;
+};
@@ -0,0 +1,45 @@
+//====================================================================
+// Bounding box tests implementation.
+//====================================================================
+
+#include "FrustumBounds.h"
+
+bool bounds_outside_frustum (const mesh_bounds& bounds, const float m[16])
+{
+    // Gribb/Hartmann plane extraction for row vectors: each plane is the w
+    // column plus or minus the x or y column.
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        for (int sign = -1; sign <= 1; sign += 2)
+        {
+            float plane[4];
+            for (int row = 0; row < 4; ++row)
+            {
+                plane[row] = m[row * 4 + 3] + sign * m[row * 4 + axis];
+            }
+
+            // Test the box corner furthest along the plane normal
+            float distance = plane[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                distance += plane[i] * (plane[i] > 0 ? bounds.max[i] : bounds.min[i]);
+            }
+            if (distance < 0)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+float bounds_nearest_depth (const mesh_bounds& bounds, const float m[16])
+{
+    // Depth is -z, so the nearest corner is the one furthest along +z
+    float z = m[14];
+    for (int i = 0; i < 3; ++i)
+    {
+        z += m[i * 4 + 2] * (m[i * 4 + 2] > 0 ? bounds.max[i] : bounds.min[i]);
+    }
+    return -z;
+}
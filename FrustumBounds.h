@@ -0,0 +1,22 @@
+//====================================================================
+// Bounding box tests against the transforms the stereo draws use.
+//
+// Deliberately free of Windows and Direct3D types so they can be
+// checked offline against recorded meshes and transforms.
+//====================================================================
+
+#pragma once
+
+struct mesh_bounds {
+    float min[3];
+    float max[3];
+};
+
+// True if the box is entirely outside the left, right, top or bottom
+// plane of the frustum described by a row-vector object to clip space
+// matrix, as passed to the vertex shader.
+bool bounds_outside_frustum (const mesh_bounds& bounds, const float object_to_clip[16]);
+
+// Distance in front of the viewer of the box's nearest corner, for a
+// row-vector object to view space matrix looking down -z
+float bounds_nearest_depth (const mesh_bounds& bounds, const float object_to_view[16]);
@@ -0,0 +1,229 @@
+//====================================================================
+// GPU pass timings from Direct3D 9 timestamp queries.
+//====================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "GpuProfiler.h"
+
+GpuProfiler::GpuProfiler (IDirect3DDevice9* device)
+{
+    memset(this->frames, 0, sizeof(this->frames));
+    this->current = 0;
+    this->in_frame = false;
+    this->collected_frames = 0;
+    this->dropped_frames = 0;
+    this->scope_count = 0;
+
+    bool created =
+        SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, NULL)) &&
+        SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, NULL)) &&
+        SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, NULL));
+    for (int i = 0; created && i < GPU_PROFILER_FRAMES; ++i)
+    {
+        frame& f = this->frames[i];
+        created =
+            SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &f.disjoint)) &&
+            SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &f.frequency));
+        for (int j = 0; created && j <= GPU_PROFILER_MARKS; ++j)
+        {
+            created = SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &f.timestamps[j]));
+        }
+    }
+    if (!created)
+    {
+        OutputDebugStringA("PinballVRcade: no timestamp queries, GPU timings disabled\n");
+        this->release();
+    }
+}
+
+GpuProfiler::~GpuProfiler ()
+{
+    this->release();
+}
+
+void GpuProfiler::release ()
+{
+    for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+    {
+        frame& f = this->frames[i];
+        if (f.disjoint)
+        {
+            f.disjoint->Release();
+            f.disjoint = 0;
+        }
+        if (f.frequency)
+        {
+            f.frequency->Release();
+            f.frequency = 0;
+        }
+        for (int j = 0; j <= GPU_PROFILER_MARKS; ++j)
+        {
+            if (f.timestamps[j])
+            {
+                f.timestamps[j]->Release();
+                f.timestamps[j] = 0;
+            }
+        }
+    }
+}
+
+void GpuProfiler::begin_frame ()
+{
+    if (!this->valid())
+    {
+        return;
+    }
+
+    // The set we're about to reuse was issued GPU_PROFILER_FRAMES ago
+    frame& f = this->frames[this->current];
+    if (f.pending)
+    {
+        this->collect(f);
+        f.pending = false;
+    }
+    f.mark_count = 0;
+    f.disjoint->Issue(D3DISSUE_BEGIN);
+    this->in_frame = true;
+}
+
+void GpuProfiler::mark (const char* scope)
+{
+    if (!this->in_frame)
+    {
+        return;
+    }
+    frame& f = this->frames[this->current];
+    if (f.mark_count != 0 && strcmp(f.names[f.mark_count - 1], scope) == 0)
+    {
+        return;
+    }
+    if (f.mark_count == GPU_PROFILER_MARKS)
+    {
+        // Out of marks, the last scope runs to the end of the frame
+        return;
+    }
+    f.names[f.mark_count] = scope;
+    f.timestamps[f.mark_count]->Issue(D3DISSUE_END);
+    ++f.mark_count;
+}
+
+void GpuProfiler::end_frame ()
+{
+    if (!this->in_frame)
+    {
+        return;
+    }
+    frame& f = this->frames[this->current];
+    f.timestamps[f.mark_count]->Issue(D3DISSUE_END);
+    f.frequency->Issue(D3DISSUE_END);
+    f.disjoint->Issue(D3DISSUE_END);
+    f.pending = true;
+    this->in_frame = false;
+    this->current = (this->current + 1) % GPU_PROFILER_FRAMES;
+}
+
+void GpuProfiler::reset ()
+{
+    for (int i = 0; i < GPU_PROFILER_FRAMES; ++i)
+    {
+        this->frames[i].pending = false;
+    }
+    this->in_frame = false;
+}
+
+void GpuProfiler::collect (frame& f)
+{
+    // Never flush; anything that isn't ready yet is dropped
+    BOOL disjoint;
+    UINT64 frequency;
+    UINT64 timestamps[GPU_PROFILER_MARKS + 1];
+    bool ready =
+        f.disjoint->GetData(&disjoint, sizeof(disjoint), 0) == S_OK &&
+        f.frequency->GetData(&frequency, sizeof(frequency), 0) == S_OK;
+    for (unsigned int i = 0; ready && i <= f.mark_count; ++i)
+    {
+        ready = f.timestamps[i]->GetData(&timestamps[i], sizeof(timestamps[i]), 0) == S_OK;
+    }
+
+    // A disjoint frame had its GPU clock change speed half way through
+    if (!ready || disjoint || frequency == 0)
+    {
+        ++this->dropped_frames;
+    }
+    else
+    {
+        // A scope can be marked many times a frame, so its segments are
+        // summed before they count towards the frame's time for it
+        double frame_ms[GPU_PROFILER_SCOPES];
+        bool in_frame_scope[GPU_PROFILER_SCOPES];
+        memset(in_frame_scope, 0, sizeof(in_frame_scope));
+        for (unsigned int i = 0; i < f.mark_count; ++i)
+        {
+            unsigned int s = 0;
+            while (s < this->scope_count && strcmp(this->scopes[s].name, f.names[i]) != 0)
+            {
+                ++s;
+            }
+            if (s == this->scope_count)
+            {
+                if (s == GPU_PROFILER_SCOPES)
+                {
+                    continue;
+                }
+                this->scopes[s].name = f.names[i];
+                this->scopes[s].total_ms = 0;
+                this->scopes[s].worst_ms = 0;
+                this->scopes[s].samples = 0;
+                ++this->scope_count;
+            }
+            double ms = 1000.0 * (double)(timestamps[i + 1] - timestamps[i]) / (double)frequency;
+            frame_ms[s] = in_frame_scope[s] ? frame_ms[s] + ms : ms;
+            in_frame_scope[s] = true;
+        }
+        for (unsigned int s = 0; s < this->scope_count; ++s)
+        {
+            if (in_frame_scope[s])
+            {
+                this->scopes[s].total_ms += frame_ms[s];
+                this->scopes[s].worst_ms = max(this->scopes[s].worst_ms, frame_ms[s]);
+                ++this->scopes[s].samples;
+            }
+        }
+        ++this->collected_frames;
+    }
+
+    if (this->collected_frames + this->dropped_frames >= 300)
+    {
+        this->report();
+    }
+}
+
+void GpuProfiler::report ()
+{
+    // Same shape as the CPU side's Present timings, one line per scope
+    char message[160];
+    for (unsigned int s = 0; s < this->scope_count; ++s)
+    {
+        const scope_stats& stats = this->scopes[s];
+        if (stats.samples)
+        {
+            sprintf_s(message, "PinballVRcade: GPU %s took %.2f ms on average, %.2f ms at worst\n",
+                stats.name,
+                stats.total_ms / stats.samples,
+                stats.worst_ms);
+            OutputDebugStringA(message);
+        }
+    }
+    if (this->dropped_frames)
+    {
+        sprintf_s(message, "PinballVRcade: GPU timings dropped for %u of %u frames\n",
+            this->dropped_frames,
+            this->collected_frames + this->dropped_frames);
+        OutputDebugStringA(message);
+    }
+    this->scope_count = 0;
+    this->collected_frames = 0;
+    this->dropped_frames = 0;
+}
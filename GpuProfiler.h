@@ -0,0 +1,69 @@
+//====================================================================
+// GPU pass timings from Direct3D 9 timestamp queries.
+//
+// Each frame gets its own set of queries out of a ring several frames
+// deep, so by the time a set comes round again the GPU has long
+// finished with it and the results are read back without flushing or
+// waiting. A frame whose results still aren't there is dropped rather
+// than waited for.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+#define GPU_PROFILER_FRAMES 4
+#define GPU_PROFILER_MARKS 32
+#define GPU_PROFILER_SCOPES 16
+
+class GpuProfiler
+{
+public:
+    GpuProfiler (IDirect3DDevice9* device);
+    ~GpuProfiler ();
+
+    // False if the driver has no timestamp queries
+    bool valid () const { return this->frames[0].frequency != 0; }
+
+    void begin_frame ();
+    void end_frame ();
+
+    // Closes the current scope and opens the named one. Names are kept by
+    // pointer, so pass string literals; marking the scope that's already
+    // open does nothing.
+    void mark (const char* scope);
+
+    // Results in flight are lost across a Reset
+    void reset ();
+
+private:
+    GpuProfiler (const GpuProfiler&);
+    GpuProfiler& operator= (const GpuProfiler&);
+
+    struct frame {
+        IDirect3DQuery9* disjoint;
+        IDirect3DQuery9* frequency;
+        IDirect3DQuery9* timestamps[GPU_PROFILER_MARKS + 1];
+        const char* names[GPU_PROFILER_MARKS];
+        unsigned int mark_count;
+        bool pending;
+    };
+    struct scope_stats {
+        const char* name;
+        double total_ms;
+        double worst_ms;
+        unsigned int samples; // Frames the scope ran in
+    };
+
+    void release ();
+    void collect (frame& f);
+    void report ();
+
+    frame frames[GPU_PROFILER_FRAMES];
+    unsigned int current;
+    bool in_frame;
+    unsigned int collected_frames;
+    unsigned int dropped_frames;
+    scope_stats scopes[GPU_PROFILER_SCOPES];
+    unsigned int scope_count;
+};
@@ -0,0 +1,245 @@
+//====================================================================
+// Hidden area stencil mask implementation.
+//
+// Each eye's distortion mesh is turned inside out: every vertex is
+// placed where it samples the eye texture rather than where it lands
+// on screen, once per colour channel, so together the triangles cover
+// exactly the texels the lens can show. The buffer starts with a quad
+// over the whole eye that clears the bit before the mesh sets it.
+//====================================================================
+
+#include <string.h>
+#include <d3dx9.h>
+
+#include "HiddenAreaMask.h"
+
+static const char s_vertex_shader_source[] =
+    "float4 main (in float2 uv : POSITION0) : POSITION\n"
+    "{\n"
+    "    return float4(uv * float2(2, -2) + float2(-1, 1), 0.5, 1.0);\n"
+    "}\n";
+
+static const char s_pixel_shader_source[] =
+    "float4 main () : COLOR\n"
+    "{\n"
+    "    return float4(0, 0, 0, 0);\n"
+    "}\n";
+
+static const D3DVERTEXELEMENT9 s_vertex_elements[] = {
+    { 0, 0, D3DDECLTYPE_FLOAT2, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+    D3DDECL_END()
+};
+
+struct mask_vertex {
+    float u, v;
+};
+
+static bool compile_shader (const char source[], const char profile[], ID3DXBuffer** code)
+{
+    ID3DXBuffer* errors = 0;
+    HRESULT result = D3DXCompileShader(source, (UINT)strlen(source), NULL, NULL, "main", profile, 0, code, &errors, NULL);
+    if (errors)
+    {
+        OutputDebugStringA((const char*)errors->GetBufferPointer());
+        errors->Release();
+    }
+    return SUCCEEDED(result);
+}
+
+DWORD stencil_top_bit (D3DFORMAT format)
+{
+    switch (format)
+    {
+    case D3DFMT_D24S8:
+    case D3DFMT_D24FS8:
+        return 0x80;
+    case D3DFMT_D24X4S4:
+        return 0x08;
+    case D3DFMT_D15S1:
+        return 0x01;
+    default:
+        return 0;
+    }
+}
+
+HiddenAreaMask::HiddenAreaMask (ovrHmd hmd, const ovrFovPort eye_fov[2])
+{
+    this->hmd = hmd;
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        this->eye_fov[eye] = eye_fov[eye];
+        this->vertex_buffer[eye] = 0;
+        this->index_buffer[eye] = 0;
+        this->vertex_count[eye] = 0;
+        this->triangle_count[eye] = 0;
+    }
+    this->declaration = 0;
+    this->vertex_shader = 0;
+    this->pixel_shader = 0;
+}
+
+HiddenAreaMask::~HiddenAreaMask ()
+{
+    this->release();
+}
+
+void HiddenAreaMask::release ()
+{
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        if (this->vertex_buffer[eye])
+        {
+            this->vertex_buffer[eye]->Release();
+            this->vertex_buffer[eye] = 0;
+        }
+        if (this->index_buffer[eye])
+        {
+            this->index_buffer[eye]->Release();
+            this->index_buffer[eye] = 0;
+        }
+    }
+    if (this->declaration)
+    {
+        this->declaration->Release();
+        this->declaration = 0;
+    }
+    if (this->vertex_shader)
+    {
+        this->vertex_shader->Release();
+        this->vertex_shader = 0;
+    }
+    if (this->pixel_shader)
+    {
+        this->pixel_shader->Release();
+        this->pixel_shader = 0;
+    }
+}
+
+bool HiddenAreaMask::create (IDirect3DDevice9* device)
+{
+    this->release();
+
+    unsigned int caps = ovrDistortionCap_Chromatic;
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        ovrDistortionMesh mesh;
+        if (!ovrHmd_CreateDistortionMesh(this->hmd, (ovrEyeType)eye, this->eye_fov[eye], caps, &mesh))
+        {
+            OutputDebugStringA("PinballVRcade: couldn't create distortion mesh for the hidden area mask\n");
+            this->release();
+            return false;
+        }
+
+        // Tan eye angles to UV across the eye viewport
+        ovrSizei eye_size = { 1024, 1024 };
+        ovrRecti eye_rect = { { 0, 0 }, eye_size };
+        ovrVector2f scale_offset[2];
+        ovrHmd_GetRenderScaleAndOffset(this->eye_fov[eye], eye_size, eye_rect, scale_offset);
+
+        UINT vertex_count = 4 + 3 * mesh.VertexCount;
+        UINT index_count = 6 + 3 * mesh.IndexCount;
+        bool uploaded = vertex_count <= 0xFFFF &&
+            SUCCEEDED(device->CreateVertexBuffer(vertex_count * sizeof(mask_vertex), D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &this->vertex_buffer[eye], NULL)) &&
+            SUCCEEDED(device->CreateIndexBuffer(index_count * sizeof(unsigned short), D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, &this->index_buffer[eye], NULL));
+        mask_vertex* vertices;
+        unsigned short* indices;
+        if (uploaded && SUCCEEDED(this->vertex_buffer[eye]->Lock(0, 0, (void**)&vertices, 0)))
+        {
+            mask_vertex quad[4] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+            memcpy(vertices, quad, sizeof(quad));
+            vertices += 4;
+            for (unsigned int i = 0; i < mesh.VertexCount; ++i)
+            {
+                const ovrDistortionVertex& vertex = mesh.pVertexData[i];
+                const ovrVector2f* channels[3] = { &vertex.TanEyeAnglesR, &vertex.TanEyeAnglesG, &vertex.TanEyeAnglesB };
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    mask_vertex& out = vertices[channel * mesh.VertexCount + i];
+                    out.u = channels[channel]->x * scale_offset[0].x + scale_offset[1].x;
+                    out.v = channels[channel]->y * scale_offset[0].y + scale_offset[1].y;
+                }
+            }
+            this->vertex_buffer[eye]->Unlock();
+        }
+        if (uploaded && SUCCEEDED(this->index_buffer[eye]->Lock(0, 0, (void**)&indices, 0)))
+        {
+            unsigned short quad[6] = { 0, 1, 2, 2, 1, 3 };
+            memcpy(indices, quad, sizeof(quad));
+            indices += 6;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                // Past the quad, then this channel's copy of the vertices
+                unsigned short base = (unsigned short)(4 + channel * mesh.VertexCount);
+                for (unsigned int i = 0; i < mesh.IndexCount; ++i)
+                {
+                    *indices++ = base + mesh.pIndexData[i];
+                }
+            }
+            this->index_buffer[eye]->Unlock();
+        }
+        this->vertex_count[eye] = vertex_count;
+        this->triangle_count[eye] = index_count / 3;
+        ovrHmd_DestroyDistortionMesh(&mesh);
+        if (!uploaded)
+        {
+            this->release();
+            return false;
+        }
+    }
+
+    ID3DXBuffer* vertex_code = 0;
+    ID3DXBuffer* pixel_code = 0;
+    bool compiled =
+        compile_shader(s_vertex_shader_source, "vs_2_0", &vertex_code) &&
+        compile_shader(s_pixel_shader_source, "ps_2_0", &pixel_code);
+    bool created = compiled &&
+        SUCCEEDED(device->CreateVertexShader((const DWORD*)vertex_code->GetBufferPointer(), &this->vertex_shader)) &&
+        SUCCEEDED(device->CreatePixelShader((const DWORD*)pixel_code->GetBufferPointer(), &this->pixel_shader)) &&
+        SUCCEEDED(device->CreateVertexDeclaration(s_vertex_elements, &this->declaration));
+    if (vertex_code)
+    {
+        vertex_code->Release();
+    }
+    if (pixel_code)
+    {
+        pixel_code->Release();
+    }
+    if (!created)
+    {
+        this->release();
+        return false;
+    }
+    return true;
+}
+
+void HiddenAreaMask::draw (IDirect3DDevice9* device, const D3DVIEWPORT9 eye_viewport[2], DWORD stencil_bit)
+{
+    // Only the stencil bit is written
+    device->SetRenderState(D3DRS_ZENABLE, D3DZB_FALSE);
+    device->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+    device->SetRenderState(D3DRS_COLORWRITEENABLE, 0);
+    device->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+    device->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+    device->SetRenderState(D3DRS_SCISSORTESTENABLE, FALSE);
+    device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    device->SetRenderState(D3DRS_CLIPPLANEENABLE, 0);
+    device->SetRenderState(D3DRS_STENCILENABLE, TRUE);
+    device->SetRenderState(D3DRS_TWOSIDEDSTENCILMODE, FALSE);
+    device->SetRenderState(D3DRS_STENCILFUNC, D3DCMP_ALWAYS);
+    device->SetRenderState(D3DRS_STENCILPASS, D3DSTENCILOP_REPLACE);
+    device->SetRenderState(D3DRS_STENCILWRITEMASK, stencil_bit);
+    device->SetVertexDeclaration(this->declaration);
+    device->SetVertexShader(this->vertex_shader);
+    device->SetPixelShader(this->pixel_shader);
+
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        device->SetViewport(&eye_viewport[eye]);
+        device->SetStreamSource(0, this->vertex_buffer[eye], 0, sizeof(mask_vertex));
+        device->SetIndices(this->index_buffer[eye]);
+        device->SetRenderState(D3DRS_STENCILREF, 0);
+        device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, 4, 0, 2);
+        device->SetRenderState(D3DRS_STENCILREF, stencil_bit);
+        device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 4, this->vertex_count[eye] - 4, 6, this->triangle_count[eye] - 2);
+    }
+}
@@ -0,0 +1,52 @@
+//====================================================================
+// Hidden area stencil mask.
+//
+// Marks which pixels of each eye can actually be seen through the lens
+// in one bit of the stencil buffer, so scene draws can reject the rest
+// before shading them. The visible area is the part of the eye texture
+// the distortion mesh samples, taken from the LibOVR mesh API once and
+// kept in a managed vertex buffer.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+#include <OVR.h>
+
+class HiddenAreaMask
+{
+public:
+    HiddenAreaMask (ovrHmd hmd, const ovrFovPort eye_fov[2]);
+    ~HiddenAreaMask ();
+
+    // Builds the mesh and shaders. Everything lives in the managed pool or
+    // is pool independent, so nothing needs to be recreated around a Reset.
+    bool create (IDirect3DDevice9* device);
+
+    // Clears stencil_bit across each eye viewport, then sets it wherever the
+    // lens can see. Other stencil bits, depth and colour are left alone but
+    // the device state is not; the caller saves and restores it. Must be
+    // called inside BeginScene/EndScene.
+    void draw (IDirect3DDevice9* device, const D3DVIEWPORT9 eye_viewport[2], DWORD stencil_bit);
+
+private:
+    HiddenAreaMask (const HiddenAreaMask&);
+    HiddenAreaMask& operator= (const HiddenAreaMask&);
+
+    void release ();
+
+    ovrHmd hmd;
+    ovrFovPort eye_fov[2];
+
+    IDirect3DVertexBuffer9* vertex_buffer[2];
+    IDirect3DIndexBuffer9* index_buffer[2];
+    UINT vertex_count[2];
+    UINT triangle_count[2];
+
+    IDirect3DVertexDeclaration9* declaration;
+    IDirect3DVertexShader9* vertex_shader;
+    IDirect3DPixelShader9* pixel_shader;
+};
+
+// Highest stencil bit of a depth format, or 0 if it has no stencil
+DWORD stencil_top_bit (D3DFORMAT format);
@@ -0,0 +1,119 @@
+//====================================================================
+// LibOVR initialization overlapped with the game's startup.
+//====================================================================
+
+#include <stdio.h>
+#include <Windows.h>
+
+#include "HmdStartup.h"
+#include "StartupTimeline.h"
+#include "TrackingThread.h"
+
+static HANDLE s_thread = 0;
+static ovrHmd s_hmd = 0;
+static TrackingThread* s_tracking = 0;
+static bool s_reported = false;
+
+// When initialization ran, for the report
+static LARGE_INTEGER s_init_start;
+static LARGE_INTEGER s_init_end;
+
+static void initialize_hmd ()
+{
+    QueryPerformanceCounter(&s_init_start);
+    startup_timeline_begin("ovr_Initialize");
+    ovr_Initialize();
+    startup_timeline_end("ovr_Initialize");
+    startup_timeline_begin("ovrHmd_Create");
+    ovrHmd hmd = ovrHmd_Create(0);
+    startup_timeline_end("ovrHmd_Create");
+    if (!hmd)
+    {
+        const char* error = ovrHmd_GetLastError(hmd);
+        OutputDebugStringA(error);
+    }
+
+    // Recorded and synthetic tracking don't need a headset on the desk, so
+    // fall back to a virtual DK2 to keep the stereo path running.
+    TrackingSource* source = create_tracking_source(hmd);
+    if (!hmd && !source->needs_hmd())
+    {
+        hmd = ovrHmd_CreateDebug(ovrHmd_DK2);
+    }
+
+    // Poll tracking off the render thread
+    if (hmd)
+    {
+        ovrHmd_ConfigureTracking(hmd, ovrTrackingCap_Orientation | ovrTrackingCap_MagYawCorrection | ovrTrackingCap_Position, 0);
+        s_tracking = new TrackingThread(source, 1000);
+    }
+    else
+    {
+        OutputDebugStringA("PinballVRcade: no headset found, passing the game's rendering through\n");
+        delete source;
+    }
+    s_hmd = hmd;
+    QueryPerformanceCounter(&s_init_end);
+}
+
+static DWORD WINAPI startup_thread_main (LPVOID)
+{
+    initialize_hmd();
+    return 0;
+}
+
+void hmd_startup_begin ()
+{
+    // Doesn't run until DllMain returns and the loader lock is released
+    s_thread = CreateThread(NULL, 0, &startup_thread_main, NULL, 0, NULL);
+}
+
+void hmd_startup_result (ovrHmd* hmd, TrackingThread** tracking)
+{
+    if (!s_reported)
+    {
+        LARGE_INTEGER wait_start;
+        LARGE_INTEGER wait_end;
+        QueryPerformanceCounter(&wait_start);
+        if (s_thread)
+        {
+            if (WaitForSingleObject(s_thread, 0) == WAIT_TIMEOUT)
+            {
+                startup_timeline_begin("waiting for LibOVR");
+                WaitForSingleObject(s_thread, INFINITE);
+                startup_timeline_end("waiting for LibOVR");
+            }
+            CloseHandle(s_thread);
+            s_thread = 0;
+        }
+        else
+        {
+            // The thread couldn't be started, so it's done the old way
+            initialize_hmd();
+        }
+        QueryPerformanceCounter(&wait_end);
+
+        // Whatever we didn't have to wait for came off the game's startup
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        double ms_per_tick = 1000.0 / (double)frequency.QuadPart;
+        double init_ms = (s_init_end.QuadPart - s_init_start.QuadPart) * ms_per_tick;
+        double wait_ms = (wait_end.QuadPart - wait_start.QuadPart) * ms_per_tick;
+        char message[160];
+        sprintf_s(message, "PinballVRcade: LibOVR initialization took %.1f ms, device creation waited %.1f ms of it\n", init_ms, wait_ms);
+        OutputDebugStringA(message);
+        s_reported = true;
+    }
+    *hmd = s_hmd;
+    *tracking = s_tracking;
+}
+
+void hmd_startup_shutdown ()
+{
+    // The tracking thread was terminated along with the rest, possibly
+    // holding locks, so nothing is freed; the recording is just finished
+    if (s_tracking)
+    {
+        s_tracking->finish();
+    }
+}
@@ -0,0 +1,28 @@
+//====================================================================
+// LibOVR initialization overlapped with the game's startup.
+//
+// Runtime and USB enumeration take long enough to show up in the time
+// to first frame, so they run on a background thread started as soon
+// as the DLL attaches, while the game loads. Device creation is the
+// first point that needs the result and only waits for whatever part
+// of it is still outstanding.
+//====================================================================
+
+#pragma once
+
+#include <OVR.h>
+
+class TrackingThread;
+
+// Starts initialization in the background. Called once from DllMain.
+void hmd_startup_begin ();
+
+// The headset and its tracking thread, waiting for initialization to
+// finish if it hasn't. Both are null when no headset turned up, in
+// which case devices are passed through untouched. Every call returns
+// the same pair.
+void hmd_startup_result (ovrHmd* hmd, TrackingThread** tracking);
+
+// Finishes any trace being recorded. Only for DllMain at process exit,
+// when every other thread is already gone.
+void hmd_startup_shutdown ();
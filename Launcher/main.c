@@ -4,8 +4,124 @@
 //====================================================================
 
 #include <Windows.h>
+#include <stdio.h>
+
+#include "../StartupTimeline.h"
 
 #define HOOK_DLL "PinballVRcade.dll"
+#define STARTUP_LOG "PinballVRcade.startup.log"
+
+// How long to wait for the first frame before giving up on the report
+#define FIRST_FRAME_TIMEOUT_MS 120000
+
+//====================================================================
+// Startup timeline helpers. The launcher owns the shared block and
+// writes the report once the game presents its first frame.
+//====================================================================
+
+static void add_timeline_event (startup_timeline* timeline, DWORD kind, const char name[], const LARGE_INTEGER* timestamp)
+{
+    LONG index;
+    startup_event* event;
+
+    if (!timeline)
+    {
+        return;
+    }
+
+    index = InterlockedIncrement(&timeline->event_count) - 1;
+    if (index >= STARTUP_TIMELINE_MAX_EVENTS)
+    {
+        return;
+    }
+    event = &timeline->events[index];
+    if (timestamp)
+    {
+        event->timestamp = *timestamp;
+    }
+    else
+    {
+        QueryPerformanceCounter(&event->timestamp);
+    }
+    event->kind = kind;
+    event->thread_id = GetCurrentThreadId();
+    strncpy(event->name, name, sizeof(event->name) - 1);
+    InterlockedExchange(&event->committed, 1);
+}
+
+static void write_timeline_line (FILE* log, const char line[])
+{
+    OutputDebugStringA(line);
+    if (log)
+    {
+        fputs(line, log);
+    }
+}
+
+// Lists every event relative to the launcher starting, with the length
+// of each phase on the line that ends it
+static void write_timeline_report (const startup_timeline* timeline, const char log_path[], const char exe_path[], BOOL presented)
+{
+    FILE* log;
+    SYSTEMTIME now;
+    char line[256];
+    LONG count;
+    LONG i;
+    LONG j;
+    double ms_per_tick;
+    double offset;
+    double duration;
+    const startup_event* event;
+
+    log = fopen(log_path, "a");
+    GetLocalTime(&now);
+    sprintf(line, "Startup of %s on %04u-%02u-%02u %02u:%02u:%02u%s\n",
+        exe_path, now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond,
+        presented ? "" : " (no frame presented)");
+    write_timeline_line(log, line);
+    write_timeline_line(log, "   offset ms  duration ms  event\n");
+
+    count = min(timeline->event_count, STARTUP_TIMELINE_MAX_EVENTS);
+    ms_per_tick = 1000.0 / (double)timeline->frequency.QuadPart;
+    for (i = 0; i < count; ++i)
+    {
+        event = &timeline->events[i];
+        if (!event->committed)
+        {
+            continue;
+        }
+        offset = (event->timestamp.QuadPart - timeline->events[0].timestamp.QuadPart) * ms_per_tick;
+        if (event->kind == STARTUP_EVENT_BEGIN)
+        {
+            sprintf(line, "%12.2f               > %s\n", offset, event->name);
+        }
+        else if (event->kind == STARTUP_EVENT_END)
+        {
+            // Pair with the closest earlier begin of the same phase
+            duration = 0.0;
+            for (j = i - 1; j >= 0; --j)
+            {
+                if (timeline->events[j].kind == STARTUP_EVENT_BEGIN && strcmp(timeline->events[j].name, event->name) == 0)
+                {
+                    duration = (event->timestamp.QuadPart - timeline->events[j].timestamp.QuadPart) * ms_per_tick;
+                    break;
+                }
+            }
+            sprintf(line, "%12.2f %12.2f  < %s\n", offset, duration, event->name);
+        }
+        else
+        {
+            sprintf(line, "%12.2f               * %s\n", offset, event->name);
+        }
+        write_timeline_line(log, line);
+    }
+    write_timeline_line(log, "\n");
+
+    if (log)
+    {
+        fclose(log);
+    }
+}
 
 int CALLBACK WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
@@ -21,6 +137,17 @@ int CALLBACK WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdL
     char* file_part;
     LPVOID path_memory;
     HANDLE hook_init_thread;
+    LARGE_INTEGER launch_time;
+    LARGE_INTEGER create_time;
+    char timeline_name[64];
+    char log_path[MAX_PATH];
+    HANDLE timeline_mapping;
+    startup_timeline* timeline;
+    HANDLE first_frame;
+    HANDLE wait_handles[2];
+    DWORD wait_result;
+
+    QueryPerformanceCounter(&launch_time);
 
     // Try to find Pinball Arcade
     success = 0;
@@ -67,6 +194,7 @@ int CALLBACK WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdL
     // Try to launch Pinball Arcade
     memset(&startup_info, 0, sizeof(startup_info));
     startup_info.cb = sizeof(startup_info);
+    QueryPerformanceCounter(&create_time);
     success = CreateProcessA(
         exe_path,
         NULL, // lpCommandLine
@@ -85,13 +213,35 @@ int CALLBACK WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdL
         return;
     }
     
+    // Set up the startup timeline while the game is still suspended, so
+    // the DLL can find it from the very first thing it does
+    sprintf(timeline_name, "%s%lu", STARTUP_TIMELINE_MAPPING_NAME, process_info.dwProcessId);
+    timeline_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(startup_timeline), timeline_name);
+    timeline = timeline_mapping ? (startup_timeline*)MapViewOfFile(timeline_mapping, FILE_MAP_WRITE, 0, 0, sizeof(startup_timeline)) : NULL;
+    if (timeline)
+    {
+        timeline->magic = STARTUP_TIMELINE_MAGIC;
+        timeline->version = STARTUP_TIMELINE_VERSION;
+        QueryPerformanceFrequency(&timeline->frequency);
+        add_timeline_event(timeline, STARTUP_EVENT_MARK, "launcher started", &launch_time);
+        add_timeline_event(timeline, STARTUP_EVENT_BEGIN, "CreateProcessA", &create_time);
+        add_timeline_event(timeline, STARTUP_EVENT_END, "CreateProcessA", NULL);
+    }
+    sprintf(timeline_name, "%s%lu", STARTUP_TIMELINE_FIRST_FRAME_NAME, process_info.dwProcessId);
+    first_frame = CreateEventA(NULL, TRUE, FALSE, timeline_name);
+
     // Get the local path to our launcher
     GetModuleFileNameA(NULL, launcher_path, sizeof(launcher_path));
 
     // Get the directory from the path
     GetFullPathNameA(launcher_path, sizeof(dll_path), dll_path, &file_part);
     *file_part = '\0';
+    strcpy(log_path, dll_path);
     strncat((char*)dll_path, HOOK_DLL, MAX_PATH);
+    strncat(log_path, STARTUP_LOG, MAX_PATH - strlen(log_path) - 1);
+
+    // Injection includes the DLL's DllMain, which records its own phases
+    add_timeline_event(timeline, STARTUP_EVENT_BEGIN, "DLL injection", NULL);
 
     // Allocate memory in the process space of Pinball Arcade
     path_memory = VirtualAllocEx(process_info.hProcess, NULL, MAX_PATH, MEM_COMMIT, PAGE_READWRITE);
@@ -111,7 +261,33 @@ int CALLBACK WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdL
     // Wait for our hook to load
     WaitForSingleObject(hook_init_thread, INFINITE);
     CloseHandle(hook_init_thread);
+    add_timeline_event(timeline, STARTUP_EVENT_END, "DLL injection", NULL);
 
+    add_timeline_event(timeline, STARTUP_EVENT_MARK, "game resumed", NULL);
     ResumeThread(process_info.hThread);
+
+    // Wait for the first frame, or for the game to quit before getting there
+    if (timeline && first_frame)
+    {
+        wait_handles[0] = first_frame;
+        wait_handles[1] = process_info.hProcess;
+        wait_result = WaitForMultipleObjects(2, wait_handles, FALSE, FIRST_FRAME_TIMEOUT_MS);
+        write_timeline_report(timeline, log_path, exe_path, wait_result == WAIT_OBJECT_0);
+    }
+
+    if (timeline)
+    {
+        UnmapViewOfFile(timeline);
+    }
+    if (timeline_mapping)
+    {
+        CloseHandle(timeline_mapping);
+    }
+    if (first_frame)
+    {
+        CloseHandle(first_frame);
+    }
+    CloseHandle(process_info.hThread);
+    CloseHandle(process_info.hProcess);
     return 0;
 }
\ No newline at end of file
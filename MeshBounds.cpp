@@ -0,0 +1,108 @@
+//====================================================================
+// Mesh bounds cache implementation.
+//====================================================================
+
+#include <float.h>
+#include <string.h>
+#include <xmmintrin.h>
+
+#include "MeshBounds.h"
+
+bool MeshBoundsCache::key::operator< (const key& other) const
+{
+    return memcmp(this, &other, sizeof(key)) < 0;
+}
+
+// Min/max pass over strided float3 positions, four lanes at a time
+static void compute_bounds (const unsigned char* positions, UINT stride, UINT count, mesh_bounds* out)
+{
+    __m128 low = _mm_set1_ps(FLT_MAX);
+    __m128 high = _mm_set1_ps(-FLT_MAX);
+    for (UINT i = 0; i < count; ++i, positions += stride)
+    {
+        const float* p = (const float*)positions;
+        __m128 v = _mm_setr_ps(p[0], p[1], p[2], 0.0f);
+        low = _mm_min_ps(low, v);
+        high = _mm_max_ps(high, v);
+    }
+    float low_values[4];
+    float high_values[4];
+    _mm_storeu_ps(low_values, low);
+    _mm_storeu_ps(high_values, high);
+    memcpy(out->min, low_values, sizeof(out->min));
+    memcpy(out->max, high_values, sizeof(out->max));
+}
+
+bool MeshBoundsCache::lookup (
+    const position_layout& layout,
+    IDirect3DIndexBuffer9* indices,
+    INT base_vertex,
+    UINT min_index,
+    UINT num_vertices,
+    UINT start_index,
+    UINT primitive_count,
+    mesh_bounds* out)
+{
+    Direct3DVertexBuffer9Hooks* buffer = static_cast<Direct3DVertexBuffer9Hooks*>(layout.buffer);
+    if (!buffer || !buffer->shadow_data() || num_vertices == 0)
+    {
+        return false;
+    }
+
+    key k;
+    memset(&k, 0, sizeof(k));
+    k.buffer = layout.buffer;
+    k.indices = indices;
+    k.stream_offset = layout.stream_offset;
+    k.stride = layout.stride;
+    k.position_offset = layout.position_offset;
+    k.base_vertex = base_vertex;
+    k.min_index = min_index;
+    k.num_vertices = num_vertices;
+    k.start_index = start_index;
+    k.primitive_count = primitive_count;
+
+    // Reuse the cached bounds unless the buffer was written since
+    std::map<key, entry>::iterator found = this->entries.find(k);
+    if (found != this->entries.end() && found->second.version == buffer->version())
+    {
+        *out = found->second.bounds;
+        return true;
+    }
+
+    // The draw can only reference vertices in [min_index, min_index + num_vertices)
+    // relative to the base vertex, so bound that whole range rather than
+    // walking the index buffer
+    INT first_vertex = base_vertex + (INT)min_index;
+    if (first_vertex < 0)
+    {
+        return false;
+    }
+    UINT start = layout.stream_offset + first_vertex * layout.stride + layout.position_offset;
+    UINT end = start + (num_vertices - 1) * layout.stride + 3 * sizeof(float);
+    if (end > buffer->length())
+    {
+        return false;
+    }
+
+    entry e;
+    e.version = buffer->version();
+    compute_bounds(buffer->shadow_data() + start, layout.stride, num_vertices, &e.bounds);
+    this->entries[k] = e;
+    *out = e.bounds;
+    return true;
+}
+
+void MeshBoundsCache::evict (IDirect3DVertexBuffer9* buffer)
+{
+    // Keys order bytewise with the buffer first, so a buffer's meshes sit
+    // together, starting from its key with everything else zeroed
+    key first;
+    memset(&first, 0, sizeof(first));
+    first.buffer = buffer;
+    std::map<key, entry>::iterator it = this->entries.lower_bound(first);
+    while (it != this->entries.end() && it->first.buffer == buffer)
+    {
+        this->entries.erase(it++);
+    }
+}
@@ -0,0 +1,63 @@
+//====================================================================
+// Cached bounding boxes for the meshes Pinball Arcade draws, used to
+// skip stereo draws that fall outside one eye's view.
+//====================================================================
+
+#pragma once
+
+#include <map>
+
+#include <d3d9.h>
+
+#include "Direct3DVertexBuffer9Hooks.h"
+#include "FrustumBounds.h"
+
+// Where vertex positions live in the bound vertex stream
+struct position_layout {
+    IDirect3DVertexBuffer9* buffer;
+    UINT stream_offset;
+    UINT stride;
+    UINT position_offset;
+};
+
+class MeshBoundsCache
+{
+public:
+    // Look up (or compute on first use) the object space bounds of the
+    // vertices an indexed draw can reference. Returns false if the data
+    // isn't available, e.g. for dynamic buffers.
+    bool lookup (
+        const position_layout& layout,
+        IDirect3DIndexBuffer9* indices,
+        INT base_vertex,
+        UINT min_index,
+        UINT num_vertices,
+        UINT start_index,
+        UINT primitive_count,
+        mesh_bounds* out
+    );
+
+    // Forgets every mesh drawn from a buffer that's being destroyed, so a
+    // new buffer at the same address starts afresh
+    void evict (IDirect3DVertexBuffer9* buffer);
+
+private:
+    struct key {
+        IDirect3DVertexBuffer9* buffer;
+        IDirect3DIndexBuffer9* indices;
+        UINT stream_offset;
+        UINT stride;
+        UINT position_offset;
+        INT base_vertex;
+        UINT min_index;
+        UINT num_vertices;
+        UINT start_index;
+        UINT primitive_count;
+        bool operator< (const key& other) const;
+    };
+    struct entry {
+        unsigned int version;
+        mesh_bounds bounds;
+    };
+    std::map<key, entry> entries;
+};
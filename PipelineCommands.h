@@ -0,0 +1,214 @@
+//====================================================================
+// Command packets the pipelined device queues for its render thread.
+//
+// Each packet is a command_header followed by one of these argument
+// structs, then any variable sized payload (shader constants, clear
+// rects, user pointer vertices and indices). Objects are held as the
+// driver's own pointers, AddRef'd while queued.
+//====================================================================
+
+#pragma once
+
+#include <d3d9.h>
+
+enum command_opcode {
+    COMMAND_SET_RENDER_STATE,
+    COMMAND_SET_SAMPLER_STATE,
+    COMMAND_SET_TEXTURE_STAGE_STATE,
+    COMMAND_SET_TEXTURE,
+    COMMAND_SET_STREAM_SOURCE,
+    COMMAND_SET_STREAM_SOURCE_FREQ,
+    COMMAND_SET_INDICES,
+    COMMAND_SET_VERTEX_DECLARATION,
+    COMMAND_SET_FVF,
+    COMMAND_SET_VERTEX_SHADER,
+    COMMAND_SET_PIXEL_SHADER,
+    COMMAND_LIGHT_ENABLE,
+    COMMAND_BEGIN_SCENE,
+    COMMAND_END_SCENE,
+    COMMAND_DRAW_PRIMITIVE,
+    COMMAND_DRAW_INDEXED_PRIMITIVE,
+    COMMAND_SET_DEPTH_STENCIL_SURFACE,
+    COMMAND_SET_VIEWPORT,
+    COMMAND_SET_SCISSOR_RECT,
+    COMMAND_SET_TRANSFORM,
+    COMMAND_SET_MATERIAL,
+    COMMAND_SET_LIGHT,
+    COMMAND_SET_CLIP_PLANE,
+    COMMAND_SET_VERTEX_SHADER_CONSTANT_F,
+    COMMAND_SET_VERTEX_SHADER_CONSTANT_I,
+    COMMAND_SET_VERTEX_SHADER_CONSTANT_B,
+    COMMAND_SET_PIXEL_SHADER_CONSTANT_F,
+    COMMAND_SET_PIXEL_SHADER_CONSTANT_I,
+    COMMAND_SET_PIXEL_SHADER_CONSTANT_B,
+    COMMAND_SET_RENDER_TARGET,
+    COMMAND_CLEAR,
+    COMMAND_DRAW_PRIMITIVE_UP,
+    COMMAND_DRAW_INDEXED_PRIMITIVE_UP,
+    COMMAND_STRETCH_RECT,
+    COMMAND_COLOR_FILL,
+    COMMAND_PRESENT,
+    COMMAND_ISSUE_QUERY,
+};
+
+#pragma pack(push, 4)
+struct command_set_render_state_args {
+    D3DRENDERSTATETYPE State;
+    DWORD Value;
+};
+struct command_set_sampler_state_args {
+    DWORD Sampler;
+    D3DSAMPLERSTATETYPE Type;
+    DWORD Value;
+};
+struct command_set_texture_stage_state_args {
+    DWORD Stage;
+    D3DTEXTURESTAGESTATETYPE Type;
+    DWORD Value;
+};
+struct command_set_texture_args {
+    DWORD Stage;
+    IDirect3DBaseTexture9* pTexture;
+};
+struct command_set_stream_source_args {
+    UINT StreamNumber;
+    IDirect3DVertexBuffer9* pStreamData;
+    UINT OffsetInBytes;
+    UINT Stride;
+};
+struct command_set_stream_source_freq_args {
+    UINT StreamNumber;
+    UINT Setting;
+};
+struct command_set_indices_args {
+    IDirect3DIndexBuffer9* pIndexData;
+};
+struct command_set_vertex_declaration_args {
+    IDirect3DVertexDeclaration9* pDecl;
+};
+struct command_set_fvf_args {
+    DWORD FVF;
+};
+struct command_set_vertex_shader_args {
+    IDirect3DVertexShader9* pShader;
+};
+struct command_set_pixel_shader_args {
+    IDirect3DPixelShader9* pShader;
+};
+struct command_light_enable_args {
+    DWORD Index;
+    BOOL Enable;
+};
+struct command_draw_primitive_args {
+    D3DPRIMITIVETYPE PrimitiveType;
+    UINT StartVertex;
+    UINT PrimitiveCount;
+};
+struct command_draw_indexed_primitive_args {
+    D3DPRIMITIVETYPE PrimitiveType;
+    INT BaseVertexIndex;
+    UINT MinVertexIndex;
+    UINT NumVertices;
+    UINT startIndex;
+    UINT primCount;
+};
+struct command_set_depth_stencil_surface_args {
+    IDirect3DSurface9* pNewZStencil;
+};
+struct command_set_viewport_args {
+    D3DVIEWPORT9 value;
+};
+struct command_set_scissor_rect_args {
+    RECT value;
+};
+struct command_set_transform_args {
+    D3DTRANSFORMSTATETYPE State;
+    D3DMATRIX value;
+};
+struct command_set_material_args {
+    D3DMATERIAL9 value;
+};
+struct command_set_light_args {
+    DWORD Index;
+    D3DLIGHT9 value;
+};
+struct command_set_clip_plane_args {
+    DWORD Index;
+    float plane[4];
+};
+struct command_set_vertex_shader_constant_f_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_vertex_shader_constant_i_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_vertex_shader_constant_b_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_pixel_shader_constant_f_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_pixel_shader_constant_i_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_pixel_shader_constant_b_args {
+    UINT StartRegister;
+    UINT count;
+};
+struct command_set_render_target_args {
+    DWORD RenderTargetIndex;
+    IDirect3DSurface9* pRenderTarget;
+};
+struct command_clear_args {
+    DWORD Count;
+    DWORD Flags;
+    D3DCOLOR Color;
+    float Z;
+    DWORD Stencil;
+};
+struct command_draw_primitive_up_args {
+    D3DPRIMITIVETYPE PrimitiveType;
+    UINT PrimitiveCount;
+    UINT VertexStreamZeroStride;
+};
+struct command_draw_indexed_primitive_up_args {
+    D3DPRIMITIVETYPE PrimitiveType;
+    UINT MinVertexIndex;
+    UINT NumVertices;
+    UINT PrimitiveCount;
+    D3DFORMAT IndexDataFormat;
+    UINT VertexStreamZeroStride;
+    DWORD index_bytes;
+};
+struct command_stretch_rect_args {
+    IDirect3DSurface9* pSourceSurface;
+    IDirect3DSurface9* pDestSurface;
+    D3DTEXTUREFILTERTYPE Filter;
+    BOOL has_source_rect;
+    BOOL has_dest_rect;
+    RECT source_rect;
+    RECT dest_rect;
+};
+struct command_color_fill_args {
+    IDirect3DSurface9* pSurface;
+    BOOL has_rect;
+    RECT rect;
+    D3DCOLOR color;
+};
+struct command_present_args {
+    BOOL has_source_rect;
+    BOOL has_dest_rect;
+    RECT source_rect;
+    RECT dest_rect;
+    HWND hDestWindowOverride;
+};
+struct command_issue_query_args {
+    IDirect3DQuery9* query;
+    DWORD flags;
+};
+#pragma pack(pop)
@@ -0,0 +1,221 @@
+//====================================================================
+// Recorded head pose trace implementation.
+//====================================================================
+
+#include <math.h>
+#include <stddef.h>
+
+#include "PoseTrace.h"
+
+static short pack_unit (float value)
+{
+    value = max(-1.0f, min(1.0f, value));
+    return (short)floor(value * 32767.0f + 0.5f);
+}
+
+static float unpack_unit (short value)
+{
+    return value / 32767.0f;
+}
+
+PoseTraceWriter::PoseTraceWriter (const char path[])
+{
+    this->start_time = -1;
+    this->written_count = 0;
+    this->buffered = 0;
+    this->file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (this->file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    // Write a placeholder header, the record count is filled in on close
+    pose_trace_header header;
+    header.magic = POSE_TRACE_MAGIC;
+    header.version = POSE_TRACE_VERSION;
+    header.record_count = 0;
+    header.record_size = sizeof(pose_trace_record);
+    DWORD written;
+    WriteFile(this->file, &header, sizeof(header), &written, NULL);
+}
+
+PoseTraceWriter::~PoseTraceWriter ()
+{
+    this->finish();
+}
+
+void PoseTraceWriter::flush ()
+{
+    DWORD written;
+    WriteFile(this->file, this->buffer, this->buffered * sizeof(pose_trace_record), &written, NULL);
+    this->written_count += this->buffered;
+    this->buffered = 0;
+}
+
+void PoseTraceWriter::finish ()
+{
+    if (this->file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    this->flush();
+    DWORD written;
+    SetFilePointer(this->file, offsetof(pose_trace_header, record_count), NULL, FILE_BEGIN);
+    WriteFile(this->file, &this->written_count, sizeof(this->written_count), &written, NULL);
+    CloseHandle(this->file);
+    this->file = INVALID_HANDLE_VALUE;
+}
+
+void PoseTraceWriter::append (double time, const ovrPosef& pose)
+{
+    if (this->file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    if (this->start_time < 0)
+    {
+        this->start_time = time;
+    }
+
+    pose_trace_record record;
+    record.time_us = (unsigned __int64)((time - this->start_time) * 1000000.0);
+    record.orientation[0] = pack_unit(pose.Orientation.x);
+    record.orientation[1] = pack_unit(pose.Orientation.y);
+    record.orientation[2] = pack_unit(pose.Orientation.z);
+    record.orientation[3] = pack_unit(pose.Orientation.w);
+    record.position[0] = pose.Position.x;
+    record.position[1] = pose.Position.y;
+    record.position[2] = pose.Position.z;
+
+    // Only counted once it's whole, in case the thread dies part way
+    this->buffer[this->buffered] = record;
+    ++this->buffered;
+    if (this->buffered == POSE_TRACE_BUFFER)
+    {
+        this->flush();
+    }
+}
+
+PoseTraceReader::PoseTraceReader (const char path[])
+{
+    this->mapping = 0;
+    this->view = 0;
+    this->records = 0;
+    this->record_count = 0;
+
+    this->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (this->file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    DWORD file_size = GetFileSize(this->file, NULL);
+    if (file_size < sizeof(pose_trace_header))
+    {
+        return;
+    }
+    this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!this->mapping)
+    {
+        return;
+    }
+    this->view = MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!this->view)
+    {
+        return;
+    }
+
+    const pose_trace_header* header = (const pose_trace_header*)this->view;
+    if (header->magic != POSE_TRACE_MAGIC || header->version != POSE_TRACE_VERSION || header->record_size != sizeof(pose_trace_record))
+    {
+        return;
+    }
+
+    // Trust the file size over the header in case recording was cut short
+    unsigned int available = (file_size - sizeof(pose_trace_header)) / sizeof(pose_trace_record);
+    this->records = (const pose_trace_record*)(header + 1);
+    this->record_count = header->record_count ? min(header->record_count, available) : available;
+}
+
+PoseTraceReader::~PoseTraceReader ()
+{
+    if (this->view)
+    {
+        UnmapViewOfFile(this->view);
+    }
+    if (this->mapping)
+    {
+        CloseHandle(this->mapping);
+    }
+    if (this->file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(this->file);
+    }
+}
+
+double PoseTraceReader::duration () const
+{
+    if (!this->valid())
+    {
+        return 0;
+    }
+    return this->records[this->record_count - 1].time_us / 1000000.0;
+}
+
+ovrPosef PoseTraceReader::pose_at (double time) const
+{
+    ovrPosef pose;
+    memset(&pose, 0, sizeof(pose));
+    pose.Orientation.w = 1.0f;
+    if (!this->valid())
+    {
+        return pose;
+    }
+
+    // Loop the trace so playback can run for as long as needed
+    double trace_duration = this->duration();
+    if (trace_duration > 0)
+    {
+        time = fmod(time, trace_duration);
+        if (time < 0)
+        {
+            time += trace_duration;
+        }
+    }
+    unsigned __int64 time_us = (unsigned __int64)(time * 1000000.0);
+
+    // Binary search for the first record after the requested time
+    unsigned int low = 1;
+    unsigned int high = this->record_count - 1;
+    while (low < high)
+    {
+        unsigned int middle = (low + high) / 2;
+        if (this->records[middle].time_us <= time_us)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    const pose_trace_record& a = this->records[low - 1];
+    const pose_trace_record& b = this->records[low];
+    unsigned __int64 span = b.time_us - a.time_us;
+    float t = span ? (float)(time_us - a.time_us) / span : 0.0f;
+    t = max(0.0f, min(1.0f, t));
+
+    // Normalized lerp is plenty at tracker sample spacing
+    OVR::Quatf qa(unpack_unit(a.orientation[0]), unpack_unit(a.orientation[1]), unpack_unit(a.orientation[2]), unpack_unit(a.orientation[3]));
+    OVR::Quatf qb(unpack_unit(b.orientation[0]), unpack_unit(b.orientation[1]), unpack_unit(b.orientation[2]), unpack_unit(b.orientation[3]));
+    if (qa.Dot(qb) < 0)
+    {
+        qb = qb * -1.0f;
+    }
+    OVR::Quatf q = qa * (1.0f - t) + qb * t;
+    q.Normalize();
+    pose.Orientation = q;
+    pose.Position.x = a.position[0] + (b.position[0] - a.position[0]) * t;
+    pose.Position.y = a.position[1] + (b.position[1] - a.position[1]) * t;
+    pose.Position.z = a.position[2] + (b.position[2] - a.position[2]) * t;
+    return pose;
+}
@@ -0,0 +1,79 @@
+//====================================================================
+// Recorded head pose trace file format.
+//
+// A trace is a small header followed by fixed size records sorted by
+// time. Orientation is stored as a normalized quaternion in 16 bit
+// fixed point and time as 64 bit microseconds from the first sample,
+// which keeps each record at 28 bytes (about 28 KB per second at 1 kHz).
+// Version 1 had 32 bit times, which wrapped after 71 minutes.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+#include <OVR.h>
+
+#define POSE_TRACE_MAGIC 0x54525650 // 'PVRT'
+#define POSE_TRACE_VERSION 2
+#define POSE_TRACE_BUFFER 256
+
+#pragma pack(push, 1)
+struct pose_trace_header {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int record_count;
+    unsigned int record_size;
+};
+
+struct pose_trace_record {
+    unsigned __int64 time_us;
+    short orientation[4];
+    float position[3];
+};
+#pragma pack(pop)
+
+// Appends samples to a trace file as they arrive. Records are buffered
+// without locks and written straight through Win32, so the trace can
+// still be finished after the appending thread was terminated.
+class PoseTraceWriter
+{
+public:
+    PoseTraceWriter (const char path[]);
+    ~PoseTraceWriter ();
+
+    void append (double time, const ovrPosef& pose);
+
+    // Writes out what's buffered, fills in the header's record count and
+    // closes the file. Later appends are dropped.
+    void finish ();
+
+private:
+    void flush ();
+
+    HANDLE file;
+    double start_time;
+    unsigned int written_count;
+    pose_trace_record buffer[POSE_TRACE_BUFFER];
+    unsigned int buffered;
+};
+
+// Memory maps a trace file and interpolates poses out of it.
+class PoseTraceReader
+{
+public:
+    PoseTraceReader (const char path[]);
+    ~PoseTraceReader ();
+
+    bool valid () const { return this->record_count > 1; }
+    double duration () const;
+
+    // Time is relative to the start of the trace and wraps around.
+    ovrPosef pose_at (double time) const;
+
+private:
+    HANDLE file;
+    HANDLE mapping;
+    const void* view;
+    const pose_trace_record* records;
+    unsigned int record_count;
+};
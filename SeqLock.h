@@ -0,0 +1,65 @@
+//====================================================================
+// Single-writer sequence lock used to publish small POD values from
+// one thread to any number of readers without blocking either side.
+//
+// The writer bumps the sequence to an odd value, copies the payload
+// and bumps it back to even. Readers copy the payload and retry if
+// the sequence was odd or changed underneath them, so they can never
+// observe a torn value.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+#include <string.h>
+
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock ()
+    {
+        this->sequence = 0;
+        memset((void*)&this->value, 0, sizeof(T));
+    }
+
+    // Must only ever be called from a single thread.
+    void write (const T& new_value)
+    {
+        LONG sequence = this->sequence;
+        InterlockedExchange(&this->sequence, sequence + 1);
+        memcpy((void*)&this->value, &new_value, sizeof(T));
+        InterlockedExchange(&this->sequence, sequence + 2);
+    }
+
+    // Safe from any thread. Returns the sequence number of the copy,
+    // which is zero until the first write.
+    LONG read (T* out) const
+    {
+        for (;;)
+        {
+            LONG before = this->sequence;
+            _ReadWriteBarrier();
+            MemoryBarrier();
+            if (before & 1)
+            {
+                YieldProcessor();
+                continue;
+            }
+            memcpy(out, (const void*)&this->value, sizeof(T));
+            MemoryBarrier();
+            _ReadWriteBarrier();
+            if (this->sequence == before)
+            {
+                return before / 2;
+            }
+        }
+    }
+
+private:
+    SeqLock (const SeqLock&);
+    SeqLock& operator= (const SeqLock&);
+
+    volatile LONG sequence;
+    volatile T value;
+};
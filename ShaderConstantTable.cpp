@@ -0,0 +1,92 @@
+//====================================================================
+// Constant table parser implementation.
+//
+// Layout follows D3DXSHADER_CONSTANTTABLE / D3DXSHADER_CONSTANTINFO
+// from d3dx9shader.h, redeclared here so every offset can be bounds
+// checked against the comment block it came from.
+//====================================================================
+
+#include <string.h>
+
+#include "ShaderConstantTable.h"
+
+#define CTAB_FOURCC 0x42415443 // 'CTAB'
+
+#pragma pack(push, 1)
+struct ctab_header {
+    DWORD size;
+    DWORD creator;
+    DWORD version;
+    DWORD constant_count;
+    DWORD constant_info;
+    DWORD flags;
+    DWORD target;
+};
+struct ctab_constant_info {
+    DWORD name;
+    WORD register_set;
+    WORD register_index;
+    WORD register_count;
+    WORD reserved;
+    DWORD type_info;
+    DWORD default_value;
+};
+#pragma pack(pop)
+
+bool parse_constant_table (const DWORD* function, UINT size, std::vector<shader_constant>* constants)
+{
+    constants->clear();
+    UINT token_count = size / sizeof(DWORD);
+
+    // The table lives in a comment token right after the version token
+    for (UINT cursor = 1; cursor < token_count; )
+    {
+        DWORD token = function[cursor];
+        if ((token & D3DSI_OPCODE_MASK) != D3DSIO_COMMENT)
+        {
+            return false;
+        }
+        UINT comment_tokens = (token & D3DSI_COMMENTSIZE_MASK) >> D3DSI_COMMENTSIZE_SHIFT;
+        if (cursor + 1 + comment_tokens > token_count)
+        {
+            return false;
+        }
+        if (comment_tokens == 0 || function[cursor + 1] != CTAB_FOURCC)
+        {
+            cursor += 1 + comment_tokens;
+            continue;
+        }
+
+        // Offsets inside the table are relative to the byte after the fourcc
+        const unsigned char* table = (const unsigned char*)&function[cursor + 2];
+        UINT table_size = (comment_tokens - 1) * sizeof(DWORD);
+        if (table_size < sizeof(ctab_header))
+        {
+            return false;
+        }
+        const ctab_header* header = (const ctab_header*)table;
+        if (header->constant_info > table_size ||
+            header->constant_count > (table_size - header->constant_info) / sizeof(ctab_constant_info))
+        {
+            return false;
+        }
+
+        const ctab_constant_info* info = (const ctab_constant_info*)(table + header->constant_info);
+        for (DWORD i = 0; i < header->constant_count; ++i)
+        {
+            if (info[i].name >= table_size)
+            {
+                return false;
+            }
+            const char* name = (const char*)table + info[i].name;
+            shader_constant constant;
+            constant.name.assign(name, strnlen(name, table_size - info[i].name));
+            constant.register_set = (shader_register_set)info[i].register_set;
+            constant.register_index = info[i].register_index;
+            constant.register_count = info[i].register_count;
+            constants->push_back(constant);
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,31 @@
+//====================================================================
+// Parser for the constant table (CTAB) that the HLSL compiler embeds
+// as a comment in D3D9 shader bytecode. It maps each named uniform to
+// the registers it was assigned.
+//====================================================================
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <d3d9.h>
+
+// Mirrors D3DXREGISTER_SET
+enum shader_register_set {
+    SHADER_REGISTER_BOOL = 0,
+    SHADER_REGISTER_INT4 = 1,
+    SHADER_REGISTER_FLOAT4 = 2,
+    SHADER_REGISTER_SAMPLER = 3,
+};
+
+struct shader_constant {
+    std::string name;
+    shader_register_set register_set;
+    UINT register_index;
+    UINT register_count;
+};
+
+// Returns false if the bytecode has no well formed constant table.
+// size is the byte size of the token stream.
+bool parse_constant_table (const DWORD* function, UINT size, std::vector<shader_constant>* constants);
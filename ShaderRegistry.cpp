@@ -0,0 +1,324 @@
+//====================================================================
+// Shader registry implementation.
+//====================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ShaderRegistry.h"
+#include "Config.h"
+#include "ContentHash.h"
+#include "ShaderConstantTable.h"
+
+#define SHADER_CACHE_MAGIC 0x43535650 // 'PVSC'
+
+#pragma pack(push, 1)
+struct shader_cache_header {
+    unsigned int magic;
+    unsigned int analysis_version;
+    unsigned int record_size;
+};
+struct shader_cache_record {
+    unsigned __int64 hash;
+    shader_analysis analysis;
+};
+#pragma pack(pop)
+
+UINT shader_bytecode_size (const DWORD* function)
+{
+    // Walk the token stream: comments carry their length, and from shader
+    // model 2 on so do instructions. Operand tokens always have bit 31 set.
+    bool sized_instructions = D3DSHADER_VERSION_MAJOR(function[0]) >= 2;
+    const DWORD* cursor = function + 1;
+    for (;;)
+    {
+        DWORD token = *cursor;
+        if (token == D3DSIO_END)
+        {
+            return (UINT)((cursor + 1 - function) * sizeof(DWORD));
+        }
+        if ((token & D3DSI_OPCODE_MASK) == D3DSIO_COMMENT)
+        {
+            cursor += 1 + ((token & D3DSI_COMMENTSIZE_MASK) >> D3DSI_COMMENTSIZE_SHIFT);
+        }
+        else if (sized_instructions)
+        {
+            cursor += 1 + ((token & D3DSI_INSTLENGTH_MASK) >> D3DSI_INSTLENGTH_SHIFT);
+        }
+        else
+        {
+            ++cursor;
+            while (*cursor & 0x80000000)
+            {
+                ++cursor;
+            }
+        }
+    }
+}
+
+static UINT count_instructions (const DWORD* function)
+{
+    bool sized_instructions = D3DSHADER_VERSION_MAJOR(function[0]) >= 2;
+    UINT count = 0;
+    const DWORD* cursor = function + 1;
+    while (*cursor != D3DSIO_END)
+    {
+        DWORD token = *cursor;
+        if ((token & D3DSI_OPCODE_MASK) == D3DSIO_COMMENT)
+        {
+            cursor += 1 + ((token & D3DSI_COMMENTSIZE_MASK) >> D3DSI_COMMENTSIZE_SHIFT);
+            continue;
+        }
+        ++count;
+        if (sized_instructions)
+        {
+            cursor += 1 + ((token & D3DSI_INSTLENGTH_MASK) >> D3DSI_INSTLENGTH_SHIFT);
+        }
+        else
+        {
+            ++cursor;
+            while (*cursor & 0x80000000)
+            {
+                ++cursor;
+            }
+        }
+    }
+    return count;
+}
+
+// Find the transform uniform. Pinball Arcade calls it C_WORLDVIEWPROJ, but
+// accept the common spellings in case shaders get rebuilt.
+static void find_wvp_register (const DWORD* function, UINT size, shader_analysis* analysis)
+{
+    analysis->wvp_register = 11;
+    analysis->wvp_register_count = 4;
+    std::vector<shader_constant> constants;
+    if (!parse_constant_table(function, size, &constants))
+    {
+        return;
+    }
+
+    analysis->wvp_register = -1;
+    analysis->wvp_register_count = 0;
+    for (size_t i = 0; i < constants.size(); ++i)
+    {
+        const shader_constant& constant = constants[i];
+        if (constant.register_set != SHADER_REGISTER_FLOAT4 || constant.register_count < 4)
+        {
+            continue;
+        }
+        const char* name = constant.name.c_str();
+        if (_stricmp(name, "C_WORLDVIEWPROJ") == 0
+            || _stricmp(name, "WorldViewProj") == 0
+            || _stricmp(name, "WorldViewProjection") == 0
+            || _stricmp(name, "g_mWorldViewProjection") == 0)
+        {
+            analysis->wvp_register = constant.register_index;
+            analysis->wvp_register_count = 4;
+            return;
+        }
+    }
+}
+
+ShaderRegistry::ShaderRegistry ()
+{
+    InitializeCriticalSection(&this->lock);
+    this->cache_path = config_data_path("PinballVRcade.shadercache");
+    this->load_cache();
+}
+
+void ShaderRegistry::load_cache ()
+{
+    FILE* file;
+    if (fopen_s(&file, this->cache_path.c_str(), "rb") != 0)
+    {
+        return;
+    }
+    shader_cache_header header;
+    bool valid =
+        fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == SHADER_CACHE_MAGIC
+        && header.analysis_version == SHADER_ANALYSIS_VERSION
+        && header.record_size == sizeof(shader_cache_record);
+    if (valid)
+    {
+        shader_cache_record record;
+        while (fread(&record, sizeof(record), 1, file) == 1)
+        {
+            this->analysis_cache[record.hash] = record.analysis;
+        }
+    }
+    fclose(file);
+
+    // Start over if the file was written by a different version
+    if (!valid)
+    {
+        DeleteFileA(this->cache_path.c_str());
+    }
+}
+
+void ShaderRegistry::append_to_cache (unsigned __int64 hash, const shader_analysis& analysis)
+{
+    FILE* file;
+    if (fopen_s(&file, this->cache_path.c_str(), "ab") != 0)
+    {
+        return;
+    }
+    if (ftell(file) == 0)
+    {
+        shader_cache_header header;
+        header.magic = SHADER_CACHE_MAGIC;
+        header.analysis_version = SHADER_ANALYSIS_VERSION;
+        header.record_size = sizeof(shader_cache_record);
+        fwrite(&header, sizeof(header), 1, file);
+    }
+    shader_cache_record record;
+    record.hash = hash;
+    record.analysis = analysis;
+    fwrite(&record, sizeof(record), 1, file);
+    fclose(file);
+}
+
+const shader_analysis& ShaderRegistry::analyze (unsigned __int64 hash, const DWORD* function, UINT size)
+{
+    std::map<unsigned __int64, shader_analysis>::iterator found = this->analysis_cache.find(hash);
+    if (found != this->analysis_cache.end())
+    {
+        return found->second;
+    }
+
+    shader_analysis analysis;
+    memset(&analysis, 0, sizeof(analysis));
+    analysis.version_token = function[0];
+    analysis.bytecode_size = size;
+    analysis.instruction_count = count_instructions(function);
+    if ((function[0] & 0xFFFF0000) == 0xFFFE0000)
+    {
+        find_wvp_register(function, size, &analysis);
+    }
+    else
+    {
+        analysis.wvp_register = -1;
+        analysis.wvp_register_count = 0;
+    }
+
+    this->append_to_cache(hash, analysis);
+    return this->analysis_cache[hash] = analysis;
+}
+
+HRESULT ShaderRegistry::create_vertex_shader (IDirect3DDevice9* device, IDirect3DDevice9* inner, const DWORD* function, IDirect3DVertexShader9** shader_out)
+{
+    UINT size = shader_bytecode_size(function);
+    unsigned __int64 hash = hash_bytes(s_empty_hash, function, size);
+
+    EnterCriticalSection(&this->lock);
+    std::map<unsigned __int64, entry<Direct3DVertexShader9Hooks> >::iterator found = this->vertex_shaders.find(hash);
+    if (found != this->vertex_shaders.end()
+        && found->second.bytecode.size() * sizeof(DWORD) == size
+        && memcmp(&found->second.bytecode[0], function, size) == 0
+        && found->second.shader->try_add_ref())
+    {
+        // Same bytecode as a live shader, skip the driver entirely
+        *shader_out = found->second.shader;
+        LeaveCriticalSection(&this->lock);
+        return D3D_OK;
+    }
+
+    IDirect3DVertexShader9* shader;
+    HRESULT result = inner->CreateVertexShader(function, &shader);
+    if (SUCCEEDED(result))
+    {
+        entry<Direct3DVertexShader9Hooks> new_entry;
+        new_entry.shader = new Direct3DVertexShader9Hooks(device, shader, this, hash, this->analyze(hash, function, size));
+        new_entry.bytecode.assign(function, function + size / sizeof(DWORD));
+        this->vertex_shaders[hash] = new_entry;
+        this->vertex_wrappers[shader] = new_entry.shader;
+        *shader_out = new_entry.shader;
+    }
+    LeaveCriticalSection(&this->lock);
+    return result;
+}
+
+HRESULT ShaderRegistry::create_pixel_shader (IDirect3DDevice9* device, IDirect3DDevice9* inner, const DWORD* function, IDirect3DPixelShader9** shader_out)
+{
+    UINT size = shader_bytecode_size(function);
+    unsigned __int64 hash = hash_bytes(s_empty_hash, function, size);
+
+    EnterCriticalSection(&this->lock);
+    std::map<unsigned __int64, entry<Direct3DPixelShader9Hooks> >::iterator found = this->pixel_shaders.find(hash);
+    if (found != this->pixel_shaders.end()
+        && found->second.bytecode.size() * sizeof(DWORD) == size
+        && memcmp(&found->second.bytecode[0], function, size) == 0
+        && found->second.shader->try_add_ref())
+    {
+        // Same bytecode as a live shader, skip the driver entirely
+        *shader_out = found->second.shader;
+        LeaveCriticalSection(&this->lock);
+        return D3D_OK;
+    }
+
+    IDirect3DPixelShader9* shader;
+    HRESULT result = inner->CreatePixelShader(function, &shader);
+    if (SUCCEEDED(result))
+    {
+        entry<Direct3DPixelShader9Hooks> new_entry;
+        new_entry.shader = new Direct3DPixelShader9Hooks(device, shader, this, hash, this->analyze(hash, function, size));
+        new_entry.bytecode.assign(function, function + size / sizeof(DWORD));
+        this->pixel_shaders[hash] = new_entry;
+        this->pixel_wrappers[shader] = new_entry.shader;
+        *shader_out = new_entry.shader;
+    }
+    LeaveCriticalSection(&this->lock);
+    return result;
+}
+
+void ShaderRegistry::forget (Direct3DVertexShader9Hooks* shader, unsigned __int64 hash)
+{
+    EnterCriticalSection(&this->lock);
+    std::map<unsigned __int64, entry<Direct3DVertexShader9Hooks> >::iterator found = this->vertex_shaders.find(hash);
+    if (found != this->vertex_shaders.end() && found->second.shader == shader)
+    {
+        this->vertex_shaders.erase(found);
+    }
+    this->vertex_wrappers.erase(Direct3DVertexShader9Hooks::unwrap(shader));
+    LeaveCriticalSection(&this->lock);
+}
+
+void ShaderRegistry::forget (Direct3DPixelShader9Hooks* shader, unsigned __int64 hash)
+{
+    EnterCriticalSection(&this->lock);
+    std::map<unsigned __int64, entry<Direct3DPixelShader9Hooks> >::iterator found = this->pixel_shaders.find(hash);
+    if (found != this->pixel_shaders.end() && found->second.shader == shader)
+    {
+        this->pixel_shaders.erase(found);
+    }
+    this->pixel_wrappers.erase(Direct3DPixelShader9Hooks::unwrap(shader));
+    LeaveCriticalSection(&this->lock);
+}
+
+template <typename Wrapper, typename Interface>
+static Wrapper* find_wrapper (const std::map<Interface*, Wrapper*>& wrappers, Interface* shader)
+{
+    typename std::map<Interface*, Wrapper*>::const_iterator found = wrappers.find(shader);
+    if (found == wrappers.end() || !found->second->try_add_ref())
+    {
+        return 0;
+    }
+    return found->second;
+}
+
+Direct3DVertexShader9Hooks* ShaderRegistry::wrapper_of (IDirect3DVertexShader9* shader)
+{
+    EnterCriticalSection(&this->lock);
+    Direct3DVertexShader9Hooks* wrapper = find_wrapper(this->vertex_wrappers, shader);
+    LeaveCriticalSection(&this->lock);
+    return wrapper;
+}
+
+Direct3DPixelShader9Hooks* ShaderRegistry::wrapper_of (IDirect3DPixelShader9* shader)
+{
+    EnterCriticalSection(&this->lock);
+    Direct3DPixelShader9Hooks* wrapper = find_wrapper(this->pixel_wrappers, shader);
+    LeaveCriticalSection(&this->lock);
+    return wrapper;
+}
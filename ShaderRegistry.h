@@ -0,0 +1,169 @@
+//====================================================================
+// Content-addressed registry of the shaders the game creates.
+//
+// Pinball Arcade creates the same shader bytecode over and over as
+// tables load. The registry hashes each blob, hands back the existing
+// shader for duplicates and keeps per-shader analysis results, which
+// are also saved to disk so later launches don't redo the analysis.
+//====================================================================
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include <d3d9.h>
+
+// Facts we derive from shader bytecode. Bump SHADER_ANALYSIS_VERSION
+// whenever this changes so stale on-disk caches get discarded.
+#define SHADER_ANALYSIS_VERSION 2
+struct shader_analysis {
+    DWORD version_token;
+    UINT bytecode_size;
+    UINT instruction_count;
+
+    // Float register holding the world-view-projection matrix, or -1 if
+    // the shader has a constant table but no such matrix. Shaders without
+    // a constant table are assumed to use the legacy register 11.
+    int wvp_register;
+    UINT wvp_register_count;
+};
+
+class ShaderRegistry;
+
+// Wrapper handed to the game in place of the driver's shader object.
+template <typename Interface>
+class Direct3DShader9Hooks : public Interface
+{
+public:
+    Direct3DShader9Hooks (IDirect3DDevice9* device, Interface* inner, ShaderRegistry* registry, unsigned __int64 hash, const shader_analysis& analysis)
+    {
+        this->device = device;
+        this->inner = inner;
+        this->registry = registry;
+        this->hash = hash;
+        this->analysis = analysis;
+        this->ref_count = 1;
+    }
+
+    static Interface* unwrap (Interface* shader)
+    {
+        return shader ? static_cast<Direct3DShader9Hooks*>(shader)->inner : 0;
+    }
+
+    const shader_analysis& get_analysis () const { return this->analysis; }
+
+    // AddRef unless the last reference is already on its way out
+    bool try_add_ref ()
+    {
+        for (;;)
+        {
+            LONG count = *(volatile LONG*)&this->ref_count;
+            if (count == 0)
+            {
+                return false;
+            }
+            if (InterlockedCompareExchange((LONG*)&this->ref_count, count + 1, count) == count)
+            {
+                return true;
+            }
+        }
+    }
+
+    /*** IUnknown methods ***/
+    STDMETHOD(QueryInterface)(THIS_ REFIID riid, void** ppvObj)
+    {
+        if (riid == IID_IUnknown || riid == __uuidof(Interface))
+        {
+            this->AddRef();
+            *ppvObj = this;
+            return S_OK;
+        }
+        return this->inner->QueryInterface(riid, ppvObj);
+    }
+
+    STDMETHOD_(ULONG,AddRef)(THIS)
+    {
+        return InterlockedIncrement((LONG*)&this->ref_count);
+    }
+
+    STDMETHOD_(ULONG,Release)(THIS);
+
+    /*** IDirect3DVertexShader9 / IDirect3DPixelShader9 methods ***/
+    STDMETHOD(GetDevice)(THIS_ IDirect3DDevice9** ppDevice)
+    {
+        this->device->AddRef();
+        *ppDevice = this->device;
+        return D3D_OK;
+    }
+
+    STDMETHOD(GetFunction)(THIS_ void* pData,UINT* pSizeOfData)
+    {
+        return this->inner->GetFunction(pData, pSizeOfData);
+    }
+
+private:
+    IDirect3DDevice9* device;
+    Interface* inner;
+    ShaderRegistry* registry;
+    unsigned __int64 hash;
+    shader_analysis analysis;
+    ULONG ref_count;
+};
+
+typedef Direct3DShader9Hooks<IDirect3DVertexShader9> Direct3DVertexShader9Hooks;
+typedef Direct3DShader9Hooks<IDirect3DPixelShader9> Direct3DPixelShader9Hooks;
+
+class ShaderRegistry
+{
+public:
+    ShaderRegistry ();
+
+    HRESULT create_vertex_shader (IDirect3DDevice9* device, IDirect3DDevice9* inner, const DWORD* function, IDirect3DVertexShader9** shader_out);
+    HRESULT create_pixel_shader (IDirect3DDevice9* device, IDirect3DDevice9* inner, const DWORD* function, IDirect3DPixelShader9** shader_out);
+
+    // Called by the wrappers when the game lets go of the last reference
+    void forget (Direct3DVertexShader9Hooks* shader, unsigned __int64 hash);
+    void forget (Direct3DPixelShader9Hooks* shader, unsigned __int64 hash);
+
+    // The wrapper the game holds for one of the driver's shaders, AddRef'd,
+    // or null if it's not ours or on its way out
+    Direct3DVertexShader9Hooks* wrapper_of (IDirect3DVertexShader9* shader);
+    Direct3DPixelShader9Hooks* wrapper_of (IDirect3DPixelShader9* shader);
+
+private:
+    template <typename Wrapper>
+    struct entry {
+        Wrapper* shader;
+        std::vector<DWORD> bytecode;
+    };
+
+    const shader_analysis& analyze (unsigned __int64 hash, const DWORD* function, UINT size);
+    void load_cache ();
+    void append_to_cache (unsigned __int64 hash, const shader_analysis& analysis);
+
+    std::map<unsigned __int64, entry<Direct3DVertexShader9Hooks> > vertex_shaders;
+    std::map<unsigned __int64, entry<Direct3DPixelShader9Hooks> > pixel_shaders;
+    std::map<IDirect3DVertexShader9*, Direct3DVertexShader9Hooks*> vertex_wrappers;
+    std::map<IDirect3DPixelShader9*, Direct3DPixelShader9Hooks*> pixel_wrappers;
+    std::map<unsigned __int64, shader_analysis> analysis_cache;
+    std::string cache_path;
+    CRITICAL_SECTION lock;
+};
+
+template <typename Interface>
+ULONG Direct3DShader9Hooks<Interface>::Release ()
+{
+    ULONG count = InterlockedDecrement((LONG*)&this->ref_count);
+    if (count == 0)
+    {
+        this->registry->forget(this, this->hash);
+        this->inner->Release();
+        delete this;
+    }
+    return count;
+}
+
+// Size in bytes of a shader token stream up to and including its end token
+UINT shader_bytecode_size (const DWORD* function);
@@ -0,0 +1,90 @@
+//====================================================================
+// Startup timeline, patch DLL side.
+//
+// Opens the block the launcher created for this process and appends
+// events to it. Startup is short and mostly single threaded, so once
+// the block is full further events are simply dropped.
+//====================================================================
+
+#include <stdio.h>
+#include <string.h>
+
+#include "StartupTimeline.h"
+
+static startup_timeline* s_timeline = 0;
+static volatile LONG s_opened = 0;
+static volatile LONG s_first_frame = 0;
+
+static startup_timeline* open_timeline ()
+{
+    // Only try once; games started without the launcher have no block
+    if (InterlockedExchange(&s_opened, 1) == 0)
+    {
+        char name[64];
+        sprintf_s(name, "%s%lu", STARTUP_TIMELINE_MAPPING_NAME, GetCurrentProcessId());
+        HANDLE mapping = OpenFileMappingA(FILE_MAP_WRITE, FALSE, name);
+        if (mapping)
+        {
+            startup_timeline* timeline = (startup_timeline*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(startup_timeline));
+            CloseHandle(mapping);
+            if (timeline && timeline->magic == STARTUP_TIMELINE_MAGIC && timeline->version == STARTUP_TIMELINE_VERSION)
+            {
+                InterlockedExchangePointer((PVOID*)&s_timeline, timeline);
+            }
+        }
+    }
+    return s_timeline;
+}
+
+static void add_event (DWORD kind, const char name[])
+{
+    startup_timeline* timeline = open_timeline();
+    if (!timeline)
+    {
+        return;
+    }
+    LONG index = InterlockedIncrement(&timeline->event_count) - 1;
+    if (index >= STARTUP_TIMELINE_MAX_EVENTS)
+    {
+        return;
+    }
+    startup_event* event = &timeline->events[index];
+    QueryPerformanceCounter(&event->timestamp);
+    event->kind = kind;
+    event->thread_id = GetCurrentThreadId();
+    strncpy_s(event->name, name, _TRUNCATE);
+    InterlockedExchange(&event->committed, 1);
+}
+
+void startup_timeline_begin (const char name[])
+{
+    add_event(STARTUP_EVENT_BEGIN, name);
+}
+
+void startup_timeline_end (const char name[])
+{
+    add_event(STARTUP_EVENT_END, name);
+}
+
+void startup_timeline_mark (const char name[])
+{
+    add_event(STARTUP_EVENT_MARK, name);
+}
+
+void startup_timeline_first_frame ()
+{
+    if (InterlockedExchange(&s_first_frame, 1) != 0)
+    {
+        return;
+    }
+    add_event(STARTUP_EVENT_MARK, "first frame presented");
+
+    char name[64];
+    sprintf_s(name, "%s%lu", STARTUP_TIMELINE_FIRST_FRAME_NAME, GetCurrentProcessId());
+    HANDLE first_frame = OpenEventA(EVENT_MODIFY_STATE, FALSE, name);
+    if (first_frame)
+    {
+        SetEvent(first_frame);
+        CloseHandle(first_frame);
+    }
+}
@@ -0,0 +1,59 @@
+//====================================================================
+// Startup timeline shared between the launcher and the patch DLL.
+//
+// The launcher creates a named block of shared memory for the game's
+// process before injecting the DLL. Both sides append timestamped
+// events to it, and once the first frame is presented the launcher
+// writes out a breakdown of where startup time went.
+//
+// This header is included from the launcher's C code as well, so the
+// shared layout has to stay plain C.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+
+// Both names get the game's process id appended
+#define STARTUP_TIMELINE_MAPPING_NAME "Local\\PinballVRcadeStartup"
+#define STARTUP_TIMELINE_FIRST_FRAME_NAME "Local\\PinballVRcadeFirstFrame"
+
+#define STARTUP_TIMELINE_MAGIC 0x4C545350 // 'PSTL'
+#define STARTUP_TIMELINE_VERSION 1
+#define STARTUP_TIMELINE_MAX_EVENTS 64
+
+enum startup_event_kind {
+    STARTUP_EVENT_BEGIN,
+    STARTUP_EVENT_END,
+    STARTUP_EVENT_MARK,
+};
+
+typedef struct startup_event {
+    LARGE_INTEGER timestamp; // QueryPerformanceCounter, comparable across processes
+    DWORD kind;
+    DWORD thread_id;
+    volatile LONG committed; // Set last, readers skip events still being written
+    char name[44];
+} startup_event;
+
+typedef struct startup_timeline {
+    DWORD magic;
+    DWORD version;
+    LARGE_INTEGER frequency;
+    volatile LONG event_count;
+    startup_event events[STARTUP_TIMELINE_MAX_EVENTS];
+} startup_timeline;
+
+#ifdef __cplusplus
+
+// Record the start and end of a startup phase, or a single point in time.
+// These do nothing when the game wasn't started from the launcher.
+void startup_timeline_begin (const char name[]);
+void startup_timeline_end (const char name[]);
+void startup_timeline_mark (const char name[]);
+
+// Marks the first presented frame and lets the launcher print the
+// timeline. Only the first call has any effect.
+void startup_timeline_first_frame ();
+
+#endif
@@ -0,0 +1,156 @@
+//====================================================================
+// Simulation timestep patch implementation.
+//====================================================================
+
+#include <Windows.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+#include "TimestepPatch.h"
+#include "Config.h"
+#include "hacks.h"
+
+static struct {
+    bool located;
+    bool failed;
+
+    // Patched locations
+    uintptr_t ms_per_tick_address;
+    uintptr_t global_step_address;
+    uintptr_t frame_interval_address;
+
+    // The game's values before we touched anything
+    double original_ms_per_tick;
+    float original_global_step;
+    unsigned original_frame_interval;
+
+    // Current patch state
+    double rate;
+    double ms_per_frame;
+    double interval_error;
+    unsigned frame_interval;
+} s_timestep;
+
+static bool locate ()
+{
+    if (s_timestep.located || s_timestep.failed)
+    {
+        return s_timestep.located;
+    }
+
+    rolling_crc crc;
+    crc.block_size = 9;
+    crc.a = 0x05cc;
+    crc.b = 0x1acf;
+
+    uintptr_t address = find_fingerprint(crc);
+    if (!address)
+    {
+        s_timestep.failed = true;
+        return false;
+    }
+
+    // Get the address of the intervals_per_tick global by reading its address from
+    // an instruction that uses it as an operand.
+    uintptr_t ms_per_tick_compare = address + 0x00C5D0B5 - 0x00C5D046;
+    read_code(ms_per_tick_compare + 2, sizeof(s_timestep.ms_per_tick_address), &s_timestep.ms_per_tick_address);
+
+    // Same for the global step scale
+    uintptr_t global_step_load = address + 0x00C5D0F7 - 0x00C5D046;
+    read_code(global_step_load + 2, sizeof(s_timestep.global_step_address), &s_timestep.global_step_address);
+
+    // The instruction that assigns the simulation steps has the frame interval
+    // in milliseconds as an immediate operand
+    s_timestep.frame_interval_address = address + 0x00C5D100 - 0x00C5D046 + 1;
+
+    // Remember the originals so every patch starts from the same place
+    read_code(s_timestep.ms_per_tick_address, sizeof(s_timestep.original_ms_per_tick), &s_timestep.original_ms_per_tick);
+    read_code(s_timestep.global_step_address, sizeof(s_timestep.original_global_step), &s_timestep.original_global_step);
+    read_code(s_timestep.frame_interval_address, sizeof(s_timestep.original_frame_interval), &s_timestep.original_frame_interval);
+    s_timestep.frame_interval = s_timestep.original_frame_interval;
+    s_timestep.located = true;
+    return true;
+}
+
+static void set_frame_interval (unsigned milliseconds)
+{
+    if (milliseconds != s_timestep.frame_interval)
+    {
+        // This may run every frame, so keep the code page executable while
+        // we write to it instead of going through install_patch
+        DWORD old_rights;
+        DWORD new_rights = PAGE_EXECUTE_READWRITE;
+        VirtualProtect((LPVOID)s_timestep.frame_interval_address, sizeof(milliseconds), new_rights, &old_rights);
+        *(volatile unsigned*)s_timestep.frame_interval_address = milliseconds;
+        VirtualProtect((LPVOID)s_timestep.frame_interval_address, sizeof(milliseconds), old_rights, &new_rights);
+        FlushInstructionCache(GetCurrentProcess(), (LPCVOID)s_timestep.frame_interval_address, sizeof(milliseconds));
+        s_timestep.frame_interval = milliseconds;
+    }
+}
+
+bool timestep_patch_apply (double frame_hz)
+{
+    if (!locate())
+    {
+        return false;
+    }
+
+    if (frame_hz <= 0)
+    {
+        // Put the game back the way we found it
+        install_patch(s_timestep.ms_per_tick_address, sizeof(s_timestep.original_ms_per_tick), &s_timestep.original_ms_per_tick);
+        install_patch(s_timestep.global_step_address, sizeof(s_timestep.original_global_step), &s_timestep.original_global_step);
+        set_frame_interval(s_timestep.original_frame_interval);
+        s_timestep.rate = 0;
+        return true;
+    }
+
+    // Reassign the tick interval to the frame interval
+    double ms_per_tick = 1000.0 / frame_hz;
+    install_patch(s_timestep.ms_per_tick_address, sizeof(ms_per_tick), &ms_per_tick);
+
+    // Scale the global step from the game's 60 Hz baseline
+    float global_step = (float)(s_timestep.original_global_step * (60.0 / frame_hz));
+    install_patch(s_timestep.global_step_address, sizeof(global_step), &global_step);
+
+    // Start the dithered frame interval from scratch
+    s_timestep.rate = frame_hz;
+    s_timestep.ms_per_frame = ms_per_tick;
+    s_timestep.interval_error = 0;
+    timestep_patch_frame();
+    return true;
+}
+
+double timestep_patch_rate ()
+{
+    return s_timestep.rate;
+}
+
+void timestep_patch_frame ()
+{
+    if (s_timestep.rate <= 0)
+    {
+        return;
+    }
+
+    // Carry the fractional millisecond over to the next frame so that over
+    // time the game advances exactly 1000 / rate milliseconds per frame
+    double wanted = s_timestep.ms_per_frame + s_timestep.interval_error;
+    unsigned milliseconds = (unsigned)floor(wanted + 0.5);
+    s_timestep.interval_error = wanted - milliseconds;
+    set_frame_interval(milliseconds);
+}
+
+double timestep_patch_target_rate (unsigned int refresh_hz, bool fullscreen)
+{
+    // Rate=auto follows the display refresh rate in fullscreen only, since
+    // a window doesn't get vsync'd presents at the desktop rate. Any number
+    // forces that simulation rate.
+    std::string setting = config_string("Simulation", "Rate", "auto");
+    if (_stricmp(setting.c_str(), "auto") == 0)
+    {
+        return fullscreen ? refresh_hz : 0;
+    }
+    return atof(setting.c_str());
+}
@@ -0,0 +1,28 @@
+//====================================================================
+// Patch for Pinball Arcade's fixed simulation timestep.
+//
+// The game assumes a 60 Hz display. These functions retune its
+// physics tick to another rate and can be re-applied at any time, for
+// instance after a Reset changes the refresh rate. Every application
+// starts again from the game's original values, so repeated calls
+// never compound.
+//====================================================================
+
+#pragma once
+
+// Retune the simulation for the given rate in Hz, or restore the
+// original timing if frame_hz is zero. Returns false if the code to
+// patch couldn't be found.
+bool timestep_patch_apply (double frame_hz);
+
+// Rate most recently applied, or zero if unpatched.
+double timestep_patch_rate ();
+
+// Call once per presented frame. When the frame interval isn't a whole
+// number of milliseconds this dithers the game's integer interval so
+// the simulation clock doesn't drift from the display.
+void timestep_patch_frame ();
+
+// Rate the simulation should run at for a display refresh rate, taking
+// the [Simulation] Rate setting into account. Zero means leave it alone.
+double timestep_patch_target_rate (unsigned int refresh_hz, bool fullscreen);
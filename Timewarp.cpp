@@ -0,0 +1,83 @@
+//====================================================================
+// Missed frame detection and orientation-only reprojection.
+//====================================================================
+
+#include "Timewarp.h"
+
+FrameDeadline::FrameDeadline ()
+{
+    this->refresh_interval = 0;
+    this->lead = 0;
+    this->last_present = 0;
+}
+
+void FrameDeadline::configure (double refresh_interval, double lead)
+{
+    this->refresh_interval = refresh_interval;
+    this->lead = lead;
+}
+
+void FrameDeadline::presented (double time)
+{
+    // Game frames and re-presents are reported from different places, so
+    // only ever move forwards
+    if (time > this->last_present)
+    {
+        this->last_present = time;
+    }
+}
+
+bool FrameDeadline::missed (double now) const
+{
+    if (this->refresh_interval <= 0 || this->last_present <= 0)
+    {
+        return false;
+    }
+    return now >= this->last_present + this->refresh_interval - this->lead;
+}
+
+static void rotation_matrix (const timewarp_quat& q, float out[3][3])
+{
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    out[0][0] = 1 - 2 * (yy + zz);
+    out[0][1] = 2 * (xy - wz);
+    out[0][2] = 2 * (xz + wy);
+    out[1][0] = 2 * (xy + wz);
+    out[1][1] = 1 - 2 * (xx + zz);
+    out[1][2] = 2 * (yz - wx);
+    out[2][0] = 2 * (xz - wy);
+    out[2][1] = 2 * (yz + wx);
+    out[2][2] = 1 - 2 * (xx + yy);
+}
+
+void timewarp_orientation_matrix (const timewarp_quat& rendered, const timewarp_quat& latest, float out[4][4])
+{
+    // Now-view to world, then world to rendered-view. The inverse of a
+    // rotation is its transpose, so rendered is read by columns.
+    //
+    // Poses are in LibOVR's eye space (+y up, -z forward) but the shader
+    // rotates tan-angle directions (x, y down, +z forward), as
+    // ovrHmd_GetEyeTimewarpMatrices does. The change of basis B =
+    // diag(1, -1, -1) is its own inverse, so B R B just flips the sign of
+    // every element pairing x with y or z.
+    static const float basis[3] = { 1, -1, -1 };
+    float rendered_rotation[3][3];
+    float latest_rotation[3][3];
+    rotation_matrix(rendered, rendered_rotation);
+    rotation_matrix(latest, latest_rotation);
+    for (int row = 0; row < 3; ++row)
+    {
+        for (int column = 0; column < 3; ++column)
+        {
+            out[row][column] = basis[row] * basis[column] * (
+                rendered_rotation[0][row] * latest_rotation[0][column] +
+                rendered_rotation[1][row] * latest_rotation[1][column] +
+                rendered_rotation[2][row] * latest_rotation[2][column]);
+        }
+        out[row][3] = 0;
+    }
+    out[3][0] = out[3][1] = out[3][2] = 0;
+    out[3][3] = 1;
+}
@@ -0,0 +1,44 @@
+//====================================================================
+// Missed frame detection and orientation-only reprojection for
+// re-presenting the last frame when the game can't keep up.
+//
+// Deliberately free of Windows, Direct3D and LibOVR types so it can be
+// driven from recorded timing and pose traces on any platform.
+//====================================================================
+
+#pragma once
+
+struct timewarp_quat {
+    float x, y, z, w;
+};
+
+// Tracks when frames went out and tells whether the next refresh is
+// going to come around without a new one. Times are in seconds on any
+// monotonic clock, as long as it's the same one throughout.
+class FrameDeadline
+{
+public:
+    FrameDeadline ();
+
+    // Lead is how long before a refresh a re-present has to be started
+    // for it to make that refresh. A zero interval disables detection.
+    void configure (double refresh_interval, double lead);
+
+    // A frame, new or re-presented, was submitted at this time
+    void presented (double time);
+
+    // True once the refresh after the last submitted frame is too close
+    // to wait any longer for a new one
+    bool missed (double now) const;
+
+private:
+    double refresh_interval;
+    double lead;
+    double last_present;
+};
+
+// Rotation taking view directions of the head orientation now into
+// the view the frame was rendered from, with no translation, in the
+// +z forward tan-angle basis the distortion shader works in. Written
+// row by row, which is how its timewarp registers expect it.
+void timewarp_orientation_matrix (const timewarp_quat& rendered, const timewarp_quat& latest, float out[4][4]);
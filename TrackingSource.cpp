@@ -0,0 +1,210 @@
+//====================================================================
+// Tracking source implementations.
+//====================================================================
+
+#include <math.h>
+#include <string.h>
+#include <string>
+
+#include "TrackingSource.h"
+#include "PoseTrace.h"
+#include "Config.h"
+
+//====================================================================
+// Live headset tracking through LibOVR
+//====================================================================
+
+class OVRTrackingSource : public TrackingSource
+{
+public:
+    OVRTrackingSource (ovrHmd hmd)
+    {
+        this->hmd = hmd;
+    }
+
+    virtual bool sample (double target_time, ovrPosef* pose)
+    {
+        if (!this->hmd)
+        {
+            return false;
+        }
+        ovrTrackingState state = ovrHmd_GetTrackingState(this->hmd, target_time);
+        *pose = state.HeadPose.ThePose;
+        return true;
+    }
+
+    virtual bool needs_hmd () const
+    {
+        return true;
+    }
+
+private:
+    ovrHmd hmd;
+};
+
+//====================================================================
+// Playback of a recorded pose trace
+//====================================================================
+
+class TraceTrackingSource : public TrackingSource
+{
+public:
+    TraceTrackingSource (const char path[], float speed)
+        : trace(path)
+    {
+        this->speed = speed;
+        this->start_time = -1;
+        if (!this->trace.valid())
+        {
+            OutputDebugStringA("PinballVRcade: couldn't load tracking trace file\n");
+        }
+    }
+
+    virtual bool sample (double target_time, ovrPosef* pose)
+    {
+        if (!this->trace.valid())
+        {
+            return false;
+        }
+        if (this->start_time < 0)
+        {
+            this->start_time = target_time;
+        }
+        *pose = this->trace.pose_at((target_time - this->start_time) * this->speed);
+        return true;
+    }
+
+    virtual bool needs_hmd () const
+    {
+        return false;
+    }
+
+private:
+    PoseTraceReader trace;
+    float speed;
+    double start_time;
+};
+
+//====================================================================
+// Deterministic synthetic head motion: a slow look around the table
+// with a little positional sway, like a player leaning in.
+//====================================================================
+
+class SyntheticTrackingSource : public TrackingSource
+{
+public:
+    SyntheticTrackingSource (float speed)
+    {
+        this->speed = speed;
+        this->start_time = -1;
+    }
+
+    virtual bool sample (double target_time, ovrPosef* pose)
+    {
+        if (this->start_time < 0)
+        {
+            this->start_time = target_time;
+        }
+        float t = (float)((target_time - this->start_time) * this->speed);
+        float yaw = 0.35f * sinf(t * 0.9f);
+        float pitch = -0.15f + 0.12f * sinf(t * 1.3f + 0.5f);
+        float roll = 0.03f * sinf(t * 2.1f);
+        OVR::Quatf orientation =
+            OVR::Quatf(OVR::Vector3f(0, 1, 0), yaw)
+            * OVR::Quatf(OVR::Vector3f(1, 0, 0), pitch)
+            * OVR::Quatf(OVR::Vector3f(0, 0, 1), roll);
+        pose->Orientation = orientation;
+        pose->Position.x = 0.05f * sinf(t * 0.7f);
+        pose->Position.y = 0.02f * sinf(t * 1.1f);
+        pose->Position.z = 0.04f * sinf(t * 0.5f + 1.0f);
+        return true;
+    }
+
+    virtual bool needs_hmd () const
+    {
+        return false;
+    }
+
+private:
+    float speed;
+    double start_time;
+};
+
+//====================================================================
+// Wraps another source and records the poses it measures
+//====================================================================
+
+class RecordingTrackingSource : public TrackingSource
+{
+public:
+    RecordingTrackingSource (TrackingSource* inner, const char path[])
+        : writer(path)
+    {
+        this->inner = inner;
+    }
+
+    virtual ~RecordingTrackingSource ()
+    {
+        delete this->inner;
+    }
+
+    virtual bool sample (double target_time, ovrPosef* pose)
+    {
+        return this->inner->sample(target_time, pose);
+    }
+
+    virtual void begin_tick (double sample_time)
+    {
+        // Record the measured pose rather than the prediction, once per
+        // tick even though each tick samples both eyes
+        this->inner->begin_tick(sample_time);
+        ovrPosef measured;
+        if (this->inner->sample(sample_time, &measured))
+        {
+            this->writer.append(sample_time, measured);
+        }
+    }
+
+    virtual bool needs_hmd () const
+    {
+        return this->inner->needs_hmd();
+    }
+
+    virtual void finish ()
+    {
+        this->inner->finish();
+        this->writer.finish();
+    }
+
+private:
+    TrackingSource* inner;
+    PoseTraceWriter writer;
+};
+
+TrackingSource* create_tracking_source (ovrHmd hmd)
+{
+    std::string source_name = config_string("Tracking", "Source", "ovr");
+    float speed = config_float("Tracking", "PlaybackSpeed", 1.0f);
+
+    TrackingSource* source;
+    if (_stricmp(source_name.c_str(), "trace") == 0)
+    {
+        std::string path = config_string("Tracking", "TraceFile", "PinballVRcade.trace");
+        source = new TraceTrackingSource(path.c_str(), speed);
+    }
+    else if (_stricmp(source_name.c_str(), "synthetic") == 0)
+    {
+        source = new SyntheticTrackingSource(speed);
+    }
+    else
+    {
+        source = new OVRTrackingSource(hmd);
+    }
+
+    std::string record_path = config_string("Tracking", "RecordFile", "");
+    if (!record_path.empty())
+    {
+        source = new RecordingTrackingSource(source, record_path.c_str());
+    }
+    return source;
+}
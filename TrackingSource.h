@@ -0,0 +1,41 @@
+//====================================================================
+// Head tracking source interface.
+//
+// The tracking thread pulls poses from one of these instead of
+// talking to LibOVR directly, so stereo rendering can be driven by a
+// live headset, a recorded trace or synthetic motion.
+//
+// Selected through the [Tracking] section of PinballVRcade.ini:
+//    Source=ovr|trace|synthetic
+//    TraceFile=<path>       trace to play back for Source=trace
+//    PlaybackSpeed=<scale>  1 plays at recorded speed, 2 twice as fast
+//    RecordFile=<path>      record whatever the source produces
+//====================================================================
+
+#pragma once
+
+#include <OVR.h>
+
+class TrackingSource
+{
+public:
+    virtual ~TrackingSource () {}
+
+    // Fill in the head pose predicted for target_time, which is on the
+    // ovr_GetTimeInSeconds clock. Called from the tracking thread only.
+    virtual bool sample (double target_time, ovrPosef* pose) = 0;
+
+    // Called once per tracking tick, before the tick's samples, with the
+    // time the tick's poses are measured at.
+    virtual void begin_tick (double sample_time) {}
+
+    // True if the source needs a real headset to produce poses.
+    virtual bool needs_hmd () const = 0;
+
+    // Completes anything the source writes out. Called once the tracking
+    // thread is gone, which may have been part way through a tick.
+    virtual void finish () {}
+};
+
+// Builds the source configured in the ini file. Never returns null.
+TrackingSource* create_tracking_source (ovrHmd hmd);
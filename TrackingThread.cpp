@@ -0,0 +1,96 @@
+//====================================================================
+// Tracking thread implementation.
+//
+// ovrHmd_GetTrackingState is thread safe, so we keep it and any other
+// tracking source off the render thread entirely. Any latency spike in
+// the SDK only delays the next published sample instead of the game's
+// frame.
+//====================================================================
+
+#include "TrackingThread.h"
+
+#include <mmsystem.h>
+
+TrackingThread::TrackingThread (TrackingSource* source, unsigned int poll_hz)
+{
+    this->source = source;
+    this->poll_interval_ms = poll_hz ? max(1000 / poll_hz, 1u) : 1;
+    this->stop = 0;
+
+    // Until the first frame begins, just predict for "now"
+    prediction_targets initial_targets;
+    initial_targets.eye_scanout_seconds[0] = 0;
+    initial_targets.eye_scanout_seconds[1] = 0;
+    this->targets.write(initial_targets);
+
+    // Take one sample synchronously so readers always have a pose
+    this->poll();
+
+    timeBeginPeriod(1);
+    this->thread = CreateThread(NULL, 0, &TrackingThread::thread_main, this, 0, NULL);
+    if (this->thread)
+    {
+        SetThreadPriority(this->thread, THREAD_PRIORITY_ABOVE_NORMAL);
+    }
+}
+
+TrackingThread::~TrackingThread ()
+{
+    InterlockedExchange(&this->stop, 1);
+    if (this->thread)
+    {
+        WaitForSingleObject(this->thread, INFINITE);
+        CloseHandle(this->thread);
+    }
+    timeEndPeriod(1);
+    delete this->source;
+}
+
+void TrackingThread::set_prediction_targets (const double eye_scanout_seconds[2])
+{
+    prediction_targets new_targets;
+    new_targets.eye_scanout_seconds[0] = eye_scanout_seconds[0];
+    new_targets.eye_scanout_seconds[1] = eye_scanout_seconds[1];
+    this->targets.write(new_targets);
+}
+
+bool TrackingThread::latest (pose_sample* out) const
+{
+    return this->published_pose.read(out) != 0;
+}
+
+void TrackingThread::finish ()
+{
+    this->source->finish();
+}
+
+DWORD WINAPI TrackingThread::thread_main (LPVOID param)
+{
+    TrackingThread* self = (TrackingThread*)param;
+    while (!self->stop)
+    {
+        self->poll();
+        Sleep(self->poll_interval_ms);
+    }
+    return 0;
+}
+
+void TrackingThread::poll ()
+{
+    prediction_targets current_targets;
+    this->targets.read(&current_targets);
+
+    pose_sample sample;
+    sample.sample_time = ovr_GetTimeInSeconds();
+    this->source->begin_tick(sample.sample_time);
+    for (int eye = 0; eye < 2; ++eye)
+    {
+        // Never predict into the past if the render thread fell behind
+        double target = max(current_targets.eye_scanout_seconds[eye], sample.sample_time);
+        if (!this->source->sample(target, &sample.eye_pose[eye]))
+        {
+            return;
+        }
+    }
+    this->published_pose.write(sample);
+}
@@ -0,0 +1,52 @@
+//====================================================================
+// Background thread that polls a head tracking source at a fixed rate
+// and publishes the latest predicted poses for the render thread.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+#include <OVR.h>
+
+#include "SeqLock.h"
+#include "TrackingSource.h"
+
+class TrackingThread
+{
+public:
+    struct pose_sample {
+        ovrPosef eye_pose[2];
+        double sample_time;
+    };
+
+    // Takes ownership of the source.
+    TrackingThread (TrackingSource* source, unsigned int poll_hz);
+    ~TrackingThread ();
+
+    // Called by the render thread after ovrHmd_BeginFrame to tell the
+    // tracking thread which scanout times to predict poses for.
+    void set_prediction_targets (const double eye_scanout_seconds[2]);
+
+    // Wait-free in the absence of a concurrent write; never blocks on
+    // the tracking source. Returns false if no pose has been published yet.
+    bool latest (pose_sample* out) const;
+
+    // Completes anything the source writes out, such as a recording, when
+    // the process exits without the thread being stopped first
+    void finish ();
+
+private:
+    struct prediction_targets {
+        double eye_scanout_seconds[2];
+    };
+
+    static DWORD WINAPI thread_main (LPVOID param);
+    void poll ();
+
+    TrackingSource* source;
+    DWORD poll_interval_ms;
+    volatile LONG stop;
+    HANDLE thread;
+    SeqLock<pose_sample> published_pose;
+    SeqLock<prediction_targets> targets;
+};
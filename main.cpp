@@ -6,8 +6,11 @@
 #include <d3d9.h>
 #include <d3dx9.h>
 
+#include "Config.h"
 #include "hacks.h"
 #include "Direct3D9Hooks.h"
+#include "HmdStartup.h"
+#include "StartupTimeline.h"
 
 
 //====================================================================
@@ -16,11 +19,24 @@
 
 typedef IDirect3D9* (WINAPI* Direct3DCreate9_t)(UINT SDKVersion);
 static Direct3DCreate9_t s_system_Direct3DCreate9;
+typedef HRESULT (WINAPI* Direct3DCreate9Ex_t)(UINT SDKVersion, IDirect3D9Ex** ppD3D);
 
 static IDirect3D9* WINAPI hook_Direct3DCreate9(UINT SDKVersion)
 {
+    // Direct3D9Ex only exists from Vista on, so look it up rather than
+    // import it
+    if (config_int("Rendering", "FlipModel", 0))
+    {
+        Direct3DCreate9Ex_t create_ex = (Direct3DCreate9Ex_t)GetProcAddress(GetModuleHandleA("d3d9.dll"), "Direct3DCreate9Ex");
+        IDirect3D9Ex* inner_ex;
+        if (create_ex && SUCCEEDED(create_ex(SDKVersion, &inner_ex)))
+        {
+            return new Direct3D9Hooks(inner_ex, inner_ex);
+        }
+        OutputDebugStringA("PinballVRcade: Direct3D9Ex isn't available, presenting the usual way\n");
+    }
     IDirect3D9* inner = s_system_Direct3DCreate9(SDKVersion);
-    return new Direct3D9Hooks(inner);
+    return new Direct3D9Hooks(inner, 0);
 }
 
 //====================================================================
@@ -117,7 +133,7 @@ void install_hook (const char module_name[], const char import_name[], LPVOID ne
 // fingerprint in order to patch a function.
 //====================================================================
 
-uintptr_t find_fingerprint (const rolling_crc& fingerprint)
+static uintptr_t scan_text_segment (const rolling_crc& fingerprint)
 {
     HANDLE module = GetModuleHandleA(NULL);
     IMAGE_DOS_HEADER* image_header = (IMAGE_DOS_HEADER*)module;
@@ -152,6 +168,14 @@ uintptr_t find_fingerprint (const rolling_crc& fingerprint)
     return 0;
 }
 
+uintptr_t find_fingerprint (const rolling_crc& fingerprint)
+{
+    startup_timeline_begin("fingerprint scan");
+    uintptr_t address = scan_text_segment(fingerprint);
+    startup_timeline_end("fingerprint scan");
+    return address;
+}
+
 void install_patch (uintptr_t address, size_t patch_size, const void* patch)
 {
     unsigned char* patch_address = (unsigned char*)address;
@@ -187,9 +211,18 @@ BOOL APIENTRY DllMain(HINSTANCE hModule, DWORD dwReason, PVOID lpReserved)
 	switch (dwReason) 
 	{
         case DLL_PROCESS_ATTACH:
+            startup_timeline_begin("install_hacks");
             install_hacks();
+            startup_timeline_end("install_hacks");
+            hmd_startup_begin();
 		    break;
 	    case DLL_PROCESS_DETACH:
+            // Only when the process exits; unloading the DLL would leave the
+            // tracking thread running code that's gone anyway
+            if (lpReserved)
+            {
+                hmd_startup_shutdown();
+            }
 		    break;		
 	}
 	return TRUE;
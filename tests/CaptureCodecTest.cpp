@@ -0,0 +1,146 @@
+//====================================================================
+// Capture stream round trip with synthetic frames: a still table
+// under a moving ball, frames of noise, and a change of size, all of
+// which have to come back bit for bit.
+//====================================================================
+
+#include <string.h>
+#include <vector>
+
+#include "CaptureCodec.h"
+#include "Check.h"
+
+#define WIDTH 160
+#define HEIGHT 90
+#define PITCH (WIDTH * 4 + 64)
+#define FRAMES (CAPTURE_KEYFRAME_INTERVAL * 2 + 10)
+
+static unsigned int s_random = 1;
+
+static unsigned char next_random ()
+{
+    s_random = s_random * 1664525 + 1013904223;
+    return (unsigned char)(s_random >> 24);
+}
+
+// BGRX with padding past each row, which must not end up in the stream
+static void draw_frame (std::vector<unsigned char>& pixels, unsigned int width, unsigned int height, unsigned int pitch, int frame, bool noise)
+{
+    pixels.assign((size_t)pitch * height, 0xCD);
+    int ball_x = (frame * 3) % width;
+    int ball_y = (frame * 2) % height;
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            unsigned char* pixel = &pixels[y * pitch + x * 4];
+            int dx = (int)x - ball_x, dy = (int)y - ball_y;
+            if (noise)
+            {
+                pixel[0] = next_random();
+                pixel[1] = next_random();
+                pixel[2] = next_random();
+            }
+            else if (dx * dx + dy * dy < 25)
+            {
+                pixel[0] = pixel[1] = pixel[2] = 230;
+            }
+            else
+            {
+                pixel[0] = (unsigned char)(x * 255 / width);
+                pixel[1] = (unsigned char)(40 + (x / 16 + y / 16) % 2 * 20);
+                pixel[2] = (unsigned char)(y * 255 / height);
+            }
+            pixel[3] = next_random();
+        }
+    }
+}
+
+static void check_same (const CaptureDecoder::frame& decoded, const std::vector<unsigned char>& pixels, unsigned int width, unsigned int height, unsigned int pitch)
+{
+    CHECK(decoded.width == width && decoded.height == height);
+    CHECK(decoded.pixels.size() == (size_t)width * height * 3);
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            const unsigned char* in = &pixels[y * pitch + x * 4];
+            const unsigned char* out = &decoded.pixels[(y * width + x) * 3];
+            CHECK(in[0] == out[0] && in[1] == out[1] && in[2] == out[2]);
+        }
+    }
+}
+
+int main ()
+{
+    CaptureEncoder encoder;
+    std::vector<unsigned char> stream;
+    std::vector<std::vector<unsigned char> > frames;
+    encoder.begin(stream);
+
+    // Past two key frame intervals, a few frames of noise in between, then
+    // a smaller window, which has to start with a key frame
+    size_t still_bytes = 0;
+    for (int i = 0; i < FRAMES; ++i)
+    {
+        frames.push_back(std::vector<unsigned char>());
+        bool noise = i >= 70 && i < 73;
+        draw_frame(frames.back(), WIDTH, HEIGHT, PITCH, i, noise);
+        size_t before = stream.size();
+        encoder.encode(&frames.back()[0], WIDTH, HEIGHT, PITCH, i / 60.0, stream);
+        if (i > 0 && i < 70 && i % CAPTURE_KEYFRAME_INTERVAL != 0)
+        {
+            still_bytes += stream.size() - before;
+        }
+    }
+    std::vector<unsigned char> small;
+    draw_frame(small, WIDTH / 2, HEIGHT / 2, WIDTH * 2, 0, false);
+    encoder.encode(&small[0], WIDTH / 2, HEIGHT / 2, WIDTH * 2, FRAMES / 60.0, stream);
+
+    // Frames where only the ball moved compress to a small part of the
+    // raw pixels
+    CHECK(still_bytes < (size_t)68 * WIDTH * HEIGHT * 3 / 10);
+
+    CaptureDecoder decoder;
+    CaptureDecoder::frame decoded;
+    const unsigned char* data = &stream[0];
+    const unsigned char* end = data + stream.size();
+    CHECK(decoder.read_header(data, end));
+    for (int i = 0; i < FRAMES; ++i)
+    {
+        CHECK(decoder.read_frame(data, end, &decoded));
+        CHECK(decoded.time == i / 60.0);
+        check_same(decoded, frames[i], WIDTH, HEIGHT, PITCH);
+    }
+    CHECK(decoder.read_frame(data, end, &decoded));
+    check_same(decoded, small, WIDTH / 2, HEIGHT / 2, WIDTH * 2);
+    CHECK(data == end);
+    CHECK(!decoder.read_frame(data, end, &decoded));
+
+    // Not a capture
+    const unsigned char* bad = (const unsigned char*)"PVRCAP00";
+    CHECK(!decoder.read_header(bad, bad + 8));
+
+    // Cut short anywhere in a frame
+    data = &stream[0];
+    CHECK(decoder.read_header(data, end));
+    const unsigned char* first = data;
+    CHECK(decoder.read_frame(data, end, &decoded));
+    size_t first_size = data - first;
+    for (size_t cut = 0; cut < first_size; cut += cut < 64 ? 1 : 101)
+    {
+        data = &stream[0];
+        CHECK(decoder.read_header(data, end));
+        CHECK(!decoder.read_frame(data, data + cut, &decoded));
+    }
+
+    // A frame between key frames can't be decoded without the one before
+    data = &stream[0];
+    CHECK(decoder.read_header(data, end));
+    CHECK(decoder.read_frame(data, end, &decoded));
+    CaptureDecoder late;
+    const unsigned char* header = &stream[0];
+    CHECK(late.read_header(header, end));
+    CHECK(!late.read_frame(data, end, &decoded));
+    return 0;
+}
@@ -0,0 +1,30 @@
+//====================================================================
+// Checks for the tests. Each test is its own executable that reports
+// the first failed check and exits nonzero.
+//====================================================================
+
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        double check_actual = (actual); \
+        double check_expected = (expected); \
+        if (!(fabs(check_actual - check_expected) <= (tolerance))) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, check_actual, check_expected); \
+            exit(1); \
+        } \
+    } while (0)
@@ -0,0 +1,127 @@
+//====================================================================
+// CommandRing: packets wrapping around the end of the buffer, and a
+// producer and consumer on separate threads passing packets of every
+// size up to the whole capacity.
+//====================================================================
+
+#include <string.h>
+#include <thread>
+
+#include "CommandRing.h"
+#include "Check.h"
+
+#define CAPACITY 4096
+#define PACKETS 200000
+
+struct test_packet {
+    command_header header;
+    DWORD sequence;
+    DWORD fill;
+    // Followed by size - sizeof(test_packet) bytes of fill
+};
+
+static DWORD next_random (DWORD* state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+static void send (CommandRing& ring, DWORD sequence, DWORD size)
+{
+    test_packet* packet = (test_packet*)ring.reserve(7, size);
+    CHECK(packet->header.size >= size && packet->header.size % 8 == 0);
+    packet->sequence = sequence;
+    packet->fill = sequence & 0xFF;
+    memset(packet + 1, (int)packet->fill, packet->header.size - sizeof(test_packet));
+    ring.commit();
+}
+
+static void check_packet (const command_header* command, DWORD sequence)
+{
+    const test_packet* packet = (const test_packet*)command;
+    CHECK(command->opcode == 7);
+    CHECK(packet->sequence == sequence);
+    const unsigned char* fill = (const unsigned char*)(packet + 1);
+    for (DWORD i = 0; i < command->size - sizeof(test_packet); ++i)
+    {
+        CHECK(fill[i] == packet->fill);
+    }
+}
+
+int main ()
+{
+    // Sizes round up to whole 8 byte units
+    {
+        CommandRing ring(CAPACITY);
+        CHECK(ring.empty());
+        CHECK(ring.peek() == 0);
+        send(ring, 0, sizeof(test_packet) + 1);
+        CHECK(!ring.empty());
+        const command_header* command = ring.peek();
+        CHECK(command && command->size == sizeof(test_packet) + 8);
+        check_packet(command, 0);
+        ring.release(command);
+        CHECK(ring.empty());
+        CHECK(ring.peek() == 0);
+    }
+
+    // A packet that doesn't fit before the end goes to the start, and the
+    // consumer never sees the padding
+    {
+        CommandRing ring(CAPACITY);
+        send(ring, 0, CAPACITY - 64);
+        const command_header* start = ring.peek();
+        check_packet(start, 0);
+        ring.release(start);
+        send(ring, 1, 128);
+        const command_header* command = ring.peek();
+        CHECK(command == start);
+        check_packet(command, 1);
+        ring.release(command);
+        CHECK(ring.empty());
+    }
+
+    // The whole capacity in one packet
+    {
+        CommandRing ring(CAPACITY);
+        send(ring, 2, CAPACITY);
+        check_packet(ring.peek(), 2);
+        ring.release(ring.peek());
+        CHECK(ring.empty());
+    }
+
+    // Both threads at full speed. Every packet size up to the capacity
+    // comes up, including the ones over half of it that can't fit until
+    // the padding before them has been consumed.
+    {
+        CommandRing ring(CAPACITY);
+        std::thread producer([&ring] ()
+        {
+            DWORD random = 1;
+            for (DWORD sequence = 0; sequence < PACKETS; ++sequence)
+            {
+                DWORD size = sizeof(test_packet) + next_random(&random) % (CAPACITY - sizeof(test_packet) + 1);
+                send(ring, sequence, size);
+            }
+        });
+        DWORD received = 0;
+        bool saw_large = false;
+        while (received < PACKETS)
+        {
+            const command_header* command = ring.peek();
+            if (!command)
+            {
+                ring.wait_for_work(100);
+                continue;
+            }
+            check_packet(command, received);
+            saw_large = saw_large || command->size > CAPACITY / 2;
+            ring.release(command);
+            ++received;
+        }
+        producer.join();
+        CHECK(saw_large);
+        CHECK(ring.empty());
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+//====================================================================
+// Distortion mesh caching and reference dumps, with meshes laid out
+// the way LibOVR generates them: a grid over the eye's half of the
+// screen, two triangles per cell, and tan angles pushed further out
+// towards the edge and a little more for red than for blue.
+//====================================================================
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+#include "DistortionMesh.h"
+#include "Check.h"
+
+#define GRID 16
+
+static void make_grid (int eye, std::vector<distortion_vertex>& vertices, std::vector<unsigned short>& indices)
+{
+    vertices.clear();
+    indices.clear();
+    for (int y = 0; y <= GRID; ++y)
+    {
+        for (int x = 0; x <= GRID; ++x)
+        {
+            float u = (float)x / GRID * 2 - 1;
+            float v = (float)y / GRID * 2 - 1;
+            float radius_squared = u * u + v * v;
+            distortion_vertex vertex;
+            vertex.screen_pos[0] = (u + (eye == 0 ? -1 : 1)) * 0.5f;
+            vertex.screen_pos[1] = v;
+            vertex.timewarp_factor = (float)x / GRID;
+            vertex.vignette_factor = radius_squared > 1.5f ? 0.0f : 1.0f;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                float scale = 1.0f + radius_squared * (0.24f - 0.01f * channel);
+                vertex.tan_eye_angles[channel][0] = u * scale;
+                vertex.tan_eye_angles[channel][1] = v * scale;
+            }
+            vertices.push_back(vertex);
+        }
+    }
+    for (int y = 0; y < GRID; ++y)
+    {
+        for (int x = 0; x < GRID; ++x)
+        {
+            unsigned short corner = (unsigned short)(y * (GRID + 1) + x);
+            unsigned short cell[6] = {
+                corner, (unsigned short)(corner + 1), (unsigned short)(corner + GRID + 1),
+                (unsigned short)(corner + 1), (unsigned short)(corner + GRID + 2), (unsigned short)(corner + GRID + 1),
+            };
+            indices.insert(indices.end(), cell, cell + 6);
+        }
+    }
+}
+
+static void cache_grid (int eye, DistortionMesh& mesh)
+{
+    std::vector<distortion_vertex> vertices;
+    std::vector<unsigned short> indices;
+    make_grid(eye, vertices, indices);
+    CHECK(mesh.assign(&vertices[0], (unsigned int)vertices.size(), &indices[0], (unsigned int)indices.size()));
+}
+
+int main ()
+{
+    // Same layout as ovrDistortionVertex, so LibOVR's vertices copy straight in
+    CHECK(sizeof(distortion_vertex) == 40);
+    CHECK(offsetof(distortion_vertex, timewarp_factor) == 8);
+    CHECK(offsetof(distortion_vertex, vignette_factor) == 12);
+    CHECK(offsetof(distortion_vertex, tan_eye_angles) == 16);
+
+    // The cache is an exact copy of what it was given
+    std::vector<distortion_vertex> vertices;
+    std::vector<unsigned short> indices;
+    make_grid(0, vertices, indices);
+    DistortionMesh left;
+    CHECK(left.empty());
+    CHECK(left.assign(&vertices[0], (unsigned int)vertices.size(), &indices[0], (unsigned int)indices.size()));
+    CHECK(!left.empty());
+    CHECK(left.vertex_count() == (GRID + 1) * (GRID + 1));
+    CHECK(left.index_count() == GRID * GRID * 6);
+    CHECK(left.vertices() != &vertices[0]);
+    for (unsigned int i = 0; i < left.index_count(); ++i)
+    {
+        CHECK(left.indices()[i] == indices[i]);
+    }
+    for (unsigned int i = 0; i < left.vertex_count(); ++i)
+    {
+        CHECK(left.vertices()[i].tan_eye_angles[2][1] == vertices[i].tan_eye_angles[2][1]);
+        CHECK(left.vertices()[i].vignette_factor == vertices[i].vignette_factor);
+    }
+
+    // Both eyes dump back to back, left first, and read back bit for bit
+    DistortionMesh right;
+    cache_grid(1, right);
+    CHECK(!right.matches(left, 1e-3f));
+    std::vector<unsigned char> dump;
+    left.write(dump);
+    right.write(dump);
+    CHECK(dump.size() == 2 * (8 + 8 + left.vertex_count() * 40 + left.index_count() * 2));
+    const unsigned char* data = &dump[0];
+    const unsigned char* end = data + dump.size();
+    DistortionMesh reference[2];
+    CHECK(reference[0].read(data, end));
+    CHECK(reference[1].read(data, end));
+    CHECK(data == end);
+    CHECK(left.matches(reference[0], 0));
+    CHECK(right.matches(reference[1], 0));
+    CHECK(!reference[1].read(data, end));
+    CHECK(reference[1].empty());
+
+    // Changes in any vertex attribute are caught beyond the tolerance
+    for (int attribute = 0; attribute < 10; ++attribute)
+    {
+        std::vector<distortion_vertex> moved = vertices;
+        (&moved[100].screen_pos[0])[attribute] += 1e-4f;
+        DistortionMesh mesh;
+        CHECK(mesh.assign(&moved[0], (unsigned int)moved.size(), &indices[0], (unsigned int)indices.size()));
+        CHECK(!mesh.matches(reference[0], 1e-5f));
+        CHECK(mesh.matches(reference[0], 1e-3f));
+
+        (&moved[100].screen_pos[0])[attribute] = sqrtf(-1.0f);
+        CHECK(mesh.assign(&moved[0], (unsigned int)moved.size(), &indices[0], (unsigned int)indices.size()));
+        CHECK(!mesh.matches(reference[0], 1e6f));
+    }
+
+    // So are changes to the triangles, down to the winding of one
+    {
+        std::vector<unsigned short> rewound = indices;
+        unsigned short first = rewound[30];
+        rewound[30] = rewound[31];
+        rewound[31] = first;
+        DistortionMesh mesh;
+        CHECK(mesh.assign(&vertices[0], (unsigned int)vertices.size(), &rewound[0], (unsigned int)rewound.size()));
+        CHECK(!mesh.matches(reference[0], 1));
+
+        CHECK(mesh.assign(&vertices[0], (unsigned int)vertices.size(), &indices[0], (unsigned int)indices.size() - 3));
+        CHECK(!mesh.matches(reference[0], 1));
+        CHECK(!reference[0].matches(mesh, 1));
+
+        std::vector<distortion_vertex> extra = vertices;
+        extra.push_back(vertices[0]);
+        CHECK(mesh.assign(&extra[0], (unsigned int)extra.size(), &indices[0], (unsigned int)indices.size()));
+        CHECK(!mesh.matches(reference[0], 1));
+    }
+
+    // Anything but whole triangles of the given vertices isn't cached
+    {
+        DistortionMesh mesh;
+        cache_grid(0, mesh);
+        CHECK(!mesh.assign(&vertices[0], (unsigned int)vertices.size(), &indices[0], (unsigned int)indices.size() - 1));
+        CHECK(mesh.empty());
+        CHECK(mesh.vertex_count() == 0);
+
+        std::vector<unsigned short> wild = indices;
+        wild[50] = (unsigned short)vertices.size();
+        CHECK(!mesh.assign(&vertices[0], (unsigned int)vertices.size(), &wild[0], (unsigned int)wild.size()));
+        CHECK(mesh.empty());
+    }
+
+    // Malformed dumps are rejected without consuming anything
+    std::vector<unsigned char> single;
+    left.write(single);
+    for (size_t size = 0; size < single.size(); ++size)
+    {
+        data = &single[0];
+        DistortionMesh mesh;
+        CHECK(!mesh.read(data, data + size));
+        CHECK(data == &single[0]);
+        CHECK(mesh.empty());
+    }
+    {
+        std::vector<unsigned char> bad = single;
+        bad[7] = '2';
+        data = &bad[0];
+        DistortionMesh mesh;
+        CHECK(!mesh.read(data, data + bad.size()));
+
+        // An index past the vertices in an otherwise whole dump
+        bad = single;
+        bad[bad.size() - 2] = 0xFF;
+        bad[bad.size() - 1] = 0xFF;
+        data = &bad[0];
+        CHECK(!mesh.read(data, data + bad.size()));
+        CHECK(data == &bad[0]);
+
+        // Counts far beyond what the dump holds
+        bad = single;
+        bad[11] = 0x7F;
+        data = &bad[0];
+        CHECK(!mesh.read(data, data + bad.size()));
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+//====================================================================
+// Cost of deciding where each scene draw goes, replayed against a call
+// trace shaped like a Pinball Arcade frame: the room and backdrop far
+// away, then the table, the ball and the flippers close up, then the
+// HUD. Every scene draw is classified the way the stereo scene draw
+// does it, with a nearest depth test and a frustum test per eye or
+// one for the layer.
+//====================================================================
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+#include "FarFieldSchedule.h"
+#include "FrustumBounds.h"
+#include "Check.h"
+
+#define FRAMES 20000
+
+enum call_type {
+    CALL_CLEAR,
+    CALL_SCENE,
+    CALL_UI,
+    CALL_PRESENT,
+};
+
+struct call {
+    call_type type;
+    float x, y, distance; // Where a scene mesh sits in front of the viewer
+    float size;
+};
+
+// Row-vector product, as the hooks compose their transforms
+static void multiply (const float a[16], const float b[16], float out[16])
+{
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            float sum = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                sum += a[row * 4 + i] * b[i * 4 + column];
+            }
+            out[row * 4 + column] = sum;
+        }
+    }
+}
+
+static void make_trace (std::vector<call>& trace)
+{
+    call clear = { CALL_CLEAR, 0, 0, 0, 0 };
+    trace.push_back(clear);
+
+    // The room and the backdrop, drawn first
+    for (int i = 0; i < 60; ++i)
+    {
+        call mesh = { CALL_SCENE, (float)(i % 12 - 6) * 40, (float)(i / 12 - 2) * 30, 300.0f + (i % 7) * 50, 20 };
+        trace.push_back(mesh);
+    }
+
+    // The table, mostly close, with the odd far piece of scenery drawn
+    // among it and a few meshes off to the sides that get culled
+    for (int i = 0; i < 600; ++i)
+    {
+        float distance = (i % 53 == 0) ? 400.0f : 1.0f + (i % 29) * 0.1f;
+        float x = (i % 97 == 0) ? 50.0f : (float)(i % 10 - 5) * 0.1f;
+        call mesh = { CALL_SCENE, x, (float)(i % 8 - 4) * 0.1f, distance, 0.05f };
+        trace.push_back(mesh);
+    }
+
+    // The HUD and the DMD
+    for (int i = 0; i < 24; ++i)
+    {
+        call ui = { CALL_UI, 0, 0, 0, 0 };
+        trace.push_back(ui);
+    }
+    call present = { CALL_PRESENT, 0, 0, 0, 0 };
+    trace.push_back(present);
+}
+
+struct replay_counts {
+    unsigned long long far_draws;
+    unsigned long long layer_binds;
+    unsigned long long eye_draws;
+    unsigned long long culled;
+    unsigned long long composites;
+};
+
+static void replay (FarFieldSchedule& schedule, const std::vector<call>& trace, const float eye_projection[2][16], const float layer_projection[16], replay_counts& counts)
+{
+    float model_view[16] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1,
+    };
+    float object_to_clip[16];
+    bool layer_bound = false;
+    for (size_t i = 0; i < trace.size(); ++i)
+    {
+        const call& c = trace[i];
+        if (c.type != CALL_SCENE)
+        {
+            layer_bound = false;
+            if (c.type == CALL_CLEAR)
+            {
+                schedule.cleared();
+                continue;
+            }
+            if (schedule.begin_near_draw())
+            {
+                ++counts.composites;
+            }
+            if (c.type == CALL_PRESENT)
+            {
+                schedule.presented();
+            }
+            continue;
+        }
+
+        mesh_bounds bounds = { { -c.size, -c.size, -c.size }, { c.size, c.size, c.size } };
+        model_view[12] = c.x;
+        model_view[13] = c.y;
+        model_view[14] = -c.distance;
+        if (schedule.open() && schedule.is_far(bounds_nearest_depth(bounds, model_view)))
+        {
+            multiply(model_view, layer_projection, object_to_clip);
+            if (bounds_outside_frustum(bounds, object_to_clip))
+            {
+                ++counts.culled;
+                continue;
+            }
+            if (!layer_bound)
+            {
+                ++counts.layer_binds;
+                layer_bound = true;
+            }
+            schedule.begin_far_draw();
+            ++counts.far_draws;
+            continue;
+        }
+
+        layer_bound = false;
+        if (schedule.begin_near_draw())
+        {
+            ++counts.composites;
+        }
+        for (int eye = 0; eye < 2; ++eye)
+        {
+            multiply(model_view, eye_projection[eye], object_to_clip);
+            if (bounds_outside_frustum(bounds, object_to_clip))
+            {
+                ++counts.culled;
+                continue;
+            }
+            ++counts.eye_draws;
+        }
+    }
+}
+
+int main ()
+{
+    // Right handed projections with the eyes' lenses a little off centre,
+    // and one wide enough for both for the layer
+    float eye_projection[2][16] = {
+        { 0.93f, 0, 0, 0, 0, 0.75f, 0, 0, -0.06f, 0, -1, -1, 0, 0, -1, 0 },
+        { 0.93f, 0, 0, 0, 0, 0.75f, 0, 0, 0.06f, 0, -1, -1, 0, 0, -1, 0 },
+    };
+    float layer_projection[16] = { 0.88f, 0, 0, 0, 0, 0.75f, 0, 0, 0, 0, -1, -1, 0, 0, -1, 0 };
+
+    std::vector<call> trace;
+    make_trace(trace);
+    FarFieldSchedule schedule;
+    schedule.configure(50);
+
+    typedef std::chrono::steady_clock clock;
+    replay_counts counts = { 0, 0, 0, 0, 0 };
+    clock::time_point start = clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        replay(schedule, trace, eye_projection, layer_projection, counts);
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    // Each frame's far meshes go in as one run before the table; far
+    // scenery drawn among the table stays in stereo
+    CHECK(counts.composites == FRAMES);
+    CHECK(counts.layer_binds == FRAMES);
+    CHECK(counts.far_draws > 0 && counts.eye_draws > 0 && counts.culled > 0);
+
+    unsigned long long calls = (unsigned long long)trace.size() * FRAMES;
+    printf("%u frames of %u calls\n", FRAMES, (unsigned int)trace.size());
+    printf("per frame: %llu far draws in %llu layer binds, %llu eye draws, %llu culled\n",
+        counts.far_draws / FRAMES, counts.layer_binds / FRAMES, counts.eye_draws / FRAMES, counts.culled / FRAMES);
+    printf("classified %.0f calls/s (%.1f ns each, %.1f us per frame)\n", calls / seconds, seconds * 1e9 / calls, seconds * 1e6 / FRAMES);
+    return 0;
+}
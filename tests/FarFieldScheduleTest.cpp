@@ -0,0 +1,177 @@
+//====================================================================
+// Far field layer scheduling replayed against call traces of the
+// kind Pinball Arcade makes, with each mesh classified by its bounds
+// the way the stereo scene draw does it.
+//====================================================================
+
+#include <string>
+
+#include "FarFieldSchedule.h"
+#include "FrustumBounds.h"
+#include "Check.h"
+
+enum call_type {
+    CALL_CLEAR,     // Clear with D3DCLEAR_TARGET
+    CALL_SCENE,     // Indexed scene draw of a bounded mesh
+    CALL_UI,        // DrawPrimitiveUP or a stereo UI quad
+    CALL_PRESENT,
+};
+
+struct call {
+    call_type type;
+    float distance; // How far in front of the viewer a scene mesh sits
+};
+
+// Replays a trace the way the hooks do and logs what reaches the device:
+// L clears the layer, F draws into it, C composites it, N draws into the
+// eyes, U draws UI and P presents
+static std::string replay (FarFieldSchedule& schedule, const call* calls, int count)
+{
+    // A unit box, moved straight ahead of a viewer looking down -z
+    const mesh_bounds box = { { -0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, 0.5f } };
+    float model_view[16] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0,
+        0, 0, 0, 1,
+    };
+    std::string log;
+    for (int i = 0; i < count; ++i)
+    {
+        switch (calls[i].type)
+        {
+        case CALL_CLEAR:
+            schedule.cleared();
+            break;
+        case CALL_SCENE:
+            model_view[14] = -calls[i].distance;
+            if (schedule.open() && schedule.is_far(bounds_nearest_depth(box, model_view)))
+            {
+                if (schedule.begin_far_draw())
+                {
+                    log += 'L';
+                }
+                log += 'F';
+                break;
+            }
+            if (schedule.begin_near_draw())
+            {
+                log += 'C';
+            }
+            log += 'N';
+            break;
+        case CALL_UI:
+            if (schedule.begin_near_draw())
+            {
+                log += 'C';
+            }
+            log += 'U';
+            break;
+        case CALL_PRESENT:
+            if (schedule.begin_near_draw())
+            {
+                log += 'C';
+            }
+            schedule.presented();
+            log += 'P';
+            break;
+        }
+    }
+    return log;
+}
+
+#define REPLAY(schedule, calls) replay(schedule, calls, sizeof(calls) / sizeof(calls[0]))
+
+int main ()
+{
+    // Nearest points beyond 50 units are far
+    FarFieldSchedule schedule;
+    schedule.configure(50);
+
+    // Boxes reach half a unit towards the viewer
+    mesh_bounds box = { { -0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, 0.5f } };
+    float model_view[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, -10, 1 };
+    CHECK_NEAR(bounds_nearest_depth(box, model_view), 9.5, 1e-5);
+    CHECK(!schedule.is_far(9.5f));
+    CHECK(schedule.is_far(50.5f));
+    CHECK(!schedule.is_far(50));
+
+    // A right handed 90 degree projection after moving the box to (x, 0, -10),
+    // which culls it once its far corners are past the sides at w = 10.5.
+    // Row four is the translation times the projection.
+    float object_to_clip[16] = {
+        1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, -1, -1,
+        0, 0, 10 - 0.1f, 10,
+    };
+    float offsets[] = { 0, 9, 10.9f, -10.9f, 11.1f, -11.1f, 100 };
+    bool culled[] = { false, false, false, false, true, true, true };
+    for (int i = 0; i < 7; ++i)
+    {
+        object_to_clip[12] = offsets[i];
+        CHECK(bounds_outside_frustum(box, object_to_clip) == culled[i]);
+    }
+
+    // The room behind the table first, then the table, a far mesh the
+    // game happens to draw late, the HUD and the DMD
+    const call typical[] = {
+        { CALL_CLEAR, 0 },
+        { CALL_SCENE, 400 }, { CALL_SCENE, 250 }, { CALL_SCENE, 120 },
+        { CALL_SCENE, 3 }, { CALL_SCENE, 2 }, { CALL_SCENE, 300 }, { CALL_SCENE, 4 },
+        { CALL_UI, 0 }, { CALL_UI, 0 },
+        { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, typical) == "LFFFCNNNNUUP");
+
+    // The next frame starts over the same way
+    CHECK(REPLAY(schedule, typical) == "LFFFCNNNNUUP");
+
+    // Without a clear the layer still goes in before the first near draw,
+    // cleared to the last clear's values
+    const call no_clear[] = {
+        { CALL_SCENE, 400 }, { CALL_SCENE, 3 }, { CALL_SCENE, 500 }, { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, no_clear) == "LFCNNP");
+
+    // A frame of only near meshes never composites an empty layer, and
+    // far meshes after them stay in stereo
+    const call all_near[] = {
+        { CALL_CLEAR, 0 }, { CALL_SCENE, 3 }, { CALL_SCENE, 400 }, { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, all_near) == "NNP");
+
+    // UI drawn before any scene closes the layer like a near draw does
+    const call ui_first[] = {
+        { CALL_CLEAR, 0 }, { CALL_UI, 0 }, { CALL_SCENE, 400 }, { CALL_SCENE, 3 }, { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, ui_first) == "UNNP");
+
+    // A frame of only far meshes goes in at Present
+    const call all_far[] = {
+        { CALL_CLEAR, 0 }, { CALL_SCENE, 400 }, { CALL_SCENE, 600 }, { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, all_far) == "LFFCP");
+
+    // Clearing again mid-frame throws away what was composited, and the
+    // layer starts over under the next near draw
+    const call cleared_twice[] = {
+        { CALL_CLEAR, 0 }, { CALL_SCENE, 400 }, { CALL_SCENE, 3 },
+        { CALL_CLEAR, 0 }, { CALL_SCENE, 400 }, { CALL_SCENE, 3 }, { CALL_SCENE, 500 },
+        { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, cleared_twice) == "LFCNLFCNNP");
+
+    // A far mesh drawn twice before anything near only clears the layer once
+    const call drawn_twice[] = {
+        { CALL_CLEAR, 0 }, { CALL_SCENE, 400 }, { CALL_SCENE, 400 }, { CALL_SCENE, 3 }, { CALL_PRESENT, 0 },
+    };
+    CHECK(REPLAY(schedule, drawn_twice) == "LFFCNP");
+
+    // Unconfigured, everything stays in stereo
+    FarFieldSchedule disabled;
+    CHECK(!disabled.open());
+    CHECK(!disabled.is_far(1e6f));
+    CHECK(REPLAY(disabled, typical) == "NNNNNNNUUP");
+    return 0;
+}
@@ -0,0 +1,131 @@
+//====================================================================
+// FramePacer simulated against a 90Hz display: frames with known costs
+// start when the pacer says, and each one has to finish before its
+// refresh.
+//====================================================================
+
+#include "FramePacer.h"
+#include "Check.h"
+
+#define REFRESH (1.0 / 90)
+#define MARGIN 0.002
+
+struct simulation {
+    FramePacer pacer;
+    double now;
+    double total_delay;
+    unsigned int frames;
+    unsigned int missed;
+};
+
+// One frame started at the beginning of a refresh interval, its GPU work
+// queued behind its CPU work
+static void run_frame (simulation& sim, double cpu_seconds, double gpu_seconds)
+{
+    double vsync = sim.now + REFRESH;
+    double delay = sim.pacer.start_delay(vsync - sim.now);
+    CHECK(delay >= 0 && delay < REFRESH);
+    double finish = sim.now + delay + cpu_seconds + gpu_seconds;
+    if (finish > vsync)
+    {
+        ++sim.missed;
+    }
+    sim.pacer.record(cpu_seconds, gpu_seconds);
+    sim.total_delay += delay;
+    ++sim.frames;
+
+    // A late frame waits for the refresh after
+    while (vsync < finish)
+    {
+        vsync += REFRESH;
+    }
+    sim.now = vsync;
+}
+
+static void start (simulation& sim)
+{
+    sim.pacer.configure(MARGIN);
+    sim.now = 0;
+    sim.total_delay = 0;
+    sim.frames = 0;
+    sim.missed = 0;
+}
+
+int main ()
+{
+    // Nothing is held back until a quarter of the history is in
+    {
+        simulation sim;
+        start(sim);
+        CHECK(sim.pacer.start_delay(REFRESH) == 0);
+        for (int i = 0; i < FRAME_PACER_HISTORY / 4 - 1; ++i)
+        {
+            run_frame(sim, 0.003, 0.002);
+        }
+        CHECK(sim.total_delay == 0);
+        CHECK(sim.pacer.start_delay(REFRESH) == 0);
+        run_frame(sim, 0.003, 0.002);
+        CHECK(sim.pacer.start_delay(REFRESH) > 0);
+    }
+
+    // Steady 5ms frames start late enough to finish the margin before
+    // their refresh, and never miss it
+    {
+        simulation sim;
+        start(sim);
+        for (int i = 0; i < 1000; ++i)
+        {
+            run_frame(sim, 0.003, 0.002);
+        }
+        CHECK(sim.missed == 0);
+        CHECK_NEAR(sim.pacer.predicted_cost(), 0.005, 1e-9);
+        CHECK_NEAR(sim.pacer.start_delay(REFRESH), REFRESH - 0.005 - MARGIN, 1e-9);
+        CHECK(sim.total_delay / sim.frames > REFRESH - 0.005 - MARGIN - 0.001);
+    }
+
+    // Costs that vary frame to frame are paced by the worst recent one
+    {
+        simulation sim;
+        start(sim);
+        for (int i = 0; i < 1000; ++i)
+        {
+            run_frame(sim, 0.002 + 0.001 * (i % 3), 0.001 + 0.0005 * (i % 5));
+        }
+        CHECK(sim.missed == 0);
+        CHECK_NEAR(sim.pacer.predicted_cost(), 0.004 + 0.003, 1e-9);
+    }
+
+    // A frame over budget misses once, and the pacer backs off straight
+    // away rather than missing again
+    {
+        simulation sim;
+        start(sim);
+        for (int i = 0; i < 100; ++i)
+        {
+            run_frame(sim, 0.003, 0.002);
+        }
+        double before = sim.pacer.start_delay(REFRESH);
+        run_frame(sim, 0.003, 0.007);
+        CHECK(sim.pacer.start_delay(REFRESH) < before);
+        for (int i = 0; i < 100; ++i)
+        {
+            run_frame(sim, 0.003, 0.002);
+        }
+        CHECK(sim.missed == 1);
+
+        // And it's forgotten once it leaves the history
+        CHECK_NEAR(sim.pacer.start_delay(REFRESH), before, 1e-9);
+    }
+
+    // Frames that can't make it at all aren't delayed
+    {
+        simulation sim;
+        start(sim);
+        for (int i = 0; i < 100; ++i)
+        {
+            run_frame(sim, 0.008, 0.006);
+        }
+        CHECK(sim.pacer.start_delay(REFRESH) == 0);
+    }
+    return 0;
+}
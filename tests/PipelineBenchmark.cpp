@@ -0,0 +1,256 @@
+//====================================================================
+// Throughput of the pipelined device's command path: the game thread
+// encoding packets into the ring the way Direct3DDevice9Pipeline does,
+// and a render thread decoding them into a device that does nothing.
+// The mix is what a stereo scene draw turns into once the hooks have
+// split it into eyes.
+//====================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "CommandRing.h"
+#include "PipelineCommands.h"
+#include "Check.h"
+
+// Same capacity as the pipeline's ring
+#define CAPACITY (4 * 1024 * 1024)
+#define MESHES 400000
+
+template <class T>
+static T* begin_command (CommandRing& ring, DWORD opcode, DWORD extra_size = 0)
+{
+    command_header* header = ring.reserve(opcode, sizeof(command_header) + sizeof(T) + extra_size);
+    return (T*)(header + 1);
+}
+
+// Reads every argument the driver would be handed and nothing more
+class null_device
+{
+public:
+    null_device () : executed(0), sink(0) {}
+
+    void execute (const command_header* command)
+    {
+        switch (command->opcode)
+        {
+        case COMMAND_SET_RENDER_STATE:
+        {
+            const command_set_render_state_args* args = (const command_set_render_state_args*)(command + 1);
+            this->sink += args->State + args->Value;
+            break;
+        }
+        case COMMAND_SET_SAMPLER_STATE:
+        {
+            const command_set_sampler_state_args* args = (const command_set_sampler_state_args*)(command + 1);
+            this->sink += args->Sampler + args->Type + args->Value;
+            break;
+        }
+        case COMMAND_SET_TEXTURE:
+        {
+            const command_set_texture_args* args = (const command_set_texture_args*)(command + 1);
+            this->sink += args->Stage + (args->pTexture != 0);
+            break;
+        }
+        case COMMAND_SET_STREAM_SOURCE:
+        {
+            const command_set_stream_source_args* args = (const command_set_stream_source_args*)(command + 1);
+            this->sink += args->StreamNumber + args->OffsetInBytes + args->Stride + (args->pStreamData != 0);
+            break;
+        }
+        case COMMAND_SET_INDICES:
+        {
+            const command_set_indices_args* args = (const command_set_indices_args*)(command + 1);
+            this->sink += args->pIndexData != 0;
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER:
+        {
+            const command_set_vertex_shader_args* args = (const command_set_vertex_shader_args*)(command + 1);
+            this->sink += args->pShader != 0;
+            break;
+        }
+        case COMMAND_SET_PIXEL_SHADER:
+        {
+            const command_set_pixel_shader_args* args = (const command_set_pixel_shader_args*)(command + 1);
+            this->sink += args->pShader != 0;
+            break;
+        }
+        case COMMAND_SET_VIEWPORT:
+        {
+            const command_set_viewport_args* args = (const command_set_viewport_args*)(command + 1);
+            this->sink += args->value.X + args->value.Width;
+            break;
+        }
+        case COMMAND_SET_VERTEX_SHADER_CONSTANT_F:
+        {
+            const command_set_vertex_shader_constant_f_args* args = (const command_set_vertex_shader_constant_f_args*)(command + 1);
+            const float* constants = (const float*)(args + 1);
+            float sum = 0;
+            for (UINT i = 0; i < args->count * 4; ++i)
+            {
+                sum += constants[i];
+            }
+            this->sink += args->StartRegister + (unsigned int)sum;
+            break;
+        }
+        case COMMAND_DRAW_INDEXED_PRIMITIVE:
+        {
+            const command_draw_indexed_primitive_args* args = (const command_draw_indexed_primitive_args*)(command + 1);
+            this->sink += args->PrimitiveType + args->BaseVertexIndex + args->MinVertexIndex + args->NumVertices + args->startIndex + args->primCount;
+            break;
+        }
+        default:
+            CHECK(!"unexpected opcode");
+        }
+        ++this->executed;
+    }
+
+    unsigned long long executed;
+    unsigned int sink;
+};
+
+// Returns how many commands it encoded
+static unsigned int encode_mesh (CommandRing& ring, unsigned int mesh)
+{
+    // Stand-ins for the driver's objects; they're never dereferenced
+    IDirect3DVertexShader9* vertex_shader = (IDirect3DVertexShader9*)(size_t)(0x1000 + (mesh % 7) * 16);
+    IDirect3DPixelShader9* pixel_shader = (IDirect3DPixelShader9*)(size_t)(0x2000 + (mesh % 5) * 16);
+    IDirect3DVertexBuffer9* vertices = (IDirect3DVertexBuffer9*)(size_t)(0x3000 + (mesh % 64) * 16);
+    IDirect3DIndexBuffer9* indices = (IDirect3DIndexBuffer9*)(size_t)(0x4000 + (mesh % 64) * 16);
+    IDirect3DBaseTexture9* texture = (IDirect3DBaseTexture9*)(size_t)(0x5000 + (mesh % 128) * 16);
+    unsigned int count = 0;
+
+    command_set_vertex_shader_args* vertex_shader_args = begin_command<command_set_vertex_shader_args>(ring, COMMAND_SET_VERTEX_SHADER);
+    vertex_shader_args->pShader = vertex_shader;
+    ring.commit();
+    command_set_pixel_shader_args* pixel_shader_args = begin_command<command_set_pixel_shader_args>(ring, COMMAND_SET_PIXEL_SHADER);
+    pixel_shader_args->pShader = pixel_shader;
+    ring.commit();
+    command_set_stream_source_args* stream_args = begin_command<command_set_stream_source_args>(ring, COMMAND_SET_STREAM_SOURCE);
+    stream_args->StreamNumber = 0;
+    stream_args->pStreamData = vertices;
+    stream_args->OffsetInBytes = 0;
+    stream_args->Stride = 32;
+    ring.commit();
+    command_set_indices_args* indices_args = begin_command<command_set_indices_args>(ring, COMMAND_SET_INDICES);
+    indices_args->pIndexData = indices;
+    ring.commit();
+    count += 4;
+
+    for (DWORD stage = 0; stage < 2; ++stage)
+    {
+        command_set_texture_args* texture_args = begin_command<command_set_texture_args>(ring, COMMAND_SET_TEXTURE);
+        texture_args->Stage = stage;
+        texture_args->pTexture = texture;
+        ring.commit();
+        command_set_sampler_state_args* sampler_args = begin_command<command_set_sampler_state_args>(ring, COMMAND_SET_SAMPLER_STATE);
+        sampler_args->Sampler = stage;
+        sampler_args->Type = D3DSAMP_MINFILTER;
+        sampler_args->Value = 2;
+        ring.commit();
+        count += 2;
+    }
+    command_set_render_state_args* render_state_args = begin_command<command_set_render_state_args>(ring, COMMAND_SET_RENDER_STATE);
+    render_state_args->State = D3DRS_ALPHABLENDENABLE;
+    render_state_args->Value = mesh & 1;
+    ring.commit();
+    render_state_args = begin_command<command_set_render_state_args>(ring, COMMAND_SET_RENDER_STATE);
+    render_state_args->State = D3DRS_CULLMODE;
+    render_state_args->Value = 2;
+    ring.commit();
+    count += 2;
+
+    // The game's own constants for the mesh, then the eyes
+    float constants[8 * 4];
+    for (int i = 0; i < 8 * 4; ++i)
+    {
+        constants[i] = (float)(mesh + i);
+    }
+    command_set_vertex_shader_constant_f_args* constant_args = begin_command<command_set_vertex_shader_constant_f_args>(ring, COMMAND_SET_VERTEX_SHADER_CONSTANT_F, sizeof(constants));
+    constant_args->StartRegister = 15;
+    constant_args->count = 8;
+    memcpy(constant_args + 1, constants, sizeof(constants));
+    ring.commit();
+    ++count;
+    for (DWORD eye = 0; eye < 2; ++eye)
+    {
+        command_set_viewport_args* viewport_args = begin_command<command_set_viewport_args>(ring, COMMAND_SET_VIEWPORT);
+        D3DVIEWPORT9 viewport = { eye * 1182, 0, 1182, 1461, 0.0f, 1.0f };
+        viewport_args->value = viewport;
+        ring.commit();
+        constant_args = begin_command<command_set_vertex_shader_constant_f_args>(ring, COMMAND_SET_VERTEX_SHADER_CONSTANT_F, 4 * 4 * sizeof(float));
+        constant_args->StartRegister = 11;
+        constant_args->count = 4;
+        memcpy(constant_args + 1, constants, 4 * 4 * sizeof(float));
+        ring.commit();
+        command_draw_indexed_primitive_args* draw_args = begin_command<command_draw_indexed_primitive_args>(ring, COMMAND_DRAW_INDEXED_PRIMITIVE);
+        draw_args->PrimitiveType = D3DPT_TRIANGLELIST;
+        draw_args->BaseVertexIndex = 0;
+        draw_args->MinVertexIndex = 0;
+        draw_args->NumVertices = 1200;
+        draw_args->startIndex = (mesh % 64) * 3600;
+        draw_args->primCount = 1200;
+        ring.commit();
+        count += 3;
+    }
+    command_set_viewport_args* viewport_args = begin_command<command_set_viewport_args>(ring, COMMAND_SET_VIEWPORT);
+    D3DVIEWPORT9 viewport = { 0, 0, 2364, 1461, 0.0f, 1.0f };
+    viewport_args->value = viewport;
+    ring.commit();
+    return count + 1;
+}
+
+int main ()
+{
+    CommandRing ring(CAPACITY);
+    null_device device;
+    volatile LONG encoding_done = 0;
+
+    std::thread render_thread([&] {
+        for (;;)
+        {
+            const command_header* command = ring.peek();
+            if (!command)
+            {
+                // Everything was committed before encoding_done was set
+                if (encoding_done)
+                {
+                    if (ring.empty())
+                    {
+                        return;
+                    }
+                    continue;
+                }
+                ring.wait_for_work(1);
+                continue;
+            }
+            device.execute(command);
+            ring.release(command);
+        }
+    });
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    unsigned long long encoded = 0;
+    for (unsigned int mesh = 0; mesh < MESHES; ++mesh)
+    {
+        encoded += encode_mesh(ring, mesh);
+    }
+    clock::time_point encoded_time = clock::now();
+    InterlockedExchange(&encoding_done, 1);
+    ring.wake();
+    render_thread.join();
+    clock::time_point drained_time = clock::now();
+    CHECK(device.executed == encoded);
+
+    double encode_seconds = std::chrono::duration<double>(encoded_time - start).count();
+    double drain_seconds = std::chrono::duration<double>(drained_time - start).count();
+    printf("%llu commands from %u stereo meshes\n", encoded, MESHES);
+    printf("game thread encoded %.0f commands/s (%.1f ns each)\n", encoded / encode_seconds, encode_seconds * 1e9 / encoded);
+    printf("render thread drained %.0f commands/s into a null device\n", encoded / drain_seconds);
+    printf("(checksum %u)\n", device.sink);
+    return 0;
+}
@@ -0,0 +1,83 @@
+//====================================================================
+// SeqLock under contention: one writer publishing as fast as it can
+// while several readers check every copy they get is whole.
+//====================================================================
+
+#include <thread>
+#include <vector>
+
+#include "SeqLock.h"
+#include "Check.h"
+
+#define PAYLOAD_WORDS 32
+#define WRITES 2000000
+#define READERS 4
+
+// Every word of the n-th write holds n, so a torn copy mixes values
+struct payload {
+    unsigned int words[PAYLOAD_WORDS];
+};
+
+static SeqLock<payload> s_lock;
+static volatile LONG s_done = 0;
+
+static void write_all ()
+{
+    payload value;
+    for (unsigned int n = 1; n <= WRITES; ++n)
+    {
+        for (int i = 0; i < PAYLOAD_WORDS; ++i)
+        {
+            value.words[i] = n;
+        }
+        s_lock.write(value);
+    }
+    InterlockedExchange(&s_done, 1);
+}
+
+static void read_all (unsigned int* reads)
+{
+    LONG last_sequence = 0;
+    while (!s_done)
+    {
+        payload value;
+        LONG sequence = s_lock.read(&value);
+        for (int i = 1; i < PAYLOAD_WORDS; ++i)
+        {
+            CHECK(value.words[i] == value.words[0]);
+        }
+        // The sequence counts whole writes, so it names the copy exactly
+        // and never goes backwards
+        CHECK(value.words[0] == (unsigned int)sequence);
+        CHECK(sequence >= last_sequence);
+        last_sequence = sequence;
+        ++*reads;
+    }
+}
+
+int main ()
+{
+    // Nothing written reads as zeros with sequence zero
+    payload initial;
+    CHECK(s_lock.read(&initial) == 0);
+    CHECK(initial.words[0] == 0);
+
+    unsigned int reads[READERS] = {};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < READERS; ++i)
+    {
+        readers.push_back(std::thread(read_all, &reads[i]));
+    }
+    std::thread writer(write_all);
+    writer.join();
+    for (int i = 0; i < READERS; ++i)
+    {
+        readers[i].join();
+        CHECK(reads[i] > 0);
+    }
+
+    payload last;
+    CHECK(s_lock.read(&last) == WRITES);
+    CHECK(last.words[PAYLOAD_WORDS - 1] == WRITES);
+    return 0;
+}
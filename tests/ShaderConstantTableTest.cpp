@@ -0,0 +1,183 @@
+//====================================================================
+// Constant table parsing against hand assembled shader bytecode,
+// well formed and not, and against a table laid out byte for byte the
+// way the HLSL compiler emits it.
+//====================================================================
+
+#include <string.h>
+#include <vector>
+
+#include "ShaderConstantTable.h"
+#include "Check.h"
+
+struct table_constant {
+    const char* name;
+    WORD register_set;
+    WORD register_index;
+    WORD register_count;
+};
+
+// Lays a CTAB out the way the HLSL compiler does: header, constant infos,
+// then the strings they point at, all relative to the byte after the
+// fourcc
+static std::vector<unsigned char> build_table (const table_constant* constants, DWORD count)
+{
+    const DWORD header_size = 7 * sizeof(DWORD);
+    const DWORD info_size = 3 * sizeof(DWORD) + 4 * sizeof(WORD);
+    std::vector<unsigned char> table(header_size + count * info_size);
+    DWORD header[7] = { header_size, 0, 0xFFFE0300, count, header_size, 0, 0 };
+    memcpy(&table[0], header, sizeof(header));
+    for (DWORD i = 0; i < count; ++i)
+    {
+        DWORD name = (DWORD)table.size();
+        table.insert(table.end(), constants[i].name, constants[i].name + strlen(constants[i].name) + 1);
+        unsigned char* info = &table[header_size + i * info_size];
+        WORD registers[4] = { constants[i].register_set, constants[i].register_index, constants[i].register_count, 0 };
+        memcpy(info, &name, sizeof(name));
+        memcpy(info + sizeof(DWORD), registers, sizeof(registers));
+    }
+    while (table.size() % sizeof(DWORD))
+    {
+        table.push_back(0);
+    }
+    return table;
+}
+
+// Version token, the comments, then the end token
+static std::vector<DWORD> build_shader (const std::vector<std::vector<DWORD> >& comments)
+{
+    std::vector<DWORD> tokens;
+    tokens.push_back(D3DVS_VERSION(3, 0));
+    for (size_t i = 0; i < comments.size(); ++i)
+    {
+        tokens.push_back(D3DSIO_COMMENT | ((DWORD)comments[i].size() << D3DSI_COMMENTSIZE_SHIFT));
+        tokens.insert(tokens.end(), comments[i].begin(), comments[i].end());
+    }
+    tokens.push_back(D3DSIO_END);
+    return tokens;
+}
+
+static std::vector<DWORD> ctab_comment (const std::vector<unsigned char>& table)
+{
+    std::vector<DWORD> comment(1 + table.size() / sizeof(DWORD));
+    comment[0] = 0x42415443; // 'CTAB'
+    memcpy(&comment[1], &table[0], table.size());
+    return comment;
+}
+
+// A skinned vs_3_0 mesh shader with the game's uniform names, laid out
+// the way the June 2010 SDK compiler emits it: the constants sorted by
+// name, each name followed by its type info and padded with 0xAB, then
+// the target and creator strings, and after the comment
+//
+//     dcl_position v0
+//     dcl_position o0
+//     dp4 o0.x, v0, c11    (and .y, .z, .w against c12-c14)
+static const DWORD s_compiled_shader[] = {
+    0xFFFE0300, 0x005EFFFE, 0x42415443, 0x0000001C, 0x00000140, 0xFFFE0300,
+    0x00000006, 0x0000001C, 0x00000000, 0x00000138, 0x00000094, 0x00140002,
+    0x00000048, 0x0000009C, 0x00000000, 0x000000AC, 0x000F0002, 0x00000001,
+    0x000000B8, 0x00000000, 0x000000C8, 0x00100002, 0x00000001, 0x000000D4,
+    0x00000000, 0x000000E4, 0x00070002, 0x00000004, 0x000000EC, 0x00000000,
+    0x000000FC, 0x000B0002, 0x00000004, 0x0000010C, 0x00000000, 0x0000011C,
+    0x00000000, 0x00000001, 0x00000128, 0x00000000, 0x4F425F43, 0x0053454E,
+    0x00030002, 0x00040003, 0x00000018, 0x00000000, 0x4F465F43, 0x52415047,
+    0x00534D41, 0x00030001, 0x00040001, 0x00000001, 0x00000000, 0x494C5F43,
+    0x44544847, 0xAB005249, 0x00030001, 0x00030001, 0x00000001, 0x00000000,
+    0x4F575F43, 0x00444C52, 0x00030003, 0x00040004, 0x00000001, 0x00000000,
+    0x4F575F43, 0x56444C52, 0x50574549, 0x004A4F52, 0x00030003, 0x00040004,
+    0x00000001, 0x00000000, 0x53625F67, 0x6E6E696B, 0xAB006465, 0x00010000,
+    0x00010001, 0x00000001, 0x00000000, 0x335F7376, 0xAB00305F, 0x7263694D,
+    0x666F736F, 0x52282074, 0x4C482029, 0x53204C53, 0x65646168, 0x6F432072,
+    0x6C69706D, 0x39207265, 0x2E39322E, 0x2E323539, 0x31313133, 0xABABAB00,
+    0x0200001F, 0x80000000, 0x900F0000, 0x0200001F, 0x80000000, 0xE00F0000,
+    0x03000009, 0xE0010000, 0x90E40000, 0xA0E4000B, 0x03000009, 0xE0020000,
+    0x90E40000, 0xA0E4000C, 0x03000009, 0xE0040000, 0x90E40000, 0xA0E4000D,
+    0x03000009, 0xE0080000, 0x90E40000, 0xA0E4000E, 0x0000FFFF,
+};
+
+static bool parse (const std::vector<DWORD>& tokens, std::vector<shader_constant>* constants)
+{
+    return parse_constant_table(&tokens[0], (UINT)(tokens.size() * sizeof(DWORD)), constants);
+}
+
+int main ()
+{
+    const table_constant table_constants[] = {
+        { "C_WORLDVIEWPROJ", SHADER_REGISTER_FLOAT4, 11, 4 },
+        { "g_bSkinned", SHADER_REGISTER_BOOL, 0, 1 },
+        { "s_Diffuse", SHADER_REGISTER_SAMPLER, 2, 1 },
+    };
+    std::vector<unsigned char> table = build_table(table_constants, 3);
+    std::vector<shader_constant> constants;
+
+    // Every constant comes back with its registers
+    std::vector<std::vector<DWORD> > comments(1, ctab_comment(table));
+    CHECK(parse(build_shader(comments), &constants));
+    CHECK(constants.size() == 3);
+    CHECK(constants[0].name == "C_WORLDVIEWPROJ");
+    CHECK(constants[0].register_set == SHADER_REGISTER_FLOAT4);
+    CHECK(constants[0].register_index == 11);
+    CHECK(constants[0].register_count == 4);
+    CHECK(constants[1].name == "g_bSkinned");
+    CHECK(constants[1].register_set == SHADER_REGISTER_BOOL);
+    CHECK(constants[2].name == "s_Diffuse");
+    CHECK(constants[2].register_set == SHADER_REGISTER_SAMPLER);
+    CHECK(constants[2].register_index == 2);
+
+    // Other comments ahead of the table are skipped over
+    std::vector<DWORD> other(3, 0x12345678);
+    comments.insert(comments.begin(), other);
+    CHECK(parse(build_shader(comments), &constants));
+    CHECK(constants.size() == 3);
+    CHECK(constants[0].register_index == 11);
+
+    // No table at all
+    std::vector<std::vector<DWORD> > no_comments;
+    CHECK(!parse(build_shader(no_comments), &constants));
+    CHECK(constants.empty());
+    CHECK(!parse(build_shader(std::vector<std::vector<DWORD> >(1, other)), &constants));
+
+    // A comment claiming more tokens than the shader has
+    std::vector<DWORD> truncated = build_shader(std::vector<std::vector<DWORD> >(1, ctab_comment(table)));
+    truncated.resize(truncated.size() - 4);
+    CHECK(!parse(truncated, &constants));
+
+    // Constant infos running past the end of the table
+    std::vector<unsigned char> overcounted = table;
+    DWORD count = 1000;
+    memcpy(&overcounted[3 * sizeof(DWORD)], &count, sizeof(count));
+    CHECK(!parse(build_shader(std::vector<std::vector<DWORD> >(1, ctab_comment(overcounted))), &constants));
+
+    // A name pointing outside the table
+    std::vector<unsigned char> bad_name = table;
+    DWORD name = (DWORD)table.size() + 16;
+    memcpy(&bad_name[7 * sizeof(DWORD)], &name, sizeof(name));
+    CHECK(!parse(build_shader(std::vector<std::vector<DWORD> >(1, ctab_comment(bad_name))), &constants));
+
+    // A name left unterminated at the end of the table stops there
+    std::vector<unsigned char> unterminated = table;
+    for (size_t i = unterminated.size(); i > 0 && unterminated[i - 1] == 0; --i)
+    {
+        unterminated[i - 1] = 'x';
+    }
+    CHECK(parse(build_shader(std::vector<std::vector<DWORD> >(1, ctab_comment(unterminated))), &constants));
+    CHECK(constants.size() == 3);
+    CHECK(constants[2].name.compare(0, 9, "s_Diffuse") == 0);
+    CHECK(constants[2].name.size() > 9);
+
+    // What the compiler emits, down to the padding and the code after it
+    CHECK(parse_constant_table(s_compiled_shader, sizeof(s_compiled_shader), &constants));
+    CHECK(constants.size() == 6);
+    const char* names[6] = { "C_BONES", "C_FOGPARAMS", "C_LIGHTDIR", "C_WORLD", "C_WORLDVIEWPROJ", "g_bSkinned" };
+    UINT indices[6] = { 20, 15, 16, 7, 11, 0 };
+    UINT counts[6] = { 72, 1, 1, 4, 4, 1 };
+    for (int i = 0; i < 6; ++i)
+    {
+        CHECK(constants[i].name == names[i]);
+        CHECK(constants[i].register_set == (i < 5 ? SHADER_REGISTER_FLOAT4 : SHADER_REGISTER_BOOL));
+        CHECK(constants[i].register_index == indices[i]);
+        CHECK(constants[i].register_count == counts[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+//====================================================================
+// Missed frame detection against a trace of present times, and the
+// timewarp rotation against head turns whose answer is known.
+//====================================================================
+
+#include <math.h>
+
+#include "Timewarp.h"
+#include "Check.h"
+
+static timewarp_quat axis_angle (float x, float y, float z, float angle)
+{
+    timewarp_quat q;
+    float s = sinf(angle / 2);
+    q.x = x * s;
+    q.y = y * s;
+    q.z = z * s;
+    q.w = cosf(angle / 2);
+    return q;
+}
+
+// Where the matrix takes a tan-angle direction, +z forward and y down
+static void transform (const float m[4][4], const float in[3], float out[3])
+{
+    for (int row = 0; row < 3; ++row)
+    {
+        out[row] = m[row][0] * in[0] + m[row][1] * in[1] + m[row][2] * in[2];
+    }
+}
+
+static void check_rotation (const float m[4][4])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            float dot = m[0][i] * m[0][j] + m[1][i] * m[1][j] + m[2][i] * m[2][j];
+            CHECK_NEAR(dot, i == j ? 1.0 : 0.0, 1e-5);
+        }
+        CHECK(m[i][3] == 0 && m[3][i] == 0);
+    }
+    CHECK(m[3][3] == 1);
+}
+
+static void check_deadlines ()
+{
+    // 75Hz with 2ms of lead: a re-present is due 11.33ms after a present
+    const double refresh = 1.0 / 75;
+    FrameDeadline deadline;
+    CHECK(!deadline.missed(1.0));
+    deadline.configure(refresh, 0.002);
+    CHECK(!deadline.missed(1.0));
+
+    // A trace of presents, the third frame a whole refresh late
+    const double presents[] = { 1.0, 1.0 + refresh, 1.0 + 3 * refresh, 1.0 + 4 * refresh };
+    deadline.presented(presents[0]);
+    CHECK(!deadline.missed(presents[0] + 0.005));
+    CHECK(!deadline.missed(presents[0] + refresh - 0.0021));
+    CHECK(deadline.missed(presents[0] + refresh - 0.0019));
+    deadline.presented(presents[1]);
+    CHECK(!deadline.missed(presents[1] + 0.005));
+    CHECK(deadline.missed(presents[1] + refresh - 0.002));
+
+    // The re-present covers the missed refresh and starts the clock again
+    double represent = presents[1] + refresh - 0.002;
+    deadline.presented(represent);
+    CHECK(!deadline.missed(presents[1] + refresh));
+    CHECK(deadline.missed(represent + refresh - 0.002));
+
+    // Reports can come in out of order, and never move the clock back
+    deadline.presented(presents[2]);
+    deadline.presented(presents[1]);
+    CHECK(!deadline.missed(presents[2] + 0.005));
+    CHECK(deadline.missed(presents[2] + refresh));
+
+    // Zero interval turns detection off
+    deadline.configure(0, 0.002);
+    CHECK(!deadline.missed(presents[3] + 1));
+}
+
+int main ()
+{
+    check_deadlines();
+
+    const float forward[3] = { 0, 0, 1 };
+    const float pi = 3.14159265f;
+    float m[4][4];
+    float direction[3];
+
+    // No head motion, no warp
+    timewarp_quat rendered = axis_angle(0.36f, 0.48f, 0.8f, 0.7f);
+    timewarp_orientation_matrix(rendered, rendered, m);
+    check_rotation(m);
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            CHECK_NEAR(m[i][j], i == j ? 1.0 : 0.0, 1e-5);
+        }
+    }
+
+    // Turning left since the frame was rendered: what's straight ahead now
+    // was off to the left of the rendered view
+    const timewarp_quat identity = { 0, 0, 0, 1 };
+    float angle = 10 * pi / 180;
+    timewarp_orientation_matrix(identity, axis_angle(0, 1, 0, angle), m);
+    check_rotation(m);
+    transform(m, forward, direction);
+    CHECK_NEAR(direction[0], -sinf(angle), 1e-5);
+    CHECK_NEAR(direction[1], 0, 1e-5);
+    CHECK_NEAR(direction[2], cosf(angle), 1e-5);
+
+    // Looking up: it was above, which is -y in the tan-angle basis
+    timewarp_orientation_matrix(identity, axis_angle(1, 0, 0, angle), m);
+    transform(m, forward, direction);
+    CHECK_NEAR(direction[0], 0, 1e-5);
+    CHECK_NEAR(direction[1], -sinf(angle), 1e-5);
+    CHECK_NEAR(direction[2], cosf(angle), 1e-5);
+
+    // Rolling keeps the centre where it was and turns the rest around it
+    timewarp_orientation_matrix(identity, axis_angle(0, 0, 1, angle), m);
+    transform(m, forward, direction);
+    CHECK_NEAR(direction[2], 1, 1e-5);
+
+    // A trace of a head looking around: the warp only depends on the
+    // motion between the two poses, and warping back undoes it
+    timewarp_quat previous = axis_angle(0, 1, 0, 0);
+    for (int frame = 1; frame < 200; ++frame)
+    {
+        float t = frame / 75.0f;
+        timewarp_quat latest = axis_angle(0, 1, 0, 0.35f * sinf(t * 0.9f));
+        float there[4][4], back[4][4];
+        timewarp_orientation_matrix(previous, latest, there);
+        timewarp_orientation_matrix(latest, previous, back);
+        check_rotation(there);
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                float product = there[i][0] * back[0][j] + there[i][1] * back[1][j] + there[i][2] * back[2][j];
+                CHECK_NEAR(product, i == j ? 1.0 : 0.0, 1e-5);
+            }
+        }
+        float turn = 0.35f * (sinf(t * 0.9f) - sinf((frame - 1) / 75.0f * 0.9f));
+        transform(there, forward, direction);
+        CHECK_NEAR(direction[0], -sinf(turn), 1e-5);
+        previous = latest;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+//====================================================================
+// Stand-in for the parts of Windows.h the portable modules use, so
+// they and their tests build with GCC or Clang elsewhere. Only on the
+// include path when not building for Windows.
+//====================================================================
+
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef int LONG;
+typedef unsigned int DWORD;
+typedef unsigned short WORD;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef void* HANDLE;
+typedef struct compat_window* HWND;
+
+struct RECT {
+    LONG left;
+    LONG top;
+    LONG right;
+    LONG bottom;
+};
+
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+
+#define __declspec(attribute) __declspec_##attribute
+#define __declspec_align(bytes) __attribute__((aligned(bytes)))
+
+inline LONG InterlockedExchange (volatile LONG* target, LONG value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedIncrement (volatile LONG* target)
+{
+    return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement (volatile LONG* target)
+{
+    return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+#define MemoryBarrier() __sync_synchronize()
+#define _ReadWriteBarrier() __asm__ __volatile__("" ::: "memory")
+
+#if defined(__i386__) || defined(__x86_64__)
+#define YieldProcessor() __builtin_ia32_pause()
+#else
+#define YieldProcessor() sched_yield()
+#endif
+
+inline BOOL SwitchToThread ()
+{
+    return sched_yield() == 0;
+}
+
+inline void* _aligned_malloc (size_t size, size_t alignment)
+{
+    void* memory;
+    return posix_memalign(&memory, alignment, size) == 0 ? memory : 0;
+}
+
+inline void _aligned_free (void* memory)
+{
+    free(memory);
+}
+
+// Events, with just the semantics the modules rely on
+struct compat_event {
+    pthread_mutex_t mutex;
+    pthread_cond_t signalled;
+    bool manual_reset;
+    bool set;
+};
+
+inline HANDLE CreateEventA (void*, BOOL manual_reset, BOOL initial_state, const char*)
+{
+    compat_event* event = new compat_event;
+    pthread_mutex_init(&event->mutex, 0);
+    pthread_cond_init(&event->signalled, 0);
+    event->manual_reset = manual_reset != FALSE;
+    event->set = initial_state != FALSE;
+    return event;
+}
+
+inline BOOL SetEvent (HANDLE handle)
+{
+    compat_event* event = (compat_event*)handle;
+    pthread_mutex_lock(&event->mutex);
+    event->set = true;
+    pthread_cond_broadcast(&event->signalled);
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+
+inline DWORD WaitForSingleObject (HANDLE handle, DWORD timeout_ms)
+{
+    compat_event* event = (compat_event*)handle;
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&event->mutex);
+    int error = 0;
+    while (!event->set && error != ETIMEDOUT)
+    {
+        error = timeout_ms == INFINITE ?
+            pthread_cond_wait(&event->signalled, &event->mutex) :
+            pthread_cond_timedwait(&event->signalled, &event->mutex, &deadline);
+    }
+    bool was_set = event->set;
+    if (was_set && !event->manual_reset)
+    {
+        event->set = false;
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return was_set ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
+
+inline BOOL CloseHandle (HANDLE handle)
+{
+    compat_event* event = (compat_event*)handle;
+    pthread_cond_destroy(&event->signalled);
+    pthread_mutex_destroy(&event->mutex);
+    delete event;
+    return TRUE;
+}
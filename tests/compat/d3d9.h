@@ -0,0 +1,112 @@
+//====================================================================
+// Stand-in for the parts of d3d9.h the portable modules use. Only on
+// the include path when not building for Windows.
+//====================================================================
+
+#pragma once
+
+#include <Windows.h>
+
+// Shader bytecode tokens, from d3d9types.h
+#define D3DSI_OPCODE_MASK 0x0000FFFF
+#define D3DSI_COMMENTSIZE_SHIFT 16
+#define D3DSI_COMMENTSIZE_MASK 0x7FFF0000
+#define D3DSIO_COMMENT 0xFFFE
+#define D3DSIO_END 0xFFFF
+#define D3DVS_VERSION(major, minor) (0xFFFE0000 | ((major) << 8) | (minor))
+
+// Types the pipeline's command packets are built from. The interfaces
+// are only ever passed around by pointer.
+struct IDirect3DBaseTexture9;
+struct IDirect3DVertexBuffer9;
+struct IDirect3DIndexBuffer9;
+struct IDirect3DVertexDeclaration9;
+struct IDirect3DVertexShader9;
+struct IDirect3DPixelShader9;
+struct IDirect3DSurface9;
+struct IDirect3DQuery9;
+
+typedef DWORD D3DCOLOR;
+
+enum D3DPRIMITIVETYPE {
+    D3DPT_TRIANGLELIST = 4,
+    D3DPT_TRIANGLESTRIP = 5,
+};
+
+enum D3DRENDERSTATETYPE {
+    D3DRS_ZENABLE = 7,
+    D3DRS_CULLMODE = 22,
+    D3DRS_ALPHABLENDENABLE = 27,
+};
+
+enum D3DSAMPLERSTATETYPE {
+    D3DSAMP_MAGFILTER = 5,
+    D3DSAMP_MINFILTER = 6,
+};
+
+enum D3DTEXTURESTAGESTATETYPE {
+    D3DTSS_COLOROP = 1,
+};
+
+enum D3DTRANSFORMSTATETYPE {
+    D3DTS_VIEW = 2,
+    D3DTS_PROJECTION = 3,
+};
+
+enum D3DFORMAT {
+    D3DFMT_INDEX16 = 101,
+};
+
+enum D3DTEXTUREFILTERTYPE {
+    D3DTEXF_NONE = 0,
+    D3DTEXF_LINEAR = 2,
+};
+
+enum D3DLIGHTTYPE {
+    D3DLIGHT_DIRECTIONAL = 3,
+};
+
+struct D3DVECTOR {
+    float x, y, z;
+};
+
+struct D3DCOLORVALUE {
+    float r, g, b, a;
+};
+
+struct D3DMATRIX {
+    float m[4][4];
+};
+
+struct D3DVIEWPORT9 {
+    DWORD X;
+    DWORD Y;
+    DWORD Width;
+    DWORD Height;
+    float MinZ;
+    float MaxZ;
+};
+
+struct D3DMATERIAL9 {
+    D3DCOLORVALUE Diffuse;
+    D3DCOLORVALUE Ambient;
+    D3DCOLORVALUE Specular;
+    D3DCOLORVALUE Emissive;
+    float Power;
+};
+
+struct D3DLIGHT9 {
+    D3DLIGHTTYPE Type;
+    D3DCOLORVALUE Diffuse;
+    D3DCOLORVALUE Specular;
+    D3DCOLORVALUE Ambient;
+    D3DVECTOR Position;
+    D3DVECTOR Direction;
+    float Range;
+    float Falloff;
+    float Attenuation0;
+    float Attenuation1;
+    float Attenuation2;
+    float Theta;
+    float Phi;
+};